@@ -0,0 +1,2082 @@
+#define _GNU_SOURCE // memmem
+#include "block_stream.h"
+#include "block_tree.h"
+#include "blockchain.h"
+#include "byteorder.h"
+#include "chain_view.h"
+#include "exporter.h"
+#include "header_chain.h"
+#include "ingest_server.h"
+#include "hex.h"
+#include "json.h"
+#include "pipeline.h"
+#include "rcu.h"
+#include "rpc_server.h"
+#include "sealer.h"
+#include "snapshot.h"
+#include "timing.h"
+#include "verify_pool.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// -----------------------------------------------------------
+// Benchmarks
+// -----------------------------------------------------------
+
+static char **make_transactions(size_t num_transactions, size_t seed) {
+  char **transactions = (char **)malloc(sizeof(char *) * num_transactions);
+  for (size_t i = 0; i < num_transactions; i++) {
+    transactions[i] = (char *)malloc(32);
+    snprintf(transactions[i], 32, "tx-%zu-%zu", seed, i);
+  }
+  return transactions;
+}
+
+static void free_transactions(char **transactions, size_t num_transactions) {
+  for (size_t i = 0; i < num_transactions; i++) {
+    free(transactions[i]);
+  }
+  free(transactions);
+}
+
+static int bench_pipeline(int argc, char **argv) {
+  size_t num_blocks = argc > 0 ? strtoul(argv[0], NULL, 10) : 200;
+  size_t block_size = argc > 1 ? strtoul(argv[1], NULL, 10) : 64;
+  char **transactions = make_transactions(block_size, 0);
+
+  Blockchain serial = {0};
+  create_blockchain(&serial);
+  uint64_t started = monotonic_ns();
+  for (size_t i = 0; i < num_blocks; i++) {
+    create_block(&serial, transactions, block_size);
+  }
+  double serial_s = (monotonic_ns() - started) / 1e9;
+  destroy_blockchain(&serial);
+
+  Blockchain pipelined = {0};
+  create_blockchain(&pipelined);
+  PipelineConfig config = {.queue_capacity = 4};
+  Pipeline *pipeline = create_pipeline(&pipelined, &config);
+  if (pipeline == NULL) {
+    free_transactions(transactions, block_size);
+    return 1;
+  }
+  started = monotonic_ns();
+  for (size_t i = 0; i < num_blocks; i++) {
+    pipeline_submit(pipeline, transactions, block_size);
+  }
+  pipeline_flush(pipeline);
+  double pipelined_s = (monotonic_ns() - started) / 1e9;
+
+  PipelineStats stats;
+  pipeline_get_stats(pipeline, &stats);
+  destroy_pipeline(pipeline);
+
+  printf("serial:    %zu blocks x %zu tx in %.3f s (%.1f blocks/s)\n",
+         num_blocks, block_size, serial_s, num_blocks / serial_s);
+  printf("pipelined: %zu blocks x %zu tx in %.3f s (%.1f blocks/s)\n",
+         num_blocks, block_size, pipelined_s, num_blocks / pipelined_s);
+  print_pipeline_stats(&stats);
+  if (!validate_blockchain(&pipelined)) {
+    printf("Pipelined blockchain contains errors\n");
+  }
+  destroy_blockchain(&pipelined);
+  free_transactions(transactions, block_size);
+  return 0;
+}
+
+static int bench_sigs(int argc, char **argv) {
+  size_t num_transactions = argc > 0 ? strtoul(argv[0], NULL, 10) : 2000;
+  size_t num_signers = argc > 1 ? strtoul(argv[1], NULL, 10) : 1;
+  if (num_signers == 0) {
+    num_signers = 1;
+  }
+
+  Keypair *keypairs = (Keypair *)malloc(sizeof(Keypair) * num_signers);
+  Transaction *transactions =
+      (Transaction *)malloc(sizeof(Transaction) * num_transactions);
+  for (size_t i = 0; i < num_signers; i++) {
+    if (!generate_keypair(&keypairs[i])) {
+      return 1;
+    }
+  }
+  // Consecutive transactions come from the same signer, as they would when
+  // a wallet submits a burst.
+  size_t run = (num_transactions + num_signers - 1) / num_signers;
+  for (size_t i = 0; i < num_transactions; i++) {
+    char payload[64];
+    int len = snprintf(payload, sizeof(payload), "transfer-%zu", i);
+    sign_transaction(&transactions[i], &keypairs[i / run], payload, len);
+  }
+
+  uint64_t started = monotonic_ns();
+  size_t valid = 0;
+  for (size_t i = 0; i < num_transactions; i++) {
+    valid += verify_transaction(&transactions[i]);
+  }
+  double single_s = (monotonic_ns() - started) / 1e9;
+
+  started = monotonic_ns();
+  size_t batch_valid =
+      verify_transactions_batch(transactions, num_transactions, NULL);
+  double batch_s = (monotonic_ns() - started) / 1e9;
+
+  printf("single: %zu/%zu valid, %.0f sigs/s\n", valid, num_transactions,
+         num_transactions / single_s);
+  printf("batch:  %zu/%zu valid, %.0f sigs/s (%zu signers)\n", batch_valid,
+         num_transactions, num_transactions / batch_s, num_signers);
+
+  for (size_t i = 0; i < num_transactions; i++) {
+    free_transaction(&transactions[i]);
+  }
+  for (size_t i = 0; i < num_signers; i++) {
+    free_keypair(&keypairs[i]);
+  }
+  free(transactions);
+  free(keypairs);
+  return 0;
+}
+
+static int bench_verify(int argc, char **argv) {
+  size_t num_transactions = argc > 0 ? strtoul(argv[0], NULL, 10) : 4000;
+  size_t max_threads = argc > 1 ? strtoul(argv[1], NULL, 10) : 4;
+
+  Keypair keypair;
+  if (!generate_keypair(&keypair)) {
+    return 1;
+  }
+  Transaction *transactions =
+      (Transaction *)malloc(sizeof(Transaction) * num_transactions);
+  for (size_t i = 0; i < num_transactions; i++) {
+    char payload[64];
+    int len = snprintf(payload, sizeof(payload), "transfer-%zu", i);
+    sign_transaction(&transactions[i], &keypair, payload, len);
+  }
+
+  double base_rate = 0;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    VerifyPool *pool = create_verify_pool(threads, 0);
+    uint64_t started = monotonic_ns();
+    size_t first_invalid = verify_pool_run(pool, transactions, num_transactions);
+    double rate = num_transactions / ((monotonic_ns() - started) / 1e9);
+    if (threads == 1) {
+      base_rate = rate;
+    }
+    printf("%2zu threads: %.0f sigs/s (%.2fx), first invalid %zu/%zu\n",
+           threads, rate, rate / base_rate, first_invalid, num_transactions);
+    destroy_verify_pool(pool);
+  }
+
+  // Two forgeries: the lower index must win however threads interleave.
+  transactions[num_transactions * 3 / 4].signature[0] ^= 1;
+  transactions[num_transactions / 4].signature[0] ^= 1;
+  VerifyPool *pool = create_verify_pool(max_threads, 0);
+  uint64_t started = monotonic_ns();
+  size_t first_invalid = verify_pool_run(pool, transactions, num_transactions);
+  printf("tampered: first invalid %zu (expected %zu) in %.3f s\n",
+         first_invalid, num_transactions / 4,
+         (monotonic_ns() - started) / 1e9);
+  destroy_verify_pool(pool);
+
+  for (size_t i = 0; i < num_transactions; i++) {
+    free_transaction(&transactions[i]);
+  }
+  free(transactions);
+  free_keypair(&keypair);
+  return 0;
+}
+
+static int bench_sigcache(int argc, char **argv) {
+  size_t num_transactions = argc > 0 ? strtoul(argv[0], NULL, 10) : 2000;
+  size_t num_blocks = 4;
+
+  Keypair keypair;
+  if (!generate_keypair(&keypair)) {
+    return 1;
+  }
+  Transaction *transactions =
+      (Transaction *)malloc(sizeof(Transaction) * num_transactions);
+  for (size_t i = 0; i < num_transactions; i++) {
+    char payload[64];
+    int len = snprintf(payload, sizeof(payload), "transfer-%zu", i);
+    sign_transaction(&transactions[i], &keypair, payload, len);
+  }
+  size_t per_block = num_transactions / num_blocks;
+
+  // Cold: every transaction is first seen in its block.
+  Blockchain cold = {0};
+  create_blockchain(&cold);
+  uint64_t started = monotonic_ns();
+  for (size_t b = 0; b < num_blocks; b++) {
+    create_signed_block(&cold, transactions + b * per_block, per_block);
+  }
+  validate_blockchain(&cold);
+  double cold_s = (monotonic_ns() - started) / 1e9;
+  destroy_blockchain(&cold);
+
+  // Warm: transactions are admitted to the mempool first, then the same
+  // work as above is repeated with the cache in place.
+  SigCache *cache = create_sig_cache(num_transactions * 4);
+  set_signature_cache(cache);
+  for (size_t i = 0; i < num_transactions; i++) {
+    verify_transaction(&transactions[i]);
+  }
+  Blockchain warm = {0};
+  create_blockchain(&warm);
+  started = monotonic_ns();
+  for (size_t b = 0; b < num_blocks; b++) {
+    create_signed_block(&warm, transactions + b * per_block, per_block);
+  }
+  validate_blockchain(&warm);
+  double warm_s = (monotonic_ns() - started) / 1e9;
+  destroy_blockchain(&warm);
+
+  SigCacheStats stats;
+  sig_cache_get_stats(cache, &stats);
+  set_signature_cache(NULL);
+  destroy_sig_cache(cache);
+
+  printf("accept without cache: %.3f s\n", cold_s);
+  printf("accept with cache:    %.3f s (%.2fx)\n", warm_s, cold_s / warm_s);
+  printf("cache: %llu hits, %llu misses (%.1f%% hit rate), %llu inserts, "
+         "%llu evictions, capacity %zu\n",
+         (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+         100.0 * stats.hits / (stats.hits + stats.misses ? stats.hits + stats.misses : 1),
+         (unsigned long long)stats.inserts,
+         (unsigned long long)stats.evictions, stats.capacity);
+
+  for (size_t i = 0; i < num_transactions; i++) {
+    free_transaction(&transactions[i]);
+  }
+  free(transactions);
+  free_keypair(&keypair);
+  return 0;
+}
+
+static int bench_state(int argc, char **argv) {
+  size_t num_accounts = argc > 0 ? strtoul(argv[0], NULL, 10) : 1000000;
+  StateSet *state = create_state(0);
+  if (state == NULL) {
+    return 1;
+  }
+
+  // Account keys are digest slices; random public keys stand in for them.
+  unsigned char (*public_keys)[PUBLIC_KEY_SIZE] =
+      malloc(PUBLIC_KEY_SIZE * num_accounts);
+  uint64_t (*keys)[2] = malloc(sizeof(uint64_t[2]) * num_accounts);
+  uint64_t seed = 0x9e3779b97f4a7c15ull;
+  for (size_t i = 0; i < num_accounts; i++) {
+    for (size_t j = 0; j < PUBLIC_KEY_SIZE; j += 8) {
+      seed ^= seed << 13;
+      seed ^= seed >> 7;
+      seed ^= seed << 17;
+      memcpy(public_keys[i] + j, &seed, 8);
+    }
+    account_key(public_keys[i], keys[i]);
+  }
+
+  uint64_t started = monotonic_ns();
+  for (size_t i = 0; i < num_accounts; i++) {
+    state_credit(state, public_keys[i], i + 1);
+  }
+  double insert_s = (monotonic_ns() - started) / 1e9;
+
+  started = monotonic_ns();
+  uint64_t total = 0;
+  for (size_t i = 0; i < num_accounts; i++) {
+    const AccountEntry *entry = state_lookup(state, keys[i]);
+    total += entry ? entry->balance : 0;
+  }
+  double lookup_s = (monotonic_ns() - started) / 1e9;
+
+  StateStats stats;
+  state_get_stats(state, &stats);
+  printf("credit (incl. key hashing): %.0f ops/s\n", num_accounts / insert_s);
+  printf("lookup: %.1f ns/op (checksum %llu)\n", lookup_s * 1e9 / num_accounts,
+         (unsigned long long)total);
+  printf("accounts %zu, capacity %zu, load %.2f, %zu bytes, %.1f bytes/account "
+         "(%zu-byte records)\n",
+         stats.accounts, stats.capacity, stats.load_factor, stats.bytes,
+         stats.bytes_per_account, sizeof(AccountEntry));
+
+  free(keys);
+  free(public_keys);
+  destroy_state(state);
+  return 0;
+}
+
+static int bench_snapshot(int argc, char **argv) {
+  size_t num_accounts = argc > 0 ? strtoul(argv[0], NULL, 10) : 1000000;
+  size_t num_threads = argc > 1 ? strtoul(argv[1], NULL, 10) : 0;
+  const char *path = argc > 2 ? argv[2] : "bench_snapshot.bin";
+
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  StateSet *state = create_state(num_accounts);
+  unsigned char public_key[PUBLIC_KEY_SIZE] = {0};
+  for (size_t i = 0; i < num_accounts; i++) {
+    memcpy(public_key, &i, sizeof(i));
+    state_credit(state, public_key, i + 1);
+  }
+
+  SnapshotInfo info;
+  uint64_t started = monotonic_ns();
+  if (!write_snapshot(state, blockchain.tail, blockchain.count - 1, path, 0,
+                      num_threads, &info)) {
+    return 1;
+  }
+  double write_s = (monotonic_ns() - started) / 1e9;
+  double mb = (SNAPSHOT_HEADER_SIZE + info.num_chunks * HASH_SIZE +
+               info.num_accounts * SNAPSHOT_ENTRY_SIZE) /
+              1e6;
+
+  started = monotonic_ns();
+  StateSet *imported =
+      import_snapshot(path, info.block_hash, info.height, info.root,
+                      num_threads, NULL);
+  double import_s = (monotonic_ns() - started) / 1e9;
+
+  printf("snapshot: %llu accounts in %llu chunks, %.1f MB\n",
+         (unsigned long long)info.num_accounts,
+         (unsigned long long)info.num_chunks, mb);
+  printf("write:  %.3f s (%.0f MB/s)\n", write_s, mb / write_s);
+  printf("import: %.3f s (%.0f MB/s), %s\n", import_s, mb / import_s,
+         imported != NULL && imported->count == state->count ? "verified"
+                                                             : "FAILED");
+
+  destroy_state(imported);
+  destroy_state(state);
+  destroy_blockchain(&blockchain);
+  remove(path);
+  return 0;
+}
+
+static long max_rss_kb(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static int bench_prune(int argc, char **argv) {
+  size_t num_blocks = argc > 0 ? strtoul(argv[0], NULL, 10) : 50000;
+  size_t keep_full = argc > 1 ? strtoul(argv[1], NULL, 10) : 100;
+  size_t block_size = 32;
+  char **transactions = make_transactions(block_size, 0);
+
+  // Peak RSS only grows, so the pruned run goes first.
+  long baseline = max_rss_kb();
+  for (int pass = 0; pass < 2; pass++) {
+    Blockchain blockchain = {0};
+    create_blockchain(&blockchain);
+    if (pass == 0) {
+      set_pruning(&blockchain, keep_full, NULL, NULL);
+    }
+    uint64_t started = monotonic_ns();
+    for (size_t i = 0; i < num_blocks; i++) {
+      create_block(&blockchain, transactions, block_size);
+    }
+    double build_s = (monotonic_ns() - started) / 1e9;
+    bool valid = validate_blockchain(&blockchain);
+    printf("%-9s %zu blocks: %.2f s, peak RSS +%ld kB, %zu pruned, %s\n",
+           pass == 0 ? "pruned:" : "unpruned:", num_blocks, build_s,
+           max_rss_kb() - baseline, blockchain.pruned,
+           valid ? "valid" : "INVALID");
+    destroy_blockchain(&blockchain);
+  }
+  free_transactions(transactions, block_size);
+  return 0;
+}
+
+static int bench_mmr(int argc, char **argv) {
+  size_t num_blocks = argc > 0 ? strtoul(argv[0], NULL, 10) : 100000;
+  size_t num_proofs = 1000;
+  char *transactions[] = {"mmr"};
+
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  enable_mmr(&blockchain);
+  uint64_t started = monotonic_ns();
+  for (size_t i = 0; i < num_blocks; i++) {
+    create_block(&blockchain, transactions, 1);
+  }
+  double append_s = (monotonic_ns() - started) / 1e9;
+
+  // Collect the hashes a light client would already hold.
+  unsigned char(*hashes)[HASH_SIZE] = malloc(HASH_SIZE * (num_blocks + 1));
+  size_t height = 0;
+  for (Block *curr = blockchain.head; curr != NULL; curr = curr->next_block) {
+    unsigned int hash_size;
+    calculate_block_hash(curr, hashes[height++], &hash_size);
+  }
+
+  MMRProof proof;
+  double prove_s = 0, verify_s = 0;
+  size_t verified = 0;
+  for (size_t i = 0; i < num_proofs; i++) {
+    uint64_t target = (i * 2654435761u) % num_blocks;
+    started = monotonic_ns();
+    prove_ancestor(&blockchain, target, &proof);
+    prove_s += (monotonic_ns() - started) / 1e9;
+    started = monotonic_ns();
+    verified += mmr_verify(blockchain.tail->mmr_root, hashes[target], &proof);
+    verify_s += (monotonic_ns() - started) / 1e9;
+  }
+  // A proof must not verify for a different block.
+  prove_ancestor(&blockchain, 0, &proof);
+  bool forged = mmr_verify(blockchain.tail->mmr_root, hashes[1], &proof);
+
+  printf("append: %.1f us/block including MMR update\n",
+         append_s * 1e6 / num_blocks);
+  printf("prove:  %.2f us, verify: %.2f us, %zu/%zu verified, forgery %s\n",
+         prove_s * 1e6 / num_proofs, verify_s * 1e6 / num_proofs, verified,
+         num_proofs, forged ? "ACCEPTED" : "rejected");
+  printf("proof size: %zu path + %zu peaks = %zu bytes\n", proof.path_len,
+         proof.num_peaks, (proof.path_len + proof.num_peaks) * HASH_SIZE);
+  printf("chain %s\n", validate_blockchain(&blockchain) ? "valid" : "INVALID");
+
+  free(hashes);
+  destroy_blockchain(&blockchain);
+  return 0;
+}
+
+static int bench_ancestor(int argc, char **argv) {
+  size_t num_blocks = argc > 0 ? strtoul(argv[0], NULL, 10) : 200000;
+  size_t num_lookups = 100000;
+  char *transactions[] = {"ancestor"};
+  char *side_data[] = {"side"};
+
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  for (size_t i = 0; i < num_blocks; i++) {
+    create_block(&blockchain, transactions, 1);
+  }
+
+  // Reference answers come from an index built by walking next_block.
+  Block **by_height = malloc(sizeof(Block *) * (num_blocks + 1));
+  size_t height = 0;
+  for (Block *curr = blockchain.head; curr != NULL; curr = curr->next_block) {
+    by_height[height++] = curr;
+  }
+
+  size_t wrong = 0;
+  uint64_t seed = 88172645463325252ull;
+  uint64_t started = monotonic_ns();
+  for (size_t i = 0; i < num_lookups; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    Block *from = by_height[seed % (num_blocks + 1)];
+    uint64_t target = (seed >> 32) % (from->height + 1);
+    wrong += get_ancestor(from, target) != by_height[target];
+  }
+  double ancestor_s = (monotonic_ns() - started) / 1e9;
+
+  started = monotonic_ns();
+  Block *walk = blockchain.head;
+  for (size_t i = 0; i < num_blocks / 2; i++) {
+    walk = walk->next_block;
+  }
+  double linear_s = (monotonic_ns() - started) / 1e9;
+  uint64_t walk_height = walk->height;
+
+  // Side branches of up to 32 blocks grow from random blocks, including
+  // earlier side branches, so fork points fall anywhere in a real tree.
+  BlockTree *tree = create_block_tree(&blockchain);
+  size_t num_branches = num_blocks / 100 ? num_blocks / 100 : 1;
+  size_t main_blocks = tree->num_blocks;
+  for (size_t i = 0; i < num_branches; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    Block *side = tree->blocks[seed % tree->num_blocks];
+    for (size_t length = 1 + (seed >> 32) % 32; length > 0; length--) {
+      side = create_block_on(tree, side, side_data, 1);
+    }
+  }
+
+  // One end of each pair is on a side branch, the other anywhere.
+  Block **pairs = malloc(sizeof(Block *) * 2 * num_lookups);
+  size_t num_side = tree->num_blocks - main_blocks;
+  for (size_t i = 0; i < num_lookups; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    pairs[2 * i] = tree->blocks[main_blocks + seed % num_side];
+    pairs[2 * i + 1] = tree->blocks[(seed >> 32) % tree->num_blocks];
+  }
+  Block **forks = malloc(sizeof(Block *) * num_lookups);
+  started = monotonic_ns();
+  for (size_t i = 0; i < num_lookups; i++) {
+    forks[i] = find_fork_point(pairs[2 * i], pairs[2 * i + 1]);
+  }
+  double fork_s = (monotonic_ns() - started) / 1e9;
+
+  // Reference answers walk parent links one block at a time.
+  size_t num_checks = num_lookups < 2000 ? num_lookups : 2000;
+  size_t diverged = 0;
+  for (size_t i = 0; i < num_checks; i++) {
+    Block *a = pairs[2 * i];
+    Block *b = pairs[2 * i + 1];
+    while (a->height > b->height) {
+      a = a->parent;
+    }
+    while (b->height > a->height) {
+      b = b->parent;
+    }
+    diverged += a != b;
+    while (a != b) {
+      a = a->parent;
+      b = b->parent;
+    }
+    wrong += forks[i] != a;
+  }
+
+  printf("get_ancestor:    %.0f ns/lookup\n", ancestor_s * 1e9 / num_lookups);
+  printf("find_fork_point: %.0f ns/lookup over %zu side branches (%zu of "
+         "%zu checked pairs diverge)\n",
+         fork_s * 1e9 / num_lookups, num_branches, diverged, num_checks);
+  printf("linear walk to height %llu: %.0f ns\n",
+         (unsigned long long)walk_height, linear_s * 1e9);
+  printf("%zu wrong answers\n", wrong);
+
+  free(forks);
+  free(pairs);
+  free(by_height);
+  destroy_block_tree(tree);
+  destroy_blockchain(&blockchain);
+  return wrong != 0;
+}
+
+static int bench_forks(int argc, char **argv) {
+  size_t num_blocks = argc > 0 ? strtoul(argv[0], NULL, 10) : 100000;
+  size_t depth = argc > 1 ? strtoul(argv[1], NULL, 10) : 100;
+  char *main_data[] = {"main"};
+  char *side_data[] = {"side"};
+  if (depth >= num_blocks) {
+    depth = num_blocks - 1;
+  }
+
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  enable_mmr(&blockchain);
+  BlockTree *tree = create_block_tree(&blockchain);
+  for (size_t i = 0; i < num_blocks; i++) {
+    create_block_on(tree, blockchain.tail, main_data, 1);
+  }
+  Block *old_tip = blockchain.tail;
+
+  // A competing branch forks depth blocks below the tip and overtakes it
+  // with its last block.
+  Block *fork = get_ancestor(old_tip, old_tip->height - depth);
+  Block *side = fork;
+  uint64_t switch_ns = 0;
+  for (size_t i = 0; i <= depth; i++) {
+    uint64_t started = monotonic_ns();
+    side = create_block_on(tree, side, side_data, 1);
+    switch_ns = monotonic_ns() - started;
+  }
+
+  bool switched = blockchain.tail == side && best_tip(tree) == side;
+  bool found_fork = find_fork_point(old_tip, side) == fork;
+  printf("chain %zu blocks, %zu tips, reorg depth %llu in %.1f us "
+         "(including the new block), %s, %s, chain %s\n",
+         num_blocks, tree->num_tips,
+         (unsigned long long)tree->last_reorg_depth, switch_ns / 1e3,
+         switched ? "switched" : "NOT SWITCHED",
+         found_fork ? "fork found" : "FORK WRONG",
+         validate_blockchain(&blockchain) ? "valid" : "INVALID");
+
+  // Extending the old branch past the new one switches back.
+  Block *back = old_tip;
+  back = create_block_on(tree, back, main_data, 1);
+  back = create_block_on(tree, back, main_data, 1);
+  printf("switched back: %s, reorgs %llu, chain %s\n",
+         blockchain.tail == back ? "yes" : "NO",
+         (unsigned long long)tree->reorgs,
+         validate_blockchain(&blockchain) ? "valid" : "INVALID");
+
+  destroy_block_tree(tree);
+  destroy_blockchain(&blockchain);
+  return 0;
+}
+
+// Fills a block's worth of transfers: sender i pays recipient one coin
+// (branch + 1 coins, so branches conflict) at the given nonce.
+static void make_transfers(Transaction *transactions, const Keypair *senders,
+                           size_t block_size, const char *recipient_hex,
+                           size_t branch, size_t nonce) {
+  for (size_t i = 0; i < block_size; i++) {
+    char payload[PUBLIC_KEY_SIZE * 2 + 48];
+    int len = snprintf(payload, sizeof(payload), "%s:%zu:%zu", recipient_hex,
+                       branch + 1, nonce);
+    sign_transaction(&transactions[i], &senders[i], payload, len);
+  }
+}
+
+static int bench_reorg(int argc, char **argv) {
+  size_t block_size = argc > 0 ? strtoul(argv[0], NULL, 10) : 100;
+  static const size_t depths[] = {1, 10, 100};
+  char *tip_data[] = {"tip"};
+
+  Keypair *senders = (Keypair *)malloc(sizeof(Keypair) * block_size);
+  Keypair recipient;
+  generate_keypair(&recipient);
+  char recipient_hex[PUBLIC_KEY_SIZE * 2 + 1];
+  hex_encode(recipient.public_key, PUBLIC_KEY_SIZE, recipient_hex);
+  recipient_hex[PUBLIC_KEY_SIZE * 2] = '\0';
+  for (size_t i = 0; i < block_size; i++) {
+    generate_keypair(&senders[i]);
+  }
+  Transaction *transactions =
+      (Transaction *)malloc(sizeof(Transaction) * block_size);
+
+  for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+    size_t depth = depths[d];
+    Blockchain blockchain = {0};
+    create_blockchain(&blockchain);
+    blockchain.state = create_state(0);
+    for (size_t i = 0; i < block_size; i++) {
+      state_credit(blockchain.state, senders[i].public_key, 1000000);
+    }
+    BlockTree *tree = create_block_tree(&blockchain);
+    Block *fork = blockchain.tail;
+
+    // Both branches spend the same nonces, so they cannot both be applied.
+    Block *main_tip = fork;
+    Block *side = fork;
+    for (size_t i = 0; i < depth; i++) {
+      make_transfers(transactions, senders, block_size, recipient_hex, 0, i);
+      main_tip = create_signed_block_on(tree, main_tip, transactions,
+                                        block_size);
+      for (size_t j = 0; j < block_size; j++) {
+        free_transaction(&transactions[j]);
+      }
+      make_transfers(transactions, senders, block_size, recipient_hex, 1, i);
+      side = create_signed_block_on(tree, side, transactions, block_size);
+      for (size_t j = 0; j < block_size; j++) {
+        free_transaction(&transactions[j]);
+      }
+    }
+
+    // An empty block tips the side branch over: the switch disconnects
+    // depth blocks and connects depth + 1.
+    uint64_t started = monotonic_ns();
+    Block *tip = create_block_on(tree, side, tip_data, 1);
+    uint64_t switch_ns = monotonic_ns() - started;
+
+    uint64_t recipient_key[2];
+    account_key(recipient.public_key, recipient_key);
+    const AccountEntry *entry = state_lookup(blockchain.state, recipient_key);
+    bool switched = blockchain.tail == tip && main_tip != NULL &&
+                    entry != NULL && entry->balance == 2 * depth * block_size;
+    size_t undo_bytes = 0;
+    for (Block *curr = tip; curr != fork; curr = curr->parent) {
+      undo_bytes += curr->undo.count * sizeof(StateUndoEntry);
+    }
+    printf("depth %3zu: %zu transfers rolled back and %zu applied in "
+           "%.2f ms (%.1f us/block), undo %.1f KiB, %s\n",
+           depth, depth * block_size, depth * block_size, switch_ns / 1e6,
+           switch_ns / 1e3 / (2 * depth + 1), undo_bytes / 1024.0,
+           switched ? "state switched" : "STATE WRONG");
+
+    destroy_block_tree(tree);
+    destroy_state(blockchain.state);
+  }
+
+  // A peer's branch arrives out of order, so it is connected in one batch
+  // with a single fork choice. Its last block replays a spent nonce, but the
+  // blocks below it still outwork the main chain and must take over.
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  blockchain.state = create_state(0);
+  for (size_t i = 0; i < block_size; i++) {
+    state_credit(blockchain.state, senders[i].public_key, 1000000);
+  }
+  BlockTree *tree = create_block_tree(&blockchain);
+  OrphanPoolConfig config = {0};
+  tree->orphans = create_orphan_pool(&config);
+  Block *fork = blockchain.tail;
+  Block *main_tip = fork;
+  for (size_t i = 0; i < 2; i++) {
+    make_transfers(transactions, senders, block_size, recipient_hex, 0, i);
+    main_tip =
+        create_signed_block_on(tree, main_tip, transactions, block_size);
+    for (size_t j = 0; j < block_size; j++) {
+      free_transaction(&transactions[j]);
+    }
+  }
+  Block *branch[4];
+  Block *parent = fork;
+  for (size_t i = 0; i < 4; i++) {
+    make_transfers(transactions, senders, block_size, recipient_hex, 1,
+                   i < 3 ? i : 0);
+    branch[i] = create_signed_child_block(parent, transactions, block_size);
+    for (size_t j = 0; j < block_size; j++) {
+      free_transaction(&transactions[j]);
+    }
+    parent = branch[i];
+  }
+  Block *valid_tip = branch[2];
+  for (size_t i = 4; i-- > 0;) {
+    receive_block(tree, branch[i]);
+  }
+  bool took_prefix = blockchain.tail == valid_tip &&
+                     best_tip(tree) == valid_tip && main_tip != NULL &&
+                     validate_blockchain(&blockchain);
+  printf("invalid last block: valid prefix of %llu work over %llu %s\n",
+         (unsigned long long)valid_tip->chain_work,
+         (unsigned long long)main_tip->chain_work,
+         took_prefix ? "became the tail" : "WAS DROPPED");
+  destroy_orphan_pool(tree->orphans);
+  destroy_block_tree(tree);
+  destroy_state(blockchain.state);
+
+  free(transactions);
+  for (size_t i = 0; i < block_size; i++) {
+    free_keypair(&senders[i]);
+  }
+  free(senders);
+  free_keypair(&recipient);
+  return took_prefix ? 0 : 1;
+}
+
+static int bench_orphans(int argc, char **argv) {
+  size_t num_blocks = argc > 0 ? strtoul(argv[0], NULL, 10) : 20000;
+  size_t window = argc > 1 ? strtoul(argv[1], NULL, 10) : 64;
+  size_t max_orphans = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+  bool with_mmr = argc > 3 && strcmp(argv[3], "mmr") == 0;
+  if (window == 0) {
+    window = 1;
+  }
+
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  if (with_mmr) {
+    enable_mmr(&blockchain);
+  }
+  BlockTree *tree = create_block_tree(&blockchain);
+  OrphanPoolConfig config = {.max_orphans = max_orphans};
+  tree->orphans = create_orphan_pool(&config);
+
+  // A peer's chain on the same genesis, built as detached blocks. With an
+  // MMR, each commits to the hashes of all before it, as the peer's own
+  // chain would have it.
+  Block **blocks = (Block **)malloc(sizeof(Block *) * num_blocks);
+  unsigned char prev[HASH_SIZE];
+  unsigned int hash_size;
+  calculate_block_hash(blockchain.head, prev, &hash_size);
+  MMR *peer_mmr = with_mmr ? create_mmr() : NULL;
+  for (size_t i = 0; i < num_blocks; i++) {
+    char **transactions = make_transactions(4, i);
+    unsigned char **hashes = hash_transactions(transactions, 4);
+    blocks[i] = create_detached_block(prev, create_tree(hashes, 4));
+    free_transaction_hashes(hashes, 4);
+    free_transactions(transactions, 4);
+    if (peer_mmr != NULL) {
+      mmr_append(peer_mmr, prev);
+      blocks[i]->has_mmr_root =
+          mmr_root(peer_mmr, peer_mmr->num_leaves, blocks[i]->mmr_root);
+    }
+    calculate_block_hash(blocks[i], prev, &hash_size);
+  }
+  free_mmr(peer_mmr);
+
+  // Delivery is shuffled within consecutive windows of the given size.
+  uint64_t seed = 0x2545f4914f6cdd1dull;
+  for (size_t start = 0; start < num_blocks; start += window) {
+    size_t end = start + window < num_blocks ? start + window : num_blocks;
+    for (size_t i = end - 1; i > start; i--) {
+      seed ^= seed << 13;
+      seed ^= seed >> 7;
+      seed ^= seed << 17;
+      size_t j = start + seed % (i - start + 1);
+      Block *swap = blocks[i];
+      blocks[i] = blocks[j];
+      blocks[j] = swap;
+    }
+  }
+
+  size_t orphaned = 0, peak = 0;
+  uint64_t started = monotonic_ns();
+  for (size_t i = 0; i < num_blocks; i++) {
+    if (receive_block(tree, blocks[i]) == RECEIVE_ORPHANED) {
+      orphaned++;
+    }
+    if (tree->orphans->stats.orphans > peak) {
+      peak = tree->orphans->stats.orphans;
+    }
+  }
+  double elapsed_s = (monotonic_ns() - started) / 1e9;
+
+  OrphanPoolStats stats;
+  orphan_pool_get_stats(tree->orphans, &stats);
+  printf("%zu blocks in windows of %zu: %.0f blocks/s, %zu arrived early, "
+         "peak pool %zu, evicted %llu, left %zu\n",
+         num_blocks, window, num_blocks / elapsed_s, orphaned, peak,
+         (unsigned long long)stats.evicted, stats.orphans);
+  bool valid = validate_blockchain(&blockchain);
+  printf("chain height %llu of %zu%s, chain %s\n",
+         (unsigned long long)blockchain.tail->height, num_blocks,
+         with_mmr ? " with MMR" : "", valid ? "valid" : "INVALID");
+  // Unless the pool had to evict, every block must have connected.
+  bool complete = stats.evicted > 0 || (blockchain.tail->height == num_blocks &&
+                                        stats.orphans == 0);
+
+  // A block committing to the wrong MMR root is refused, not rewritten:
+  // children naming it by its hash could never connect otherwise.
+  if (with_mmr) {
+    calculate_block_hash(blockchain.tail, prev, &hash_size);
+    char **transactions = make_transactions(4, num_blocks);
+    unsigned char **hashes = hash_transactions(transactions, 4);
+    Block *forged = create_detached_block(prev, create_tree(hashes, 4));
+    free_transaction_hashes(hashes, 4);
+    free_transactions(transactions, 4);
+    forged->has_mmr_root = true;
+    memset(forged->mmr_root, 0xab, HASH_SIZE);
+    Block *tail = blockchain.tail;
+    bool refused = receive_block(tree, forged) == RECEIVE_REJECTED &&
+                   blockchain.tail == tail;
+    printf("block with a wrong MMR root %s\n",
+           refused ? "refused" : "ACCEPTED");
+    complete = complete && refused;
+  }
+
+  free(blocks);
+  destroy_orphan_pool(tree->orphans);
+  destroy_block_tree(tree);
+  destroy_blockchain(&blockchain);
+  return valid && complete ? 0 : 1;
+}
+
+// Links synthetic headers onto chain until it holds num_headers, with
+// timestamps a few seconds apart.
+static void extend_headers(HeaderChain *chain, size_t num_headers,
+                           bool with_mmr_root) {
+  EVP_MD_CTX *context = create_hash_context();
+  uint64_t seed = 0x9e3779b97f4a7c15ull;
+  int64_t timestamp =
+      chain->count > 0 ? header_timestamp(get_header(chain, chain->count - 1))
+                       : 0;
+  // MMR roots commit to every earlier header's hash, as a node's would.
+  MMRPeaks peaks = {.num_peaks = 0, .num_leaves = 0};
+  for (size_t i = 1; with_mmr_root && i < chain->count; i++) {
+    mmr_peaks_append(&peaks, header_prev_hash(get_header(chain, i)));
+  }
+  while (chain->count < num_headers) {
+    unsigned char header[BLOCK_HEADER_SIZE] = {0};
+    store_le32(header + HEADER_VERSION_OFFSET, BLOCK_VERSION);
+    if (chain->count > 0) {
+      hash_with_context(context, get_header(chain, chain->count - 1).bytes,
+                        BLOCK_HEADER_SIZE, header + HEADER_PREV_HASH_OFFSET);
+    }
+    for (size_t i = 0; i < HASH_SIZE; i += 8) {
+      seed ^= seed << 13;
+      seed ^= seed >> 7;
+      seed ^= seed << 17;
+      store_le64(header + HEADER_MERKLE_ROOT_OFFSET + i, seed);
+    }
+    if (with_mmr_root) {
+      if (chain->count > 0) {
+        mmr_peaks_append(&peaks, header + HEADER_PREV_HASH_OFFSET);
+      }
+      mmr_peaks_root(&peaks, header + HEADER_MMR_ROOT_OFFSET);
+      store_le32(header + HEADER_FLAGS_OFFSET, HEADER_HAS_MMR_ROOT);
+    }
+    timestamp += 1 + (int64_t)(seed % 30);
+    store_le64(header + HEADER_TIMESTAMP_OFFSET, (uint64_t)timestamp);
+    header_chain_append(chain, header);
+  }
+  EVP_MD_CTX_free(context);
+}
+
+static int bench_headers(int argc, char **argv) {
+  size_t num_headers = argc > 0 ? strtoul(argv[0], NULL, 10) : 1000000;
+  size_t num_threads = argc > 1 ? strtoul(argv[1], NULL, 10) : 0;
+  size_t block_size = 1000;
+
+  // A real block to prove a transaction against, then synthetic headers
+  // linked on top of it.
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  char **transactions = make_transactions(block_size, 0);
+  Block *block = create_block(&blockchain, transactions, block_size);
+  HeaderChain *chain = create_header_chain(num_headers);
+  header_chain_from_blockchain(chain, &blockchain);
+
+  uint64_t started = monotonic_ns();
+  extend_headers(chain, num_headers, false);
+  double build_s = (monotonic_ns() - started) / 1e9;
+  double megabytes = chain->count * (double)BLOCK_HEADER_SIZE / 1e6;
+  printf("%zu headers, %d bytes each, %.0f MB, built in %.2f s\n",
+         chain->count, BLOCK_HEADER_SIZE, megabytes, build_s);
+
+  size_t thread_counts[] = {1, num_threads};
+  for (size_t i = 0; i < 2; i++) {
+    started = monotonic_ns();
+    size_t first_invalid = validate_header_chain(chain, thread_counts[i]);
+    double validate_s = (monotonic_ns() - started) / 1e9;
+    printf("validate (%s): %.0f headers/s, %.0f MB/s, %s\n",
+           i == 0 ? "1 thread" : "all threads", chain->count / validate_s,
+           megabytes / validate_s,
+           first_invalid == chain->count ? "valid" : "INVALID");
+  }
+
+  size_t tampered = chain->count / 2;
+  unsigned char *merkle_root = chain->headers + tampered * BLOCK_HEADER_SIZE +
+                               HEADER_MERKLE_ROOT_OFFSET;
+  merkle_root[0] ^= 1;
+  printf("tampered header %zu detected at %zu\n", tampered,
+         validate_header_chain(chain, num_threads));
+  merkle_root[0] ^= 1;
+
+  unsigned char leaf[HASH_SIZE];
+  unsigned int hash_size;
+  compute_hash((unsigned char *)transactions[777], strlen(transactions[777]),
+               leaf, &hash_size);
+  MerkleProof proof;
+  bool proved = merkle_prove(block->merkletree, block_size, 777, &proof);
+  bool accepted = proved && verify_transaction_proof(chain, 1, leaf, &proof);
+  leaf[0] ^= 1;
+  bool forged = verify_transaction_proof(chain, 1, leaf, &proof);
+  printf("proof for transaction 777: %zu hashes, %s, forged leaf %s\n",
+         proof.path_len, accepted ? "accepted" : "REJECTED",
+         forged ? "ACCEPTED" : "rejected");
+
+  destroy_header_chain(chain);
+  free_transactions(transactions, block_size);
+  destroy_blockchain(&blockchain);
+  return 0;
+}
+
+static int bench_compact(int argc, char **argv) {
+  size_t num_headers = argc > 0 ? strtoul(argv[0], NULL, 10) : 1000000;
+  const char *path = argc > 1 ? argv[1] : "bench.headers";
+
+  for (int with_mmr_root = 0; with_mmr_root < 2; with_mmr_root++) {
+    HeaderChain *chain = create_header_chain(num_headers);
+    extend_headers(chain, num_headers, with_mmr_root);
+    double full_mb = chain->count * (double)BLOCK_HEADER_SIZE / 1e6;
+
+    uint64_t started = monotonic_ns();
+    bool saved = save_compact_headers(chain, path, 0);
+    double save_s = (monotonic_ns() - started) / 1e9;
+    FILE *file = fopen(path, "rb");
+    long size = -1;
+    if (file != NULL) {
+      fseek(file, 0, SEEK_END);
+      size = ftell(file);
+      fclose(file);
+    }
+
+    HeaderChain *loaded = create_header_chain(0);
+    started = monotonic_ns();
+    bool ok = saved && load_compact_headers(path, loaded);
+    double load_s = (monotonic_ns() - started) / 1e9;
+    ok = ok && loaded->count == chain->count &&
+         memcmp(loaded->headers, chain->headers,
+                chain->count * BLOCK_HEADER_SIZE) == 0;
+
+    printf("%s MMR roots: %.1f MB -> %.1f MB (%.1f bytes/header, %.0f%% "
+           "smaller), save %.2f s, load %.2f s (%.0f headers/s), %s\n",
+           with_mmr_root ? "with" : "without", full_mb, size / 1e6,
+           (double)size / chain->count, 100.0 * (1 - size / (full_mb * 1e6)),
+           save_s, load_s, chain->count / load_s,
+           ok ? "round trip exact" : "ROUND TRIP FAILED");
+    destroy_header_chain(loaded);
+    destroy_header_chain(chain);
+  }
+  remove(path);
+  return 0;
+}
+
+// The per-byte fprintf formatting the printers used before the exporter,
+// kept as a baseline.
+static double export_with_fprintf(const Blockchain *blockchain, FILE *out) {
+  uint64_t started = monotonic_ns();
+  uint64_t height = 0;
+  for (Block *curr = blockchain->head; curr != NULL; curr = curr->next_block) {
+    unsigned char hash[HASH_SIZE];
+    unsigned int hash_size;
+    calculate_block_hash(curr, hash, &hash_size);
+    fprintf(out, "%llu,", (unsigned long long)height++);
+    for (size_t i = 0; i < HASH_SIZE; i++) {
+      fprintf(out, "%02x", hash[i]);
+    }
+    fprintf(out, ",");
+    for (size_t i = 0; i < HASH_SIZE; i++) {
+      fprintf(out, "%02x", curr->prev_block_hash[i]);
+    }
+    fprintf(out, ",");
+    for (size_t i = 0; i < HASH_SIZE; i++) {
+      fprintf(out, "%02x", curr->merkle_root[i]);
+    }
+    fprintf(out, ",%ld,%llu\n", (long)curr->timestamp,
+            (unsigned long long)curr->nonce);
+  }
+  fflush(out);
+  return (monotonic_ns() - started) / 1e9;
+}
+
+static int bench_export(int argc, char **argv) {
+  size_t num_blocks = argc > 0 ? strtoul(argv[0], NULL, 10) : 100000;
+  const char *path = argc > 1 ? argv[1] : "/dev/null";
+  static const char *formats[] = {"binary", "jsonl", "csv"};
+
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  for (size_t i = 1; i < num_blocks; i++) {
+    char **transactions = make_transactions(1, i);
+    create_block(&blockchain, transactions, 1);
+    free_transactions(transactions, 1);
+  }
+
+  FILE *baseline = fopen(path, "w");
+  if (baseline == NULL) {
+    perror("ERROR: Failed to open export file");
+    destroy_blockchain(&blockchain);
+    return 1;
+  }
+  double baseline_s = export_with_fprintf(&blockchain, baseline);
+  fclose(baseline);
+  printf("fprintf per byte: %d blocks in %.2f s (%.0f blocks/s)\n",
+         blockchain.count, baseline_s, blockchain.count / baseline_s);
+
+  for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+    ExportFormat format;
+    parse_export_format(formats[f], &format);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      perror("ERROR: Failed to open export file");
+      destroy_blockchain(&blockchain);
+      return 1;
+    }
+    ExportStats stats;
+    bool ok = export_blockchain(&blockchain, fd, format, &stats);
+    close(fd);
+    printf("%-6s: %llu blocks, %.1f MB in %.2f s (%.0f blocks/s, %.1f "
+           "MB/s)%s\n",
+           formats[f], (unsigned long long)stats.blocks, stats.bytes / 1e6,
+           stats.seconds, stats.blocks / stats.seconds,
+           stats.bytes / 1e6 / stats.seconds, ok ? "" : " FAILED");
+  }
+  destroy_blockchain(&blockchain);
+  return 0;
+}
+
+static int bench_hex(int argc, char **argv) {
+  size_t total = argc > 0 ? strtoul(argv[0], NULL, 10) : 64u << 20;
+  static const size_t chunks[] = {HASH_SIZE, 1u << 20};
+  total -= total % (1u << 20);
+  if (total == 0) {
+    total = 1u << 20;
+  }
+  unsigned char *data = (unsigned char *)malloc(total);
+  unsigned char *decoded = (unsigned char *)malloc(total);
+  char *text = (char *)malloc(2 * total + 1);
+  for (size_t i = 0; i < total; i++) {
+    data[i] = (unsigned char)(i * 2654435761u >> 13);
+  }
+
+  // The snprintf loop the printers used before hex.h.
+  uint64_t started = monotonic_ns();
+  for (size_t i = 0; i < total; i++) {
+    snprintf(text + 2 * i, 3, "%02x", data[i]);
+  }
+  double baseline_s = (monotonic_ns() - started) / 1e9;
+  printf("snprintf: encode %.0f MB/s\n", total / 1e6 / baseline_s);
+
+  for (int impl = HEX_SCALAR; impl <= HEX_AVX2; impl++) {
+    if (!hex_use_implementation((HexImpl)impl)) {
+      printf("%-8s: not supported by this CPU\n",
+             hex_implementation_name((HexImpl)impl));
+      continue;
+    }
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+      size_t chunk = chunks[c];
+      started = monotonic_ns();
+      for (size_t i = 0; i < total; i += chunk) {
+        hex_encode(data + i, chunk, text + 2 * i);
+      }
+      double encode_s = (monotonic_ns() - started) / 1e9;
+      started = monotonic_ns();
+      bool ok = true;
+      for (size_t i = 0; i < total; i += chunk) {
+        ok &= hex_decode(text + 2 * i, 2 * chunk, decoded + i);
+      }
+      double decode_s = (monotonic_ns() - started) / 1e9;
+      ok = ok && memcmp(data, decoded, total) == 0;
+      printf("%-8s: %7zu-byte chunks, encode %.0f MB/s (%.0fx snprintf), "
+             "decode %.0f MB/s, %s\n",
+             hex_implementation_name((HexImpl)impl), chunk,
+             total / 1e6 / encode_s, baseline_s / encode_s,
+             total / 1e6 / decode_s, ok ? "round trip exact" : "MISMATCH");
+    }
+  }
+
+  // Decoding must reject a bad digit wherever it lands.
+  bool rejected = true;
+  for (size_t i = 0; i < 2 * 256; i++) {
+    char saved = text[i];
+    text[i] = "g/:@G`"[i % 6];
+    rejected &= !hex_decode(text, 2 * 256, decoded);
+    text[i] = saved;
+  }
+  printf("invalid digits %s\n", rejected ? "rejected" : "ACCEPTED");
+  hex_use_implementation(hex_best_implementation());
+  free(data);
+  free(decoded);
+  free(text);
+  return 0;
+}
+
+static void *serve_rpc(void *arg) {
+  rpc_server_run((RpcServer *)arg);
+  return NULL;
+}
+
+static int connect_loopback(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in address = {.sin_family = AF_INET,
+                                .sin_port = htons(port),
+                                .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  if (fd < 0 ||
+      connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    perror("ERROR: Failed to connect to RPC server");
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  // A server that stops answering fails the bench instead of hanging it.
+  struct timeval timeout = {.tv_sec = 10};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+typedef struct {
+  char *data;
+  size_t len;
+  size_t capacity;
+  size_t received; // bytes read over the buffer's lifetime
+} ResponseBuffer;
+
+static bool send_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    length -= (size_t)n;
+  }
+  return true;
+}
+
+// Reads count responses, counting those with the expected status. The body
+// of the last one is left at the start of the buffer, NUL terminated.
+static bool read_responses(int fd, ResponseBuffer *buffer, size_t count,
+                           int expected, size_t *matched) {
+  size_t offset = 0;
+  buffer->len = 0;
+  while (count > 0) {
+    char *header_end = NULL;
+    size_t body_len = 0;
+    if (buffer->len > offset) {
+      header_end = memmem(buffer->data + offset, buffer->len - offset,
+                          "\r\n\r\n", 4);
+    }
+    if (header_end != NULL) {
+      *header_end = '\0';
+      char *length = strstr(buffer->data + offset, "Content-Length: ");
+      body_len = length != NULL ? strtoul(length + 16, NULL, 10) : 0;
+      *header_end = '\r';
+    }
+    size_t end = header_end != NULL
+                     ? (size_t)(header_end + 4 - buffer->data) + body_len
+                     : SIZE_MAX;
+    if (end <= buffer->len) {
+      if (atoi(buffer->data + offset + 9) == expected) {
+        (*matched)++;
+      }
+      if (--count == 0) {
+        size_t body = (size_t)(header_end + 4 - buffer->data);
+        memmove(buffer->data, buffer->data + body, body_len);
+        buffer->data[body_len] = '\0';
+        buffer->len = body_len;
+        return true;
+      }
+      offset = end;
+      continue;
+    }
+    if (buffer->capacity - buffer->len < 65536) {
+      buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 1 << 20;
+      buffer->data = (char *)realloc(buffer->data, buffer->capacity);
+    }
+    ssize_t n = recv(fd, buffer->data + buffer->len,
+                     buffer->capacity - buffer->len - 1, 0);
+    if (n <= 0) {
+      return false;
+    }
+    buffer->len += (size_t)n;
+    buffer->received += (size_t)n;
+  }
+  return true;
+}
+
+typedef struct {
+  int fd;
+  const char *data;
+  size_t length;
+  bool ok;
+} BurstSender;
+
+static void *send_burst(void *arg) {
+  BurstSender *sender = (BurstSender *)arg;
+  sender->ok = send_all(sender->fd, sender->data, sender->length);
+  return NULL;
+}
+
+// Checks a proof served by the RPC server the way a client would.
+static bool check_served_proof(const char *body) {
+  const char *end = body + strlen(body);
+  JsonSpan leaf, root, num_leaves, index;
+  MerkleProof proof = {0};
+  unsigned char leaf_hash[HASH_SIZE], root_hash[HASH_SIZE];
+  if (!json_find_member(body, end, "leaf", &leaf) ||
+      !json_find_member(body, end, "merkle_root", &root) ||
+      !json_find_member(body, end, "num_leaves", &num_leaves) ||
+      !json_find_member(body, end, "index", &index) ||
+      !hex_decode(leaf.start, 2 * HASH_SIZE, leaf_hash) ||
+      !hex_decode(root.start, 2 * HASH_SIZE, root_hash)) {
+    return false;
+  }
+  proof.num_leaves = strtoul(num_leaves.start, NULL, 10);
+  proof.leaf_index = strtoul(index.start, NULL, 10);
+  const char *p = strstr(body, "\"path\":[");
+  for (p = p != NULL ? p + 8 : end; *p == '"' || *p == ',';) {
+    p += *p == ',';
+    if (proof.path_len == MERKLE_MAX_DEPTH ||
+        !hex_decode(p + 1, 2 * HASH_SIZE, proof.path[proof.path_len++])) {
+      return false;
+    }
+    p += 2 * HASH_SIZE + 2;
+  }
+  return merkle_verify(root_hash, leaf_hash, &proof);
+}
+
+static int bench_rpc(int argc, char **argv) {
+  size_t num_requests = argc > 0 ? strtoul(argv[0], NULL, 10) : 200000;
+  size_t num_connections = argc > 1 ? strtoul(argv[1], NULL, 10) : 8;
+  size_t depth = argc > 2 ? strtoul(argv[2], NULL, 10) : 32;
+  size_t num_transactions = argc > 3 ? strtoul(argv[3], NULL, 10) : 2000;
+  const size_t num_blocks = 1000;
+  size_t block_size = num_transactions / 4 ? num_transactions / 4 : 1;
+
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  for (size_t i = 1; i < num_blocks; i++) {
+    char **transactions = make_transactions(1, i);
+    create_block(&blockchain, transactions, 1);
+    free_transactions(transactions, 1);
+  }
+  SigCache *cache = create_sig_cache(num_transactions * 4);
+  set_signature_cache(cache);
+  RpcConfig config = {.ephemeral = true, .block_size = block_size};
+  RpcServer *server = create_rpc_server(&blockchain, &config);
+  if (server == NULL) {
+    return 1;
+  }
+  pthread_t thread;
+  pthread_create(&thread, NULL, serve_rpc, server);
+
+  int *fds = (int *)malloc(sizeof(int) * num_connections);
+  for (size_t c = 0; c < num_connections; c++) {
+    fds[c] = connect_loopback(server->port);
+  }
+  ResponseBuffer response = {0};
+  char *batch = (char *)malloc(depth * 64);
+
+  // Every connection keeps depth pipelined requests in flight.
+  size_t rounds = num_requests / (num_connections * depth);
+  size_t ok = 0;
+  uint64_t started = monotonic_ns();
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t c = 0; c < num_connections; c++) {
+      size_t length = 0;
+      for (size_t i = 0; i < depth; i++) {
+        size_t height = (r * 7919 + c * 104729 + i * 31) % num_blocks;
+        length += (size_t)sprintf(batch + length,
+                                  "GET /block/height/%zu HTTP/1.1\r\n\r\n",
+                                  height);
+      }
+      send_all(fds[c], batch, length);
+    }
+    for (size_t c = 0; c < num_connections; c++) {
+      read_responses(fds[c], &response, depth, 200, &ok);
+    }
+  }
+  double get_s = (monotonic_ns() - started) / 1e9;
+  size_t sent = rounds * num_connections * depth;
+  printf("GET /block/height: %zu requests over %zu connections, %zu "
+         "pipelined: %.0f req/s, %zu ok\n",
+         sent, num_connections, depth, sent / get_s, ok);
+
+  // One burst on one connection whose responses outgrow the server's output
+  // limit: the requests it holds back must still be answered. The burst is
+  // sent from another thread so the client keeps reading meanwhile.
+  const char burst_request[] = "GET /tip HTTP/1.1\r\n\r\n";
+  size_t burst_count = 32768;
+  size_t burst_length = burst_count * (sizeof(burst_request) - 1);
+  char *burst = (char *)malloc(burst_length);
+  for (size_t i = 0; i < burst_count; i++) {
+    memcpy(burst + i * (sizeof(burst_request) - 1), burst_request,
+           sizeof(burst_request) - 1);
+  }
+  BurstSender sender = {fds[0], burst, burst_length, false};
+  pthread_t sender_thread;
+  pthread_create(&sender_thread, NULL, send_burst, &sender);
+  ok = 0;
+  response.received = 0;
+  started = monotonic_ns();
+  bool burst_done = read_responses(fds[0], &response, burst_count, 200, &ok);
+  double burst_s = (monotonic_ns() - started) / 1e9;
+  pthread_join(sender_thread, NULL);
+  free(burst);
+  printf("GET /tip burst: %zu pipelined on one connection, %.1f MB of "
+         "responses in %.2f s, %zu ok, %s\n",
+         burst_count, response.received / 1e6, burst_s, ok,
+         sender.ok && burst_done && ok == burst_count ? "all answered"
+                                                      : "STALLED");
+  if (!sender.ok || !burst_done || ok != burst_count) {
+    return 1;
+  }
+
+  // Submissions are signed up front so only the server's work is timed.
+  Keypair keypair;
+  generate_keypair(&keypair);
+  char **requests = (char **)malloc(sizeof(char *) * num_transactions);
+  size_t *lengths = (size_t *)malloc(sizeof(size_t) * num_transactions);
+  for (size_t i = 0; i < num_transactions; i++) {
+    char payload[32];
+    int payload_len = snprintf(payload, sizeof(payload), "rpc-%zu", i);
+    Transaction transaction;
+    sign_transaction(&transaction, &keypair, payload, (size_t)payload_len);
+    char body[512];
+    int body_len = snprintf(body, sizeof(body),
+                            "{\"payload\":\"%s\",\"public_key\":\"", payload);
+    hex_encode(transaction.public_key, PUBLIC_KEY_SIZE, body + body_len);
+    body_len += 2 * PUBLIC_KEY_SIZE;
+    body_len += sprintf(body + body_len, "\",\"signature\":\"");
+    hex_encode(transaction.signature, SIGNATURE_SIZE, body + body_len);
+    body_len += 2 * SIGNATURE_SIZE;
+    body_len += sprintf(body + body_len, "\"}");
+    requests[i] = (char *)malloc(640);
+    lengths[i] = (size_t)snprintf(
+        requests[i], 640, "POST /tx HTTP/1.1\r\nContent-Length: %d\r\n\r\n%.*s",
+        body_len, body_len, body);
+    free_transaction(&transaction);
+  }
+  ok = 0;
+  started = monotonic_ns();
+  for (size_t i = 0; i < num_transactions;) {
+    size_t batch_size = 0;
+    for (; batch_size < depth && i < num_transactions; batch_size++, i++) {
+      send_all(fds[0], requests[i], lengths[i]);
+    }
+    read_responses(fds[0], &response, batch_size, 202, &ok);
+  }
+  double post_s = (monotonic_ns() - started) / 1e9;
+  printf("POST /tx: %zu transactions: %.0f tx/s, %zu accepted into blocks of "
+         "%zu\n",
+         num_transactions, num_transactions / post_s, ok, block_size);
+
+  // The last block sealed holds the last block_size submissions.
+  size_t proofs_ok = 0;
+  size_t tip_height = num_blocks - 1 + num_transactions / block_size;
+  started = monotonic_ns();
+  for (size_t i = 0; i < block_size; i++) {
+    char request[96];
+    int length = snprintf(request, sizeof(request),
+                          "GET /proof/%zu/%zu HTTP/1.1\r\n\r\n", tip_height, i);
+    size_t served = 0;
+    send_all(fds[0], request, (size_t)length);
+    if (read_responses(fds[0], &response, 1, 200, &served) && served &&
+        check_served_proof(response.data)) {
+      proofs_ok++;
+    }
+  }
+  double proof_s = (monotonic_ns() - started) / 1e9;
+  printf("GET /proof: %zu/%zu proofs verified by the client, %.0f req/s\n",
+         proofs_ok, block_size, block_size / proof_s);
+
+  for (size_t c = 0; c < num_connections; c++) {
+    close(fds[c]);
+  }
+  rpc_server_stop(server);
+  pthread_join(thread, NULL);
+  print_rpc_stats(&server->stats);
+  destroy_rpc_server(server);
+  destroy_blockchain(&blockchain);
+  set_signature_cache(NULL);
+  destroy_sig_cache(cache);
+  for (size_t i = 0; i < num_transactions; i++) {
+    free(requests[i]);
+  }
+  free(requests);
+  free(lengths);
+  free_keypair(&keypair);
+  free(response.data);
+  free(batch);
+  free(fds);
+  return 0;
+}
+
+typedef struct {
+  IngestServer *server;
+  double cpu_seconds;
+} IngestThread;
+
+static void *serve_ingest(void *arg) {
+  IngestThread *thread = (IngestThread *)arg;
+  ingest_server_run(thread->server);
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  thread->cpu_seconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                        (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+  return NULL;
+}
+
+typedef struct {
+  const char *path;
+  size_t num_frames;
+  size_t payload_bytes;
+  size_t producer;
+} IngestProducer;
+
+// Load generator: streams length-prefixed frames, many per write.
+static void *produce_frames(void *arg) {
+  IngestProducer *producer = (IngestProducer *)arg;
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  strncpy(address.sun_path, producer->path, sizeof(address.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 ||
+      connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    perror("ERROR: Failed to connect to ingest socket");
+    if (fd >= 0) {
+      close(fd);
+    }
+    return NULL;
+  }
+
+  const size_t frames_per_write = 4096;
+  size_t frame_size = INGEST_FRAME_HEADER_SIZE + producer->payload_bytes;
+  char *chunk = (char *)malloc(frames_per_write * frame_size);
+  for (size_t i = 0; i < frames_per_write; i++) {
+    unsigned char *frame = (unsigned char *)chunk + i * frame_size;
+    store_le32(frame, (uint32_t)producer->payload_bytes);
+    char *payload = (char *)frame + INGEST_FRAME_HEADER_SIZE;
+    memset(payload, 'x', producer->payload_bytes);
+    int length = snprintf(payload, producer->payload_bytes, "tx-%zu-%zu",
+                          producer->producer, i);
+    if (length > 0 && (size_t)length < producer->payload_bytes) {
+      payload[length] = ':';
+    }
+  }
+  for (size_t sent = 0; sent < producer->num_frames;) {
+    size_t frames = producer->num_frames - sent < frames_per_write
+                        ? producer->num_frames - sent
+                        : frames_per_write;
+    if (!send_all(fd, chunk, frames * frame_size)) {
+      break;
+    }
+    sent += frames;
+  }
+  close(fd);
+  free(chunk);
+  return NULL;
+}
+
+static int bench_ingest(int argc, char **argv) {
+  size_t num_frames = argc > 0 ? strtoul(argv[0], NULL, 10) : 2000000;
+  size_t num_producers = argc > 1 ? strtoul(argv[1], NULL, 10) : 2;
+  size_t payload_bytes = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+  const char *path = "bench.sock";
+  if (payload_bytes < 1) {
+    payload_bytes = 1;
+  }
+
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  set_pruning(&blockchain, 64, NULL, NULL);
+  Pipeline *pipeline = create_pipeline(&blockchain, NULL);
+  IngestConfig config = {.path = path};
+  IngestThread server = {create_ingest_server(pipeline, &config), 0};
+  if (pipeline == NULL || server.server == NULL) {
+    destroy_pipeline(pipeline);
+    destroy_blockchain(&blockchain);
+    return 1;
+  }
+  pthread_t server_thread;
+  pthread_create(&server_thread, NULL, serve_ingest, &server);
+
+  pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * num_producers);
+  IngestProducer *producers =
+      (IngestProducer *)malloc(sizeof(IngestProducer) * num_producers);
+  uint64_t started = monotonic_ns();
+  for (size_t p = 0; p < num_producers; p++) {
+    producers[p] = (IngestProducer){path, num_frames / num_producers,
+                                    payload_bytes, p};
+    pthread_create(&threads[p], NULL, produce_frames, &producers[p]);
+  }
+  for (size_t p = 0; p < num_producers; p++) {
+    pthread_join(threads[p], NULL);
+  }
+  double send_s = (monotonic_ns() - started) / 1e9;
+  ingest_server_stop(server.server);
+  pthread_join(server_thread, NULL);
+  pipeline_flush(pipeline);
+  double total_s = (monotonic_ns() - started) / 1e9;
+
+  const IngestStats *stats = &server.server->stats;
+  print_ingest_stats(stats);
+  printf("producers: %zu x %zu-byte frames sent in %.2f s (%.0f tx/s)\n",
+         num_producers, payload_bytes, send_s, stats->frames / send_s);
+  printf("ingest thread: %.3f us CPU per frame (%.0f tx/s per core)\n",
+         server.cpu_seconds * 1e6 / stats->frames,
+         stats->frames / server.cpu_seconds);
+  printf("end to end: %d blocks persisted in %.2f s (%.0f tx/s)\n",
+         blockchain.count - 1, total_s, stats->frames / total_s);
+
+  destroy_ingest_server(server.server);
+  destroy_pipeline(pipeline);
+  destroy_blockchain(&blockchain);
+  free(threads);
+  free(producers);
+  return 0;
+}
+
+typedef struct {
+  Sealer *sealer;
+  size_t num_transactions;
+  size_t rate; // transactions per second, 0 for as fast as possible
+} SealProducer;
+
+static void *run_sealer(void *arg) {
+  sealer_run((Sealer *)arg);
+  return NULL;
+}
+
+// Submits in 1 ms ticks so the arrival rate holds on average.
+static void *produce_paced(void *arg) {
+  SealProducer *producer = (SealProducer *)arg;
+  size_t per_tick = producer->rate ? (producer->rate + 999) / 1000
+                                   : producer->num_transactions;
+  uint64_t tick_ns = producer->rate ? 1000000ull * per_tick * 1000 /
+                                          producer->rate
+                                    : 0;
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  char payload[64];
+  size_t sent = 0;
+  while (sent < producer->num_transactions) {
+    for (size_t i = 0; i < per_tick && sent < producer->num_transactions;
+         i++, sent++) {
+      int len = snprintf(payload, sizeof(payload), "transaction-%zu", sent);
+      sealer_submit(producer->sealer, payload, (size_t)len);
+    }
+    next.tv_nsec += (long)tick_ns;
+    while (next.tv_nsec >= 1000000000l) {
+      next.tv_nsec -= 1000000000l;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+  return NULL;
+}
+
+// Sweeps the count threshold at a fixed arrival rate to show the trade
+// between seal latency and block fill.
+static int bench_seal(int argc, char **argv) {
+  size_t num_transactions = argc > 0 ? strtoul(argv[0], NULL, 10) : 200000;
+  size_t rate = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+  int max_delay_ms = argc > 2 ? atoi(argv[2]) : 20;
+  const size_t thresholds[] = {256, 1024, 4096, 16384};
+
+  printf("%zu transactions at %zu tx/s, max delay %d ms\n", num_transactions,
+         rate, max_delay_ms);
+  printf("%8s %8s %8s %8s %8s %10s %10s %10s\n", "max_tx", "blocks",
+         "by_count", "by_delay", "avg_fill", "avg_us", "p50_us", "p99_us");
+  for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++) {
+    Blockchain blockchain = {0};
+    create_blockchain(&blockchain);
+    set_pruning(&blockchain, 64, NULL, NULL);
+    Pipeline *pipeline = create_pipeline(&blockchain, NULL);
+    SealerConfig config = {.max_transactions = thresholds[t],
+                           .max_delay_ms = max_delay_ms};
+    Sealer *sealer = pipeline != NULL ? create_sealer(pipeline, &config) : NULL;
+    if (sealer == NULL) {
+      destroy_pipeline(pipeline);
+      destroy_blockchain(&blockchain);
+      return 1;
+    }
+    pthread_t sealer_thread, producer_thread;
+    SealProducer producer = {sealer, num_transactions, rate};
+    pthread_create(&sealer_thread, NULL, run_sealer, sealer);
+    pthread_create(&producer_thread, NULL, produce_paced, &producer);
+    pthread_join(producer_thread, NULL);
+    sealer_stop(sealer);
+    pthread_join(sealer_thread, NULL);
+    pipeline_flush(pipeline);
+
+    SealerStats stats;
+    sealer_get_stats(sealer, &stats);
+    printf("%8zu %8llu %8llu %8llu %7.0f%% %10.0f %10llu %10llu\n",
+           thresholds[t], (unsigned long long)stats.blocks,
+           (unsigned long long)stats.sealed_by[SEAL_BY_COUNT],
+           (unsigned long long)stats.sealed_by[SEAL_BY_DELAY],
+           stats.blocks ? 100.0 * stats.total_fill / stats.blocks : 0.0,
+           stats.blocks ? stats.total_latency_ns / 1e3 / stats.blocks : 0.0,
+           (unsigned long long)seal_latency_percentile_us(&stats, 50),
+           (unsigned long long)seal_latency_percentile_us(&stats, 99));
+    destroy_sealer(sealer);
+    destroy_pipeline(pipeline);
+    destroy_blockchain(&blockchain);
+  }
+  return 0;
+}
+
+typedef struct {
+  Blockchain *blockchain;
+  RcuDomain *rcu;
+  pthread_mutex_t *lock; // baseline: serialize readers with the writer
+  atomic_bool *running;
+  uint64_t reads;
+  uint64_t appends;
+  uint64_t max_append_ns;
+  double cpu_seconds;
+  unsigned char sink; // keeps the reads from being optimized out
+} ChainThread;
+
+static void *append_blocks(void *arg) {
+  ChainThread *writer = (ChainThread *)arg;
+  char **transactions = make_transactions(16, 0);
+  while (atomic_load_explicit(writer->running, memory_order_relaxed)) {
+    uint64_t started = monotonic_ns();
+    if (writer->lock != NULL) {
+      pthread_mutex_lock(writer->lock);
+    }
+    create_block(writer->blockchain, transactions, 16);
+    if (writer->lock != NULL) {
+      pthread_mutex_unlock(writer->lock);
+    }
+    uint64_t elapsed = monotonic_ns() - started;
+    if (elapsed > writer->max_append_ns) {
+      writer->max_append_ns = elapsed;
+    }
+    writer->appends++;
+  }
+  free_transactions(transactions, 16);
+  return NULL;
+}
+
+// Looks up random blocks from the published tip and reads their Merkle
+// roots, as an RPC thread answering block and proof queries would.
+static void *read_blocks(void *arg) {
+  ChainThread *reader = (ChainThread *)arg;
+  RcuReader *slot = reader->lock == NULL ? rcu_register_reader(reader->rcu)
+                                         : NULL;
+  uint64_t seed = (uint64_t)(uintptr_t)reader * 0x9e3779b97f4a7c15ull;
+  unsigned char sink = 0;
+  while (atomic_load_explicit(reader->running, memory_order_relaxed)) {
+    for (int i = 0; i < 256; i++) {
+      seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+      if (slot != NULL) {
+        rcu_read_lock(slot);
+      } else {
+        pthread_mutex_lock(reader->lock);
+      }
+      Block *tip = get_published_tip(reader->blockchain);
+      Block *block = get_ancestor(tip, (seed >> 33) % (tip->height + 1));
+      sink ^= block->merkle_root[0];
+      MerkleTree *tree = block->merkletree;
+      if (tree != NULL && tree->root != NULL) {
+        sink ^= tree->root->hash[0];
+      }
+      if (slot != NULL) {
+        rcu_read_unlock(slot);
+      } else {
+        pthread_mutex_unlock(reader->lock);
+      }
+    }
+    reader->reads += 256;
+  }
+  rcu_unregister_reader(slot);
+  reader->sink = sink;
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  reader->cpu_seconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                        (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+  return NULL;
+}
+
+// Readers walk the chain from the published tip while one writer appends
+// and prunes; the baseline puts every read and append behind one mutex.
+static int bench_readers(int argc, char **argv) {
+  size_t max_readers = argc > 0 ? strtoul(argv[0], NULL, 10) : 8;
+  int duration_ms = argc > 1 ? atoi(argv[1]) : 500;
+  if (max_readers == 0 || max_readers > RCU_MAX_READERS) {
+    max_readers = 8;
+  }
+
+  // Reads per CPU-second of reader time stay flat as readers are added
+  // exactly when reads scale linearly with cores.
+  printf("%8s %8s %14s %14s %14s %12s %14s %10s\n", "mode", "readers",
+         "reads/s", "per_reader/s", "reads/cpu_s", "appends/s",
+         "max_append_us", "pending");
+  for (int locked = 0; locked <= 1; locked++) {
+    for (size_t num_readers = 1; num_readers <= max_readers;
+         num_readers *= 2) {
+      Blockchain blockchain = {0};
+      create_blockchain(&blockchain);
+      RcuDomain *rcu = create_rcu_domain();
+      if (rcu == NULL) {
+        destroy_blockchain(&blockchain);
+        return 1;
+      }
+      set_chain_rcu(&blockchain, rcu);
+      set_pruning(&blockchain, 64, NULL, NULL);
+      char **seed_data = make_transactions(16, 0);
+      for (int i = 0; i < 1000; i++) {
+        create_block(&blockchain, seed_data, 16);
+      }
+      free_transactions(seed_data, 16);
+
+      pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+      atomic_bool running;
+      atomic_init(&running, true);
+      ChainThread *threads =
+          (ChainThread *)calloc(num_readers + 1, sizeof(ChainThread));
+      pthread_t *ids = (pthread_t *)malloc(sizeof(pthread_t) *
+                                           (num_readers + 1));
+      for (size_t t = 0; t <= num_readers; t++) {
+        threads[t] = (ChainThread){&blockchain, rcu, locked ? &lock : NULL,
+                                   &running, 0, 0, 0, 0, 0};
+        pthread_create(&ids[t], NULL, t == 0 ? append_blocks : read_blocks,
+                       &threads[t]);
+      }
+      struct timespec pause = {duration_ms / 1000,
+                               (duration_ms % 1000) * 1000000l};
+      uint64_t started = monotonic_ns();
+      nanosleep(&pause, NULL);
+      atomic_store(&running, false);
+      for (size_t t = 0; t <= num_readers; t++) {
+        pthread_join(ids[t], NULL);
+      }
+      double seconds = (monotonic_ns() - started) / 1e9;
+
+      uint64_t reads = 0;
+      double cpu_seconds = 0;
+      for (size_t t = 1; t <= num_readers; t++) {
+        reads += threads[t].reads;
+        cpu_seconds += threads[t].cpu_seconds;
+      }
+      RcuStats rcu_stats;
+      rcu_get_stats(rcu, &rcu_stats);
+      printf("%8s %8zu %14.0f %14.0f %14.0f %12.0f %14.1f %5zu/%-4zu\n",
+             locked ? "mutex" : "rcu", num_readers, reads / seconds,
+             reads / seconds / num_readers, reads / cpu_seconds,
+             threads[0].appends / seconds, threads[0].max_append_ns / 1e3,
+             rcu_stats.pending, rcu_stats.max_pending);
+      free(threads);
+      free(ids);
+      destroy_blockchain(&blockchain);
+      destroy_rcu_domain(rcu);
+    }
+  }
+  return 0;
+}
+
+// Looks blocks up by height and by hash in another process's view, the way
+// a monitoring tool would, and prints the rates.
+static int read_view(int fd, size_t num_lookups) {
+  ChainView *view = chain_view_open_fd(fd);
+  ChainViewTip tip;
+  if (view == NULL || !chain_view_read_tip(view, &tip)) {
+    chain_view_close(view);
+    return 1;
+  }
+  uint64_t seed = 88172645463325252ull;
+  size_t wrong = 0;
+  size_t torn = 0; // overwritten while read, so the reader would retry
+  unsigned char sink = 0;
+  uint64_t started = monotonic_ns();
+  for (size_t i = 0; i < num_lookups; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    chain_view_read_tip(view, &tip);
+    uint64_t height =
+        tip.height - seed % (tip.height - tip.oldest_height + 1);
+    uint64_t sequence;
+    const ChainViewEntry *entry =
+        chain_view_block_at_height(view, height, &sequence);
+    if (entry != NULL) {
+      unsigned char byte = entry->hash[0];
+      if (chain_view_entry_stable(entry, sequence)) {
+        sink ^= byte;
+      } else {
+        torn++;
+      }
+    }
+  }
+  double zero_copy_s = (monotonic_ns() - started) / 1e9;
+
+  started = monotonic_ns();
+  for (size_t i = 0; i < num_lookups; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    chain_view_read_tip(view, &tip);
+    uint64_t height =
+        tip.height - seed % (tip.height - tip.oldest_height + 1);
+    ChainViewEntry entry;
+    uint64_t found;
+    // Blocks may leave the ring between the two lookups; only a block found
+    // at another height is wrong.
+    if (chain_view_copy_block(view, height, &entry) &&
+        chain_view_find_hash(view, entry.hash, &found)) {
+      wrong += found != height;
+    }
+  }
+  double by_hash_s = (monotonic_ns() - started) / 1e9;
+
+  printf("client: %.0f ns/zero-copy lookup (%zu torn), "
+         "%.0f ns/copy + hash lookup, %zu wrong (sink %u)\n",
+         zero_copy_s * 1e9 / num_lookups, torn,
+         by_hash_s * 1e9 / num_lookups, wrong, sink);
+  chain_view_close(view);
+  return wrong != 0;
+}
+
+// One process appends blocks and publishes each one into the view while a
+// forked client maps the region and reads from it.
+static int bench_view(int argc, char **argv) {
+  size_t num_blocks = argc > 0 ? strtoul(argv[0], NULL, 10) : 100000;
+  size_t num_lookups = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  char *transactions[] = {"view"};
+
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  set_pruning(&blockchain, 64, NULL, NULL);
+  ChainViewPublisher *publisher = create_chain_view(NULL, 0);
+  if (publisher == NULL) {
+    destroy_blockchain(&blockchain);
+    return 1;
+  }
+
+  uint64_t started = monotonic_ns();
+  for (size_t i = 0; i < num_blocks; i++) {
+    create_block(&blockchain, transactions, 1);
+  }
+  double append_s = (monotonic_ns() - started) / 1e9;
+  started = monotonic_ns();
+  for (Block *curr = blockchain.head; curr != NULL; curr = curr->next_block) {
+    chain_view_publish(publisher, curr);
+  }
+  double publish_s = (monotonic_ns() - started) / 1e9;
+  printf("node: %.0f ns/append, %.0f ns/publish, %zu KiB region, "
+         "%zu blocks in view\n",
+         append_s * 1e9 / num_blocks, publish_s * 1e9 / (num_blocks + 1),
+         publisher->size / 1024,
+         (size_t)(publisher->region->tip.height -
+                  publisher->region->tip.oldest_height + 1));
+
+  fflush(stdout);
+  pid_t client = fork();
+  if (client == 0) {
+    int failed = read_view(publisher->fd, num_lookups);
+    fflush(stdout);
+    _exit(failed);
+  }
+  // Keep the view moving while the client reads.
+  size_t appended = 0;
+  int status = 0;
+  while (client > 0 && waitpid(client, &status, WNOHANG) == 0) {
+    chain_view_publish(publisher, create_block(&blockchain, transactions, 1));
+    appended++;
+  }
+  printf("node: published %zu more blocks during the client's reads\n",
+         appended);
+
+  destroy_chain_view(publisher);
+  destroy_blockchain(&blockchain);
+  return client < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+typedef struct {
+  BlockSubscriber *subscriber;
+  useconds_t work_us; // per event, to make a slow consumer
+  uint64_t *latencies_ns;
+  size_t num_latencies;
+} StreamConsumer;
+
+static void *consume_stream(void *arg) {
+  StreamConsumer *consumer = (StreamConsumer *)arg;
+  BlockEvent event;
+  while (block_stream_wait(consumer->subscriber, &event, -1) !=
+         STREAM_CLOSED) {
+    consumer->latencies_ns[consumer->num_latencies++] =
+        monotonic_ns() - event.published_ns;
+    if (consumer->work_us > 0) {
+      usleep(consumer->work_us);
+    }
+  }
+  return NULL;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Appends paced blocks to a chain with a stream attached while subscribers
+// sleep on their eventfds; the last subscriber is slow enough to be lapped.
+static int bench_stream(int argc, char **argv) {
+  size_t num_blocks = argc > 0 ? strtoul(argv[0], NULL, 10) : 20000;
+  size_t num_subscribers = argc > 1 ? strtoul(argv[1], NULL, 10) : 4;
+  long interval_us = argc > 2 ? atol(argv[2]) : 100;
+  if (num_subscribers == 0 || num_subscribers > BLOCK_STREAM_MAX_SUBSCRIBERS) {
+    num_subscribers = 4;
+  }
+
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  set_pruning(&blockchain, 64, NULL, NULL);
+  BlockStream *stream = create_block_stream(256);
+  if (stream == NULL) {
+    destroy_blockchain(&blockchain);
+    return 1;
+  }
+  set_block_stream(&blockchain, stream);
+
+  StreamConsumer *consumers =
+      (StreamConsumer *)calloc(num_subscribers, sizeof(StreamConsumer));
+  pthread_t *ids = (pthread_t *)malloc(sizeof(pthread_t) * num_subscribers);
+  for (size_t i = 0; i < num_subscribers; i++) {
+    consumers[i].subscriber = block_stream_subscribe(stream);
+    consumers[i].work_us =
+        num_subscribers > 1 && i == num_subscribers - 1 ? 1000 : 0;
+    consumers[i].latencies_ns =
+        (uint64_t *)malloc(sizeof(uint64_t) * num_blocks);
+    pthread_create(&ids[i], NULL, consume_stream, &consumers[i]);
+  }
+
+  char **transactions = make_transactions(16, 0);
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  uint64_t started = monotonic_ns();
+  for (size_t i = 0; i < num_blocks; i++) {
+    create_block(&blockchain, transactions, 16);
+    next.tv_nsec += interval_us * 1000;
+    while (next.tv_nsec >= 1000000000l) {
+      next.tv_nsec -= 1000000000l;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+  double seconds = (monotonic_ns() - started) / 1e9;
+  block_stream_close(stream);
+  free_transactions(transactions, 16);
+
+  printf("%zu blocks in %.2f s, %zu subscribers, %llu wakeups\n", num_blocks,
+         seconds, num_subscribers, (unsigned long long)stream->wakeups);
+  printf("%10s %10s %10s %8s %10s %10s %10s\n", "subscriber", "received",
+         "missed", "resyncs", "p50_us", "p99_us", "max_us");
+  for (size_t i = 0; i < num_subscribers; i++) {
+    pthread_join(ids[i], NULL);
+    StreamConsumer *consumer = &consumers[i];
+    size_t count = consumer->num_latencies;
+    qsort(consumer->latencies_ns, count, sizeof(uint64_t), compare_u64);
+    BlockSubscriber *subscriber = consumer->subscriber;
+    printf("%9zu%s %10llu %10llu %8llu %10.1f %10.1f %10.1f\n", i,
+           consumer->work_us > 0 ? "*" : " ",
+           (unsigned long long)subscriber->received,
+           (unsigned long long)subscriber->missed,
+           (unsigned long long)subscriber->resyncs,
+           count ? consumer->latencies_ns[count / 2] / 1e3 : 0.0,
+           count ? consumer->latencies_ns[count * 99 / 100] / 1e3 : 0.0,
+           count ? consumer->latencies_ns[count - 1] / 1e3 : 0.0);
+    block_stream_unsubscribe(subscriber);
+    free(consumer->latencies_ns);
+  }
+  printf("* sleeps 1 ms per event\n");
+
+  free(consumers);
+  free(ids);
+  destroy_blockchain(&blockchain);
+  destroy_block_stream(stream);
+  return 0;
+}
+
+typedef struct {
+  const char *name;
+  const char *usage;
+  int (*run)(int argc, char **argv);
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    {"pipeline", "[blocks] [tx_per_block]", bench_pipeline},
+    {"sigs", "[transactions] [signers]", bench_sigs},
+    {"verify", "[transactions] [max_threads]", bench_verify},
+    {"sigcache", "[transactions]", bench_sigcache},
+    {"state", "[accounts]", bench_state},
+    {"snapshot", "[accounts] [threads] [path]", bench_snapshot},
+    {"prune", "[blocks] [keep_full]", bench_prune},
+    {"mmr", "[blocks]", bench_mmr},
+    {"ancestor", "[blocks]", bench_ancestor},
+    {"forks", "[blocks] [reorg_depth]", bench_forks},
+    {"reorg", "[tx_per_block]", bench_reorg},
+    {"orphans", "[blocks] [reorder_window] [max_orphans] [mmr]",
+     bench_orphans},
+    {"headers", "[headers] [threads]", bench_headers},
+    {"compact", "[headers] [path]", bench_compact},
+    {"export", "[blocks] [path]", bench_export},
+    {"hex", "[bytes]", bench_hex},
+    {"rpc", "[requests] [connections] [pipeline_depth] [transactions]",
+     bench_rpc},
+    {"ingest", "[transactions] [producers] [payload_bytes]", bench_ingest},
+    {"seal", "[transactions] [tx_per_second] [max_delay_ms]", bench_seal},
+    {"readers", "[max_readers] [duration_ms]", bench_readers},
+    {"view", "[blocks] [lookups]", bench_view},
+    {"stream", "[blocks] [subscribers] [interval_us]", bench_stream},
+};
+
+int main(int argc, char **argv) {
+  size_t count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+  if (argc >= 2) {
+    for (size_t i = 0; i < count; i++) {
+      if (strcmp(argv[1], benchmarks[i].name) == 0) {
+        return benchmarks[i].run(argc - 2, argv + 2);
+      }
+    }
+  }
+  fprintf(stderr, "Usage: %s <benchmark> [args]\n", argv[0]);
+  for (size_t i = 0; i < count; i++) {
+    fprintf(stderr, "  %s %s\n", benchmarks[i].name, benchmarks[i].usage);
+  }
+  return 1;
+}
@@ -0,0 +1,63 @@
+#ifndef BLOCK_HEADER_H
+#define BLOCK_HEADER_H
+
+#include "byteorder.h"
+#include "merkletree.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BLOCK_VERSION 1
+#define HEADER_HAS_MMR_ROOT 0x1u
+
+// Canonical header layout: fixed offsets, little-endian integers. The
+// block hash is the SHA3-512 of exactly these bytes, and header storage
+// keeps them as-is. mmr_root is all zero unless HEADER_HAS_MMR_ROOT is set.
+#define HEADER_VERSION_OFFSET 0
+#define HEADER_FLAGS_OFFSET 4
+#define HEADER_PREV_HASH_OFFSET 8
+#define HEADER_MERKLE_ROOT_OFFSET (HEADER_PREV_HASH_OFFSET + HASH_SIZE)
+#define HEADER_MMR_ROOT_OFFSET (HEADER_MERKLE_ROOT_OFFSET + HASH_SIZE)
+#define HEADER_TIMESTAMP_OFFSET (HEADER_MMR_ROOT_OFFSET + HASH_SIZE)
+#define HEADER_NONCE_OFFSET (HEADER_TIMESTAMP_OFFSET + 8)
+#define BLOCK_HEADER_SIZE (HEADER_NONCE_OFFSET + 8)
+
+// Reads fields straight out of a serialized header without decoding it.
+typedef struct {
+  const unsigned char *bytes; // BLOCK_HEADER_SIZE bytes
+} HeaderView;
+
+static inline HeaderView header_view(const unsigned char *bytes) {
+  HeaderView view = {bytes};
+  return view;
+}
+
+static inline uint32_t header_version(HeaderView view) {
+  return load_le32(view.bytes + HEADER_VERSION_OFFSET);
+}
+
+static inline bool header_has_mmr_root(HeaderView view) {
+  return (load_le32(view.bytes + HEADER_FLAGS_OFFSET) &
+          HEADER_HAS_MMR_ROOT) != 0;
+}
+
+static inline const unsigned char *header_prev_hash(HeaderView view) {
+  return view.bytes + HEADER_PREV_HASH_OFFSET;
+}
+
+static inline const unsigned char *header_merkle_root(HeaderView view) {
+  return view.bytes + HEADER_MERKLE_ROOT_OFFSET;
+}
+
+static inline const unsigned char *header_mmr_root(HeaderView view) {
+  return view.bytes + HEADER_MMR_ROOT_OFFSET;
+}
+
+static inline int64_t header_timestamp(HeaderView view) {
+  return (int64_t)load_le64(view.bytes + HEADER_TIMESTAMP_OFFSET);
+}
+
+static inline uint64_t header_nonce(HeaderView view) {
+  return load_le64(view.bytes + HEADER_NONCE_OFFSET);
+}
+
+#endif // BLOCK_HEADER_H
@@ -0,0 +1,266 @@
+#include "block_stream.h"
+#include "blockchain.h"
+#include "timing.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// -----------------------------------------------------------
+// Block Stream Implementation
+// -----------------------------------------------------------
+
+BlockStream *create_block_stream(size_t capacity) {
+  if (capacity == 0) {
+    capacity = DEFAULT_BLOCK_STREAM_CAPACITY;
+  }
+  size_t rounded = 1;
+  while (rounded < capacity) {
+    rounded <<= 1;
+  }
+
+  BlockStream *stream = (BlockStream *)aligned_alloc(
+      BLOCK_STREAM_CACHE_LINE,
+      (sizeof(BlockStream) + BLOCK_STREAM_CACHE_LINE - 1) /
+          BLOCK_STREAM_CACHE_LINE * BLOCK_STREAM_CACHE_LINE);
+  BlockStreamSlot *slots = (BlockStreamSlot *)aligned_alloc(
+      BLOCK_STREAM_CACHE_LINE, sizeof(BlockStreamSlot) * rounded);
+  if (stream == NULL || slots == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for block stream\n");
+    free(stream);
+    free(slots);
+    return NULL;
+  }
+  for (size_t i = 0; i < rounded; i++) {
+    atomic_init(&slots[i].version, 0);
+  }
+  stream->slots = slots;
+  stream->capacity = rounded;
+  atomic_init(&stream->head, 0);
+  atomic_init(&stream->closed, false);
+  atomic_init(&stream->num_slots, 0);
+  stream->wakeups = 0;
+  for (size_t i = 0; i < BLOCK_STREAM_MAX_SUBSCRIBERS; i++) {
+    BlockSubscriber *subscriber = &stream->subscribers[i];
+    atomic_init(&subscriber->waiting, false);
+    atomic_init(&subscriber->in_use, false);
+    subscriber->wake_fd = -1;
+    subscriber->stream = stream;
+  }
+  return stream;
+}
+
+void destroy_block_stream(BlockStream *stream) {
+  if (stream == NULL)
+    return;
+  for (size_t i = 0; i < BLOCK_STREAM_MAX_SUBSCRIBERS; i++) {
+    if (stream->subscribers[i].wake_fd >= 0) {
+      close(stream->subscribers[i].wake_fd);
+    }
+  }
+  free(stream->slots);
+  free(stream);
+}
+
+static void drain_wakeups(BlockSubscriber *subscriber) {
+  uint64_t count;
+  while (read(subscriber->wake_fd, &count, sizeof(count)) < 0 &&
+         errno == EINTR) {
+  }
+}
+
+// A slot's eventfd outlives its subscriber: the producer may still write to
+// it after an unsubscribe, and that stale wakeup is drained by whoever
+// takes the slot next rather than landing on a reused descriptor.
+BlockSubscriber *block_stream_subscribe(BlockStream *stream) {
+  for (size_t i = 0; i < BLOCK_STREAM_MAX_SUBSCRIBERS; i++) {
+    BlockSubscriber *subscriber = &stream->subscribers[i];
+    bool expected = false;
+    if (!atomic_compare_exchange_strong(&subscriber->in_use, &expected,
+                                        true)) {
+      continue;
+    }
+    if (subscriber->wake_fd < 0) {
+      subscriber->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (subscriber->wake_fd < 0) {
+        perror("ERROR: Failed to create subscriber eventfd");
+        atomic_store(&subscriber->in_use, false);
+        return NULL;
+      }
+    }
+    drain_wakeups(subscriber);
+    atomic_store(&subscriber->waiting, false);
+    subscriber->cursor = atomic_load(&stream->head);
+    subscriber->received = 0;
+    subscriber->missed = 0;
+    subscriber->resyncs = 0;
+    // The producer scans the slots below num_slots, and reads wake_fd only
+    // after seeing in_use and waiting set.
+    size_t used = atomic_load(&stream->num_slots);
+    while (used < i + 1 &&
+           !atomic_compare_exchange_weak(&stream->num_slots, &used, i + 1)) {
+    }
+    return subscriber;
+  }
+  fprintf(stderr, "ERROR: No free block stream subscriber slots\n");
+  return NULL;
+}
+
+void block_stream_unsubscribe(BlockSubscriber *subscriber) {
+  if (subscriber == NULL)
+    return;
+  atomic_store(&subscriber->waiting, false);
+  atomic_store(&subscriber->in_use, false);
+}
+
+void block_stream_publish(BlockStream *stream, const Block *block,
+                          uint64_t reorg_depth) {
+  uint64_t sequence = atomic_load_explicit(&stream->head, memory_order_relaxed);
+  BlockStreamSlot *slot = &stream->slots[sequence & (stream->capacity - 1)];
+  unsigned char hash[HASH_SIZE];
+  unsigned int hash_size;
+  calculate_block_hash((Block *)block, hash, &hash_size);
+
+  // Readers that copy the slot while it is rewritten see the odd version or
+  // a changed one afterwards, and treat the copy as lapped.
+  atomic_store_explicit(&slot->version, 2 * sequence + 1,
+                        memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  BlockEvent *event = &slot->event;
+  event->sequence = sequence;
+  event->height = block->height;
+  event->chain_work = block->chain_work;
+  event->reorg_depth = reorg_depth;
+  event->timestamp = (int64_t)block->timestamp;
+  event->num_transactions = block->num_transactions;
+  memcpy(event->hash, hash, HASH_SIZE);
+  event->published_ns = monotonic_ns();
+  atomic_store_explicit(&slot->version, 2 * sequence + 2,
+                        memory_order_release);
+
+  // Paired with block_stream_arm(): either the producer sees a subscriber
+  // waiting, or the subscriber sees the new head before it sleeps.
+  atomic_store_explicit(&stream->head, sequence + 1, memory_order_seq_cst);
+  size_t used = atomic_load_explicit(&stream->num_slots, memory_order_acquire);
+  for (size_t i = 0; i < used; i++) {
+    BlockSubscriber *subscriber = &stream->subscribers[i];
+    if (atomic_load_explicit(&subscriber->waiting, memory_order_seq_cst) &&
+        atomic_exchange(&subscriber->waiting, false)) {
+      uint64_t one = 1;
+      if (write(subscriber->wake_fd, &one, sizeof(one)) == sizeof(one)) {
+        stream->wakeups++;
+      }
+    }
+  }
+}
+
+void block_stream_close(BlockStream *stream) {
+  atomic_store(&stream->closed, true);
+  size_t used = atomic_load(&stream->num_slots);
+  for (size_t i = 0; i < used; i++) {
+    BlockSubscriber *subscriber = &stream->subscribers[i];
+    if (atomic_exchange(&subscriber->waiting, false)) {
+      uint64_t one = 1;
+      if (write(subscriber->wake_fd, &one, sizeof(one)) < 0) {
+        perror("ERROR: Failed to wake block stream subscriber");
+      }
+    }
+  }
+}
+
+// Copies the event with the given sequence, or returns false if the slot
+// has moved on to a later one.
+static bool read_slot(const BlockStream *stream, uint64_t sequence,
+                      BlockEvent *event) {
+  const BlockStreamSlot *slot =
+      &stream->slots[sequence & (stream->capacity - 1)];
+  uint64_t version =
+      atomic_load_explicit(&slot->version, memory_order_acquire);
+  if (version != 2 * sequence + 2) {
+    return false;
+  }
+  memcpy(event, &slot->event, sizeof(BlockEvent));
+  atomic_thread_fence(memory_order_acquire);
+  return atomic_load_explicit(&slot->version, memory_order_relaxed) ==
+         version;
+}
+
+StreamResult block_stream_next(BlockSubscriber *subscriber,
+                               BlockEvent *event) {
+  BlockStream *stream = subscriber->stream;
+  uint64_t head = atomic_load_explicit(&stream->head, memory_order_acquire);
+  if (subscriber->cursor == head) {
+    return atomic_load(&stream->closed) &&
+                   atomic_load(&stream->head) == subscriber->cursor
+               ? STREAM_CLOSED
+               : STREAM_EMPTY;
+  }
+  if (head - subscriber->cursor <= stream->capacity &&
+      read_slot(stream, subscriber->cursor, event)) {
+    subscriber->cursor++;
+    subscriber->received++;
+    return STREAM_EVENT;
+  }
+
+  // Lapped: jump to the newest event. It can itself be overwritten while
+  // copied if the producer laps the ring again, so retry from the new head.
+  for (;;) {
+    head = atomic_load_explicit(&stream->head, memory_order_acquire);
+    if (read_slot(stream, head - 1, event)) {
+      break;
+    }
+  }
+  subscriber->missed += head - 1 - subscriber->cursor;
+  subscriber->cursor = head;
+  subscriber->received++;
+  subscriber->resyncs++;
+  return STREAM_RESYNC;
+}
+
+bool block_stream_arm(BlockSubscriber *subscriber) {
+  BlockStream *stream = subscriber->stream;
+  atomic_store_explicit(&subscriber->waiting, true, memory_order_seq_cst);
+  if (atomic_load_explicit(&stream->head, memory_order_seq_cst) !=
+          subscriber->cursor ||
+      atomic_load(&stream->closed)) {
+    atomic_store(&subscriber->waiting, false);
+    return false;
+  }
+  return true;
+}
+
+StreamResult block_stream_wait(BlockSubscriber *subscriber, BlockEvent *event,
+                               int timeout_ms) {
+  uint64_t deadline =
+      timeout_ms < 0 ? 0 : monotonic_ns() + (uint64_t)timeout_ms * 1000000ull;
+  for (;;) {
+    StreamResult result = block_stream_next(subscriber, event);
+    if (result != STREAM_EMPTY) {
+      return result;
+    }
+    if (!block_stream_arm(subscriber)) {
+      continue;
+    }
+
+    int wait_ms = -1;
+    if (timeout_ms >= 0) {
+      uint64_t now = monotonic_ns();
+      wait_ms =
+          now >= deadline ? 0 : (int)((deadline - now + 999999) / 1000000);
+    }
+    struct pollfd ready = {subscriber->wake_fd, POLLIN, 0};
+    int polled = poll(&ready, 1, wait_ms);
+    if (polled < 0 && errno != EINTR) {
+      perror("ERROR: Failed to wait for block stream");
+    }
+    bool gave_up = polled == 0 || (polled < 0 && errno != EINTR);
+    drain_wakeups(subscriber);
+    if (gave_up) {
+      atomic_store(&subscriber->waiting, false);
+      return block_stream_next(subscriber, event);
+    }
+  }
+}
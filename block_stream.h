@@ -0,0 +1,110 @@
+#ifndef BLOCK_STREAM_H
+#define BLOCK_STREAM_H
+
+#include "block_header.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEFAULT_BLOCK_STREAM_CAPACITY 1024
+#define BLOCK_STREAM_MAX_SUBSCRIBERS 64
+#define BLOCK_STREAM_CACHE_LINE 64
+
+typedef struct Block Block;
+
+// A new tip of the chain, as pushed by its writer.
+typedef struct {
+  uint64_t sequence; // position in the stream, from 0
+  uint64_t height;
+  uint64_t chain_work;
+  uint64_t reorg_depth; // blocks dropped from the old tip; 0 when extending
+  int64_t timestamp;
+  size_t num_transactions;
+  uint64_t published_ns; // monotonic_ns() when pushed
+  unsigned char hash[HASH_SIZE];
+} BlockEvent;
+
+// version is a seqlock over the event: 2 * sequence + 1 while the producer
+// writes it, 2 * sequence + 2 once written.
+typedef struct {
+  _Alignas(BLOCK_STREAM_CACHE_LINE) atomic_uint_fast64_t version;
+  BlockEvent event;
+} BlockStreamSlot;
+
+typedef enum {
+  STREAM_EVENT,  // the next event, in order
+  STREAM_EMPTY,  // caught up
+  STREAM_RESYNC, // lapped: events were lost, and this is the newest one
+  STREAM_CLOSED, // caught up and nothing more will come
+} StreamResult;
+
+// One consumer. waiting is set while it sleeps on wake_fd, so the producer
+// only pays for a wakeup write when someone is asleep. The cursor and
+// counters belong to the subscriber's thread.
+typedef struct {
+  _Alignas(BLOCK_STREAM_CACHE_LINE) atomic_bool waiting;
+  atomic_bool in_use;
+  int wake_fd; // eventfd, kept with the slot until the stream is destroyed
+  struct BlockStream *stream;
+  uint64_t cursor; // sequence of the next event to read
+  uint64_t received;
+  uint64_t missed;
+  uint64_t resyncs;
+} BlockSubscriber;
+
+// Single-producer, multi-consumer broadcast ring of new tips. The producer
+// never waits for consumers: each keeps its own cursor, and one that falls
+// a whole ring behind finds its next event overwritten. It is then resynced
+// to a snapshot, the newest event, and told how many it missed; a consumer
+// that needs every block refetches them from the chain, starting from the
+// last height it saw.
+typedef struct BlockStream {
+  BlockStreamSlot *slots;
+  size_t capacity; // power of two
+  _Alignas(BLOCK_STREAM_CACHE_LINE) atomic_uint_fast64_t head; // next sequence
+  atomic_bool closed;
+  atomic_size_t num_slots; // subscriber slots ever used, scanned on publish
+  uint64_t wakeups;        // eventfd writes, producer-owned
+  BlockSubscriber subscribers[BLOCK_STREAM_MAX_SUBSCRIBERS];
+} BlockStream;
+
+// -----------------------------------------------------------
+// Block stream management
+// -----------------------------------------------------------
+// capacity 0 takes the default and is rounded up to a power of two.
+BlockStream *create_block_stream(size_t capacity);
+// Every subscriber must have unsubscribed.
+void destroy_block_stream(BlockStream *stream);
+// Subscribers see only blocks pushed after they subscribe. Returns NULL
+// once BLOCK_STREAM_MAX_SUBSCRIBERS are subscribed.
+BlockSubscriber *block_stream_subscribe(BlockStream *stream);
+void block_stream_unsubscribe(BlockSubscriber *subscriber);
+
+// -----------------------------------------------------------
+// Producing (the chain's writer thread only)
+// -----------------------------------------------------------
+// Hashes block once and wakes every sleeping subscriber. Set on a chain with
+// set_block_stream(), which pushes each block it links and each new tip a
+// reorganization switches to.
+void block_stream_publish(BlockStream *stream, const Block *block,
+                          uint64_t reorg_depth);
+// Subscribers get STREAM_CLOSED once they have read everything pushed.
+void block_stream_close(BlockStream *stream);
+
+// -----------------------------------------------------------
+// Consuming (one thread per subscriber)
+// -----------------------------------------------------------
+// Never blocks.
+StreamResult block_stream_next(BlockSubscriber *subscriber, BlockEvent *event);
+// Blocks on the eventfd until an event arrives or timeout_ms passes (-1
+// waits forever); STREAM_EMPTY means it timed out.
+StreamResult block_stream_wait(BlockSubscriber *subscriber, BlockEvent *event,
+                               int timeout_ms);
+// For consumers with their own poll or epoll loop: after
+// block_stream_next() returns STREAM_EMPTY, arm and wait for wake_fd to
+// become readable, then drain it. Returns false, without arming, if events
+// arrived in between.
+bool block_stream_arm(BlockSubscriber *subscriber);
+
+#endif // BLOCK_STREAM_H
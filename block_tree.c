@@ -0,0 +1,724 @@
+#include "block_tree.h"
+#include "byteorder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// -----------------------------------------------------------
+// Tip heap
+// -----------------------------------------------------------
+
+// More work wins; on a tie the block seen first keeps its place.
+static inline bool better_tip(const Block *a, const Block *b) {
+  if (a->chain_work != b->chain_work) {
+    return a->chain_work > b->chain_work;
+  }
+  return a->sequence < b->sequence;
+}
+
+static inline void place_tip(BlockTree *tree, size_t index, Block *block) {
+  tree->tips[index] = block;
+  block->tip_index = index;
+}
+
+static void sift_up(BlockTree *tree, size_t index) {
+  Block *block = tree->tips[index];
+  while (index > 0) {
+    size_t parent = (index - 1) / 2;
+    if (!better_tip(block, tree->tips[parent])) {
+      break;
+    }
+    place_tip(tree, index, tree->tips[parent]);
+    index = parent;
+  }
+  place_tip(tree, index, block);
+}
+
+static void sift_down(BlockTree *tree, size_t index) {
+  Block *block = tree->tips[index];
+  for (;;) {
+    size_t child = 2 * index + 1;
+    if (child >= tree->num_tips) {
+      break;
+    }
+    if (child + 1 < tree->num_tips &&
+        better_tip(tree->tips[child + 1], tree->tips[child])) {
+      child++;
+    }
+    if (!better_tip(tree->tips[child], block)) {
+      break;
+    }
+    place_tip(tree, index, tree->tips[child]);
+    index = child;
+  }
+  place_tip(tree, index, block);
+}
+
+static bool reserve_tip_slot(BlockTree *tree) {
+  if (tree->num_tips == tree->tips_capacity) {
+    size_t capacity = tree->tips_capacity ? tree->tips_capacity * 2 : 8;
+    Block **grown = (Block **)realloc(tree->tips, sizeof(Block *) * capacity);
+    if (grown == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate memory for tip heap\n");
+      return false;
+    }
+    tree->tips = grown;
+    tree->tips_capacity = capacity;
+  }
+  return true;
+}
+
+static bool push_tip(BlockTree *tree, Block *block) {
+  if (!reserve_tip_slot(tree)) {
+    return false;
+  }
+  place_tip(tree, tree->num_tips++, block);
+  sift_up(tree, block->tip_index);
+  return true;
+}
+
+// Marks a tip set aside in tree->held rather than in the heap.
+#define HELD_TIP (SIZE_MAX - 1)
+
+// Removes block from the held tips by swapping the last one into its place.
+static void release_held(BlockTree *tree, Block *block) {
+  for (size_t i = 0; i < tree->num_held; i++) {
+    if (tree->held[i] == block) {
+      tree->held[i] = tree->held[--tree->num_held];
+      block->tip_index = SIZE_MAX;
+      return;
+    }
+  }
+}
+
+static void remove_tip(BlockTree *tree, Block *block) {
+  size_t index = block->tip_index;
+  if (index == HELD_TIP) {
+    release_held(tree, block);
+    return;
+  }
+  if (index == SIZE_MAX) {
+    return;
+  }
+  block->tip_index = SIZE_MAX;
+  Block *last = tree->tips[--tree->num_tips];
+  if (index == tree->num_tips) {
+    return;
+  }
+  place_tip(tree, index, last);
+  sift_up(tree, index);
+  sift_down(tree, last->tip_index);
+}
+
+// Makes block a tip again unless it already is one.
+static bool add_tip(BlockTree *tree, Block *block) {
+  return block->tip_index != SIZE_MAX || push_tip(tree, block);
+}
+
+// Takes a tip out of the heap but keeps it, to be offered to fork choice
+// again once the best chain moves.
+static void hold_tip(BlockTree *tree, Block *block) {
+  remove_tip(tree, block);
+  if (tree->num_held == tree->held_capacity) {
+    size_t capacity = tree->held_capacity ? tree->held_capacity * 2 : 8;
+    Block **grown = (Block **)realloc(tree->held, sizeof(Block *) * capacity);
+    if (grown == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate memory for held tips\n");
+      return;
+    }
+    tree->held = grown;
+    tree->held_capacity = capacity;
+  }
+  tree->held[tree->num_held++] = block;
+  block->tip_index = HELD_TIP;
+}
+
+// Moves every held tip with more work than the tail back into the heap.
+static void offer_held(BlockTree *tree) {
+  for (size_t i = 0; i < tree->num_held;) {
+    Block *block = tree->held[i];
+    if (!better_tip(block, tree->chain->tail) ||
+        !reserve_tip_slot(tree)) {
+      i++;
+      continue;
+    }
+    tree->held[i] = tree->held[--tree->num_held];
+    block->tip_index = SIZE_MAX;
+    push_tip(tree, block);
+  }
+}
+
+// -----------------------------------------------------------
+// BlockTree Implementation
+// -----------------------------------------------------------
+
+static bool reserve_index_slot(BlockTree *tree);
+
+static bool reserve_block_slot(BlockTree *tree) {
+  if (!reserve_index_slot(tree)) {
+    return false;
+  }
+  if (tree->num_blocks == tree->blocks_capacity) {
+    size_t capacity = tree->blocks_capacity ? tree->blocks_capacity * 2 : 64;
+    Block **grown =
+        (Block **)realloc(tree->blocks, sizeof(Block *) * capacity);
+    if (grown == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate memory for block index\n");
+      return false;
+    }
+    tree->blocks = grown;
+    tree->blocks_capacity = capacity;
+  }
+  return true;
+}
+
+static size_t index_slot(const BlockTree *tree, const unsigned char *hash) {
+  return (size_t)load_le64(hash) & (tree->index_capacity - 1);
+}
+
+static void index_insert(BlockTree *tree, const unsigned char *hash,
+                         Block *block) {
+  size_t slot = index_slot(tree, hash);
+  while (tree->index[slot].block != NULL) {
+    slot = (slot + 1) & (tree->index_capacity - 1);
+  }
+  memcpy(tree->index[slot].hash, hash, HASH_SIZE);
+  tree->index[slot].block = block;
+}
+
+// Keeps the hash index at most half full.
+static bool reserve_index_slot(BlockTree *tree) {
+  if ((tree->num_blocks + 1) * 2 <= tree->index_capacity) {
+    return true;
+  }
+  size_t capacity = tree->index_capacity ? tree->index_capacity * 2 : 128;
+  BlockIndexEntry *grown =
+      (BlockIndexEntry *)calloc(capacity, sizeof(BlockIndexEntry));
+  if (grown == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for block index\n");
+    return false;
+  }
+  BlockIndexEntry *old = tree->index;
+  size_t old_capacity = tree->index_capacity;
+  tree->index = grown;
+  tree->index_capacity = capacity;
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old[i].block != NULL) {
+      index_insert(tree, old[i].hash, old[i].block);
+    }
+  }
+  free(old);
+  return true;
+}
+
+Block *find_block(const BlockTree *tree, const unsigned char *hash) {
+  if (tree->index_capacity == 0) {
+    return NULL;
+  }
+  size_t slot = index_slot(tree, hash);
+  while (tree->index[slot].block != NULL) {
+    if (memcmp(tree->index[slot].hash, hash, HASH_SIZE) == 0) {
+      return tree->index[slot].block;
+    }
+    slot = (slot + 1) & (tree->index_capacity - 1);
+  }
+  return NULL;
+}
+
+// The block's slots must have been reserved.
+static void track_block(BlockTree *tree, Block *block) {
+  unsigned char hash[HASH_SIZE];
+  unsigned int hash_size;
+  calculate_block_hash(block, hash, &hash_size);
+  index_insert(tree, hash, block);
+  tree->blocks[tree->num_blocks++] = block;
+  block->sequence = tree->next_sequence++;
+  block->sealed = true;
+}
+
+BlockTree *create_block_tree(Blockchain *chain) {
+  BlockTree *tree = (BlockTree *)calloc(1, sizeof(BlockTree));
+  if (tree == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for block tree\n");
+    return NULL;
+  }
+  tree->chain = chain;
+  for (Block *curr = chain->head; curr != NULL; curr = curr->next_block) {
+    if (!reserve_block_slot(tree)) {
+      free(tree->index);
+      free(tree->blocks);
+      free(tree);
+      return NULL;
+    }
+    track_block(tree, curr);
+  }
+  if (chain->tail != NULL && !push_tip(tree, chain->tail)) {
+    free(tree->index);
+    free(tree->blocks);
+    free(tree);
+    return NULL;
+  }
+  return tree;
+}
+
+// Frees every block, on any branch, and leaves the chain empty.
+void destroy_block_tree(BlockTree *tree) {
+  if (tree == NULL)
+    return;
+  for (size_t i = 0; i < tree->num_blocks; i++) {
+    free_block(tree->blocks[i]);
+  }
+  tree->chain->head = NULL;
+  tree->chain->tail = NULL;
+  tree->chain->count = 0;
+  publish_tip(tree->chain, NULL);
+  free(tree->index);
+  free(tree->blocks);
+  free(tree->tips);
+  free(tree->held);
+  free(tree);
+}
+
+Block *best_tip(const BlockTree *tree) {
+  return tree->num_tips > 0 ? tree->tips[0] : NULL;
+}
+
+typedef enum {
+  REORG_DONE,
+  REORG_FAILED,  // the branch does not connect; its tip is dropped
+  REORG_BLOCKED, // the branch is valid but out of reach; its tip is held
+} ReorgResult;
+
+// Moves the state from the current tail to new_tip: blocks above the fork
+// are disconnected newest first, then the new branch is connected oldest
+// first. If a block on the new branch fails, it is marked invalid, its
+// parent becomes a tip if it is above the fork, and the old branch is
+// restored.
+static bool switch_state(BlockTree *tree, Block *fork, Block *new_tip) {
+  Blockchain *chain = tree->chain;
+  Block *old_tip = chain->tail;
+  uint64_t old_depth = old_tip->height - fork->height;
+  uint64_t new_depth = new_tip->height - fork->height;
+  size_t depth = (size_t)(old_depth > new_depth ? old_depth : new_depth);
+  Block **path = (Block **)malloc(sizeof(Block *) * depth);
+  if (path == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for reorganization\n");
+    return false;
+  }
+
+  for (Block *curr = old_tip; curr != fork; curr = curr->parent) {
+    disconnect_block_state(chain->state, curr);
+  }
+
+  size_t i = (size_t)new_depth;
+  for (Block *curr = new_tip; curr != fork; curr = curr->parent) {
+    path[--i] = curr;
+  }
+  for (; i < new_depth; i++) {
+    if (!connect_block_state(chain->state, path[i])) {
+      break;
+    }
+  }
+  if (i == new_depth) {
+    free(path);
+    return true;
+  }
+
+  // The blocks below it did connect, so that prefix of the branch still
+  // competes on its own work.
+  path[i]->invalid = true;
+  if (path[i]->parent != fork) {
+    add_tip(tree, path[i]->parent);
+  }
+  while (i-- > 0) {
+    disconnect_block_state(chain->state, path[i]);
+  }
+  i = (size_t)old_depth;
+  for (Block *curr = old_tip; curr != fork; curr = curr->parent) {
+    path[--i] = curr;
+  }
+  for (; i < old_depth; i++) {
+    if (!connect_block_state(chain->state, path[i])) {
+      fprintf(stderr, "ERROR: Failed to restore the previous best chain\n");
+      break;
+    }
+  }
+  free(path);
+  return false;
+}
+
+// Points the main chain at new_tip. Only the blocks above the fork point
+// are touched: the state is rolled back to the fork and forward along the
+// new branch, their next_block links are rewritten from the new tip back
+// to the fork, and the MMR is rewound to the fork and replayed forward.
+static ReorgResult reorganize(BlockTree *tree, Block *new_tip) {
+  Blockchain *chain = tree->chain;
+  Block *fork = find_fork_point(chain->tail, new_tip);
+  if (fork == NULL) {
+    fprintf(stderr, "ERROR: Best tip does not share the chain's genesis\n");
+    return REORG_FAILED;
+  }
+  if (chain->state != NULL) {
+    // Pruned blocks have no transactions left to disconnect.
+    for (Block *curr = chain->tail; curr != fork; curr = curr->parent) {
+      if (curr->pruned) {
+        fprintf(stderr, "ERROR: Reorganization crosses pruned blocks\n");
+        return REORG_BLOCKED;
+      }
+    }
+    if (!switch_state(tree, fork, new_tip)) {
+      return REORG_FAILED;
+    }
+  }
+
+  tree->reorgs++;
+  tree->last_reorg_depth = chain->tail->height - fork->height;
+
+  for (Block *curr = new_tip; curr != fork; curr = curr->parent) {
+    curr->parent->next_block = curr;
+  }
+  new_tip->next_block = NULL;
+  chain->tail = new_tip;
+  chain->count = (int)(new_tip->height + 1);
+  // Pruning only ever reaches the best chain, so the pruned blocks are a
+  // prefix of it. If that prefix ran past the fork, the new branch keeps
+  // the part up to the fork, and its blocks above the fork are all full.
+  if (chain->oldest_full != NULL &&
+      chain->oldest_full->height > fork->height) {
+    chain->pruned = (size_t)fork->height + 1;
+    chain->oldest_full = fork->next_block;
+  }
+  publish_tip(chain, new_tip);
+  if (chain->stream != NULL) {
+    block_stream_publish(chain->stream, new_tip, tree->last_reorg_depth);
+  }
+
+  if (chain->mmr != NULL) {
+    if (chain->mmr->num_leaves > fork->height) {
+      mmr_truncate(chain->mmr, fork->height);
+    }
+    Block *curr = get_ancestor(new_tip, chain->mmr->num_leaves);
+    for (; curr != new_tip; curr = curr->next_block) {
+      unsigned char hash[HASH_SIZE];
+      unsigned int hash_size;
+      calculate_block_hash(curr, hash, &hash_size);
+      mmr_append(chain->mmr, hash);
+    }
+  }
+  return REORG_DONE;
+}
+
+// Tips that cannot be connected are dropped and the next best is tried,
+// so the tail is always the best tip whose branch is valid. Tips that are
+// valid but out of reach are held, and offered again whenever a
+// reorganization moves the tail.
+static void choose_best_chain(BlockTree *tree) {
+  Block *best;
+  while ((best = best_tip(tree)) != tree->chain->tail) {
+    ReorgResult result = reorganize(tree, best);
+    if (result == REORG_DONE) {
+      if (tree->num_held == 0) {
+        return;
+      }
+      offer_held(tree);
+    } else if (result == REORG_BLOCKED) {
+      hold_tip(tree, best);
+    } else {
+      remove_tip(tree, best);
+    }
+  }
+}
+
+// Peaks of the MMR over parent and every ancestor, which a child of parent
+// commits to. A side-branch parent normally carries its own peaks, so this
+// is one append. Otherwise the branch is walked down to the nearest block
+// that does, or to where it leaves the best chain, whose prefix of the
+// chain's MMR is shared, and its hashes are appended oldest first: newest
+// taken from parent, the rest from prev_block_hash.
+static bool branch_mmr_peaks(const Blockchain *chain, Block *parent,
+                             MMRPeaks *peaks) {
+  unsigned char hash[HASH_SIZE];
+  unsigned int hash_size;
+  if (parent->mmr_peaks != NULL) {
+    *peaks = *parent->mmr_peaks;
+    calculate_block_hash(parent, hash, &hash_size);
+    mmr_peaks_append(peaks, hash);
+    return true;
+  }
+
+  Block *fork = find_fork_point(chain->tail, parent);
+  if (fork == NULL) {
+    return false;
+  }
+  uint64_t shared = fork->height + 1 < chain->mmr->num_leaves
+                        ? fork->height + 1
+                        : chain->mmr->num_leaves;
+  Block *base = parent;
+  while (base->height >= shared && base->mmr_peaks == NULL) {
+    base = base->parent;
+  }
+  if (base->height >= shared) {
+    *peaks = *base->mmr_peaks;
+  } else if (!mmr_get_peaks(chain->mmr, shared, peaks)) {
+    return false;
+  }
+  // Hashes of the blocks from base (if it carried its peaks) up to parent.
+  uint64_t first = base->height >= shared ? base->height : shared;
+  size_t depth = (size_t)(parent->height + 1 - first);
+  if (depth == 0) {
+    return true; // parent is on the best chain
+  }
+  unsigned char(*hashes)[HASH_SIZE] =
+      (unsigned char(*)[HASH_SIZE])malloc((size_t)HASH_SIZE * depth);
+  if (hashes == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for branch MMR\n");
+    return false;
+  }
+  calculate_block_hash(parent, hashes[0], &hash_size);
+  Block *curr = parent;
+  for (size_t i = 1; i < depth; i++) {
+    memcpy(hashes[i], curr->prev_block_hash, HASH_SIZE);
+    curr = curr->parent;
+  }
+  for (size_t i = depth; i-- > 0;) {
+    mmr_peaks_append(peaks, hashes[i]);
+  }
+  free(hashes);
+  return true;
+}
+
+// Gives a block placed off the tail its MMR commitment and keeps the peaks
+// behind it. A received block arrives committed, and its root is checked
+// rather than filled in: children name it by a hash that covers it.
+static bool commit_branch_mmr(const Blockchain *chain, Block *parent,
+                              Block *block) {
+  MMRPeaks *peaks = (MMRPeaks *)malloc(sizeof(MMRPeaks));
+  unsigned char root[HASH_SIZE];
+  if (peaks == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for branch MMR\n");
+    return false;
+  }
+  if (!branch_mmr_peaks(chain, parent, peaks) ||
+      !mmr_peaks_root(peaks, root)) {
+    free(peaks);
+    return false;
+  }
+  if (block->has_mmr_root) {
+    if (memcmp(root, block->mmr_root, HASH_SIZE) != 0) {
+      fprintf(stderr, "ERROR: Received block commits to a wrong MMR root\n");
+      free(peaks);
+      return false;
+    }
+  } else {
+    memcpy(block->mmr_root, root, HASH_SIZE);
+    block->has_mmr_root = true;
+  }
+  block->mmr_peaks = peaks;
+  return true;
+}
+
+// Links a freshly built child of parent into the tree; the caller re-runs
+// fork choice. Extending the tail is the common case and goes through the
+// regular append path, which also connects the state and maintains the MMR
+// and pruning. Returns false, leaving the block to the caller, only if it
+// could not extend the tail.
+static bool insert_block(BlockTree *tree, Block *parent, Block *block) {
+  Blockchain *chain = tree->chain;
+  block->invalid = parent->invalid;
+  // The append path commits blocks on the tail to the MMR; a side-branch
+  // block commits to its own branch's, so it is still provable once fork
+  // choice switches to it.
+  if (parent != chain->tail && chain->mmr != NULL &&
+      !commit_branch_mmr(chain, parent, block)) {
+    return false;
+  }
+  if (parent == chain->tail) {
+    if (chain->state != NULL && !connect_block_state(chain->state, block)) {
+      return false;
+    }
+    if (!link_block(chain, block)) {
+      if (chain->state != NULL) {
+        disconnect_block_state(chain->state, block);
+      }
+      return false;
+    }
+  }
+  track_block(tree, block);
+  if (block->invalid) {
+    return true;
+  }
+
+  remove_tip(tree, parent);
+  push_tip(tree, block);
+  return true;
+}
+
+// Validates a received block against its parent and links it.
+static bool connect_received(BlockTree *tree, Block *parent, Block *block) {
+  if (block->work == 0 || !reserve_block_slot(tree) ||
+      !reserve_tip_slot(tree)) {
+    free_block(block);
+    return false;
+  }
+  set_block_parent(block, parent);
+  if (!validate_block(block, parent)) {
+    fprintf(stderr, "ERROR: Received block failed validation\n");
+    free_block(block);
+    return false;
+  }
+  // Its hash is what children name it by, so it must already commit to an
+  // MMR root; insert_block() or link_block() checks which.
+  if (tree->chain->mmr != NULL && !block->has_mmr_root) {
+    fprintf(stderr, "ERROR: Received block commits to no MMR root\n");
+    free_block(block);
+    return false;
+  }
+  if (!insert_block(tree, parent, block)) {
+    free_block(block);
+    return false;
+  }
+  return true;
+}
+
+// Connects, breadth first, every orphan descending from block.
+static void connect_orphans(BlockTree *tree, Block *block) {
+  if (tree->orphans == NULL || tree->orphans->stats.orphans == 0) {
+    return;
+  }
+  size_t capacity = 16, head = 0, tail = 0;
+  Block **queue = (Block **)malloc(sizeof(Block *) * capacity);
+  if (queue == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for orphan queue\n");
+    return;
+  }
+  queue[tail++] = block;
+  while (head < tail) {
+    Block *parent = queue[head++];
+    unsigned char hash[HASH_SIZE];
+    unsigned int hash_size;
+    calculate_block_hash(parent, hash, &hash_size);
+
+    Block *child;
+    while ((child = orphan_pool_take_child(tree->orphans, hash)) != NULL) {
+      if (!connect_received(tree, parent, child)) {
+        continue;
+      }
+      if (tail == capacity) {
+        Block **grown =
+            (Block **)realloc(queue, sizeof(Block *) * capacity * 2);
+        if (grown == NULL) {
+          fprintf(stderr,
+                  "ERROR: Failed to allocate memory for orphan queue\n");
+          continue;
+        }
+        queue = grown;
+        capacity *= 2;
+      }
+      queue[tail++] = child;
+    }
+  }
+  free(queue);
+}
+
+// Brings in any orphans waiting on block, then re-runs fork choice once.
+static void settle(BlockTree *tree, Block *block) {
+  connect_orphans(tree, block);
+  choose_best_chain(tree);
+}
+
+Block *attach_block(BlockTree *tree, Block *parent, MerkleTree *merkletree,
+                    uint64_t work) {
+  if (parent == NULL || merkletree == NULL || work == 0) {
+    fprintf(stderr, "Block data is invalid\n");
+    return NULL;
+  }
+
+  // Grow both indexes first so nothing can fail once the block is linked.
+  if (!reserve_block_slot(tree) || !reserve_tip_slot(tree)) {
+    return NULL;
+  }
+
+  Block *block = create_child_block(parent, merkletree);
+  if (block == NULL) {
+    return NULL;
+  }
+  block->work = work;
+  block->chain_work = parent->chain_work + work;
+  if (!insert_block(tree, parent, block)) {
+    free(block);
+    return NULL;
+  }
+  settle(tree, block);
+  return block;
+}
+
+Block *create_signed_block_on(BlockTree *tree, Block *parent,
+                              const Transaction *transactions,
+                              size_t num_transactions) {
+  if (parent == NULL) {
+    fprintf(stderr, "Block data is invalid\n");
+    return NULL;
+  }
+  if (!reserve_block_slot(tree) || !reserve_tip_slot(tree)) {
+    return NULL;
+  }
+
+  Block *block =
+      create_signed_child_block(parent, transactions, num_transactions);
+  if (block == NULL) {
+    return NULL;
+  }
+  if (!insert_block(tree, parent, block)) {
+    free_block(block);
+    return NULL;
+  }
+  settle(tree, block);
+  return block;
+}
+
+Block *create_block_on(BlockTree *tree, Block *parent,
+                       char **transaction_data, size_t num_transactions) {
+  unsigned char **transaction_hashes =
+      hash_transactions(transaction_data, num_transactions);
+  if (transaction_hashes == NULL) {
+    return NULL;
+  }
+  MerkleTree *merkletree = create_tree(transaction_hashes, num_transactions);
+  free_transaction_hashes(transaction_hashes, num_transactions);
+  if (merkletree == NULL) {
+    return NULL;
+  }
+
+  Block *block = attach_block(tree, parent, merkletree, 1);
+  if (block == NULL) {
+    free_tree(merkletree);
+  }
+  return block;
+}
+
+ReceiveResult receive_block(BlockTree *tree, Block *block) {
+  unsigned char hash[HASH_SIZE];
+  unsigned int hash_size;
+  calculate_block_hash(block, hash, &hash_size);
+  if (find_block(tree, hash) != NULL) {
+    free_block(block);
+    return RECEIVE_DUPLICATE;
+  }
+
+  Block *parent = find_block(tree, block->prev_block_hash);
+  if (parent == NULL) {
+    if (tree->orphans == NULL) {
+      free_block(block);
+      return RECEIVE_REJECTED;
+    }
+    return orphan_pool_add(tree->orphans, block, time(NULL))
+               ? RECEIVE_ORPHANED
+               : RECEIVE_REJECTED;
+  }
+
+  if (!connect_received(tree, parent, block)) {
+    return RECEIVE_REJECTED;
+  }
+  settle(tree, block);
+  return RECEIVE_CONNECTED;
+}
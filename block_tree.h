@@ -0,0 +1,76 @@
+#ifndef BLOCK_TREE_H
+#define BLOCK_TREE_H
+
+#include "blockchain.h"
+#include "orphan_pool.h"
+#include <stdint.h>
+
+typedef struct {
+  unsigned char hash[HASH_SIZE];
+  Block *block; // NULL marks an empty slot
+} BlockIndexEntry;
+
+typedef enum {
+  RECEIVE_CONNECTED,
+  RECEIVE_ORPHANED,  // parent unknown; held until it arrives
+  RECEIVE_DUPLICATE, // already in the tree
+  RECEIVE_REJECTED,  // failed validation or could not be stored
+} ReceiveResult;
+
+// Tracks every block received, including competing branches, on top of a
+// Blockchain. The Blockchain's head..tail next_block links always describe
+// the current best chain; switching branches relinks only the blocks
+// between the fork point and the new tip.
+typedef struct {
+  Blockchain *chain;
+  Block **blocks; // every block the tree owns, for teardown
+  size_t num_blocks;
+  size_t blocks_capacity;
+  BlockIndexEntry *index; // open addressing on block hash
+  size_t index_capacity;  // power of two
+  Block **tips; // max-heap on (chain_work, earliest sequence)
+  size_t num_tips;
+  size_t tips_capacity;
+  Block **held; // valid tips a reorganization could not reach
+  size_t num_held;
+  size_t held_capacity;
+  uint64_t next_sequence;
+  uint64_t reorgs;
+  uint64_t last_reorg_depth;
+  OrphanPool *orphans; // optional; not owned
+} BlockTree;
+
+// -----------------------------------------------------------
+// Block tree management
+// -----------------------------------------------------------
+// Takes ownership of the chain's blocks. From then on, add blocks through
+// the tree rather than append_block()/create_block().
+BlockTree *create_block_tree(Blockchain *chain);
+void destroy_block_tree(BlockTree *tree);
+
+// -----------------------------------------------------------
+// Block tree interaction
+// -----------------------------------------------------------
+// Attaches a block carrying merkletree under parent, which may be any block
+// in the tree, and re-runs fork choice. work must be at least 1.
+Block *attach_block(BlockTree *tree, Block *parent, MerkleTree *merkletree,
+                    uint64_t work);
+Block *create_block_on(BlockTree *tree, Block *parent,
+                       char **transaction_data, size_t num_transactions);
+// Signed blocks change the chain's state only while they are on the best
+// chain. A block on a side branch is checked against the state once fork
+// choice first connects it; if that fails it is marked invalid, along with
+// any block later built on it, and the previous best chain stays.
+Block *create_signed_block_on(BlockTree *tree, Block *parent,
+                              const Transaction *transactions,
+                              size_t num_transactions);
+Block *best_tip(const BlockTree *tree);
+Block *find_block(const BlockTree *tree, const unsigned char *hash);
+// Takes ownership of a detached block (see create_detached_block()) and
+// places it by its prev_block_hash. If the parent is unknown the block is
+// held in the orphan pool; whenever a block joins the tree, the orphans
+// descending from it are validated and connected as one batch, with a
+// single fork choice at the end.
+ReceiveResult receive_block(BlockTree *tree, Block *block);
+
+#endif // BLOCK_TREE_H
@@ -1,4 +1,7 @@
 #include "blockchain.h"
+#include "byteorder.h"
+#include "hex.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -6,37 +9,31 @@
 // Blockchain Implementation
 // -----------------------------------------------------------
 
+static VerifyPool *verify_pool = NULL;
+
+void set_verify_pool(VerifyPool *pool) { verify_pool = pool; }
+
 void print_compute_hash(unsigned char *digest_value,
                         unsigned int digest_length) {
-  printf("Printing digest:\n");
-  for (unsigned int j = 0; j < digest_length; j++) {
-    fprintf(stdout, "%02x", digest_value[j]);
+  char hex[2 * HASH_SIZE + 2];
+  if (digest_length > HASH_SIZE) {
+    digest_length = HASH_SIZE;
   }
-  fprintf(stdout, "\n");
+  hex_encode(digest_value, digest_length, hex);
+  hex[2 * digest_length] = '\n';
+  hex[2 * digest_length + 1] = '\0';
+  printf("Printing digest:\n");
+  fputs(hex, stdout);
 }
 
-Block *create_block(Blockchain *blockchain, char **transaction_data,
-                    size_t num_transactions) {
-  Block *new_block = (Block *)malloc(sizeof(Block));
-  if (new_block == NULL) {
-    fprintf(stderr, "ERROR: Failed to allocate memory for new block\n");
-    return NULL;
-  }
-  unsigned char hash[HASH_SIZE];
+unsigned char **hash_transactions(char **transaction_data,
+                                  size_t num_transactions) {
   unsigned int hash_size;
-  Block *last = blockchain->tail;
-
-  calculate_block_hash(last, hash, &hash_size);
-  memcpy(new_block->prev_block_hash, hash, HASH_SIZE);
-
-  new_block->timestamp = time(NULL);
-
   unsigned char **transaction_hashes =
       (unsigned char **)malloc(sizeof(unsigned char *) * num_transactions);
   if (transaction_hashes == NULL) {
     fprintf(stderr,
             "ERROR: Failed to allocate memory for transaction hashes\n");
-    free(new_block);
     return NULL;
   }
   for (size_t i = 0; i < num_transactions; i++) {
@@ -44,25 +41,174 @@ Block *create_block(Blockchain *blockchain, char **transaction_data,
     if (transaction_hashes[i] == NULL) {
       fprintf(stderr,
               "ERROR: Failed to allocate memory for transaction hash\n");
-      for (size_t j = 0; j < i; j++) {
-        free(transaction_hashes[j]);
-      }
-      free(transaction_hashes);
-      free(new_block);
+      free_transaction_hashes(transaction_hashes, i);
       return NULL;
     }
     compute_hash((unsigned char *)transaction_data[i],
                  strlen(transaction_data[i]), transaction_hashes[i],
                  &hash_size);
   }
+  return transaction_hashes;
+}
 
-  new_block->merkletree = create_tree(transaction_hashes, num_transactions);
-
+void free_transaction_hashes(unsigned char **transaction_hashes,
+                             size_t num_transactions) {
+  if (transaction_hashes == NULL)
+    return;
   for (size_t i = 0; i < num_transactions; i++) {
     free(transaction_hashes[i]);
   }
   free(transaction_hashes);
+}
+
+static void set_merkle_root(Block *block) {
+  if (block->merkletree != NULL && block->merkletree->root != NULL) {
+    memcpy(block->merkle_root, block->merkletree->root->hash, HASH_SIZE);
+  } else {
+    memset(block->merkle_root, 0, HASH_SIZE);
+  }
+}
+
+static void free_block_transactions(Block *block) {
+  for (size_t i = 0; i < block->num_transactions; i++) {
+    free_transaction(&block->transactions[i]);
+  }
+  free(block->transactions);
+  block->transactions = NULL;
+  block->num_transactions = 0;
+}
+
+static void free_retired_tree(void *merkletree) {
+  free_tree((MerkleTree *)merkletree);
+}
+
+// Frees a tree readers may still hold once they have all moved past it.
+static void retire_tree(Blockchain *blockchain, MerkleTree *merkletree) {
+  if (blockchain->rcu != NULL) {
+    rcu_retire(blockchain->rcu, merkletree, free_retired_tree);
+  } else {
+    free_tree(merkletree);
+  }
+}
+
+static void prune_block(Blockchain *blockchain, Block *block) {
+  if (blockchain->archive != NULL) {
+    blockchain->archive(block, blockchain->archive_ctx);
+  }
+  // Unpublished before it is retired: a reclaim pass inside rcu_retire()
+  // may free it as soon as no reader is pinned to an older period.
+  MerkleTree *merkletree = atomic_exchange(&block->merkletree, NULL);
+  retire_tree(blockchain, merkletree);
+  free_block_transactions(block);
+  free_state_undo(&block->undo);
+  block->pruned = true;
+}
+
+// Walks forward from the oldest full block, so each block is pruned once
+// and the cost per append is constant.
+static void prune_blocks(Blockchain *blockchain) {
+  if (blockchain->keep_full == 0) {
+    return;
+  }
+  while ((size_t)blockchain->count - blockchain->pruned >
+         blockchain->keep_full) {
+    Block *oldest = blockchain->oldest_full != NULL ? blockchain->oldest_full
+                                                    : blockchain->head;
+    prune_block(blockchain, oldest);
+    blockchain->oldest_full = oldest->next_block;
+    blockchain->pruned++;
+  }
+}
+
+void set_pruning(Blockchain *blockchain, size_t keep_full, PruneFn archive,
+                 void *archive_ctx) {
+  blockchain->keep_full = keep_full;
+  blockchain->archive = archive;
+  blockchain->archive_ctx = archive_ctx;
+  prune_blocks(blockchain);
+}
+
+// Allocates a block known only by its parent's hash, as when it arrives
+// from elsewhere; set_block_parent() places it once the parent is known.
+Block *create_detached_block(const unsigned char *prev_block_hash,
+                             MerkleTree *merkletree) {
+  Block *new_block = (Block *)malloc(sizeof(Block));
+  if (new_block == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for new block\n");
+    return NULL;
+  }
+  new_block->version = BLOCK_VERSION;
+  memcpy(new_block->prev_block_hash, prev_block_hash, HASH_SIZE);
+  new_block->nonce = 0;
+  new_block->has_mmr_root = false;
+  new_block->mmr_peaks = NULL;
+  new_block->parent = NULL;
+  new_block->skip = NULL;
+  new_block->height = 0;
+  new_block->work = 1;
+  new_block->chain_work = new_block->work;
+  new_block->sequence = 0;
+  new_block->tip_index = SIZE_MAX;
+  new_block->timestamp = time(NULL);
+  new_block->merkletree = merkletree;
+  set_merkle_root(new_block);
+  new_block->pruned = false;
+  new_block->invalid = false;
+  new_block->sealed = false;
+  new_block->transactions = NULL;
+  new_block->num_transactions = 0;
+  memset(&new_block->undo, 0, sizeof(StateUndo));
   new_block->next_block = NULL;
+  return new_block;
+}
+
+void set_block_parent(Block *block, Block *parent) {
+  block->parent = parent;
+  block->height = parent->height + 1;
+  block->skip = get_ancestor(parent, skip_height(block->height));
+  block->chain_work = parent->chain_work + block->work;
+}
+
+// Allocates a block on top of parent without linking it into any chain.
+Block *create_child_block(Block *parent, MerkleTree *merkletree) {
+  unsigned char prev_block_hash[HASH_SIZE];
+  unsigned int hash_size;
+  calculate_block_hash(parent, prev_block_hash, &hash_size);
+  Block *new_block = create_detached_block(prev_block_hash, merkletree);
+  if (new_block != NULL) {
+    set_block_parent(new_block, parent);
+  }
+  return new_block;
+}
+
+void free_block(Block *block) {
+  free_tree(block->merkletree);
+  free_block_transactions(block);
+  free_state_undo(&block->undo);
+  free(block->mmr_peaks);
+  free(block);
+}
+
+// Links a block built on the tail into the chain, maintaining the MMR and
+// pruning. A block that already commits to an MMR root, as a received one
+// does, must commit to this chain's: rewriting it would change its hash.
+bool link_block(Blockchain *blockchain, Block *new_block) {
+  if (blockchain->mmr != NULL) {
+    MMR *mmr = blockchain->mmr;
+    unsigned char root[HASH_SIZE];
+    if (!mmr_append(mmr, new_block->prev_block_hash)) {
+      return false;
+    }
+    if (!mmr_root(mmr, mmr->num_leaves, root) ||
+        (new_block->has_mmr_root &&
+         memcmp(root, new_block->mmr_root, HASH_SIZE) != 0)) {
+      fprintf(stderr, "ERROR: Block commits to a different MMR root\n");
+      mmr_truncate(mmr, mmr->num_leaves - 1);
+      return false;
+    }
+    memcpy(new_block->mmr_root, root, HASH_SIZE);
+    new_block->has_mmr_root = true;
+  }
 
   if (blockchain->tail != NULL) {
     blockchain->tail->next_block = new_block;
@@ -71,7 +217,170 @@ Block *create_block(Blockchain *blockchain, char **transaction_data,
   }
   blockchain->tail = new_block;
   blockchain->count++;
+  new_block->sealed = true;
+  publish_tip(blockchain, new_block);
+  if (blockchain->stream != NULL) {
+    block_stream_publish(blockchain->stream, new_block, 0);
+  }
+  prune_blocks(blockchain);
+  return true;
+}
 
+Block *append_block(Blockchain *blockchain, MerkleTree *merkletree) {
+  Block *new_block = create_child_block(blockchain->tail, merkletree);
+  if (new_block == NULL) {
+    return NULL;
+  }
+  if (!link_block(blockchain, new_block)) {
+    free(new_block);
+    return NULL;
+  }
+  return new_block;
+}
+
+Block *create_block(Blockchain *blockchain, char **transaction_data,
+                    size_t num_transactions) {
+  unsigned char **transaction_hashes =
+      hash_transactions(transaction_data, num_transactions);
+  if (transaction_hashes == NULL) {
+    return NULL;
+  }
+
+  MerkleTree *merkletree = create_tree(transaction_hashes, num_transactions);
+  free_transaction_hashes(transaction_hashes, num_transactions);
+  if (merkletree == NULL) {
+    return NULL;
+  }
+
+  Block *new_block = append_block(blockchain, merkletree);
+  if (new_block == NULL) {
+    free_tree(merkletree);
+  }
+  return new_block;
+}
+
+static MerkleTree *build_transaction_tree(const Transaction *transactions,
+                                          size_t num_transactions) {
+  unsigned char *ids = (unsigned char *)malloc(HASH_SIZE * num_transactions);
+  unsigned char **leaves =
+      (unsigned char **)malloc(sizeof(unsigned char *) * num_transactions);
+  if (ids == NULL || leaves == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for transaction ids\n");
+    free(ids);
+    free(leaves);
+    return NULL;
+  }
+  for (size_t i = 0; i < num_transactions; i++) {
+    leaves[i] = ids + i * HASH_SIZE;
+    transaction_id(&transactions[i], leaves[i]);
+  }
+  MerkleTree *merkletree = create_tree(leaves, num_transactions);
+  free(leaves);
+  free(ids);
+  return merkletree;
+}
+
+static Transaction *copy_transactions(const Transaction *transactions,
+                                      size_t num_transactions) {
+  Transaction *copy =
+      (Transaction *)malloc(sizeof(Transaction) * num_transactions);
+  if (copy == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for transactions\n");
+    return NULL;
+  }
+  for (size_t i = 0; i < num_transactions; i++) {
+    if (!copy_transaction(&copy[i], &transactions[i])) {
+      for (size_t j = 0; j < i; j++) {
+        free_transaction(&copy[j]);
+      }
+      free(copy);
+      return NULL;
+    }
+  }
+  return copy;
+}
+
+// Builds an unlinked signed block on top of parent without touching any
+// state. Rejects the block if any signature fails. The leaves are the
+// transaction ids.
+Block *create_signed_child_block(Block *parent,
+                                 const Transaction *transactions,
+                                 size_t num_transactions) {
+  if (transactions == NULL || num_transactions == 0) {
+    fprintf(stderr, "Transaction data is invalid\n");
+    return NULL;
+  }
+  if (verify_transactions_batch(transactions, num_transactions, NULL) !=
+      num_transactions) {
+    fprintf(stderr, "ERROR: Block contains an invalid signature\n");
+    return NULL;
+  }
+
+  Transaction *body = copy_transactions(transactions, num_transactions);
+  MerkleTree *merkletree =
+      body != NULL ? build_transaction_tree(body, num_transactions) : NULL;
+  Block *new_block =
+      merkletree != NULL ? create_child_block(parent, merkletree) : NULL;
+  if (new_block == NULL) {
+    free_tree(merkletree);
+    if (body != NULL) {
+      for (size_t i = 0; i < num_transactions; i++) {
+        free_transaction(&body[i]);
+      }
+      free(body);
+    }
+    return NULL;
+  }
+  new_block->transactions = body;
+  new_block->num_transactions = num_transactions;
+  return new_block;
+}
+
+// Applies the block's transfers and keeps the undo records on the block
+// until it is disconnected or pruned. Blocks without transactions connect
+// trivially.
+bool connect_block_state(StateSet *state, Block *block) {
+  if (block->invalid) {
+    return false;
+  }
+  if (block->num_transactions == 0) {
+    return true;
+  }
+  if (!state_apply_transactions(state, block->transactions,
+                                block->num_transactions, &block->undo)) {
+    fprintf(stderr, "ERROR: Block contains an invalid transfer\n");
+    return false;
+  }
+  return true;
+}
+
+void disconnect_block_state(StateSet *state, Block *block) {
+  state_revert(state, &block->undo);
+  free_state_undo(&block->undo);
+}
+
+// Rejects the whole block if any signature fails or, when the chain tracks
+// state, if any transfer cannot be applied.
+Block *create_signed_block(Blockchain *blockchain,
+                           const Transaction *transactions,
+                           size_t num_transactions) {
+  Block *new_block = create_signed_child_block(blockchain->tail, transactions,
+                                               num_transactions);
+  if (new_block == NULL) {
+    return NULL;
+  }
+  if (blockchain->state != NULL &&
+      !connect_block_state(blockchain->state, new_block)) {
+    free_block(new_block);
+    return NULL;
+  }
+  if (!link_block(blockchain, new_block)) {
+    if (blockchain->state != NULL) {
+      disconnect_block_state(blockchain->state, new_block);
+    }
+    free_block(new_block);
+    return NULL;
+  }
   return new_block;
 }
 
@@ -81,79 +390,241 @@ void destroy_blockchain(Blockchain *blockchain) {
 
   while (curr != NULL) {
     next = curr->next_block;
-    free_tree(curr->merkletree);
-    free(curr);
+    free_block(curr);
     curr = next;
   }
 
   blockchain->head = NULL;
   blockchain->tail = NULL;
   blockchain->count = 0;
+  blockchain->pruned = 0;
+  blockchain->oldest_full = NULL;
+  publish_tip(blockchain, NULL);
+  free_mmr(blockchain->mmr);
+  blockchain->mmr = NULL;
 }
 
 Block *get_last_block(Blockchain *blockchain) { return blockchain->tail; }
 
+// Room for both hash lines, a 20-character timestamp and the labels.
+#define BLOCK_STRING_SIZE 384
+
+// Formats the fields print_block() shows, one per line, in a single pass.
+// out holds BLOCK_STRING_SIZE bytes.
+static size_t format_block(Block *block, char *out) {
+  char *p = out;
+  memcpy(p, "Previous Block Hash: ", 21);
+  p += 21;
+  hex_encode(block->prev_block_hash, HASH_SIZE, p);
+  p += 2 * HASH_SIZE;
+  p += snprintf(p, BLOCK_STRING_SIZE - (size_t)(p - out),
+                "\nTimestamp: %ld\n", (long)block->timestamp);
+
+  if (block->pruned ||
+      (block->merkletree != NULL && block->merkletree->root != NULL)) {
+    unsigned char root_hash[HASH_SIZE];
+    unsigned int root_hash_size;
+    compute_hash(block->merkle_root, HASH_SIZE, root_hash, &root_hash_size);
+    memcpy(p, "Merkle Tree Root Hash: ", 23);
+    p += 23;
+    hex_encode(root_hash, root_hash_size, p);
+    p += 2 * root_hash_size;
+    *p++ = '\n';
+  } else {
+    memcpy(p, "Merkle Tree: NULL\n", 18);
+    p += 18;
+  }
+  *p = '\0';
+  return (size_t)(p - out);
+}
+
 char *block_to_string(Block *block) {
-  size_t block_size = HASH_SIZE * 2 + sizeof(block->timestamp) + 100;
-  char *str_block = (char *)malloc(block_size);
+  char *str_block = (char *)malloc(BLOCK_STRING_SIZE);
   if (str_block == NULL) {
     fprintf(stderr, "ERROR: Memory allocation failed for block string\n");
     return NULL;
   }
+  format_block(block, str_block);
+  return str_block;
+}
 
-  str_block[0] = '\0';
+void print_block(Block *block) {
+  char str_block[BLOCK_STRING_SIZE];
+  format_block(block, str_block);
+  fputs(str_block, stdout);
+}
 
-  snprintf(str_block, block_size, "Previous Block Hash: ");
-  for (size_t i = 0; i < HASH_SIZE; i++) {
-    snprintf(str_block + strlen(str_block), block_size - strlen(str_block),
-             "%02x", block->prev_block_hash[i]);
+void encode_block_header(const Block *block, unsigned char *header) {
+  store_le32(header + HEADER_VERSION_OFFSET, block->version);
+  store_le32(header + HEADER_FLAGS_OFFSET,
+             block->has_mmr_root ? HEADER_HAS_MMR_ROOT : 0);
+  memcpy(header + HEADER_PREV_HASH_OFFSET, block->prev_block_hash, HASH_SIZE);
+  memcpy(header + HEADER_MERKLE_ROOT_OFFSET, block->merkle_root, HASH_SIZE);
+  if (block->has_mmr_root) {
+    memcpy(header + HEADER_MMR_ROOT_OFFSET, block->mmr_root, HASH_SIZE);
+  } else {
+    memset(header + HEADER_MMR_ROOT_OFFSET, 0, HASH_SIZE);
   }
+  store_le64(header + HEADER_TIMESTAMP_OFFSET, (uint64_t)block->timestamp);
+  store_le64(header + HEADER_NONCE_OFFSET, block->nonce);
+}
 
-  snprintf(str_block + strlen(str_block), block_size - strlen(str_block),
-           "\nTimestamp: %ld\n", block->timestamp);
+void calculate_block_hash(Block *block, unsigned char *digest_value,
+                          unsigned int *digest_length) {
+  unsigned char header[BLOCK_HEADER_SIZE];
+  encode_block_header(block, header);
+  if (!compute_hash(header, BLOCK_HEADER_SIZE, digest_value, digest_length)) {
+    fprintf(stderr, "ERROR: Failed to calculate block hash\n");
+  }
+}
 
-  if (block->merkletree != NULL && block->merkletree->root != NULL) {
-    unsigned char root_hash[HASH_SIZE];
-    unsigned int root_hash_size;
+static inline uint64_t clear_lowest_one(uint64_t n) { return n & (n - 1); }
+
+// Same scheme as Bitcoin's CBlockIndex::pskip: skips are spread so that
+// any ancestor is reachable in O(log n) hops, while odd heights jump
+// further back than a plain power-of-two ladder would.
+uint64_t skip_height(uint64_t height) {
+  if (height < 2) {
+    return 0;
+  }
+  return (height & 1) ? clear_lowest_one(clear_lowest_one(height - 1)) + 1
+                      : clear_lowest_one(height);
+}
+
+Block *get_ancestor(Block *block, uint64_t height) {
+  if (block == NULL || height > block->height) {
+    return NULL;
+  }
 
-    compute_hash(block->merkletree->root->hash, HASH_SIZE, root_hash,
-                 &root_hash_size);
-    snprintf(str_block + strlen(str_block), block_size - strlen(str_block),
-             "Merkle Tree Root Hash: ");
-    for (size_t i = 0; i < root_hash_size; i++) {
-      snprintf(str_block + strlen(str_block), block_size - strlen(str_block),
-               "%02x", root_hash[i]);
+  Block *walk = block;
+  while (walk->height > height) {
+    uint64_t skip = skip_height(walk->height);
+    uint64_t skip_prev = skip_height(walk->height - 1);
+    // Take the skip unless it overshoots, or unless the parent's skip gets
+    // at least as close for one extra hop.
+    if (walk->skip != NULL &&
+        (skip == height ||
+         (skip > height && !(skip_prev + 2 < skip && skip_prev >= height)))) {
+      walk = walk->skip;
+    } else {
+      walk = walk->parent;
     }
-  } else {
-    snprintf(str_block + strlen(str_block), block_size - strlen(str_block),
-             "Merkle Tree: NULL\n");
   }
+  return walk;
+}
 
-  return str_block;
+// Lowest common ancestor of two blocks in the same tree, or NULL if they
+// share none.
+Block *find_fork_point(Block *a, Block *b) {
+  if (a == NULL || b == NULL) {
+    return NULL;
+  }
+  if (a->height > b->height) {
+    a = get_ancestor(a, b->height);
+  } else if (b->height > a->height) {
+    b = get_ancestor(b, a->height);
+  }
+
+  // Equal heights give equal skip heights, so both sides can jump together
+  // whenever the skips still differ.
+  while (a != b && a != NULL && b != NULL) {
+    if (a->skip != NULL && b->skip != NULL && a->skip != b->skip) {
+      a = a->skip;
+      b = b->skip;
+    } else {
+      a = a->parent;
+      b = b->parent;
+    }
+  }
+  return a == b ? a : NULL;
 }
 
-void calculate_block_hash(Block *block, unsigned char *digest_value,
-                          unsigned int *digest_length) {
-  unsigned char merkle_root[HASH_SIZE];
-  compute_hash(block->merkletree->root->hash, HASH_SIZE, merkle_root,
-               digest_length);
+Block *get_block_at_height(Blockchain *blockchain, uint64_t height) {
+  return get_ancestor(blockchain->tail, height);
+}
 
-  size_t block_size = HASH_SIZE + HASH_SIZE;
+void set_chain_rcu(Blockchain *blockchain, RcuDomain *rcu) {
+  blockchain->rcu = rcu;
+}
 
-  unsigned char *block_data = (unsigned char *)malloc(block_size);
-  if (block_data == NULL) {
-    fprintf(stderr, "ERROR: Memory allocation failed for block data\n");
-    return;
+void publish_tip(Blockchain *blockchain, Block *tip) {
+  atomic_store_explicit(&blockchain->published_tip, tip,
+                        memory_order_release);
+}
+
+Block *get_published_tip(Blockchain *blockchain) {
+  return atomic_load_explicit(&blockchain->published_tip,
+                              memory_order_acquire);
+}
+
+Block *get_published_block_at_height(Blockchain *blockchain,
+                                     uint64_t height) {
+  return get_ancestor(get_published_tip(blockchain), height);
+}
+
+void set_block_stream(Blockchain *blockchain, BlockStream *stream) {
+  blockchain->stream = stream;
+}
+
+bool enable_mmr(Blockchain *blockchain) {
+  if (blockchain->mmr != NULL) {
+    return true;
+  }
+  MMR *mmr = create_mmr();
+  if (mmr == NULL) {
+    return false;
   }
+  // The tail is added when its successor is appended.
+  for (Block *curr = blockchain->head; curr != NULL && curr != blockchain->tail;
+       curr = curr->next_block) {
+    unsigned char hash[HASH_SIZE];
+    unsigned int hash_size;
+    calculate_block_hash(curr, hash, &hash_size);
+    if (!mmr_append(mmr, hash)) {
+      free_mmr(mmr);
+      return false;
+    }
+  }
+  blockchain->mmr = mmr;
+  return true;
+}
 
-  memcpy(block_data, block->prev_block_hash, HASH_SIZE);
-  memcpy(block_data + HASH_SIZE, merkle_root, HASH_SIZE);
+bool prove_ancestor(Blockchain *blockchain, uint64_t height,
+                    MMRProof *proof) {
+  if (blockchain->mmr == NULL || blockchain->tail == NULL ||
+      !blockchain->tail->has_mmr_root) {
+    return false;
+  }
+  // The tail's root covers every block before it.
+  return mmr_prove(blockchain->mmr, height, (uint64_t)blockchain->count - 1,
+                   proof);
+}
 
-  if (!compute_hash(block_data, block_size, digest_value, digest_length)) {
-    fprintf(stderr, "ERROR: Failed to calculate block hash\n");
+// A signed block is valid only if every signature checks out and the
+// transactions hash to the Merkle root the header commits to.
+// Pruned blocks were checked when connected and are trusted through their
+// cached root.
+static bool validate_block_body(Block *block) {
+  if (block->pruned || block->transactions == NULL) {
+    return true;
+  }
+  size_t verified =
+      verify_pool != NULL
+          ? verify_pool_run(verify_pool, block->transactions,
+                            block->num_transactions)
+          : verify_transactions_batch(block->transactions,
+                                      block->num_transactions, NULL);
+  if (verified != block->num_transactions) {
+    return false;
   }
 
-  free(block_data);
+  MerkleTree *expected =
+      build_transaction_tree(block->transactions, block->num_transactions);
+  bool matches = expected != NULL && expected->root != NULL &&
+                 memcmp(expected->root->hash, block->merkle_root, HASH_SIZE) ==
+                     0;
+  free_tree(expected);
+  return matches;
 }
 
 bool validate_block(Block *block, Block *prev_block) {
@@ -168,7 +639,44 @@ bool validate_block(Block *block, Block *prev_block) {
   calculate_block_hash(prev_block, prev_block_digest,
                        &prev_block_digest_length);
 
-  return memcmp(block->prev_block_hash, prev_block_digest, HASH_SIZE) == 0;
+  if (memcmp(block->prev_block_hash, prev_block_digest, HASH_SIZE) != 0) {
+    return false;
+  }
+
+  return validate_block_body(block);
+}
+
+// Blocks that carry an MMR root are checked against an MMR rebuilt from
+// the chain itself, started the first time such a block is seen. From then
+// on every block must carry one: enable_mmr() never switches off.
+static bool validate_mmr_root(Blockchain *blockchain, Block *block,
+                              uint64_t height, MMR **mmr) {
+  if (*mmr == NULL) {
+    if (!block->has_mmr_root) {
+      return true;
+    }
+    *mmr = create_mmr();
+    if (*mmr == NULL) {
+      return false;
+    }
+    for (Block *curr = blockchain->head; curr != block;
+         curr = curr->next_block) {
+      unsigned char hash[HASH_SIZE];
+      unsigned int hash_size;
+      calculate_block_hash(curr, hash, &hash_size);
+      mmr_append(*mmr, hash);
+    }
+  }
+
+  unsigned char root[HASH_SIZE];
+  if (!block->has_mmr_root || !mmr_root(*mmr, height, root) ||
+      memcmp(root, block->mmr_root, HASH_SIZE) != 0) {
+    return false;
+  }
+  unsigned char hash[HASH_SIZE];
+  unsigned int hash_size;
+  calculate_block_hash(block, hash, &hash_size);
+  return mmr_append(*mmr, hash);
 }
 
 bool validate_blockchain(Blockchain *blockchain) {
@@ -177,14 +685,23 @@ bool validate_blockchain(Blockchain *blockchain) {
 
   bool valid = true;
   Block *curr = blockchain->head;
+  MMR *mmr = NULL;
+  uint64_t height = 0;
 
   while (curr != NULL && curr->next_block != NULL) {
-    if (!validate_block(curr->next_block, curr)) {
+    if (!validate_block(curr->next_block, curr) ||
+        !validate_mmr_root(blockchain, curr, height, &mmr)) {
       valid = false;
       break;
     }
     curr = curr->next_block;
+    height++;
+  }
+  if (valid && curr != NULL && mmr != NULL &&
+      !validate_mmr_root(blockchain, curr, height, &mmr)) {
+    valid = false;
   }
+  free_mmr(mmr);
   return valid;
 }
 
@@ -204,6 +721,24 @@ void create_blockchain(Blockchain *blockchain) {
 
   unsigned char *transaction_hashes[] = {hash};
   genesis->merkletree = create_tree(transaction_hashes, 1);
+  set_merkle_root(genesis);
+  genesis->version = BLOCK_VERSION;
+  genesis->nonce = 0;
+  genesis->pruned = false;
+  genesis->invalid = false;
+  genesis->sealed = true;
+  genesis->has_mmr_root = false;
+  genesis->mmr_peaks = NULL;
+  genesis->parent = NULL;
+  genesis->skip = NULL;
+  genesis->height = 0;
+  genesis->work = 1;
+  genesis->chain_work = 1;
+  genesis->sequence = 0;
+  genesis->tip_index = SIZE_MAX;
+  genesis->transactions = NULL;
+  genesis->num_transactions = 0;
+  memset(&genesis->undo, 0, sizeof(StateUndo));
   genesis->timestamp = time(0);
   memset(genesis->prev_block_hash, 0, HASH_SIZE);
   genesis->next_block = NULL;
@@ -211,6 +746,12 @@ void create_blockchain(Blockchain *blockchain) {
   blockchain->head = genesis;
   blockchain->tail = genesis;
   blockchain->count = 1;
+  blockchain->pruned = 0;
+  blockchain->oldest_full = NULL;
+  blockchain->mmr = NULL;
+  blockchain->rcu = NULL;
+  blockchain->stream = NULL;
+  publish_tip(blockchain, genesis);
 }
 
 void print_blockchain(Blockchain *blockchain) {
@@ -226,41 +767,56 @@ void print_blockchain(Blockchain *blockchain) {
   size_t i = 0;
   while (current_block != NULL) {
     printf("Block %zu\n", i);
-    printf("Previous Block Hash: ");
-
-    for (size_t j = 0; j < HASH_SIZE; j++) {
-      printf("%02x", current_block->prev_block_hash[j]);
-    }
-    printf("\n");
-
-    printf("Timestamp: %ld\n", current_block->timestamp);
-
-    unsigned char root_hash[HASH_SIZE];
-    unsigned int root_hash_size;
-    if (current_block->merkletree != NULL) {
-      compute_hash(current_block->merkletree->root->hash, HASH_SIZE, root_hash,
-                   &root_hash_size);
-      printf("Merkle Tree Root Hash: ");
-      for (size_t k = 0; k < root_hash_size; k++) {
-        printf("%02x", root_hash[k]);
-      }
-      printf("\n");
-    } else {
-      printf("Merkle Tree: NULL\n");
-    }
-
+    print_block(current_block);
+    putchar('\n');
     current_block = current_block->next_block;
-    printf("\n");
     i++;
   }
   printf("===================================================\n");
 }
 
-bool add_transaction(Block *block, const char *transaction) {
-  if (block == NULL || transaction == NULL) {
+// Appends a signed transaction to a block that has not been built on yet.
+// Unsigned or forged transactions are rejected.
+bool add_transaction(Block *block, const Transaction *transaction) {
+  if (block == NULL || transaction == NULL || transaction->payload == NULL) {
     fprintf(stderr, "Transaction data is invalid\n");
     return false;
   }
+  if (block->sealed || block->pruned) {
+    fprintf(stderr, "ERROR: Cannot add a transaction to a sealed block\n");
+    return false;
+  }
+  if (block->merkletree != NULL && block->transactions == NULL) {
+    fprintf(stderr,
+            "ERROR: Cannot add a signed transaction to an unsigned block\n");
+    return false;
+  }
+  if (!verify_transaction(transaction)) {
+    fprintf(stderr, "ERROR: Transaction signature is invalid\n");
+    return false;
+  }
 
+  Transaction *grown = (Transaction *)realloc(
+      block->transactions,
+      sizeof(Transaction) * (block->num_transactions + 1));
+  if (grown == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for transaction\n");
+    return false;
+  }
+  block->transactions = grown;
+  if (!copy_transaction(&grown[block->num_transactions], transaction)) {
+    return false;
+  }
+
+  MerkleTree *merkletree =
+      build_transaction_tree(grown, block->num_transactions + 1);
+  if (merkletree == NULL) {
+    free_transaction(&grown[block->num_transactions]);
+    return false;
+  }
+  free_tree(block->merkletree);
+  block->merkletree = merkletree;
+  set_merkle_root(block);
+  block->num_transactions++;
   return true;
 }
@@ -1,7 +1,14 @@
 #ifndef BLOCK_CHAIN_H
 #define BLOCK_CHAIN_H
 
+#include "block_header.h"
+#include "block_stream.h"
 #include "merkletree.h"
+#include "mmr.h"
+#include "rcu.h"
+#include "state.h"
+#include "transaction.h"
+#include "verify_pool.h"
 #include <stdbool.h>
 #include <time.h>
 
@@ -9,15 +16,53 @@ typedef struct Block Block;
 
 struct Block {
   Block *next_block;
+  Block *parent;
+  Block *skip; // ancestor at skip_height(height), for O(log n) lookups
+  uint64_t height;
+  uint64_t work;       // this block's contribution to fork choice
+  uint64_t chain_work; // sum of work from genesis up to this block
+  uint64_t sequence;   // arrival order, breaks chain_work ties
+  size_t tip_index;    // slot in a BlockTree's tip heap, SIZE_MAX if none
+                       // and SIZE_MAX - 1 while the tree holds it aside
+  uint32_t version;
   unsigned char prev_block_hash[HASH_SIZE];
   time_t timestamp;
-  MerkleTree *merkletree;
+  uint64_t nonce;
+  MerkleTree *_Atomic merkletree; // NULL once pruned
+  unsigned char merkle_root[HASH_SIZE]; // kept after pruning
+  bool pruned;
+  bool invalid; // failed to connect; never becomes part of the best chain
+  bool sealed;  // linked into a chain or tree, so its header is final
+  // Root of the MMR over every earlier block's hash; part of the block hash
+  // when present.
+  unsigned char mmr_root[HASH_SIZE];
+  bool has_mmr_root;
+  // Peaks of that MMR, kept for blocks placed off the best chain so a child
+  // on the same branch extends them with one append.
+  MMRPeaks *mmr_peaks;
+  Transaction *transactions; // NULL for blocks built from raw strings
+  size_t num_transactions;
+  StateUndo undo; // set while connected to the state, to roll it back
 };
 
+// Called with a block about to be pruned, while its tree and transactions
+// are still attached, so they can be archived.
+typedef void (*PruneFn)(Block *block, void *ctx);
+
 typedef struct {
   Block *head;
   Block *tail;
   int count;
+  StateSet *state; // optional; signed blocks are applied to it as appended
+  size_t keep_full; // 0 keeps every block in full
+  size_t pruned;
+  Block *oldest_full;
+  PruneFn archive;
+  void *archive_ctx;
+  MMR *mmr; // hashes of every block but the tail, after enable_mmr()
+  RcuDomain *rcu; // concurrent readers, after set_chain_rcu()
+  Block *_Atomic published_tip; // the tail, once fully linked
+  BlockStream *stream; // new tips are pushed here, after set_block_stream()
 } Blockchain;
 
 // -----------------------------------------------------------
@@ -27,16 +72,98 @@ void create_blockchain(Blockchain *blockchain);
 Block *create_block(Blockchain *blockchain, char **transaction_data,
                     size_t num_transactions);
 Block *get_last_block(Blockchain *blockchain);
+// Keeps the newest keep_full blocks intact; older ones keep only their
+// header and Merkle root. With a pipeline attached, keep_full must exceed
+// the number of blocks in flight behind the seal stage.
+void set_pruning(Blockchain *blockchain, size_t keep_full, PruneFn archive,
+                 void *archive_ctx);
 char *block_to_string(Block *block);
 void destroy_blockchain(Blockchain *blockchain);
+// The block hash is the SHA3-512 of the canonical header (block_header.h).
+void encode_block_header(const Block *block, unsigned char *header);
 void calculate_block_hash(Block *block, unsigned char *digest_value,
                           unsigned int *digest_length);
 
+// -----------------------------------------------------------
+// Block production stages (create_block runs them back to back)
+// -----------------------------------------------------------
+unsigned char **hash_transactions(char **transaction_data,
+                                  size_t num_transactions);
+void free_transaction_hashes(unsigned char **transaction_hashes,
+                             size_t num_transactions);
+Block *create_detached_block(const unsigned char *prev_block_hash,
+                             MerkleTree *merkletree);
+void set_block_parent(Block *block, Block *parent);
+Block *create_child_block(Block *parent, MerkleTree *merkletree);
+bool link_block(Blockchain *blockchain, Block *new_block);
+Block *append_block(Blockchain *blockchain, MerkleTree *merkletree);
+void free_block(Block *block);
+Block *create_signed_child_block(Block *parent,
+                                 const Transaction *transactions,
+                                 size_t num_transactions);
+Block *create_signed_block(Blockchain *blockchain,
+                           const Transaction *transactions,
+                           size_t num_transactions);
+
+// -----------------------------------------------------------
+// State connection
+// -----------------------------------------------------------
+// Connecting applies a block's transfers and records its undo data;
+// disconnecting restores the accounts it touched and drops that data.
+// Blocks must be disconnected newest first.
+bool connect_block_state(StateSet *state, Block *block);
+void disconnect_block_state(StateSet *state, Block *block);
+
+// -----------------------------------------------------------
+// Ancestor lookup
+// -----------------------------------------------------------
+uint64_t skip_height(uint64_t height);
+Block *get_ancestor(Block *block, uint64_t height);
+Block *find_fork_point(Block *a, Block *b);
+Block *get_block_at_height(Blockchain *blockchain, uint64_t height);
+
+// -----------------------------------------------------------
+// Concurrent readers
+// -----------------------------------------------------------
+// One thread appends; any number of others read without locks. The writer
+// publishes each new tail with a release store once it is fully linked, so
+// a reader that loads the tip in an rcu_read_lock() section may follow
+// parent and skip links and read any header field. Of the body, only the
+// Merkle tree may be read, and it is NULL once pruned: with an RCU domain
+// set, pruning unpublishes a tree and retires it to the domain, which frees
+// it once every reader has moved past, without the writer waiting. head,
+// tail, count, next_block and the transactions are writer-only. Nothing
+// else in a linked block changes; add_transaction() refuses them.
+// The domain must outlive the chain; trees still retired to it are freed
+// by destroy_rcu_domain() at the latest.
+void set_chain_rcu(Blockchain *blockchain, RcuDomain *rcu);
+void publish_tip(Blockchain *blockchain, Block *tip);
+Block *get_published_tip(Blockchain *blockchain);
+Block *get_published_block_at_height(Blockchain *blockchain,
+                                     uint64_t height);
+// Pushes every block linked from now on, and every tip a reorganization
+// switches to, into stream (block_stream.h), from the appending thread.
+void set_block_stream(Blockchain *blockchain, BlockStream *stream);
+
+// -----------------------------------------------------------
+// Chain history proofs
+// -----------------------------------------------------------
+// Backfills the MMR with the existing blocks; every block appended after
+// this commits to the MMR root of its ancestors.
+bool enable_mmr(Blockchain *blockchain);
+// Proves that the block at height is an ancestor of the tail, against the
+// tail's mmr_root. Verify with mmr_verify(tail->mmr_root, block_hash, proof).
+bool prove_ancestor(Blockchain *blockchain, uint64_t height,
+                    MMRProof *proof);
+
 // -----------------------------------------------------------
 // Blockchain validation
 // -----------------------------------------------------------
 bool validate_block(Block *block, Block *prev_block);
 bool validate_blockchain(Blockchain *blockchain);
+// Fans signature checks in validate_block() out to the pool; NULL (the
+// default) verifies on the calling thread.
+void set_verify_pool(VerifyPool *pool);
 
 // -----------------------------------------------------------
 // Blockchain printing
@@ -47,6 +174,11 @@ void print_blockchain(Blockchain *blockchain);
 // -----------------------------------------------------------
 // Blockchain interaction
 // -----------------------------------------------------------
-bool add_transaction(Block *block, const char *transaction);
+// The block's Merkle tree is rebuilt, but the transaction is not applied to
+// the chain state; use create_signed_block() for state-changing blocks.
+// Only for a block still being built: once linked, its hash is committed to
+// by its successors and the MMR and has been published to readers and
+// streams, so sealed blocks, the tip included, are rejected.
+bool add_transaction(Block *block, const Transaction *transaction);
 
 #endif // BLOCK_CHAIN_H
@@ -0,0 +1,67 @@
+#ifndef BYTEORDER_H
+#define BYTEORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Little-endian load/store for on-disk and on-wire formats.
+
+static inline void store_le32(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+  p[2] = (unsigned char)(v >> 16);
+  p[3] = (unsigned char)(v >> 24);
+}
+
+static inline void store_le64(unsigned char *p, uint64_t v) {
+  store_le32(p, (uint32_t)v);
+  store_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint32_t load_le32(const unsigned char *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t load_le64(const unsigned char *p) {
+  return (uint64_t)load_le32(p) | (uint64_t)load_le32(p + 4) << 32;
+}
+
+// LEB128 varints: 7 bits per byte, low group first, high bit set on every
+// byte but the last. At most 10 bytes for a uint64_t.
+#define MAX_VARINT_SIZE 10
+
+static inline size_t store_varint(unsigned char *p, uint64_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (unsigned char)v;
+  return n;
+}
+
+// Returns the bytes consumed, or 0 if the varint is truncated or too long.
+static inline size_t load_varint(const unsigned char *p,
+                                 const unsigned char *end, uint64_t *v) {
+  uint64_t result = 0;
+  for (size_t n = 0; n < MAX_VARINT_SIZE && p + n < end; n++) {
+    result |= (uint64_t)(p[n] & 0x7f) << (7 * n);
+    if ((p[n] & 0x80) == 0) {
+      *v = result;
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+// Maps signed deltas to unsigned so small negative values stay short.
+static inline uint64_t zigzag_encode(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+#endif // BYTEORDER_H
@@ -0,0 +1,304 @@
+#define _GNU_SOURCE // memfd_create
+#include "chain_view.h"
+#include "blockchain.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define VIEW_ALIGN 64
+
+_Static_assert(CHAIN_VIEW_HASH_SIZE == HASH_SIZE,
+               "chain view hashes must match the node's");
+_Static_assert(CHAIN_VIEW_HEADER_SIZE == BLOCK_HEADER_SIZE,
+               "chain view headers must match the node's");
+
+static size_t align_up(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// -----------------------------------------------------------
+// Seqlock writes
+// -----------------------------------------------------------
+// The odd sequence is ordered before the data by the release fence, and the
+// data before the even sequence by the release store.
+
+static void write_begin(atomic_uint_fast64_t *sequence) {
+  uint64_t value = atomic_load_explicit(sequence, memory_order_relaxed);
+  atomic_store_explicit(sequence, value + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+}
+
+static void write_end(atomic_uint_fast64_t *sequence) {
+  uint64_t value = atomic_load_explicit(sequence, memory_order_relaxed);
+  atomic_store_explicit(sequence, value + 1, memory_order_release);
+}
+
+// -----------------------------------------------------------
+// Hash index
+// -----------------------------------------------------------
+
+static uint64_t index_home(const ChainViewRegion *region,
+                           const unsigned char *hash) {
+  uint64_t key;
+  memcpy(&key, hash, sizeof(key));
+  return key & (region->index_slots - 1);
+}
+
+static ChainViewEntry *entry_for(ChainViewPublisher *publisher,
+                                 uint64_t height) {
+  return &publisher->entries[height & (publisher->region->capacity - 1)];
+}
+
+static void index_insert(ChainViewPublisher *publisher, uint64_t height,
+                         const unsigned char *hash) {
+  uint64_t mask = publisher->region->index_slots - 1;
+  uint64_t slot = index_home(publisher->region, hash);
+  while (atomic_load_explicit(&publisher->index[slot],
+                              memory_order_relaxed) != 0) {
+    slot = (slot + 1) & mask;
+  }
+  atomic_store_explicit(&publisher->index[slot], height + 1,
+                        memory_order_relaxed);
+}
+
+// Linear probing with backward-shift deletion, so lookups never meet
+// tombstones however long the node runs.
+static void index_remove(ChainViewPublisher *publisher, uint64_t height,
+                         const unsigned char *hash) {
+  uint64_t mask = publisher->region->index_slots - 1;
+  uint64_t hole = index_home(publisher->region, hash);
+  uint64_t value;
+  while ((value = atomic_load_explicit(&publisher->index[hole],
+                                       memory_order_relaxed)) != height + 1) {
+    if (value == 0) {
+      return;
+    }
+    hole = (hole + 1) & mask;
+  }
+
+  uint64_t next = hole;
+  for (;;) {
+    next = (next + 1) & mask;
+    value = atomic_load_explicit(&publisher->index[next], memory_order_relaxed);
+    if (value == 0) {
+      break;
+    }
+    uint64_t home =
+        index_home(publisher->region, entry_for(publisher, value - 1)->hash);
+    // Move the entry back unless its home lies cyclically in (hole, next].
+    bool stays = hole <= next ? (home > hole && home <= next)
+                              : (home > hole || home <= next);
+    if (!stays) {
+      atomic_store_explicit(&publisher->index[hole], value,
+                            memory_order_relaxed);
+      hole = next;
+    }
+  }
+  atomic_store_explicit(&publisher->index[hole], 0, memory_order_relaxed);
+}
+
+// -----------------------------------------------------------
+// Chain View Implementation
+// -----------------------------------------------------------
+
+static void clear_entry(ChainViewPublisher *publisher, ChainViewEntry *entry) {
+  if (entry->height == INVALID_VIEW_HEIGHT) {
+    return;
+  }
+  index_remove(publisher, entry->height, entry->hash);
+  write_begin(&entry->sequence);
+  entry->height = INVALID_VIEW_HEIGHT;
+  write_end(&entry->sequence);
+}
+
+static void write_entry(ChainViewPublisher *publisher, const Block *block,
+                        const unsigned char *hash) {
+  ChainViewEntry *entry = entry_for(publisher, block->height);
+  clear_entry(publisher, entry);
+  write_begin(&entry->sequence);
+  entry->height = block->height;
+  entry->chain_work = block->chain_work;
+  memcpy(entry->hash, hash, HASH_SIZE);
+  encode_block_header(block, entry->header);
+  write_end(&entry->sequence);
+  index_insert(publisher, block->height, hash);
+  if (block->height < publisher->lowest_height) {
+    publisher->lowest_height = block->height;
+  }
+  publisher->published++;
+}
+
+ChainViewPublisher *create_chain_view(const char *name, size_t capacity) {
+  if (capacity == 0) {
+    capacity = DEFAULT_CHAIN_VIEW_CAPACITY;
+  }
+  size_t rounded = 1;
+  while (rounded < capacity) {
+    rounded <<= 1;
+  }
+  capacity = rounded;
+
+  ChainViewPublisher *publisher =
+      (ChainViewPublisher *)calloc(1, sizeof(ChainViewPublisher));
+  if (publisher == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for chain view\n");
+    return NULL;
+  }
+  publisher->fd = -1;
+  publisher->lowest_height = INVALID_VIEW_HEIGHT;
+
+  size_t entries_offset = align_up(sizeof(ChainViewRegion), VIEW_ALIGN);
+  size_t index_offset = align_up(
+      entries_offset + capacity * sizeof(ChainViewEntry), VIEW_ALIGN);
+  size_t index_slots = 2 * capacity;
+  publisher->size = align_up(
+      index_offset + index_slots * sizeof(atomic_uint_fast64_t),
+      (size_t)sysconf(_SC_PAGESIZE));
+
+  if (name != NULL) {
+    publisher->name = strdup(name);
+    shm_unlink(name);
+    publisher->fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                             0644);
+  } else {
+    publisher->fd = memfd_create("cblockchain-view", MFD_CLOEXEC);
+  }
+  if (publisher->fd < 0 ||
+      ftruncate(publisher->fd, (off_t)publisher->size) < 0) {
+    perror("ERROR: Failed to create chain view region");
+    destroy_chain_view(publisher);
+    return NULL;
+  }
+  void *mapping = mmap(NULL, publisher->size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, publisher->fd, 0);
+  if (mapping == MAP_FAILED) {
+    perror("ERROR: Failed to map chain view region");
+    destroy_chain_view(publisher);
+    return NULL;
+  }
+
+  // ftruncate zero-filled the region: every index slot is empty and every
+  // sequence even.
+  ChainViewRegion *region = (ChainViewRegion *)mapping;
+  region->version = CHAIN_VIEW_VERSION;
+  region->entry_size = sizeof(ChainViewEntry);
+  region->capacity = capacity;
+  region->index_slots = index_slots;
+  region->entries_offset = entries_offset;
+  region->index_offset = index_offset;
+  region->size = publisher->size;
+  region->has_tip = false;
+  publisher->region = region;
+  publisher->entries = (ChainViewEntry *)((char *)mapping + entries_offset);
+  publisher->index = (atomic_uint_fast64_t *)((char *)mapping + index_offset);
+  for (size_t i = 0; i < capacity; i++) {
+    publisher->entries[i].height = INVALID_VIEW_HEIGHT;
+  }
+  // Clients check the magic first, so it goes in last.
+  atomic_thread_fence(memory_order_release);
+  memcpy(region->magic, CHAIN_VIEW_MAGIC, sizeof(region->magic));
+  return publisher;
+}
+
+void destroy_chain_view(ChainViewPublisher *publisher) {
+  if (publisher == NULL)
+    return;
+  if (publisher->region != NULL) {
+    munmap(publisher->region, publisher->size);
+  }
+  if (publisher->fd >= 0) {
+    close(publisher->fd);
+    if (publisher->name != NULL) {
+      shm_unlink(publisher->name);
+    }
+  }
+  free(publisher->name);
+  free(publisher);
+}
+
+// A block to write and its hash, pointing into its child's prev_block_hash.
+typedef struct {
+  const Block *block;
+  const unsigned char *hash;
+} ViewPathEntry;
+
+bool chain_view_publish(ChainViewPublisher *publisher, const Block *tip) {
+  ChainViewRegion *region = publisher->region;
+  if (tip == NULL) {
+    return false;
+  }
+
+  // Newest first: the tip, then each ancestor not yet in the view, whose
+  // hash its child already carries. Stopping at the first one present is
+  // only safe while the tip moves up: blocks above a lower tip shared ring
+  // slots with older heights, which must be rewritten too.
+  bool lower = region->has_tip && tip->height < region->tip.height;
+  size_t limit = (size_t)(tip->height < region->capacity ? tip->height + 1
+                                                          : region->capacity);
+  ViewPathEntry *path = (ViewPathEntry *)malloc(sizeof(ViewPathEntry) * limit);
+  if (path == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for chain view path\n");
+    return false;
+  }
+  unsigned char tip_hash[HASH_SIZE];
+  unsigned int hash_size;
+  calculate_block_hash((Block *)tip, tip_hash, &hash_size);
+
+  size_t length = 0;
+  size_t walked = 0;
+  const unsigned char *hash = tip_hash;
+  for (const Block *block = tip; block != NULL; block = block->parent) {
+    const ChainViewEntry *entry = entry_for(publisher, block->height);
+    bool present = entry->height == block->height &&
+                   memcmp(entry->hash, hash, HASH_SIZE) == 0;
+    if (present && !lower) {
+      break;
+    }
+    if (!present) {
+      path[length].block = block;
+      path[length++].hash = hash;
+    }
+    hash = block->prev_block_hash;
+    if (++walked == limit) {
+      break;
+    }
+  }
+
+  write_begin(&region->sequence);
+  // A reorganization onto a shorter branch leaves stale blocks above it.
+  if (region->has_tip) {
+    for (uint64_t height = region->tip.height;
+         height > tip->height && region->tip.height - height <
+                                     region->capacity;
+         height--) {
+      ChainViewEntry *entry = entry_for(publisher, height);
+      if (entry->height == height) {
+        clear_entry(publisher, entry);
+      }
+    }
+  }
+  for (size_t i = length; i-- > 0;) {
+    write_entry(publisher, path[i].block, path[i].hash);
+  }
+  region->tip.height = tip->height;
+  region->tip.chain_work = tip->chain_work;
+  memcpy(region->tip.hash, tip_hash, HASH_SIZE);
+  uint64_t ring_start =
+      tip->height + 1 > region->capacity ? tip->height + 1 - region->capacity
+                                         : 0;
+  region->tip.oldest_height = publisher->lowest_height > ring_start
+                                  ? publisher->lowest_height
+                                  : ring_start;
+  region->has_tip = true;
+  write_end(&region->sequence);
+
+  free(path);
+  return true;
+}
+
+void chain_view_persist(Block *block, void *publisher) {
+  chain_view_publish((ChainViewPublisher *)publisher, block);
+}
@@ -0,0 +1,43 @@
+#ifndef CHAIN_VIEW_H
+#define CHAIN_VIEW_H
+
+#include "chain_view_client.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEFAULT_CHAIN_VIEW_CAPACITY 65536
+
+typedef struct Block Block;
+
+// Node side: owns the region and is its only writer.
+typedef struct {
+  ChainViewRegion *region;
+  ChainViewEntry *entries;
+  atomic_uint_fast64_t *index;
+  size_t size;
+  int fd;
+  char *name; // shm_open name, unlinked on destroy; NULL for a memfd
+  uint64_t lowest_height; // lowest height ever published
+  uint64_t published;     // entries written
+} ChainViewPublisher;
+
+// -----------------------------------------------------------
+// Chain view publishing
+// -----------------------------------------------------------
+// Creates the region with shm_open(name), replacing any old one, or as an
+// anonymous memfd when name is NULL, to be handed over by fd. capacity 0
+// takes the default and is rounded up to a power of two.
+ChainViewPublisher *create_chain_view(const char *name, size_t capacity);
+void destroy_chain_view(ChainViewPublisher *publisher);
+// Makes tip the view's tip. Ancestors missing from the view are written
+// too, walking parent links back to the first one already present (or
+// through the whole ring when the tip moves down), so this both extends the
+// view and follows reorganizations. One block is hashed per call; the rest
+// of the hashes come from prev_block_hash.
+bool chain_view_publish(ChainViewPublisher *publisher, const Block *tip);
+// PersistFn for a pipeline whose persist_ctx is the publisher.
+void chain_view_persist(Block *block, void *publisher);
+
+#endif // CHAIN_VIEW_H
@@ -0,0 +1,182 @@
+#include "chain_view_client.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Readers of a node's chain view. This file and chain_view_client.h use
+// nothing from the node, so monitoring tools can build against them alone
+// (make libchainview.a).
+
+// -----------------------------------------------------------
+// Seqlock reads
+// -----------------------------------------------------------
+
+static uint64_t read_begin(const atomic_uint_fast64_t *sequence) {
+  uint64_t value;
+  while ((value = atomic_load_explicit(sequence, memory_order_acquire)) & 1) {
+    sched_yield();
+  }
+  return value;
+}
+
+// True if the writer got in since read_begin() returned sequence.
+static bool read_retry(const atomic_uint_fast64_t *sequence,
+                       uint64_t value) {
+  atomic_thread_fence(memory_order_acquire);
+  return atomic_load_explicit(sequence, memory_order_relaxed) != value;
+}
+
+// -----------------------------------------------------------
+// Chain View Client Implementation
+// -----------------------------------------------------------
+
+ChainView *chain_view_open(const char *name) {
+  int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("ERROR: Failed to open chain view");
+    return NULL;
+  }
+  ChainView *view = chain_view_open_fd(fd);
+  close(fd);
+  return view;
+}
+
+// Maps read-only and checks the layout before trusting any offset in it.
+ChainView *chain_view_open_fd(int fd) {
+  struct stat info;
+  if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(ChainViewRegion)) {
+    fprintf(stderr, "ERROR: Chain view region is missing or truncated\n");
+    return NULL;
+  }
+  size_t size = (size_t)info.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    perror("ERROR: Failed to map chain view");
+    return NULL;
+  }
+
+  const ChainViewRegion *region = (const ChainViewRegion *)mapping;
+  uint64_t capacity = region->capacity;
+  uint64_t index_slots = region->index_slots;
+  if (memcmp(region->magic, CHAIN_VIEW_MAGIC, sizeof(region->magic)) != 0 ||
+      region->version != CHAIN_VIEW_VERSION ||
+      region->entry_size != sizeof(ChainViewEntry) || region->size > size ||
+      capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+      index_slots != 2 * capacity ||
+      region->entries_offset + capacity * sizeof(ChainViewEntry) >
+          region->index_offset ||
+      region->index_offset + index_slots * sizeof(atomic_uint_fast64_t) >
+          region->size) {
+    fprintf(stderr, "ERROR: Chain view region has an unknown layout\n");
+    munmap(mapping, size);
+    return NULL;
+  }
+
+  ChainView *view = (ChainView *)malloc(sizeof(ChainView));
+  if (view == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for chain view\n");
+    munmap(mapping, size);
+    return NULL;
+  }
+  view->region = region;
+  view->entries =
+      (const ChainViewEntry *)((const char *)mapping + region->entries_offset);
+  view->index = (const atomic_uint_fast64_t *)((const char *)mapping +
+                                               region->index_offset);
+  view->size = size;
+  return view;
+}
+
+void chain_view_close(ChainView *view) {
+  if (view == NULL)
+    return;
+  munmap((void *)view->region, view->size);
+  free(view);
+}
+
+bool chain_view_read_tip(const ChainView *view, ChainViewTip *tip) {
+  uint64_t sequence;
+  bool has_tip;
+  do {
+    sequence = read_begin(&view->region->sequence);
+    has_tip = view->region->has_tip;
+    memcpy(tip, &view->region->tip, sizeof(ChainViewTip));
+  } while (read_retry(&view->region->sequence, sequence));
+  return has_tip;
+}
+
+const ChainViewEntry *chain_view_block_at_height(const ChainView *view,
+                                                 uint64_t height,
+                                                 uint64_t *sequence) {
+  const ChainViewEntry *entry =
+      &view->entries[height & (view->region->capacity - 1)];
+  for (;;) {
+    uint64_t value = read_begin(&entry->sequence);
+    bool present = entry->height == height;
+    if (read_retry(&entry->sequence, value)) {
+      continue;
+    }
+    if (!present) {
+      return NULL;
+    }
+    *sequence = value;
+    return entry;
+  }
+}
+
+bool chain_view_entry_stable(const ChainViewEntry *entry, uint64_t sequence) {
+  return !read_retry(&entry->sequence, sequence);
+}
+
+bool chain_view_copy_block(const ChainView *view, uint64_t height,
+                           ChainViewEntry *out) {
+  for (;;) {
+    uint64_t sequence;
+    const ChainViewEntry *entry =
+        chain_view_block_at_height(view, height, &sequence);
+    if (entry == NULL) {
+      return false;
+    }
+    memcpy(out, entry, sizeof(ChainViewEntry));
+    if (chain_view_entry_stable(entry, sequence)) {
+      return true;
+    }
+  }
+}
+
+bool chain_view_find_hash(const ChainView *view, const unsigned char *hash,
+                          uint64_t *height) {
+  const ChainViewRegion *region = view->region;
+  uint64_t mask = region->index_slots - 1;
+  uint64_t home;
+  memcpy(&home, hash, sizeof(home));
+  bool found;
+  uint64_t sequence;
+  do {
+    sequence = read_begin(&region->sequence);
+    found = false;
+    uint64_t slot = home & mask;
+    for (uint64_t probes = 0; probes <= mask; probes++) {
+      uint64_t value =
+          atomic_load_explicit(&view->index[slot], memory_order_relaxed);
+      if (value == 0) {
+        break;
+      }
+      const ChainViewEntry *entry =
+          &view->entries[(value - 1) & (region->capacity - 1)];
+      if (entry->height == value - 1 &&
+          memcmp(entry->hash, hash, CHAIN_VIEW_HASH_SIZE) == 0) {
+        *height = value - 1;
+        found = true;
+        break;
+      }
+      slot = (slot + 1) & mask;
+    }
+  } while (read_retry(&region->sequence, sequence));
+  return found;
+}
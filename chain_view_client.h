@@ -0,0 +1,88 @@
+#ifndef CHAIN_VIEW_CLIENT_H
+#define CHAIN_VIEW_CLIENT_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Reader side of a node's chain view, and the layout of the shared region.
+// Self-contained: tools that include only this header and link
+// libchainview.a need neither the node's headers nor OpenSSL.
+
+#define CHAIN_VIEW_MAGIC "CBVIEW01"
+#define CHAIN_VIEW_VERSION 1
+#define INVALID_VIEW_HEIGHT UINT64_MAX
+// Sizes of a block hash (SHA3-512) and a serialized header; the node
+// checks them against its own HASH_SIZE and BLOCK_HEADER_SIZE.
+#define CHAIN_VIEW_HASH_SIZE 64
+#define CHAIN_VIEW_HEADER_SIZE 216
+
+// One block in the view. sequence is a seqlock over the entry: odd while
+// the node rewrites it, which only happens when its ring slot is reused
+// or a reorganization replaces it.
+typedef struct {
+  atomic_uint_fast64_t sequence;
+  uint64_t height; // INVALID_VIEW_HEIGHT for an empty slot
+  uint64_t chain_work;
+  unsigned char hash[CHAIN_VIEW_HASH_SIZE];
+  // Canonical header bytes, laid out as in block_header.h.
+  unsigned char header[CHAIN_VIEW_HEADER_SIZE];
+} ChainViewEntry;
+
+typedef struct {
+  uint64_t height;
+  uint64_t oldest_height; // lowest height still held by the ring
+  uint64_t chain_work;
+  unsigned char hash[CHAIN_VIEW_HASH_SIZE];
+} ChainViewTip;
+
+// Start of the shared region. The entries follow at entries_offset as a
+// ring indexed by height % capacity, holding the newest capacity blocks of
+// the best chain, and the hash index at index_offset: an open-addressing
+// table keyed by the first eight bytes of each hash, whose slots hold
+// height + 1 or 0 when empty. The tip and the index share one seqlock.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_size;
+  uint64_t capacity;    // power of two
+  uint64_t index_slots; // power of two, twice the capacity
+  uint64_t entries_offset;
+  uint64_t index_offset;
+  uint64_t size;
+  _Alignas(64) atomic_uint_fast64_t sequence;
+  bool has_tip;
+  ChainViewTip tip;
+} ChainViewRegion;
+
+// Client side: a read-only mapping of someone else's region.
+typedef struct {
+  const ChainViewRegion *region;
+  const ChainViewEntry *entries;
+  const atomic_uint_fast64_t *index;
+  size_t size;
+} ChainView;
+
+// -----------------------------------------------------------
+// Chain view client
+// -----------------------------------------------------------
+ChainView *chain_view_open(const char *name);
+ChainView *chain_view_open_fd(int fd);
+void chain_view_close(ChainView *view);
+// Consistent copy of the tip; false while nothing is published.
+bool chain_view_read_tip(const ChainView *view, ChainViewTip *tip);
+// Zero-copy lookup: returns the entry in the mapping, or NULL if the height
+// is not in the view, and its sequence. The entry's fields are only
+// trustworthy if chain_view_entry_stable() still holds after reading them.
+const ChainViewEntry *chain_view_block_at_height(const ChainView *view,
+                                                 uint64_t height,
+                                                 uint64_t *sequence);
+bool chain_view_entry_stable(const ChainViewEntry *entry, uint64_t sequence);
+// Copying lookups, retried until consistent.
+bool chain_view_copy_block(const ChainView *view, uint64_t height,
+                           ChainViewEntry *out);
+bool chain_view_find_hash(const ChainView *view, const unsigned char *hash,
+                          uint64_t *height);
+
+#endif // CHAIN_VIEW_CLIENT_H
@@ -0,0 +1,309 @@
+#include "exporter.h"
+#include "byteorder.h"
+#include "hex.h"
+#include "timing.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// -----------------------------------------------------------
+// Buffered writer
+// -----------------------------------------------------------
+
+bool writer_init(BufferedWriter *writer, int fd, size_t capacity) {
+  memset(writer, 0, sizeof(BufferedWriter));
+  writer->fd = fd;
+  writer->capacity = capacity ? capacity : DEFAULT_WRITER_CAPACITY;
+  writer->buffer = (char *)malloc(writer->capacity);
+  if (writer->buffer == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for output buffer\n");
+    return false;
+  }
+  return true;
+}
+
+bool writer_flush(BufferedWriter *writer) {
+  size_t offset = 0;
+  while (offset < writer->used && !writer->failed) {
+    ssize_t n =
+        write(writer->fd, writer->buffer + offset, writer->used - offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("ERROR: Failed to write export");
+      writer->failed = true;
+      break;
+    }
+    offset += (size_t)n;
+  }
+  writer->written += offset;
+  writer->used = 0;
+  return !writer->failed;
+}
+
+char *writer_reserve(BufferedWriter *writer, size_t length) {
+  if (writer->capacity - writer->used < length) {
+    writer_flush(writer);
+  }
+  return writer->buffer + writer->used;
+}
+
+void writer_commit(BufferedWriter *writer, size_t length) {
+  writer->used += length;
+}
+
+void writer_write(BufferedWriter *writer, const void *data, size_t length) {
+  const char *p = (const char *)data;
+  while (length > 0) {
+    if (writer->used == writer->capacity) {
+      writer_flush(writer);
+    }
+    size_t chunk = writer->capacity - writer->used;
+    if (chunk > length) {
+      chunk = length;
+    }
+    memcpy(writer->buffer + writer->used, p, chunk);
+    writer->used += chunk;
+    p += chunk;
+    length -= chunk;
+  }
+}
+
+void writer_free(BufferedWriter *writer) {
+  free(writer->buffer);
+  writer->buffer = NULL;
+}
+
+// -----------------------------------------------------------
+// Formatting helpers
+// -----------------------------------------------------------
+
+static inline void write_literal(BufferedWriter *writer, const char *text) {
+  writer_write(writer, text, strlen(text));
+}
+
+static void write_hex(BufferedWriter *writer, const unsigned char *data,
+                      size_t length) {
+  // Hex out in slices so the reservation always fits the buffer.
+  while (length > 0) {
+    size_t chunk = length < 4096 ? length : 4096;
+    char *out = writer_reserve(writer, 2 * chunk);
+    hex_encode(data, chunk, out);
+    writer_commit(writer, 2 * chunk);
+    data += chunk;
+    length -= chunk;
+  }
+}
+
+static void write_u64(BufferedWriter *writer, uint64_t value) {
+  char digits[20];
+  size_t n = 0;
+  do {
+    digits[n++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value > 0);
+  char *out = writer_reserve(writer, n);
+  for (size_t i = 0; i < n; i++) {
+    out[i] = digits[n - 1 - i];
+  }
+  writer_commit(writer, n);
+}
+
+static void write_i64(BufferedWriter *writer, int64_t value) {
+  if (value < 0) {
+    writer_write(writer, "-", 1);
+    write_u64(writer, (uint64_t)0 - (uint64_t)value);
+  } else {
+    write_u64(writer, (uint64_t)value);
+  }
+}
+
+// 0 passes through, 1 uses a short escape, 2 needs \u00XX.
+static const unsigned char json_escape_class[256] = {
+    [0x00] = 2, [0x01] = 2, [0x02] = 2, [0x03] = 2, [0x04] = 2, [0x05] = 2,
+    [0x06] = 2, [0x07] = 2, ['\b'] = 1, ['\t'] = 1, ['\n'] = 1, [0x0b] = 2,
+    ['\f'] = 1, ['\r'] = 1, [0x0e] = 2, [0x0f] = 2, [0x10] = 2, [0x11] = 2,
+    [0x12] = 2, [0x13] = 2, [0x14] = 2, [0x15] = 2, [0x16] = 2, [0x17] = 2,
+    [0x18] = 2, [0x19] = 2, [0x1a] = 2, [0x1b] = 2, [0x1c] = 2, [0x1d] = 2,
+    [0x1e] = 2, [0x1f] = 2, ['"'] = 1, ['\\'] = 1, [0x7f] = 2,
+};
+
+// Payloads are written as UTF-8 JSON strings; runs that need no escaping
+// are copied in one go.
+static void write_json_string(BufferedWriter *writer, const char *text,
+                              size_t length) {
+  writer_write(writer, "\"", 1);
+  size_t run = 0;
+  for (size_t i = 0; i < length; i++) {
+    unsigned char c = (unsigned char)text[i];
+    unsigned char escape = json_escape_class[c];
+    if (escape == 0) {
+      continue;
+    }
+    writer_write(writer, text + run, i - run);
+    run = i + 1;
+    char sequence[6] = {'\\', 0};
+    if (escape == 1) {
+      sequence[1] = c == '\b'   ? 'b'
+                    : c == '\t' ? 't'
+                    : c == '\n' ? 'n'
+                    : c == '\f' ? 'f'
+                    : c == '\r' ? 'r'
+                                : (char)c;
+      writer_write(writer, sequence, 2);
+    } else {
+      memcpy(sequence + 1, "u00", 3);
+      hex_encode(&c, 1, sequence + 4);
+      writer_write(writer, sequence, 6);
+    }
+  }
+  writer_write(writer, text + run, length - run);
+  writer_write(writer, "\"", 1);
+}
+
+// -----------------------------------------------------------
+// Record writers
+// -----------------------------------------------------------
+
+static void export_binary_block(BufferedWriter *writer, Block *block) {
+  unsigned char *out =
+      (unsigned char *)writer_reserve(writer, BLOCK_HEADER_SIZE + 5);
+  encode_block_header(block, out);
+  out[BLOCK_HEADER_SIZE] = block->pruned;
+  store_le32(out + BLOCK_HEADER_SIZE + 1, (uint32_t)block->num_transactions);
+  writer_commit(writer, BLOCK_HEADER_SIZE + 5);
+
+  for (size_t i = 0; i < block->num_transactions; i++) {
+    const Transaction *transaction = &block->transactions[i];
+    unsigned char length[4];
+    store_le32(length, (uint32_t)transaction->payload_len);
+    writer_write(writer, length, sizeof(length));
+    writer_write(writer, transaction->payload, transaction->payload_len);
+    writer_write(writer, transaction->public_key, PUBLIC_KEY_SIZE);
+    writer_write(writer, transaction->signature, SIGNATURE_SIZE);
+  }
+}
+
+static void export_jsonl_block(BufferedWriter *writer, Block *block,
+                               const unsigned char *hash) {
+  write_literal(writer, "{\"height\":");
+  write_u64(writer, block->height);
+  write_literal(writer, ",\"hash\":\"");
+  write_hex(writer, hash, HASH_SIZE);
+  write_literal(writer, "\",\"prev_block_hash\":\"");
+  write_hex(writer, block->prev_block_hash, HASH_SIZE);
+  write_literal(writer, "\",\"merkle_root\":\"");
+  write_hex(writer, block->merkle_root, HASH_SIZE);
+  write_literal(writer, "\"");
+  if (block->has_mmr_root) {
+    write_literal(writer, ",\"mmr_root\":\"");
+    write_hex(writer, block->mmr_root, HASH_SIZE);
+    write_literal(writer, "\"");
+  }
+  write_literal(writer, ",\"version\":");
+  write_u64(writer, block->version);
+  write_literal(writer, ",\"timestamp\":");
+  write_i64(writer, (int64_t)block->timestamp);
+  write_literal(writer, ",\"nonce\":");
+  write_u64(writer, block->nonce);
+  write_literal(writer, block->pruned ? ",\"pruned\":true" : ",\"pruned\":false");
+  write_literal(writer, ",\"transactions\":[");
+  for (size_t i = 0; i < block->num_transactions; i++) {
+    const Transaction *transaction = &block->transactions[i];
+    write_literal(writer, i == 0 ? "{\"payload\":" : ",{\"payload\":");
+    write_json_string(writer, transaction->payload, transaction->payload_len);
+    write_literal(writer, ",\"public_key\":\"");
+    write_hex(writer, transaction->public_key, PUBLIC_KEY_SIZE);
+    write_literal(writer, "\",\"signature\":\"");
+    write_hex(writer, transaction->signature, SIGNATURE_SIZE);
+    write_literal(writer, "\"}");
+  }
+  write_literal(writer, "]}\n");
+}
+
+static void export_csv_block(BufferedWriter *writer, Block *block,
+                             const unsigned char *hash) {
+  write_u64(writer, block->height);
+  writer_write(writer, ",", 1);
+  write_hex(writer, hash, HASH_SIZE);
+  writer_write(writer, ",", 1);
+  write_hex(writer, block->prev_block_hash, HASH_SIZE);
+  writer_write(writer, ",", 1);
+  write_hex(writer, block->merkle_root, HASH_SIZE);
+  writer_write(writer, ",", 1);
+  if (block->has_mmr_root) {
+    write_hex(writer, block->mmr_root, HASH_SIZE);
+  }
+  writer_write(writer, ",", 1);
+  write_i64(writer, (int64_t)block->timestamp);
+  writer_write(writer, ",", 1);
+  write_u64(writer, block->nonce);
+  writer_write(writer, ",", 1);
+  write_u64(writer, block->num_transactions);
+  write_literal(writer, block->pruned ? ",1\n" : ",0\n");
+}
+
+// -----------------------------------------------------------
+// Exporter Implementation
+// -----------------------------------------------------------
+
+bool parse_export_format(const char *name, ExportFormat *format) {
+  if (strcmp(name, "binary") == 0) {
+    *format = EXPORT_BINARY;
+  } else if (strcmp(name, "jsonl") == 0) {
+    *format = EXPORT_JSONL;
+  } else if (strcmp(name, "csv") == 0) {
+    *format = EXPORT_CSV;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool export_blockchain(const Blockchain *blockchain, int fd,
+                       ExportFormat format, ExportStats *stats) {
+  memset(stats, 0, sizeof(ExportStats));
+  BufferedWriter writer;
+  if (!writer_init(&writer, fd, 0)) {
+    return false;
+  }
+  uint64_t started = monotonic_ns();
+
+  if (format == EXPORT_BINARY) {
+    writer_write(&writer, EXPORT_MAGIC, 8);
+  } else if (format == EXPORT_CSV) {
+    write_literal(&writer, "height,hash,prev_block_hash,merkle_root,mmr_root,"
+                           "timestamp,nonce,transactions,pruned\n");
+  }
+
+  for (Block *curr = blockchain->head; curr != NULL && !writer.failed;
+       curr = curr->next_block) {
+    unsigned char hash[HASH_SIZE];
+    unsigned int hash_size;
+    if (format != EXPORT_BINARY) {
+      calculate_block_hash(curr, hash, &hash_size);
+    }
+    switch (format) {
+    case EXPORT_BINARY:
+      export_binary_block(&writer, curr);
+      break;
+    case EXPORT_JSONL:
+      export_jsonl_block(&writer, curr, hash);
+      break;
+    case EXPORT_CSV:
+      export_csv_block(&writer, curr, hash);
+      break;
+    }
+    stats->blocks++;
+    stats->transactions += curr->num_transactions;
+  }
+
+  bool ok = writer_flush(&writer);
+  stats->bytes = writer.written;
+  stats->seconds = (monotonic_ns() - started) / 1e9;
+  writer_free(&writer);
+  return ok;
+}
@@ -0,0 +1,57 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include "blockchain.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define EXPORT_MAGIC "CBEXPRT1"
+#define DEFAULT_WRITER_CAPACITY (1u << 20)
+
+typedef enum { EXPORT_BINARY, EXPORT_JSONL, EXPORT_CSV } ExportFormat;
+
+// Collects output in one large buffer and hands it to write(2) only when
+// full, so formatting never goes through stdio per field.
+typedef struct {
+  int fd;
+  char *buffer;
+  size_t used;
+  size_t capacity;
+  uint64_t written;
+  bool failed;
+} BufferedWriter;
+
+typedef struct {
+  uint64_t blocks;
+  uint64_t transactions;
+  uint64_t bytes;
+  double seconds;
+} ExportStats;
+
+// -----------------------------------------------------------
+// Buffered writer
+// -----------------------------------------------------------
+bool writer_init(BufferedWriter *writer, int fd, size_t capacity);
+// Returns a pointer to at least length free bytes; commit what was used
+// with writer_commit(). length must not exceed the capacity.
+char *writer_reserve(BufferedWriter *writer, size_t length);
+void writer_commit(BufferedWriter *writer, size_t length);
+void writer_write(BufferedWriter *writer, const void *data, size_t length);
+bool writer_flush(BufferedWriter *writer);
+void writer_free(BufferedWriter *writer);
+
+// -----------------------------------------------------------
+// Chain export
+// -----------------------------------------------------------
+// Streams every block from head to tail. Binary output is EXPORT_MAGIC,
+// then per block the canonical header, a pruned byte, a u32 transaction
+// count and each signed transaction as u32 payload length, payload,
+// public key and signature. JSONL has one object per block; CSV one row
+// per block after a header row. Pruned and string blocks export their
+// header only.
+bool export_blockchain(const Blockchain *blockchain, int fd,
+                       ExportFormat format, ExportStats *stats);
+bool parse_export_format(const char *name, ExportFormat *format);
+
+#endif // EXPORTER_H
@@ -0,0 +1,481 @@
+#include "header_chain.h"
+#include "byteorder.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_HEADER_THREADS 64
+
+#define COMPACT_PREFIX_SIZE 24
+#define COMPACT_HAS_MMR_ROOT 0x01
+#define COMPACT_CHECKPOINT 0x02
+#define COMPACT_VERSION 0x04 // version is not BLOCK_VERSION
+#define COMPACT_FLAGS 0x08   // flags other than HEADER_HAS_MMR_ROOT are set
+#define COMPACT_DERIVED_MMR_ROOT 0x10 // mmr_root left out, rebuilt on load
+// Prefix flag: the decoder keeps an MMR over the header hashes.
+#define COMPACT_TRACKS_MMR 0x1u
+#define COMPACT_MAX_RECORD                                                     \
+  (1 + 2 * MAX_VARINT_SIZE + 3 * HASH_SIZE + 2 * MAX_VARINT_SIZE)
+
+// -----------------------------------------------------------
+// HeaderChain Implementation
+// -----------------------------------------------------------
+
+HeaderChain *create_header_chain(size_t initial_capacity) {
+  HeaderChain *chain = (HeaderChain *)calloc(1, sizeof(HeaderChain));
+  if (chain == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for header chain\n");
+    return NULL;
+  }
+  if (initial_capacity > 0) {
+    chain->headers =
+        (unsigned char *)malloc(BLOCK_HEADER_SIZE * initial_capacity);
+    if (chain->headers == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate memory for headers\n");
+      free(chain);
+      return NULL;
+    }
+    chain->capacity = initial_capacity;
+  }
+  return chain;
+}
+
+void destroy_header_chain(HeaderChain *chain) {
+  if (chain == NULL)
+    return;
+  free(chain->headers);
+  free(chain);
+}
+
+bool header_chain_append(HeaderChain *chain, const unsigned char *header) {
+  if (chain->count == chain->capacity) {
+    size_t capacity = chain->capacity ? chain->capacity * 2 : 1024;
+    unsigned char *grown =
+        (unsigned char *)realloc(chain->headers, BLOCK_HEADER_SIZE * capacity);
+    if (grown == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate memory for headers\n");
+      return false;
+    }
+    chain->headers = grown;
+    chain->capacity = capacity;
+  }
+  memcpy(chain->headers + chain->count * BLOCK_HEADER_SIZE, header,
+         BLOCK_HEADER_SIZE);
+  chain->count++;
+  return true;
+}
+
+bool header_chain_from_blockchain(HeaderChain *chain,
+                                  const Blockchain *blockchain) {
+  for (Block *curr = blockchain->head; curr != NULL;
+       curr = curr->next_block) {
+    unsigned char header[BLOCK_HEADER_SIZE];
+    encode_block_header(curr, header);
+    if (!header_chain_append(chain, header)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// -----------------------------------------------------------
+// Header chain validation
+// -----------------------------------------------------------
+
+typedef struct {
+  const HeaderChain *chain;
+  size_t begin; // heights whose links this worker checks
+  size_t end;
+  size_t first_invalid;
+} HeaderJob;
+
+// Each link is independent: header i - 1 is hashed in place and compared
+// with the prev_block_hash stored in header i.
+static void *validate_range(void *arg) {
+  HeaderJob *job = (HeaderJob *)arg;
+  job->first_invalid = SIZE_MAX;
+  EVP_MD_CTX *context = create_hash_context();
+  if (context == NULL) {
+    job->first_invalid = job->begin;
+    return NULL;
+  }
+  for (size_t i = job->begin; i < job->end; i++) {
+    unsigned char hash[HASH_SIZE];
+    if (!hash_with_context(context, get_header(job->chain, i - 1).bytes,
+                           BLOCK_HEADER_SIZE, hash) ||
+        memcmp(hash, header_prev_hash(get_header(job->chain, i)),
+               HASH_SIZE) != 0) {
+      job->first_invalid = i;
+      break;
+    }
+  }
+  EVP_MD_CTX_free(context);
+  return NULL;
+}
+
+size_t validate_header_chain(const HeaderChain *chain, size_t num_threads) {
+  if (chain->count < 2) {
+    return chain->count;
+  }
+  if (num_threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = cpus > 0 ? (size_t)cpus : 1;
+  }
+  if (num_threads > MAX_HEADER_THREADS) {
+    num_threads = MAX_HEADER_THREADS;
+  }
+  size_t links = chain->count - 1;
+  if (num_threads > links) {
+    num_threads = links;
+  }
+
+  HeaderJob jobs[MAX_HEADER_THREADS];
+  pthread_t threads[MAX_HEADER_THREADS];
+  size_t started = 0;
+  for (size_t t = 0; t < num_threads; t++) {
+    jobs[t].chain = chain;
+    jobs[t].begin = 1 + links * t / num_threads;
+    jobs[t].end = 1 + links * (t + 1) / num_threads;
+  }
+  // The caller takes the first range itself.
+  for (size_t t = 1; t < num_threads; t++, started++) {
+    if (pthread_create(&threads[t], NULL, validate_range, &jobs[t]) != 0) {
+      break;
+    }
+  }
+  for (size_t t = started + 1; t < num_threads; t++) {
+    validate_range(&jobs[t]);
+  }
+  validate_range(&jobs[0]);
+  for (size_t t = 1; t <= started; t++) {
+    pthread_join(threads[t], NULL);
+  }
+
+  for (size_t t = 0; t < num_threads; t++) {
+    if (jobs[t].first_invalid != SIZE_MAX) {
+      return jobs[t].first_invalid;
+    }
+  }
+  return chain->count;
+}
+
+bool verify_transaction_proof(const HeaderChain *chain, uint64_t height,
+                              const unsigned char *leaf,
+                              const MerkleProof *proof) {
+  if (height >= chain->count) {
+    return false;
+  }
+  return merkle_verify(header_merkle_root(get_header(chain, height)), leaf,
+                       proof);
+}
+
+// -----------------------------------------------------------
+// Compact storage
+// -----------------------------------------------------------
+
+unsigned char *encode_compact_headers(const HeaderChain *chain,
+                                      uint32_t checkpoint_interval,
+                                      size_t *size) {
+  if (checkpoint_interval == 0) {
+    checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+  }
+  bool tracks_mmr = false;
+  for (size_t i = 0; i < chain->count && !tracks_mmr; i++) {
+    tracks_mmr = header_has_mmr_root(get_header(chain, i));
+  }
+  unsigned char *data = (unsigned char *)malloc(
+      COMPACT_PREFIX_SIZE + chain->count * COMPACT_MAX_RECORD + HASH_SIZE);
+  if (data == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for compact headers\n");
+    return NULL;
+  }
+  memcpy(data, COMPACT_HEADERS_MAGIC, 8);
+  store_le32(data + 8, checkpoint_interval);
+  store_le32(data + 12, tracks_mmr ? COMPACT_TRACKS_MMR : 0);
+  store_le64(data + 16, chain->count);
+
+  unsigned char *p = data + COMPACT_PREFIX_SIZE;
+  int64_t prev_timestamp = 0;
+  MMRPeaks peaks = {.num_peaks = 0, .num_leaves = 0};
+  for (size_t i = 0; i < chain->count; i++) {
+    HeaderView header = get_header(chain, i);
+    uint32_t version = header_version(header);
+    uint32_t flags = load_le32(header.bytes + HEADER_FLAGS_OFFSET);
+    bool checkpoint = i % checkpoint_interval == 0;
+
+    // A root that the decoder's own MMR reproduces is left out; any other
+    // (a chain not starting at genesis, say) is stored.
+    bool derived = false;
+    if (tracks_mmr && i > 0) {
+      mmr_peaks_append(&peaks, header_prev_hash(header));
+    }
+    if (flags & HEADER_HAS_MMR_ROOT) {
+      unsigned char root[HASH_SIZE];
+      derived = mmr_peaks_root(&peaks, root) &&
+                memcmp(root, header_mmr_root(header), HASH_SIZE) == 0;
+    }
+
+    unsigned char *tag = p++;
+    *tag = 0;
+    if (derived) {
+      *tag |= COMPACT_DERIVED_MMR_ROOT;
+    } else if (flags & HEADER_HAS_MMR_ROOT) {
+      *tag |= COMPACT_HAS_MMR_ROOT;
+    }
+    if (checkpoint) {
+      *tag |= COMPACT_CHECKPOINT;
+    }
+    if (version != BLOCK_VERSION) {
+      *tag |= COMPACT_VERSION;
+      p += store_varint(p, version);
+    }
+    if (flags & ~HEADER_HAS_MMR_ROOT) {
+      *tag |= COMPACT_FLAGS;
+      p += store_varint(p, flags);
+    }
+    if (checkpoint) {
+      memcpy(p, header_prev_hash(header), HASH_SIZE);
+      p += HASH_SIZE;
+    }
+    memcpy(p, header_merkle_root(header), HASH_SIZE);
+    p += HASH_SIZE;
+    if ((flags & HEADER_HAS_MMR_ROOT) && !derived) {
+      memcpy(p, header_mmr_root(header), HASH_SIZE);
+      p += HASH_SIZE;
+    }
+    int64_t timestamp = header_timestamp(header);
+    p += store_varint(p, zigzag_encode(timestamp - prev_timestamp));
+    prev_timestamp = timestamp;
+    p += store_varint(p, header_nonce(header));
+  }
+  if (chain->count > 0) {
+    unsigned int hash_size;
+    if (!compute_hash(get_header(chain, chain->count - 1).bytes,
+                      BLOCK_HEADER_SIZE, p, &hash_size)) {
+      free(data);
+      return NULL;
+    }
+    p += HASH_SIZE;
+  }
+
+  *size = (size_t)(p - data);
+  unsigned char *trimmed = (unsigned char *)realloc(data, *size);
+  return trimmed != NULL ? trimmed : data;
+}
+
+static bool take_bytes(const unsigned char **p, const unsigned char *end,
+                       unsigned char *out, size_t length) {
+  if ((size_t)(end - *p) < length) {
+    return false;
+  }
+  memcpy(out, *p, length);
+  *p += length;
+  return true;
+}
+
+static bool take_varint(const unsigned char **p, const unsigned char *end,
+                        uint64_t *value) {
+  size_t length = load_varint(*p, end, value);
+  *p += length;
+  return length > 0;
+}
+
+// Rebuilds header i in place in the chain's array. Its prev_block_hash is
+// the hash of header i - 1, or read from the record at a checkpoint, where
+// the two must agree. Checkpoints sit exactly where the prefix's interval
+// puts them, so a record cannot opt out of one. peaks, if not NULL, is the
+// MMR over every header before this one, and gives a derived mmr_root.
+static bool decode_record(const unsigned char **p, const unsigned char *end,
+                          EVP_MD_CTX *context, uint32_t checkpoint_interval,
+                          MMRPeaks *peaks, HeaderChain *chain,
+                          int64_t *timestamp) {
+  unsigned char *header = chain->headers + chain->count * BLOCK_HEADER_SIZE;
+  uint64_t version = BLOCK_VERSION, flags = 0, delta, nonce;
+  unsigned char tag;
+  if (!take_bytes(p, end, &tag, 1) ||
+      ((tag & COMPACT_VERSION) && !take_varint(p, end, &version)) ||
+      ((tag & COMPACT_FLAGS) && !take_varint(p, end, &flags)) ||
+      version > UINT32_MAX || flags > UINT32_MAX) {
+    return false;
+  }
+  bool checkpoint = chain->count % checkpoint_interval == 0;
+  if (checkpoint != ((tag & COMPACT_CHECKPOINT) != 0)) {
+    fprintf(stderr, "ERROR: Compact header %zu has a misplaced checkpoint\n",
+            chain->count);
+    return false;
+  }
+  if ((tag & COMPACT_HAS_MMR_ROOT) && (tag & COMPACT_DERIVED_MMR_ROOT)) {
+    return false;
+  }
+  if (tag & (COMPACT_HAS_MMR_ROOT | COMPACT_DERIVED_MMR_ROOT)) {
+    flags |= HEADER_HAS_MMR_ROOT;
+  }
+  store_le32(header + HEADER_VERSION_OFFSET, (uint32_t)version);
+  store_le32(header + HEADER_FLAGS_OFFSET, (uint32_t)flags);
+
+  if (chain->count > 0 &&
+      !hash_with_context(context, header - BLOCK_HEADER_SIZE,
+                         BLOCK_HEADER_SIZE, header + HEADER_PREV_HASH_OFFSET)) {
+    return false;
+  }
+  if (checkpoint) {
+    unsigned char stored[HASH_SIZE];
+    if (!take_bytes(p, end, stored, HASH_SIZE)) {
+      return false;
+    }
+    if (chain->count == 0) {
+      memcpy(header + HEADER_PREV_HASH_OFFSET, stored, HASH_SIZE);
+    } else if (memcmp(stored, header + HEADER_PREV_HASH_OFFSET, HASH_SIZE) !=
+               0) {
+      fprintf(stderr, "ERROR: Compact headers fail checkpoint at %zu\n",
+              chain->count);
+      return false;
+    }
+  }
+  if (peaks != NULL && chain->count > 0) {
+    mmr_peaks_append(peaks, header + HEADER_PREV_HASH_OFFSET);
+  }
+
+  if (!take_bytes(p, end, header + HEADER_MERKLE_ROOT_OFFSET, HASH_SIZE)) {
+    return false;
+  }
+  if (tag & COMPACT_HAS_MMR_ROOT) {
+    if (!take_bytes(p, end, header + HEADER_MMR_ROOT_OFFSET, HASH_SIZE)) {
+      return false;
+    }
+  } else if (tag & COMPACT_DERIVED_MMR_ROOT) {
+    if (peaks == NULL ||
+        !mmr_peaks_root(peaks, header + HEADER_MMR_ROOT_OFFSET)) {
+      return false;
+    }
+  } else {
+    memset(header + HEADER_MMR_ROOT_OFFSET, 0, HASH_SIZE);
+  }
+  if (!take_varint(p, end, &delta) || !take_varint(p, end, &nonce)) {
+    return false;
+  }
+  *timestamp += zigzag_decode(delta);
+  store_le64(header + HEADER_TIMESTAMP_OFFSET, (uint64_t)*timestamp);
+  store_le64(header + HEADER_NONCE_OFFSET, nonce);
+  chain->count++;
+  return true;
+}
+
+bool decode_compact_headers(const unsigned char *data, size_t size,
+                            HeaderChain *chain) {
+  if (chain->count != 0 || size < COMPACT_PREFIX_SIZE ||
+      memcmp(data, COMPACT_HEADERS_MAGIC, 8) != 0) {
+    fprintf(stderr, "ERROR: Not a compact header file\n");
+    return false;
+  }
+  uint32_t checkpoint_interval = load_le32(data + 8);
+  uint32_t file_flags = load_le32(data + 12);
+  uint64_t count = load_le64(data + 16);
+  // Every record is at least a tag, a Merkle root and two varints, and a
+  // non-empty chain ends with the hash of its last header.
+  if (checkpoint_interval == 0 || (file_flags & ~COMPACT_TRACKS_MMR) ||
+      (count > 0 && size - COMPACT_PREFIX_SIZE < HASH_SIZE) ||
+      count > (size - COMPACT_PREFIX_SIZE) / (HASH_SIZE + 3)) {
+    fprintf(stderr, "ERROR: Compact header count is corrupt\n");
+    return false;
+  }
+  if (count > chain->capacity) {
+    unsigned char *grown =
+        (unsigned char *)realloc(chain->headers, BLOCK_HEADER_SIZE * count);
+    if (grown == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate memory for headers\n");
+      return false;
+    }
+    chain->headers = grown;
+    chain->capacity = count;
+  }
+
+  EVP_MD_CTX *context = create_hash_context();
+  if (context == NULL) {
+    return false;
+  }
+  const unsigned char *p = data + COMPACT_PREFIX_SIZE;
+  const unsigned char *end = data + size - (count > 0 ? HASH_SIZE : 0);
+  int64_t timestamp = 0;
+  MMRPeaks peaks = {.num_peaks = 0, .num_leaves = 0};
+  MMRPeaks *tracked = (file_flags & COMPACT_TRACKS_MMR) ? &peaks : NULL;
+  bool ok = true;
+  while (chain->count < count) {
+    if (!decode_record(&p, end, context, checkpoint_interval, tracked, chain,
+                       &timestamp)) {
+      fprintf(stderr, "ERROR: Compact header %zu is corrupt\n", chain->count);
+      ok = false;
+      break;
+    }
+  }
+  // The tip hash covers every header after the last checkpoint.
+  if (ok && count > 0) {
+    unsigned char tip[HASH_SIZE];
+    if (!hash_with_context(context, get_header(chain, count - 1).bytes,
+                           BLOCK_HEADER_SIZE, tip) ||
+        memcmp(tip, end, HASH_SIZE) != 0) {
+      fprintf(stderr, "ERROR: Compact headers fail the tip hash\n");
+      ok = false;
+    }
+  }
+  EVP_MD_CTX_free(context);
+  if (ok && p != end) {
+    fprintf(stderr, "ERROR: Trailing data after compact headers\n");
+    ok = false;
+  }
+  if (!ok) {
+    chain->count = 0;
+  }
+  return ok;
+}
+
+bool save_compact_headers(const HeaderChain *chain, const char *path,
+                          uint32_t checkpoint_interval) {
+  size_t size;
+  unsigned char *data =
+      encode_compact_headers(chain, checkpoint_interval, &size);
+  if (data == NULL) {
+    return false;
+  }
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    perror("ERROR: Failed to create header file");
+    free(data);
+    return false;
+  }
+  bool ok = fwrite(data, 1, size, file) == size;
+  if (fclose(file) != 0 || !ok) {
+    perror("ERROR: Failed to write header file");
+    ok = false;
+  }
+  free(data);
+  return ok;
+}
+
+bool load_compact_headers(const char *path, HeaderChain *chain) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    perror("ERROR: Failed to open header file");
+    return false;
+  }
+  unsigned char *data = NULL;
+  long size = -1;
+  if (fseek(file, 0, SEEK_END) == 0) {
+    size = ftell(file);
+  }
+  if (size >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+    data = (unsigned char *)malloc(size > 0 ? (size_t)size : 1);
+  }
+  bool ok = data != NULL && fread(data, 1, (size_t)size, file) == (size_t)size;
+  fclose(file);
+  if (!ok) {
+    fprintf(stderr, "ERROR: Failed to read header file\n");
+    free(data);
+    return false;
+  }
+  ok = decode_compact_headers(data, (size_t)size, chain);
+  free(data);
+  return ok;
+}
@@ -0,0 +1,79 @@
+#ifndef HEADER_CHAIN_H
+#define HEADER_CHAIN_H
+
+#include "block_header.h"
+#include "blockchain.h"
+#include "merkletree.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define COMPACT_HEADERS_MAGIC "CBHDRS02"
+#define DEFAULT_CHECKPOINT_INTERVAL 1024
+
+// Light client chain: canonical headers only, stored back to back so the
+// header at height i starts at headers + i * BLOCK_HEADER_SIZE and
+// validation streams through the array.
+typedef struct {
+  unsigned char *headers;
+  size_t count;
+  size_t capacity;
+} HeaderChain;
+
+// -----------------------------------------------------------
+// Header chain management
+// -----------------------------------------------------------
+HeaderChain *create_header_chain(size_t initial_capacity);
+void destroy_header_chain(HeaderChain *chain);
+// Appends a serialized header without checking linkage;
+// validate_header_chain() checks a whole batch at once.
+bool header_chain_append(HeaderChain *chain, const unsigned char *header);
+bool header_chain_from_blockchain(HeaderChain *chain,
+                                  const Blockchain *blockchain);
+
+static inline HeaderView get_header(const HeaderChain *chain,
+                                    uint64_t height) {
+  return header_view(chain->headers + height * BLOCK_HEADER_SIZE);
+}
+
+// -----------------------------------------------------------
+// Header chain validation
+// -----------------------------------------------------------
+// Returns the lowest height whose prev_block_hash does not match its
+// predecessor, or chain->count if every link holds. num_threads 0 uses
+// every CPU.
+size_t validate_header_chain(const HeaderChain *chain, size_t num_threads);
+// Checks that leaf is in the block at height; the leaf is the transaction
+// id for signed blocks and the SHA3-512 of the data for string blocks.
+bool verify_transaction_proof(const HeaderChain *chain, uint64_t height,
+                              const unsigned char *leaf,
+                              const MerkleProof *proof);
+
+// -----------------------------------------------------------
+// Compact storage
+// -----------------------------------------------------------
+// Archival encoding: each header's prev_block_hash is left out, except
+// every checkpoint_interval headers, because it is the hash of the header
+// before it. An mmr_root is left out too when it is the root of the MMR
+// over every earlier header's hash, as it is for a chain from genesis.
+// Timestamps are zigzag varint deltas and the nonce a varint. Decoding
+// rebuilds the canonical headers with one sequential hashing pass (plus,
+// for MMR roots, about one merge and one bagging hash per header), checks
+// each checkpoint it crosses and then the hash of the tip.
+//
+// Layout: magic[8], checkpoint_interval u32, flags u32, count u64, then
+// one record per header: tag byte, [version varint], [flags varint],
+// [prev_block_hash], merkle_root, [mmr_root], timestamp delta, nonce;
+// then, unless count is 0, the hash of the last header. Header i carries
+// prev_block_hash exactly when i % checkpoint_interval == 0.
+unsigned char *encode_compact_headers(const HeaderChain *chain,
+                                      uint32_t checkpoint_interval,
+                                      size_t *size);
+// Appends the decoded headers to chain, which must be empty.
+bool decode_compact_headers(const unsigned char *data, size_t size,
+                            HeaderChain *chain);
+bool save_compact_headers(const HeaderChain *chain, const char *path,
+                          uint32_t checkpoint_interval);
+bool load_compact_headers(const char *path, HeaderChain *chain);
+
+#endif // HEADER_CHAIN_H
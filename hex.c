@@ -0,0 +1,276 @@
+#include "hex.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HEX_X86 1
+#include <immintrin.h>
+#endif
+
+// Both digits of every byte value, so each input byte is one table load.
+static const char hex_pairs[513] =
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+// Nibble value of every character, 0xff for anything that is not a digit.
+static uint8_t hex_values[256];
+static pthread_once_t hex_once = PTHREAD_ONCE_INIT;
+
+typedef void (*EncodeFn)(const unsigned char *in, size_t len, char *out);
+typedef bool (*DecodeFn)(const char *in, size_t len, unsigned char *out);
+
+static EncodeFn encode_impl;
+static DecodeFn decode_impl;
+
+// -----------------------------------------------------------
+// Scalar
+// -----------------------------------------------------------
+
+static void encode_scalar(const unsigned char *in, size_t len, char *out) {
+  for (size_t i = 0; i < len; i++) {
+    memcpy(out + 2 * i, hex_pairs + 2 * in[i], 2);
+  }
+}
+
+// len is the number of output bytes.
+static bool decode_scalar(const char *in, size_t len, unsigned char *out) {
+  uint8_t invalid = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint8_t hi = hex_values[(unsigned char)in[2 * i]];
+    uint8_t lo = hex_values[(unsigned char)in[2 * i + 1]];
+    invalid |= hi | lo;
+    out[i] = (unsigned char)(hi << 4 | (lo & 0x0f));
+  }
+  return (invalid & 0xf0) == 0;
+}
+
+// -----------------------------------------------------------
+// SSSE3 / AVX2
+// -----------------------------------------------------------
+// Encoding splits each byte into nibbles and looks both up with one byte
+// shuffle against "0123456789abcdef", then interleaves them. Decoding
+// classifies every character as a digit or (case folded) letter, rejects
+// the block if any is neither, and merges nibble pairs with a multiply-add.
+
+#ifdef HEX_X86
+
+__attribute__((target("ssse3"))) static void
+encode_ssse3(const unsigned char *in, size_t len, char *out) {
+  const __m128i digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+                                       '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)(in + i));
+    __m128i hi = _mm_shuffle_epi8(digits,
+                                  _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+    __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, mask));
+    _mm_storeu_si128((__m128i *)(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i *)(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+  }
+  encode_scalar(in + i, len - i, out + 2 * i);
+}
+
+// Nibble values of 16 characters; *valid is all ones where each was a digit.
+__attribute__((target("ssse3"))) static inline __m128i
+nibbles_ssse3(__m128i chars, __m128i *valid) {
+  __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+  __m128i is_digit =
+      _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+  __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)),
+                                _mm_set1_epi8('a'));
+  __m128i is_letter =
+      _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+  *valid = _mm_or_si128(is_digit, is_letter);
+  return _mm_or_si128(
+      _mm_and_si128(digit, is_digit),
+      _mm_and_si128(_mm_add_epi8(letter, _mm_set1_epi8(10)), is_letter));
+}
+
+__attribute__((target("ssse3"))) static bool
+decode_ssse3(const char *in, size_t len, unsigned char *out) {
+  const __m128i weights = _mm_set1_epi16(0x0110); // 16 * high + low
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i valid_a, valid_b;
+    __m128i a = nibbles_ssse3(
+        _mm_loadu_si128((const __m128i *)(in + 2 * i)), &valid_a);
+    __m128i b = nibbles_ssse3(
+        _mm_loadu_si128((const __m128i *)(in + 2 * i + 16)), &valid_b);
+    if (_mm_movemask_epi8(_mm_and_si128(valid_a, valid_b)) != 0xffff) {
+      return false;
+    }
+    __m128i bytes = _mm_packus_epi16(_mm_maddubs_epi16(a, weights),
+                                     _mm_maddubs_epi16(b, weights));
+    _mm_storeu_si128((__m128i *)(out + i), bytes);
+  }
+  return decode_scalar(in + 2 * i, len - i, out + i);
+}
+
+__attribute__((target("avx2"))) static void
+encode_avx2(const unsigned char *in, size_t len, char *out) {
+  const __m256i digits = _mm256_setr_epi8(
+      '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd',
+      'e', 'f', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b',
+      'c', 'd', 'e', 'f');
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)(in + i));
+    __m256i hi = _mm256_shuffle_epi8(
+        digits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask));
+    __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(bytes, mask));
+    // Unpacking works within each 128-bit lane; put the halves back in order.
+    __m256i first = _mm256_unpacklo_epi8(hi, lo);
+    __m256i second = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256((__m256i *)(out + 2 * i),
+                        _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256((__m256i *)(out + 2 * i + 32),
+                        _mm256_permute2x128_si256(first, second, 0x31));
+  }
+  encode_ssse3(in + i, len - i, out + 2 * i);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+nibbles_avx2(__m256i chars, __m256i *valid) {
+  __m256i digit = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+  __m256i is_digit =
+      _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+  __m256i letter = _mm256_sub_epi8(
+      _mm256_or_si256(chars, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+  __m256i is_letter =
+      _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+  *valid = _mm256_or_si256(is_digit, is_letter);
+  return _mm256_or_si256(
+      _mm256_and_si256(digit, is_digit),
+      _mm256_and_si256(_mm256_add_epi8(letter, _mm256_set1_epi8(10)),
+                       is_letter));
+}
+
+__attribute__((target("avx2"))) static bool
+decode_avx2(const char *in, size_t len, unsigned char *out) {
+  const __m256i weights = _mm256_set1_epi16(0x0110);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i valid_a, valid_b;
+    __m256i a = nibbles_avx2(
+        _mm256_loadu_si256((const __m256i *)(in + 2 * i)), &valid_a);
+    __m256i b = nibbles_avx2(
+        _mm256_loadu_si256((const __m256i *)(in + 2 * i + 32)), &valid_b);
+    if (_mm256_movemask_epi8(_mm256_and_si256(valid_a, valid_b)) != -1) {
+      return false;
+    }
+    // Packing interleaves the lanes as a0 b0 a1 b1; restore a0 a1 b0 b1.
+    __m256i bytes = _mm256_packus_epi16(_mm256_maddubs_epi16(a, weights),
+                                        _mm256_maddubs_epi16(b, weights));
+    _mm256_storeu_si256((__m256i *)(out + i),
+                        _mm256_permute4x64_epi64(bytes, 0xd8));
+  }
+  return decode_ssse3(in + 2 * i, len - i, out + i);
+}
+
+#endif // HEX_X86
+
+// -----------------------------------------------------------
+// Dispatch
+// -----------------------------------------------------------
+
+static bool implementation_supported(HexImpl impl) {
+  switch (impl) {
+  case HEX_SCALAR:
+    return true;
+#ifdef HEX_X86
+  case HEX_SSSE3:
+    return __builtin_cpu_supports("ssse3");
+  case HEX_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+static void select_implementation(HexImpl impl) {
+  switch (impl) {
+#ifdef HEX_X86
+  case HEX_AVX2:
+    encode_impl = encode_avx2;
+    decode_impl = decode_avx2;
+    break;
+  case HEX_SSSE3:
+    encode_impl = encode_ssse3;
+    decode_impl = decode_ssse3;
+    break;
+#endif
+  default:
+    encode_impl = encode_scalar;
+    decode_impl = decode_scalar;
+    break;
+  }
+}
+
+static void init_hex(void) {
+  memset(hex_values, 0xff, sizeof(hex_values));
+  for (int i = 0; i < 10; i++) {
+    hex_values['0' + i] = (uint8_t)i;
+  }
+  for (int i = 0; i < 6; i++) {
+    hex_values['a' + i] = (uint8_t)(10 + i);
+    hex_values['A' + i] = (uint8_t)(10 + i);
+  }
+  select_implementation(hex_best_implementation());
+}
+
+HexImpl hex_best_implementation(void) {
+  if (implementation_supported(HEX_AVX2)) {
+    return HEX_AVX2;
+  }
+  if (implementation_supported(HEX_SSSE3)) {
+    return HEX_SSSE3;
+  }
+  return HEX_SCALAR;
+}
+
+bool hex_use_implementation(HexImpl impl) {
+  pthread_once(&hex_once, init_hex);
+  if (!implementation_supported(impl)) {
+    return false;
+  }
+  select_implementation(impl);
+  return true;
+}
+
+const char *hex_implementation_name(HexImpl impl) {
+  switch (impl) {
+  case HEX_SSSE3:
+    return "ssse3";
+  case HEX_AVX2:
+    return "avx2";
+  default:
+    return "scalar";
+  }
+}
+
+// -----------------------------------------------------------
+// Hex Implementation
+// -----------------------------------------------------------
+
+void hex_encode(const unsigned char *in, size_t len, char *out) {
+  pthread_once(&hex_once, init_hex);
+  encode_impl(in, len, out);
+}
+
+bool hex_decode(const char *in, size_t hex_len, unsigned char *out) {
+  pthread_once(&hex_once, init_hex);
+  if (hex_len % 2 != 0) {
+    return false;
+  }
+  return decode_impl(in, hex_len / 2, out);
+}
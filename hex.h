@@ -0,0 +1,30 @@
+#ifndef HEX_H
+#define HEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Codec implementations; the best one the CPU supports is picked on first
+// use.
+typedef enum { HEX_SCALAR, HEX_SSSE3, HEX_AVX2 } HexImpl;
+
+// -----------------------------------------------------------
+// Hex encoding
+// -----------------------------------------------------------
+// Writes 2 * len lowercase hex digits to out, without a terminating NUL.
+void hex_encode(const unsigned char *in, size_t len, char *out);
+// Reads hex_len digits, upper or lower case, into hex_len / 2 bytes.
+// Returns false, with out partly written, if hex_len is odd or any
+// character is not a hex digit.
+bool hex_decode(const char *in, size_t hex_len, unsigned char *out);
+
+// -----------------------------------------------------------
+// Dispatch
+// -----------------------------------------------------------
+HexImpl hex_best_implementation(void);
+// Forces an implementation, for benchmarks; false if the CPU lacks it.
+// Not safe to call while other threads use the codec.
+bool hex_use_implementation(HexImpl impl);
+const char *hex_implementation_name(HexImpl impl);
+
+#endif // HEX_H
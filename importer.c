@@ -0,0 +1,202 @@
+#include "importer.h"
+#include "json.h"
+#include "pipeline.h"
+#include "timing.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define IMPORT_READ_SIZE (1u << 20)
+
+// One block's worth of transactions, stored back to back as C strings so
+// the pipeline copies them in a single pass. Reused for every block.
+typedef struct {
+  char *data;
+  size_t size;
+  size_t capacity;
+  size_t *offsets;
+  char **pointers;
+  size_t count;
+} ImportBatch;
+
+static char *reserve_batch(ImportBatch *batch, size_t length) {
+  if (batch->size + length + 1 > batch->capacity) {
+    size_t capacity = batch->capacity ? batch->capacity : 4096;
+    while (capacity < batch->size + length + 1) {
+      capacity *= 2;
+    }
+    char *grown = (char *)realloc(batch->data, capacity);
+    if (grown == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate memory for import batch\n");
+      return NULL;
+    }
+    batch->data = grown;
+    batch->capacity = capacity;
+  }
+  return batch->data + batch->size;
+}
+
+static bool submit_batch(Pipeline *pipeline, ImportBatch *batch,
+                         ImportStats *stats) {
+  if (batch->count == 0) {
+    return true;
+  }
+  for (size_t i = 0; i < batch->count; i++) {
+    batch->pointers[i] = batch->data + batch->offsets[i];
+  }
+  bool ok = pipeline_submit(pipeline, batch->pointers, batch->count);
+  if (ok) {
+    stats->blocks++;
+    stats->transactions += batch->count;
+  }
+  batch->count = 0;
+  batch->size = 0;
+  return ok;
+}
+
+// Adds the transaction on one line, without its newline, to the batch.
+static bool parse_line(const char *start, const char *end,
+                       const ImportConfig *config, ImportBatch *batch,
+                       ImportStats *stats) {
+  if (end > start && end[-1] == '\r') {
+    end--;
+  }
+  const char *p = start;
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    p++;
+  }
+  if (p == end) {
+    return true;
+  }
+  stats->lines++;
+
+  size_t offset = batch->size;
+  if (config->field != NULL) {
+    JsonSpan value;
+    if (!json_find_member(start, end, config->field, &value) ||
+        !value.is_string) {
+      stats->invalid++;
+      return true;
+    }
+    char *out = reserve_batch(batch, (size_t)(value.end - value.start));
+    if (out == NULL) {
+      return false;
+    }
+    ssize_t length = json_unescape(&value, out);
+    if (length < 0) {
+      stats->invalid++;
+      return true;
+    }
+    batch->size += (size_t)length + 1;
+  } else {
+    if (!json_validate(start, end)) {
+      stats->invalid++;
+      return true;
+    }
+    size_t length = (size_t)(end - start);
+    char *out = reserve_batch(batch, length);
+    if (out == NULL) {
+      return false;
+    }
+    memcpy(out, start, length);
+    out[length] = '\0';
+    batch->size += length + 1;
+  }
+  batch->offsets[batch->count++] = offset;
+  return true;
+}
+
+bool import_jsonl(Blockchain *blockchain, int fd, const ImportConfig *config,
+                  ImportStats *stats) {
+  ImportConfig settings = config != NULL ? *config : (ImportConfig){0};
+  if (settings.block_size == 0) {
+    settings.block_size = DEFAULT_IMPORT_BLOCK_SIZE;
+  }
+  if (settings.keep_full == 0) {
+    settings.keep_full = DEFAULT_IMPORT_KEEP_FULL;
+  }
+  memset(stats, 0, sizeof(ImportStats));
+
+  size_t capacity = IMPORT_READ_SIZE;
+  char *buffer = (char *)malloc(capacity);
+  ImportBatch batch = {0};
+  batch.offsets = (size_t *)malloc(sizeof(size_t) * settings.block_size);
+  batch.pointers = (char **)malloc(sizeof(char *) * settings.block_size);
+  if (buffer == NULL || batch.offsets == NULL || batch.pointers == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for import\n");
+    free(buffer);
+    free(batch.offsets);
+    free(batch.pointers);
+    return false;
+  }
+
+  // Old blocks are pruned as the import goes, so memory stays bounded by
+  // the horizon rather than the file size.
+  set_pruning(blockchain, settings.keep_full, NULL, NULL);
+  PipelineConfig pipeline_config = {.queue_capacity = settings.queue_capacity};
+  Pipeline *pipeline = create_pipeline(blockchain, &pipeline_config);
+  if (pipeline == NULL) {
+    free(buffer);
+    free(batch.offsets);
+    free(batch.pointers);
+    return false;
+  }
+
+  uint64_t started = monotonic_ns();
+  size_t filled = 0;
+  bool ok = true;
+  while (ok) {
+    ssize_t n = read(fd, buffer + filled, capacity - filled);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("ERROR: Failed to read import file");
+      ok = false;
+      break;
+    }
+    stats->bytes += (uint64_t)n;
+    filled += (size_t)n;
+
+    char *p = buffer;
+    char *limit = buffer + filled;
+    char *newline;
+    while (ok && (newline = memchr(p, '\n', (size_t)(limit - p))) != NULL) {
+      ok = parse_line(p, newline, &settings, &batch, stats) &&
+           (batch.count < settings.block_size ||
+            submit_batch(pipeline, &batch, stats));
+      p = newline + 1;
+    }
+    if (n == 0) {
+      // A last line without a newline still counts.
+      ok = ok && parse_line(p, limit, &settings, &batch, stats);
+      break;
+    }
+
+    filled = (size_t)(limit - p);
+    memmove(buffer, p, filled);
+    if (filled == capacity) {
+      // A single line longer than the buffer.
+      char *grown = (char *)realloc(buffer, capacity * 2);
+      if (grown == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for import\n");
+        ok = false;
+        break;
+      }
+      buffer = grown;
+      capacity *= 2;
+    }
+  }
+  ok = ok && submit_batch(pipeline, &batch, stats);
+  pipeline_flush(pipeline);
+  stats->seconds = (monotonic_ns() - started) / 1e9;
+
+  destroy_pipeline(pipeline);
+  free(buffer);
+  free(batch.data);
+  free(batch.offsets);
+  free(batch.pointers);
+  return ok;
+}
@@ -0,0 +1,40 @@
+#ifndef IMPORTER_H
+#define IMPORTER_H
+
+#include "blockchain.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEFAULT_IMPORT_BLOCK_SIZE 1024
+#define DEFAULT_IMPORT_KEEP_FULL 64
+
+// Zero fields take the defaults.
+typedef struct {
+  size_t block_size;     // transactions per block
+  const char *field;     // string member used as the transaction, NULL for
+                         // the whole line
+  size_t queue_capacity; // pipeline queue depth
+  size_t keep_full;      // pruning horizon while importing
+} ImportConfig;
+
+typedef struct {
+  uint64_t lines;
+  uint64_t transactions;
+  uint64_t invalid; // lines skipped as malformed or missing the field
+  uint64_t blocks;
+  uint64_t bytes;
+  double seconds;
+} ImportStats;
+
+// -----------------------------------------------------------
+// Bulk import
+// -----------------------------------------------------------
+// Streams JSONL from fd into blocks of config->block_size transactions.
+// Lines are parsed in the read buffer without allocating; the batch is
+// copied once into the pipeline, which hashes leaves and builds trees on
+// its own threads while the next batch is parsed.
+bool import_jsonl(Blockchain *blockchain, int fd, const ImportConfig *config,
+                  ImportStats *stats);
+
+#endif // IMPORTER_H
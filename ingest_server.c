@@ -0,0 +1,404 @@
+#define _GNU_SOURCE // accept4
+#include "ingest_server.h"
+#include "byteorder.h"
+#include "timing.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define INGEST_MAX_EVENTS 64
+
+struct IngestConnection {
+  int fd;
+  char *buffer; // buffer_size + 1 bytes, the last for a final terminator
+  size_t len;
+  size_t parsed;  // start of the next frame header
+  bool terminate; // the frame ending at parsed still needs its terminator
+  char **frames;  // block_size pointers into buffer
+  size_t count;
+  uint64_t first_frame_ns;
+  IngestConnection *prev;
+  IngestConnection *next;
+};
+
+// -----------------------------------------------------------
+// Framing
+// -----------------------------------------------------------
+
+static bool alloc_batch(const IngestServer *server, char **buffer,
+                        char ***frames) {
+  *buffer = (char *)malloc(server->config.buffer_size + 1);
+  *frames = (char **)malloc(sizeof(char *) * server->config.block_size);
+  if (*buffer == NULL || *frames == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for ingest buffer\n");
+    free(*buffer);
+    free(*frames);
+    return false;
+  }
+  return true;
+}
+
+// Hands the buffer, with every frame parsed so far, to the pipeline and
+// carries the unparsed tail over to a fresh one.
+static bool submit_batch(IngestServer *server, IngestConnection *conn) {
+  char *buffer;
+  char **frames;
+  if (!alloc_batch(server, &buffer, &frames)) {
+    return false;
+  }
+  size_t tail = conn->len - conn->parsed;
+  memcpy(buffer, conn->buffer + conn->parsed, tail);
+  if (conn->terminate) {
+    conn->buffer[conn->parsed] = '\0';
+  }
+
+  char *storage = conn->buffer;
+  char **ready = conn->frames;
+  size_t count = conn->count;
+  conn->buffer = buffer;
+  conn->frames = frames;
+  conn->len = tail;
+  conn->parsed = 0;
+  conn->terminate = false;
+  conn->count = 0;
+  if (count == 0) {
+    free(storage);
+    free(ready);
+    return true;
+  }
+
+  uint64_t started = monotonic_ns();
+  bool ok = pipeline_submit_owned(server->pipeline, ready, count, storage);
+  server->stats.blocked_ns += monotonic_ns() - started;
+  if (ok) {
+    server->stats.blocks++;
+  }
+  return ok;
+}
+
+// Collects every complete frame received so far. Returns false on a frame
+// too large for the buffer or a failed submission.
+static bool parse_frames(IngestServer *server, IngestConnection *conn) {
+  size_t max_payload = server->config.buffer_size - INGEST_FRAME_HEADER_SIZE;
+  while (conn->len - conn->parsed >= INGEST_FRAME_HEADER_SIZE) {
+    uint32_t length =
+        load_le32((const unsigned char *)conn->buffer + conn->parsed);
+    if (length > max_payload) {
+      fprintf(stderr, "ERROR: Ingest frame of %u bytes exceeds the buffer\n",
+              length);
+      return false;
+    }
+    if (conn->len - conn->parsed - INGEST_FRAME_HEADER_SIZE < length) {
+      break;
+    }
+    // The header has been read, so the previous frame's terminator may
+    // take its first byte.
+    if (conn->terminate) {
+      conn->buffer[conn->parsed] = '\0';
+    }
+    char *payload = conn->buffer + conn->parsed + INGEST_FRAME_HEADER_SIZE;
+    conn->parsed += INGEST_FRAME_HEADER_SIZE + length;
+    conn->terminate = true;
+    // Transactions are C strings; an embedded NUL would silently cut one.
+    if (memchr(payload, '\0', length) != NULL) {
+      server->stats.invalid++;
+      continue;
+    }
+    if (conn->count == 0) {
+      conn->first_frame_ns = monotonic_ns();
+    }
+    conn->frames[conn->count++] = payload;
+    server->stats.frames++;
+    if (conn->count == server->config.block_size &&
+        !submit_batch(server, conn)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// -----------------------------------------------------------
+// Connections
+// -----------------------------------------------------------
+
+static void close_connection(IngestServer *server, IngestConnection *conn) {
+  close(conn->fd);
+  if (conn->prev != NULL) {
+    conn->prev->next = conn->next;
+  } else {
+    server->connections = conn->next;
+  }
+  if (conn->next != NULL) {
+    conn->next->prev = conn->prev;
+  }
+  server->num_connections--;
+  free(conn->buffer);
+  free(conn->frames);
+  free(conn);
+}
+
+// Submits what the producer sent in full before closing; a trailing
+// partial frame is dropped.
+static void finish_connection(IngestServer *server, IngestConnection *conn) {
+  if (conn->count > 0) {
+    conn->len = conn->parsed;
+    submit_batch(server, conn);
+  }
+  close_connection(server, conn);
+}
+
+static void accept_connections(IngestServer *server) {
+  for (;;) {
+    int fd = accept4(server->listen_fd, NULL, NULL,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror("ERROR: Failed to accept ingest connection");
+      }
+      return;
+    }
+    IngestConnection *conn = NULL;
+    if (server->num_connections < server->config.max_connections) {
+      conn = (IngestConnection *)calloc(1, sizeof(IngestConnection));
+    }
+    if (conn == NULL || !alloc_batch(server, &conn->buffer, &conn->frames)) {
+      free(conn);
+      close(fd);
+      continue;
+    }
+    // A deep socket buffer lets each read collect more frames.
+    int size = (int)server->config.buffer_size;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    conn->fd = fd;
+    struct epoll_event event = {.events = EPOLLIN | EPOLLRDHUP | EPOLLET,
+                                .data.ptr = conn};
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+      perror("ERROR: Failed to watch ingest connection");
+      close(fd);
+      free(conn->buffer);
+      free(conn->frames);
+      free(conn);
+      continue;
+    }
+    conn->next = server->connections;
+    if (conn->next != NULL) {
+      conn->next->prev = conn;
+    }
+    server->connections = conn;
+    server->num_connections++;
+    server->stats.connections++;
+  }
+}
+
+// Reads until the socket would block, as edge-triggered events require,
+// parsing after every read so a full buffer can be handed off.
+static void service_connection(IngestServer *server, IngestConnection *conn) {
+  for (;;) {
+    if (conn->len == server->config.buffer_size &&
+        !submit_batch(server, conn)) {
+      close_connection(server, conn);
+      return;
+    }
+    struct iovec iov = {.iov_base = conn->buffer + conn->len,
+                        .iov_len = server->config.buffer_size - conn->len};
+    struct msghdr message = {.msg_iov = &iov, .msg_iovlen = 1};
+    ssize_t n = recvmsg(conn->fd, &message, 0);
+    if (n > 0) {
+      conn->len += (size_t)n;
+      server->stats.bytes += (uint64_t)n;
+      server->stats.reads++;
+      if (!parse_frames(server, conn)) {
+        finish_connection(server, conn);
+        return;
+      }
+    } else if (n == 0) {
+      finish_connection(server, conn);
+      return;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return;
+    } else if (errno != EINTR) {
+      perror("ERROR: Failed to read ingest connection");
+      finish_connection(server, conn);
+      return;
+    }
+  }
+}
+
+// Submits partial blocks whose oldest frame has waited the flush interval,
+// and returns the epoll timeout until the next one is due.
+static int flush_idle(IngestServer *server) {
+  uint64_t interval_ns = (uint64_t)server->config.flush_interval_ms * 1000000;
+  uint64_t now = monotonic_ns();
+  uint64_t next_due = UINT64_MAX;
+  for (IngestConnection *conn = server->connections; conn != NULL;
+       conn = conn->next) {
+    if (conn->count == 0) {
+      continue;
+    }
+    if (now - conn->first_frame_ns >= interval_ns) {
+      submit_batch(server, conn);
+    } else if (conn->first_frame_ns + interval_ns < next_due) {
+      next_due = conn->first_frame_ns + interval_ns;
+    }
+  }
+  if (next_due == UINT64_MAX) {
+    return -1;
+  }
+  return (int)((next_due - now + 999999) / 1000000);
+}
+
+// -----------------------------------------------------------
+// Ingest server Implementation
+// -----------------------------------------------------------
+
+static bool open_listener(IngestServer *server) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(server->path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "ERROR: Ingest socket path is too long\n");
+    return false;
+  }
+  strcpy(address.sun_path, server->path);
+  server->listen_fd =
+      socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (server->listen_fd < 0) {
+    perror("ERROR: Failed to create ingest socket");
+    return false;
+  }
+  unlink(server->path);
+  if (bind(server->listen_fd, (struct sockaddr *)&address, sizeof(address)) <
+          0 ||
+      listen(server->listen_fd, SOMAXCONN) < 0) {
+    perror("ERROR: Failed to listen on ingest socket");
+    return false;
+  }
+  return true;
+}
+
+static bool watch(int epoll_fd, int fd, void *tag) {
+  struct epoll_event event = {.events = EPOLLIN | EPOLLET, .data.ptr = tag};
+  return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+IngestServer *create_ingest_server(Pipeline *pipeline,
+                                   const IngestConfig *config) {
+  IngestServer *server = (IngestServer *)calloc(1, sizeof(IngestServer));
+  if (server == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for ingest server\n");
+    return NULL;
+  }
+  server->pipeline = pipeline;
+  server->config = config != NULL ? *config : (IngestConfig){0};
+  if (server->config.path == NULL) {
+    server->config.path = DEFAULT_INGEST_SOCKET;
+  }
+  if (server->config.block_size == 0) {
+    server->config.block_size = DEFAULT_INGEST_BLOCK_SIZE;
+  }
+  if (server->config.buffer_size <= INGEST_FRAME_HEADER_SIZE) {
+    server->config.buffer_size = DEFAULT_INGEST_BUFFER_SIZE;
+  }
+  if (server->config.max_connections == 0) {
+    server->config.max_connections = DEFAULT_INGEST_MAX_CONNECTIONS;
+  }
+  if (server->config.flush_interval_ms <= 0) {
+    server->config.flush_interval_ms = DEFAULT_INGEST_FLUSH_INTERVAL_MS;
+  }
+  server->listen_fd = -1;
+  server->wake_fd = -1;
+  server->path = strdup(server->config.path);
+  server->config.path = server->path;
+  server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (server->path == NULL || server->epoll_fd < 0 || !open_listener(server)) {
+    destroy_ingest_server(server);
+    return NULL;
+  }
+  server->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (server->wake_fd < 0 ||
+      !watch(server->epoll_fd, server->listen_fd, &server->listen_fd) ||
+      !watch(server->epoll_fd, server->wake_fd, &server->wake_fd)) {
+    perror("ERROR: Failed to set up ingest event loop");
+    destroy_ingest_server(server);
+    return NULL;
+  }
+  return server;
+}
+
+void destroy_ingest_server(IngestServer *server) {
+  if (server == NULL)
+    return;
+  while (server->connections != NULL) {
+    finish_connection(server, server->connections);
+  }
+  if (server->listen_fd >= 0) {
+    close(server->listen_fd);
+    unlink(server->path);
+  }
+  if (server->wake_fd >= 0)
+    close(server->wake_fd);
+  if (server->epoll_fd >= 0)
+    close(server->epoll_fd);
+  free(server->path);
+  free(server);
+}
+
+bool ingest_server_run(IngestServer *server) {
+  struct epoll_event events[INGEST_MAX_EVENTS];
+  bool running = true;
+  int timeout = -1;
+  while (running) {
+    int n = epoll_wait(server->epoll_fd, events, INGEST_MAX_EVENTS, timeout);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("ERROR: Failed to wait for ingest events");
+      return false;
+    }
+    for (int i = 0; i < n; i++) {
+      void *tag = events[i].data.ptr;
+      if (tag == &server->listen_fd) {
+        accept_connections(server);
+      } else if (tag == &server->wake_fd) {
+        running = false;
+      } else {
+        service_connection(server, (IngestConnection *)tag);
+      }
+    }
+    timeout = flush_idle(server);
+  }
+  for (IngestConnection *conn = server->connections; conn != NULL;
+       conn = conn->next) {
+    submit_batch(server, conn);
+  }
+  return true;
+}
+
+void ingest_server_stop(IngestServer *server) {
+  uint64_t one = 1;
+  if (write(server->wake_fd, &one, sizeof(one)) < 0) {
+    // Already signalled: the counter is non-zero either way.
+  }
+}
+
+void print_ingest_stats(const IngestStats *stats) {
+  printf("Ingest: %llu connections, %llu frames (%llu invalid), %.1f MB in "
+         "%llu reads (%.0f frames/read), %llu blocks, %.2f s blocked on the "
+         "pipeline\n",
+         (unsigned long long)stats->connections,
+         (unsigned long long)stats->frames,
+         (unsigned long long)stats->invalid, stats->bytes / 1e6,
+         (unsigned long long)stats->reads,
+         stats->reads ? (double)(stats->frames + stats->invalid) / stats->reads
+                      : 0.0,
+         (unsigned long long)stats->blocks, stats->blocked_ns / 1e9);
+}
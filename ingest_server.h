@@ -0,0 +1,75 @@
+#ifndef INGEST_SERVER_H
+#define INGEST_SERVER_H
+
+#include "pipeline.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEFAULT_INGEST_SOCKET "cblockchain.sock"
+#define DEFAULT_INGEST_BLOCK_SIZE 4096
+#define DEFAULT_INGEST_BUFFER_SIZE (4u << 20)
+#define DEFAULT_INGEST_MAX_CONNECTIONS 64
+#define DEFAULT_INGEST_FLUSH_INTERVAL_MS 100
+#define INGEST_FRAME_HEADER_SIZE 4
+
+// Zero fields take the defaults.
+typedef struct {
+  const char *path;      // Unix socket path, replaced if it exists
+  size_t block_size;     // transactions per block
+  size_t buffer_size;    // receive buffer per connection; bounds frame size
+  size_t max_connections;
+  int flush_interval_ms; // partial blocks are submitted after this long idle
+} IngestConfig;
+
+typedef struct {
+  uint64_t connections;
+  uint64_t frames;  // transactions submitted
+  uint64_t invalid; // frames dropped for containing a NUL byte
+  uint64_t bytes;
+  uint64_t reads;
+  uint64_t blocks;
+  uint64_t blocked_ns; // waiting on a full pipeline queue
+} IngestStats;
+
+typedef struct IngestConnection IngestConnection;
+
+// Single-threaded epoll server for co-located producers. Each frame is a
+// little-endian u32 payload length followed by the payload; a stream may
+// carry any number of frames per write, and one read picks up as many as
+// fit in the connection's buffer. Frames are turned into C strings in
+// place, by overwriting the next frame's first header byte with the
+// terminator once that header is read, and the receive buffer itself is
+// handed to the pipeline as a block's storage. A block therefore closes
+// early if the buffer fills first, and only the partial frame at the end
+// of a full buffer is ever copied.
+typedef struct {
+  Pipeline *pipeline;
+  IngestConfig config;
+  char *path; // owned copy, unlinked on destroy
+  int listen_fd;
+  int epoll_fd;
+  int wake_fd;
+  IngestConnection *connections;
+  size_t num_connections;
+  IngestStats stats;
+} IngestServer;
+
+// -----------------------------------------------------------
+// Ingest server management
+// -----------------------------------------------------------
+// Binds and listens immediately. The pipeline must outlive the server.
+IngestServer *create_ingest_server(Pipeline *pipeline,
+                                   const IngestConfig *config);
+void destroy_ingest_server(IngestServer *server);
+
+// -----------------------------------------------------------
+// Ingest server interaction
+// -----------------------------------------------------------
+// Serves until ingest_server_stop(), then submits every partial block.
+bool ingest_server_run(IngestServer *server);
+// Safe from any thread and from signal handlers.
+void ingest_server_stop(IngestServer *server);
+void print_ingest_stats(const IngestStats *stats);
+
+#endif // INGEST_SERVER_H
@@ -0,0 +1,325 @@
+#include "json.h"
+#include <stdint.h>
+#include <string.h>
+
+// -----------------------------------------------------------
+// Scanner
+// -----------------------------------------------------------
+// Each skip_* function takes the position of a token and returns the
+// position just past it, or NULL if the input is not valid JSON.
+
+static const char *skip_value(const char *p, const char *end, int depth);
+
+static inline const char *skip_whitespace(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+    p++;
+  }
+  return p;
+}
+
+static inline int hex_digit(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static const char *skip_string(const char *p, const char *end) {
+  if (p >= end || *p != '"') {
+    return NULL;
+  }
+  for (p++; p < end; p++) {
+    unsigned char c = (unsigned char)*p;
+    if (c == '"') {
+      return p + 1;
+    }
+    if (c < 0x20) {
+      return NULL;
+    }
+    if (c == '\\') {
+      if (++p >= end) {
+        return NULL;
+      }
+      if (*p == 'u') {
+        if (end - p < 5) {
+          return NULL;
+        }
+        for (int i = 1; i <= 4; i++) {
+          if (hex_digit(p[i]) < 0) {
+            return NULL;
+          }
+        }
+        p += 4;
+      } else if (strchr("\"\\/bfnrt", *p) == NULL || *p == '\0') {
+        return NULL;
+      }
+    }
+  }
+  return NULL;
+}
+
+static const char *skip_digits(const char *p, const char *end) {
+  const char *start = p;
+  while (p < end && *p >= '0' && *p <= '9') {
+    p++;
+  }
+  return p > start ? p : NULL;
+}
+
+static const char *skip_number(const char *p, const char *end) {
+  if (p < end && *p == '-') {
+    p++;
+  }
+  if (p < end && *p == '0') {
+    p++;
+  } else if ((p = skip_digits(p, end)) == NULL) {
+    return NULL;
+  }
+  if (p < end && *p == '.' && (p = skip_digits(p + 1, end)) == NULL) {
+    return NULL;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    if (p < end && (*p == '+' || *p == '-')) {
+      p++;
+    }
+    p = skip_digits(p, end);
+  }
+  return p;
+}
+
+static const char *skip_literal(const char *p, const char *end,
+                                const char *literal) {
+  size_t length = strlen(literal);
+  if ((size_t)(end - p) < length || memcmp(p, literal, length) != 0) {
+    return NULL;
+  }
+  return p + length;
+}
+
+// Calls back into skip_value for every element; on_member, when set, sees
+// each object member's key and value.
+typedef void (*MemberFn)(const JsonSpan *key, const JsonSpan *value,
+                         void *ctx);
+
+static const char *skip_container(const char *p, const char *end, int depth,
+                                  MemberFn on_member, void *ctx) {
+  char close = *p == '{' ? '}' : ']';
+  bool object = close == '}';
+  if (depth >= JSON_MAX_DEPTH) {
+    return NULL;
+  }
+  p = skip_whitespace(p + 1, end);
+  if (p < end && *p == close) {
+    return p + 1;
+  }
+  for (;;) {
+    JsonSpan key = {0};
+    if (object) {
+      const char *key_end = skip_string(p, end);
+      if (key_end == NULL) {
+        return NULL;
+      }
+      key.start = p + 1;
+      key.end = key_end - 1;
+      key.is_string = true;
+      p = skip_whitespace(key_end, end);
+      if (p >= end || *p != ':') {
+        return NULL;
+      }
+      p = skip_whitespace(p + 1, end);
+    }
+    const char *value_end = skip_value(p, end, depth + 1);
+    if (value_end == NULL) {
+      return NULL;
+    }
+    if (on_member != NULL) {
+      JsonSpan value = {p, value_end, *p == '"'};
+      if (value.is_string) {
+        value.start++;
+        value.end--;
+      }
+      on_member(&key, &value, ctx);
+    }
+    p = skip_whitespace(value_end, end);
+    if (p < end && *p == ',') {
+      p = skip_whitespace(p + 1, end);
+      continue;
+    }
+    if (p < end && *p == close) {
+      return p + 1;
+    }
+    return NULL;
+  }
+}
+
+static const char *skip_value(const char *p, const char *end, int depth) {
+  if (p >= end) {
+    return NULL;
+  }
+  switch (*p) {
+  case '"':
+    return skip_string(p, end);
+  case '{':
+  case '[':
+    return skip_container(p, end, depth, NULL, NULL);
+  case 't':
+    return skip_literal(p, end, "true");
+  case 'f':
+    return skip_literal(p, end, "false");
+  case 'n':
+    return skip_literal(p, end, "null");
+  default:
+    return skip_number(p, end);
+  }
+}
+
+// -----------------------------------------------------------
+// JSON Implementation
+// -----------------------------------------------------------
+
+bool json_validate(const char *p, const char *end) {
+  p = skip_value(skip_whitespace(p, end), end, 0);
+  return p != NULL && skip_whitespace(p, end) == end;
+}
+
+typedef struct {
+  const char *key;
+  size_t key_len;
+  JsonSpan *value;
+  bool found;
+} MemberLookup;
+
+static void match_member(const JsonSpan *key, const JsonSpan *value,
+                         void *ctx) {
+  MemberLookup *lookup = (MemberLookup *)ctx;
+  if (!lookup->found && (size_t)(key->end - key->start) == lookup->key_len &&
+      memcmp(key->start, lookup->key, lookup->key_len) == 0) {
+    *lookup->value = *value;
+    lookup->found = true;
+  }
+}
+
+bool json_find_member(const char *p, const char *end, const char *key,
+                      JsonSpan *value) {
+  p = skip_whitespace(p, end);
+  if (p >= end || *p != '{') {
+    return false;
+  }
+  MemberLookup lookup = {key, strlen(key), value, false};
+  p = skip_container(p, end, 0, match_member, &lookup);
+  return p != NULL && skip_whitespace(p, end) == end && lookup.found;
+}
+
+static size_t put_utf8(char *out, uint32_t code_point) {
+  if (code_point < 0x80) {
+    out[0] = (char)code_point;
+    return 1;
+  }
+  if (code_point < 0x800) {
+    out[0] = (char)(0xc0 | code_point >> 6);
+    out[1] = (char)(0x80 | (code_point & 0x3f));
+    return 2;
+  }
+  if (code_point < 0x10000) {
+    out[0] = (char)(0xe0 | code_point >> 12);
+    out[1] = (char)(0x80 | (code_point >> 6 & 0x3f));
+    out[2] = (char)(0x80 | (code_point & 0x3f));
+    return 3;
+  }
+  out[0] = (char)(0xf0 | code_point >> 18);
+  out[1] = (char)(0x80 | (code_point >> 12 & 0x3f));
+  out[2] = (char)(0x80 | (code_point >> 6 & 0x3f));
+  out[3] = (char)(0x80 | (code_point & 0x3f));
+  return 4;
+}
+
+static bool read_hex4(const char *p, const char *end, uint32_t *value) {
+  if (end - p < 4) {
+    return false;
+  }
+  *value = 0;
+  for (int i = 0; i < 4; i++) {
+    int digit = hex_digit(p[i]);
+    if (digit < 0) {
+      return false;
+    }
+    *value = *value << 4 | (uint32_t)digit;
+  }
+  return true;
+}
+
+ssize_t json_unescape(const JsonSpan *value, char *out) {
+  const char *p = value->start;
+  const char *end = value->end;
+  char *o = out;
+  while (p < end) {
+    const char *escape = memchr(p, '\\', (size_t)(end - p));
+    size_t run = (size_t)((escape != NULL ? escape : end) - p);
+    if (memchr(p, '\0', run) != NULL) {
+      return -1;
+    }
+    memcpy(o, p, run);
+    o += run;
+    p += run;
+    if (p == end) {
+      break;
+    }
+    if (++p == end) {
+      return -1;
+    }
+    char c = *p++;
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+      *o++ = c;
+      break;
+    case 'b':
+      *o++ = '\b';
+      break;
+    case 'f':
+      *o++ = '\f';
+      break;
+    case 'n':
+      *o++ = '\n';
+      break;
+    case 'r':
+      *o++ = '\r';
+      break;
+    case 't':
+      *o++ = '\t';
+      break;
+    case 'u': {
+      uint32_t code_point;
+      if (!read_hex4(p, end, &code_point)) {
+        return -1;
+      }
+      p += 4;
+      if (code_point >= 0xd800 && code_point < 0xdc00) {
+        uint32_t low;
+        if (end - p < 6 || p[0] != '\\' || p[1] != 'u' ||
+            !read_hex4(p + 2, end, &low) || low < 0xdc00 || low >= 0xe000) {
+          return -1;
+        }
+        p += 6;
+        code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+      } else if (code_point >= 0xdc00 && code_point < 0xe000) {
+        return -1;
+      }
+      if (code_point == 0) {
+        return -1;
+      }
+      o += put_utf8(o, code_point);
+      break;
+    }
+    default:
+      return -1;
+    }
+  }
+  *o = '\0';
+  return o - out;
+}
@@ -0,0 +1,33 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define JSON_MAX_DEPTH 64
+
+// A slice of the input; nothing is copied or allocated while scanning.
+// For strings the span excludes the quotes and is still escaped.
+typedef struct {
+  const char *start;
+  const char *end;
+  bool is_string;
+} JsonSpan;
+
+// -----------------------------------------------------------
+// JSON scanning
+// -----------------------------------------------------------
+// True if [p, end) is exactly one JSON value, with optional surrounding
+// whitespace.
+bool json_validate(const char *p, const char *end);
+// Validates the object in [p, end) and finds the top-level member named
+// key. Keys are compared byte for byte, without decoding escapes.
+bool json_find_member(const char *p, const char *end, const char *key,
+                      JsonSpan *value);
+// Decodes a string span into out, which needs room for the span's length
+// plus a terminating NUL. Returns the decoded length, or -1 for a bad
+// escape or an embedded NUL.
+ssize_t json_unescape(const JsonSpan *value, char *out);
+
+#endif // JSON_H
@@ -1,9 +1,410 @@
 #include "blockchain.h"
+#include "chain_view.h"
+#include "exporter.h"
+#include "hex.h"
+#include "importer.h"
+#include "ingest_server.h"
+#include "rpc_server.h"
+#include "sealer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #define UNUSED(x) (void)(x)
 
-int main(void) {
+static int usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s                 build and print a demo chain\n"
+          "       %s import <file|-> [--block-size N] [--field NAME] "
+          "[--keep N] [--validate]\n"
+          "              [--export PATH [--format jsonl|csv|binary]]\n"
+          "       %s serve [--port N] [--block-size N] [--seal-ms N]\n"
+          "       %s ingest [--socket PATH] [--block-size N] [--keep N] "
+          "[--view NAME]\n"
+          "       %s seal [--max-tx N] [--max-bytes N] [--max-delay-ms N] "
+          "[--keep N] [--view NAME]\n"
+          "       %s view NAME [height]\n",
+          program, program, program, program, program, program);
+  return 1;
+}
+
+static int run_import(const char *program, int argc, char **argv) {
+  if (argc < 1) {
+    return usage(program);
+  }
+  const char *path = argv[0];
+  ImportConfig config = {0};
+  bool validate = false;
+  const char *export_path = NULL;
+  ExportFormat format = EXPORT_JSONL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--validate") == 0) {
+      validate = true;
+    } else if (i + 1 < argc && strcmp(argv[i], "--block-size") == 0) {
+      config.block_size = strtoul(argv[++i], NULL, 10);
+    } else if (i + 1 < argc && strcmp(argv[i], "--field") == 0) {
+      config.field = argv[++i];
+    } else if (i + 1 < argc && strcmp(argv[i], "--keep") == 0) {
+      config.keep_full = strtoul(argv[++i], NULL, 10);
+    } else if (i + 1 < argc && strcmp(argv[i], "--export") == 0) {
+      export_path = argv[++i];
+    } else if (i + 1 < argc && strcmp(argv[i], "--format") == 0) {
+      if (!parse_export_format(argv[++i], &format)) {
+        return usage(program);
+      }
+    } else {
+      return usage(program);
+    }
+  }
+
+  int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+  if (fd < 0) {
+    perror("ERROR: Failed to open import file");
+    return 1;
+  }
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  ImportStats stats;
+  bool ok = import_jsonl(&blockchain, fd, &config, &stats);
+  if (fd != STDIN_FILENO) {
+    close(fd);
+  }
+
+  printf("Imported %llu transactions (%llu lines, %llu invalid) into %llu "
+         "blocks\n",
+         (unsigned long long)stats.transactions,
+         (unsigned long long)stats.lines, (unsigned long long)stats.invalid,
+         (unsigned long long)stats.blocks);
+  double tx_rate = stats.seconds > 0 ? stats.transactions / stats.seconds : 0.0;
+  double import_rate =
+      stats.seconds > 0 ? stats.bytes / 1e6 / stats.seconds : 0.0;
+  printf("%.1f MB in %.2f s: %.0f tx/s, %.1f MB/s\n", stats.bytes / 1e6,
+         stats.seconds, tx_rate, import_rate);
+  if (validate) {
+    printf("Blockchain %s\n", validate_blockchain(&blockchain)
+                                  ? "validated successfully"
+                                  : "contains errors");
+  }
+  if (ok && export_path != NULL) {
+    int out = open(export_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+      perror("ERROR: Failed to open export file");
+      ok = false;
+    } else {
+      ExportStats exported;
+      ok = export_blockchain(&blockchain, out, format, &exported);
+      close(out);
+      double export_rate = exported.seconds > 0
+                               ? exported.bytes / 1e6 / exported.seconds
+                               : 0.0;
+      printf("Exported %llu blocks, %.1f MB in %.2f s: %.1f MB/s\n",
+             (unsigned long long)exported.blocks, exported.bytes / 1e6,
+             exported.seconds, export_rate);
+    }
+  }
+  destroy_blockchain(&blockchain);
+  return ok ? 0 : 1;
+}
+
+static RpcServer *serving;
+
+static void stop_serving(int signal_number) {
+  (void)signal_number;
+  rpc_server_stop(serving);
+}
+
+static int run_serve(const char *program, int argc, char **argv) {
+  RpcConfig config = {0};
+  for (int i = 0; i < argc; i++) {
+    if (i + 1 < argc && strcmp(argv[i], "--port") == 0) {
+      config.port = (uint16_t)strtoul(argv[++i], NULL, 10);
+    } else if (i + 1 < argc && strcmp(argv[i], "--block-size") == 0) {
+      config.block_size = strtoul(argv[++i], NULL, 10);
+    } else if (i + 1 < argc && strcmp(argv[i], "--seal-ms") == 0) {
+      config.seal_interval_ms = atoi(argv[++i]);
+    } else {
+      return usage(program);
+    }
+  }
+
+  // Transactions are verified on submission; the cache spares sealing a
+  // second check.
+  SigCache *cache = create_sig_cache(
+      4 * (config.block_size ? config.block_size : DEFAULT_RPC_BLOCK_SIZE));
+  set_signature_cache(cache);
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  serving = create_rpc_server(&blockchain, &config);
+  if (serving == NULL) {
+    destroy_blockchain(&blockchain);
+    destroy_sig_cache(cache);
+    return 1;
+  }
+  signal(SIGINT, stop_serving);
+  signal(SIGTERM, stop_serving);
+  printf("Serving on http://127.0.0.1:%u\n", serving->port);
+  fflush(stdout);
+  bool ok = rpc_server_run(serving);
+  print_rpc_stats(&serving->stats);
+  destroy_rpc_server(serving);
+  destroy_blockchain(&blockchain);
+  set_signature_cache(NULL);
+  destroy_sig_cache(cache);
+  return ok ? 0 : 1;
+}
+
+// Publishes the chain so far into a shared-memory view other processes can
+// map with chain_view_open(name).
+static bool open_view(const char *name, Blockchain *blockchain,
+                      ChainViewPublisher **view) {
+  *view = create_chain_view(name, 0);
+  if (*view == NULL || !chain_view_publish(*view, blockchain->tail)) {
+    destroy_chain_view(*view);
+    return false;
+  }
+  printf("Publishing chain view %s\n", name);
+  return true;
+}
+
+static void print_view_entry(const ChainViewEntry *entry) {
+  char hash_hex[HASH_SIZE * 2 + 1];
+  hex_encode(entry->hash, HASH_SIZE, hash_hex);
+  hash_hex[HASH_SIZE * 2] = '\0';
+  HeaderView header = header_view(entry->header);
+  printf("Height: %llu\nHash: %s\nTimestamp: %llu\nChain work: %llu\n",
+         (unsigned long long)entry->height, hash_hex,
+         (unsigned long long)header_timestamp(header),
+         (unsigned long long)entry->chain_work);
+}
+
+// Reads another process's chain view: the tip, or one block by height.
+static int run_view(const char *program, int argc, char **argv) {
+  if (argc < 1 || argc > 2) {
+    return usage(program);
+  }
+  ChainView *view = chain_view_open(argv[0]);
+  if (view == NULL) {
+    return 1;
+  }
+  ChainViewTip tip;
+  if (!chain_view_read_tip(view, &tip)) {
+    fprintf(stderr, "ERROR: Nothing published yet\n");
+    chain_view_close(view);
+    return 1;
+  }
+  uint64_t height = argc == 2 ? strtoull(argv[1], NULL, 10) : tip.height;
+  ChainViewEntry entry;
+  bool found = chain_view_copy_block(view, height, &entry);
+  if (found) {
+    print_view_entry(&entry);
+    printf("View holds heights %llu to %llu\n",
+           (unsigned long long)tip.oldest_height,
+           (unsigned long long)tip.height);
+  } else {
+    fprintf(stderr, "ERROR: Height %llu is not in the view (%llu to %llu)\n",
+            (unsigned long long)height, (unsigned long long)tip.oldest_height,
+            (unsigned long long)tip.height);
+  }
+  chain_view_close(view);
+  return found ? 0 : 1;
+}
+
+static IngestServer *ingesting;
+
+static void stop_ingesting(int signal_number) {
+  (void)signal_number;
+  ingest_server_stop(ingesting);
+}
+
+static int run_ingest(const char *program, int argc, char **argv) {
+  IngestConfig config = {0};
+  size_t keep_full = DEFAULT_IMPORT_KEEP_FULL;
+  const char *view_name = NULL;
+  for (int i = 0; i < argc; i++) {
+    if (i + 1 < argc && strcmp(argv[i], "--socket") == 0) {
+      config.path = argv[++i];
+    } else if (i + 1 < argc && strcmp(argv[i], "--block-size") == 0) {
+      config.block_size = strtoul(argv[++i], NULL, 10);
+    } else if (i + 1 < argc && strcmp(argv[i], "--keep") == 0) {
+      keep_full = strtoul(argv[++i], NULL, 10);
+    } else if (i + 1 < argc && strcmp(argv[i], "--view") == 0) {
+      view_name = argv[++i];
+    } else {
+      return usage(program);
+    }
+  }
+
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  set_pruning(&blockchain, keep_full, NULL, NULL);
+  ChainViewPublisher *view = NULL;
+  if (view_name != NULL && !open_view(view_name, &blockchain, &view)) {
+    destroy_blockchain(&blockchain);
+    return 1;
+  }
+  PipelineConfig pipeline_config = {0, view ? chain_view_persist : NULL, view};
+  Pipeline *pipeline = create_pipeline(&blockchain, &pipeline_config);
+  ingesting = pipeline != NULL ? create_ingest_server(pipeline, &config) : NULL;
+  if (ingesting == NULL) {
+    destroy_pipeline(pipeline);
+    destroy_chain_view(view);
+    destroy_blockchain(&blockchain);
+    return 1;
+  }
+  signal(SIGINT, stop_ingesting);
+  signal(SIGTERM, stop_ingesting);
+  printf("Ingesting on %s\n", ingesting->path);
+  fflush(stdout);
+  bool ok = ingest_server_run(ingesting);
+  pipeline_flush(pipeline);
+  print_ingest_stats(&ingesting->stats);
+  printf("Chain height %d\n", blockchain.count - 1);
+  destroy_ingest_server(ingesting);
+  destroy_pipeline(pipeline);
+  destroy_chain_view(view);
+  destroy_blockchain(&blockchain);
+  return ok ? 0 : 1;
+}
+
+static Sealer *sealing;
+static volatile sig_atomic_t seal_interrupted;
+
+static void stop_sealing(int signal_number) {
+  (void)signal_number;
+  seal_interrupted = 1;
+  sealer_stop(sealing);
+}
+
+static void *run_sealer(void *arg) {
+  sealer_run((Sealer *)arg);
+  return NULL;
+}
+
+// Seals newline-separated transactions from stdin until end of input or
+// SIGINT.
+static int run_seal(const char *program, int argc, char **argv) {
+  SealerConfig config = {0};
+  size_t keep_full = DEFAULT_IMPORT_KEEP_FULL;
+  const char *view_name = NULL;
+  for (int i = 0; i < argc; i++) {
+    if (i + 1 < argc && strcmp(argv[i], "--max-tx") == 0) {
+      config.max_transactions = strtoul(argv[++i], NULL, 10);
+    } else if (i + 1 < argc && strcmp(argv[i], "--max-bytes") == 0) {
+      config.max_bytes = strtoul(argv[++i], NULL, 10);
+    } else if (i + 1 < argc && strcmp(argv[i], "--max-delay-ms") == 0) {
+      config.max_delay_ms = atoi(argv[++i]);
+    } else if (i + 1 < argc && strcmp(argv[i], "--keep") == 0) {
+      keep_full = strtoul(argv[++i], NULL, 10);
+    } else if (i + 1 < argc && strcmp(argv[i], "--view") == 0) {
+      view_name = argv[++i];
+    } else {
+      return usage(program);
+    }
+  }
+
+  Blockchain blockchain = {0};
+  create_blockchain(&blockchain);
+  set_pruning(&blockchain, keep_full, NULL, NULL);
+  ChainViewPublisher *view = NULL;
+  if (view_name != NULL && !open_view(view_name, &blockchain, &view)) {
+    destroy_blockchain(&blockchain);
+    return 1;
+  }
+  PipelineConfig pipeline_config = {0, view ? chain_view_persist : NULL, view};
+  Pipeline *pipeline = create_pipeline(&blockchain, &pipeline_config);
+  sealing = pipeline != NULL ? create_sealer(pipeline, &config) : NULL;
+  if (sealing == NULL) {
+    destroy_pipeline(pipeline);
+    destroy_chain_view(view);
+    destroy_blockchain(&blockchain);
+    return 1;
+  }
+
+  // Signals go to this thread, without SA_RESTART, so they interrupt the
+  // blocking read below.
+  sigset_t signals, previous;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, &previous);
+  pthread_t sealer_thread;
+  bool started =
+      pthread_create(&sealer_thread, NULL, run_sealer, sealing) == 0;
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+  if (!started) {
+    fprintf(stderr, "ERROR: Failed to start sealer thread\n");
+    destroy_sealer(sealing);
+    destroy_pipeline(pipeline);
+    destroy_chain_view(view);
+    destroy_blockchain(&blockchain);
+    return 1;
+  }
+  struct sigaction action = {0};
+  action.sa_handler = stop_sealing;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  char *line = NULL;
+  size_t capacity = 0;
+  ssize_t len;
+  while (!seal_interrupted) {
+    errno = 0;
+    len = getline(&line, &capacity, stdin);
+    if (len < 0) {
+      if (errno == EINTR && !seal_interrupted) {
+        clearerr(stdin);
+        continue;
+      }
+      break;
+    }
+    if (len > 0 && line[len - 1] == '\n') {
+      len--;
+    }
+    if (len > 0) {
+      sealer_submit(sealing, line, (size_t)len);
+    }
+  }
+  free(line);
+  sealer_stop(sealing);
+  pthread_join(sealer_thread, NULL);
+  pipeline_flush(pipeline);
+
+  SealerStats stats;
+  sealer_get_stats(sealing, &stats);
+  print_sealer_stats(&stats);
+  printf("Chain height %d\n", blockchain.count - 1);
+  destroy_sealer(sealing);
+  destroy_pipeline(pipeline);
+  destroy_chain_view(view);
+  destroy_blockchain(&blockchain);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && strcmp(argv[1], "import") == 0) {
+    return run_import(argv[0], argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "serve") == 0) {
+    return run_serve(argv[0], argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "ingest") == 0) {
+    return run_ingest(argv[0], argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "seal") == 0) {
+    return run_seal(argv[0], argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "view") == 0) {
+    return run_view(argv[0], argc - 2, argv + 2);
+  }
+  if (argc >= 2) {
+    return usage(argv[0]);
+  }
+
   Blockchain blockchain = {0};
   create_blockchain(&blockchain);
 
@@ -15,13 +416,56 @@ int main(void) {
   Block *three = create_block(&blockchain, transaction_data_two, 2);
   UNUSED(three);
 
+  StateSet *state = create_state(0);
+  blockchain.state = state;
+  Keypair alice, bob;
+  if (state != NULL && generate_keypair(&alice) && generate_keypair(&bob)) {
+    state_credit(state, alice.public_key, 100);
+
+    char bob_hex[PUBLIC_KEY_SIZE * 2 + 1];
+    hex_encode(bob.public_key, PUBLIC_KEY_SIZE, bob_hex);
+    bob_hex[PUBLIC_KEY_SIZE * 2] = '\0';
+    const uint64_t amounts[] = {30, 20};
+    Transaction signed_data[2];
+    size_t num_signed = 0;
+    for (size_t i = 0; i < 2; i++) {
+      char payload[128];
+      int len = snprintf(payload, sizeof(payload), "%s:%lu:%zu", bob_hex,
+                         (unsigned long)amounts[i], i);
+      if (sign_transaction(&signed_data[i], &alice, payload, len)) {
+        num_signed++;
+      }
+    }
+    if (num_signed == 2) {
+      Block *four = create_signed_block(&blockchain, signed_data, num_signed);
+      UNUSED(four);
+    }
+    for (size_t i = 0; i < num_signed; i++) {
+      free_transaction(&signed_data[i]);
+    }
+
+    uint64_t key[2];
+    account_key(bob.public_key, key);
+    const AccountEntry *account = state_lookup(state, key);
+    printf("Bob's balance: %lu\n",
+           account ? (unsigned long)account->balance : 0ul);
+    free_keypair(&alice);
+    free_keypair(&bob);
+  }
+
+  VerifyPool *pool = create_verify_pool(0, 0);
+  set_verify_pool(pool);
   if (!validate_blockchain(&blockchain)) {
     printf("Blockchain contains errors\n");
   } else {
     printf("Blockchain validated successfully\n");
   }
 
+  set_verify_pool(NULL);
+  destroy_verify_pool(pool);
+
   print_blockchain(&blockchain);
   destroy_blockchain(&blockchain);
+  destroy_state(state);
   return 0;
 }
@@ -3,6 +3,7 @@
 #include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/sha.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -44,27 +45,50 @@ MerkleTree *create_tree(unsigned char **transaction_hashes,
     fprintf(stderr, "ERROR: Failed to allocate memory for MerkleTree\n");
     return NULL;
   }
+  tree->root = NULL;
+  if (num_transactions == 0) {
+    return tree;
+  }
 
-  Node **nodes = (Node **)malloc(sizeof(Node) * num_transactions);
+  Node **nodes = (Node **)malloc(sizeof(Node *) * num_transactions);
+  if (nodes == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for tree level\n");
+    free(tree);
+    return NULL;
+  }
   for (size_t i = 0; i < num_transactions; i++) {
     nodes[i] = create_node(transaction_hashes[i]);
   }
 
+  // Pair up each level; an odd node out is promoted unchanged.
   while (num_transactions > 1) {
     size_t new_size = (num_transactions + 1) / 2;
 
     Node **new_nodes = (Node **)malloc(sizeof(Node *) * new_size);
-    size_t j = 0;
+    if (new_nodes == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate memory for tree level\n");
+      for (size_t i = 0; i < num_transactions; i++) {
+        free_node(nodes[i]);
+      }
+      free(nodes);
+      free(tree);
+      return NULL;
+    }
 
     for (size_t i = 0; i < new_size; i++) {
-      if (i + 1 < num_transactions) {
+      if (2 * i + 1 < num_transactions) {
         unsigned char combined_hash[HASH_SIZE];
-        combine_hashes(nodes[i]->hash, nodes[i + 1]->hash, combined_hash);
-        new_nodes[j++] = create_node(combined_hash);
+        combine_hashes(nodes[2 * i]->hash, nodes[2 * i + 1]->hash,
+                       combined_hash);
+        new_nodes[i] = create_node(combined_hash);
+        new_nodes[i]->left = nodes[2 * i];
+        new_nodes[i]->right = nodes[2 * i + 1];
       } else {
-        new_nodes[j++] = nodes[i];
+        new_nodes[i] = nodes[2 * i];
       }
     }
+    free(nodes);
+    nodes = new_nodes;
     num_transactions = new_size;
   }
 
@@ -89,29 +113,132 @@ void free_tree(MerkleTree *tree) {
   }
 }
 
+// -----------------------------------------------------------
+// Proofs
+// -----------------------------------------------------------
+
+// Node j at level h covers leaves [j * 2^h, (j + 1) * 2^h); a node whose
+// sibling would start past the last leaf was promoted unchanged.
+static size_t tree_depth(size_t num_leaves) {
+  size_t depth = 0;
+  while (((size_t)1 << depth) < num_leaves) {
+    depth++;
+  }
+  return depth;
+}
+
+bool merkle_prove(const MerkleTree *tree, size_t num_leaves,
+                  size_t leaf_index, MerkleProof *proof) {
+  if (tree == NULL || tree->root == NULL || leaf_index >= num_leaves) {
+    return false;
+  }
+  proof->leaf_index = leaf_index;
+  proof->num_leaves = num_leaves;
+  proof->path_len = 0;
+
+  // Walk down from the root, collecting siblings top first.
+  const Node *node = tree->root;
+  for (size_t level = tree_depth(num_leaves); level > 0; level--) {
+    size_t child = leaf_index >> (level - 1);
+    if (((child ^ 1) << (level - 1)) >= num_leaves) {
+      continue;
+    }
+    if (node->left == NULL || node->right == NULL) {
+      return false; // the tree was not built from num_leaves leaves
+    }
+    const Node *sibling = child & 1 ? node->left : node->right;
+    memcpy(proof->path[proof->path_len++], sibling->hash, HASH_SIZE);
+    node = child & 1 ? node->right : node->left;
+  }
+
+  for (size_t i = 0, j = proof->path_len; i + 1 < j; i++, j--) {
+    unsigned char swap[HASH_SIZE];
+    memcpy(swap, proof->path[i], HASH_SIZE);
+    memcpy(proof->path[i], proof->path[j - 1], HASH_SIZE);
+    memcpy(proof->path[j - 1], swap, HASH_SIZE);
+  }
+  return true;
+}
+
+bool merkle_verify(const unsigned char *root, const unsigned char *leaf,
+                   const MerkleProof *proof) {
+  if (proof->leaf_index >= proof->num_leaves ||
+      proof->path_len > MERKLE_MAX_DEPTH) {
+    return false;
+  }
+  unsigned char hash[HASH_SIZE];
+  memcpy(hash, leaf, HASH_SIZE);
+  size_t used = 0;
+  size_t depth = tree_depth(proof->num_leaves);
+  for (size_t level = 0; level < depth; level++) {
+    size_t node = proof->leaf_index >> level;
+    if (((node ^ 1) << level) >= proof->num_leaves) {
+      continue;
+    }
+    if (used == proof->path_len) {
+      return false;
+    }
+    unsigned char *sibling = (unsigned char *)proof->path[used++];
+    if (node & 1) {
+      combine_hashes(sibling, hash, hash);
+    } else {
+      combine_hashes(hash, sibling, hash);
+    }
+  }
+  return used == proof->path_len && memcmp(hash, root, HASH_SIZE) == 0;
+}
+
+// -----------------------------------------------------------
+// Hash
+// -----------------------------------------------------------
+
+static EVP_MD *sha3_512 = NULL;
+static pthread_once_t sha3_512_once = PTHREAD_ONCE_INIT;
+
+/* Fetching an algorithm is far more expensive than the digest itself, so it
+ * is done once per process from the default library context. */
+static void fetch_sha3_512(void) {
+  sha3_512 = EVP_MD_fetch(NULL, "SHA3-512", NULL);
+}
+
+static pthread_key_t context_key;
+static pthread_once_t context_key_once = PTHREAD_ONCE_INIT;
+
+static void free_thread_context(void *context) {
+  EVP_MD_CTX_free((EVP_MD_CTX *)context);
+}
+
+static void create_context_key(void) {
+  pthread_key_create(&context_key, free_thread_context);
+}
+
+/* Each thread keeps one digest context, so hashing does not allocate. */
+static EVP_MD_CTX *thread_context(void) {
+  pthread_once(&context_key_once, create_context_key);
+  EVP_MD_CTX *context = (EVP_MD_CTX *)pthread_getspecific(context_key);
+  if (context == NULL) {
+    context = EVP_MD_CTX_new();
+    if (context != NULL && pthread_setspecific(context_key, context) != 0) {
+      EVP_MD_CTX_free(context);
+      context = NULL;
+    }
+  }
+  return context;
+}
+
 int compute_hash(const unsigned char *data, size_t data_len,
                  unsigned char *digest_value, unsigned int *digest_length) {
-  OSSL_LIB_CTX *library_context;
   int ret = 0;
-  const char *option_properties = NULL;
-  EVP_MD *message_digest = NULL;
   EVP_MD_CTX *digest_context = NULL;
 
-  library_context = OSSL_LIB_CTX_new();
-  if (library_context == NULL) {
-    fprintf(stderr, "OSSL_LIB_CTX_new() returned NULL\n");
-    goto cleanup;
-  }
-
-  /* Fetch a message digest by name */
-  message_digest = EVP_MD_fetch(library_context, "SHA3-512", option_properties);
-  if (message_digest == NULL) {
+  pthread_once(&sha3_512_once, fetch_sha3_512);
+  if (sha3_512 == NULL) {
     fprintf(stderr, "EVP_MD_fetch could not find SHA3-512.\n");
     goto cleanup;
   }
 
   /* Determine the length of the fetched digest type */
-  *digest_length = EVP_MD_get_size(message_digest);
+  *digest_length = EVP_MD_get_size(sha3_512);
   if (*digest_length <= 0) {
     fprintf(stderr, "EVP_MD_get_size returned invalid size.\n");
     goto cleanup;
@@ -123,15 +250,15 @@ int compute_hash(const unsigned char *data, size_t data_len,
     goto cleanup;
   }
 
-  /* Create a digest context */
-  digest_context = EVP_MD_CTX_new();
+  /* Reuse this thread's digest context */
+  digest_context = thread_context();
   if (digest_context == NULL) {
     fprintf(stderr, "EVP_MD_CTX_new failed.\n");
     goto cleanup;
   }
 
   /* Initialize the digest context */
-  if (EVP_DigestInit(digest_context, message_digest) != 1) {
+  if (EVP_DigestInit_ex2(digest_context, sha3_512, NULL) != 1) {
     fprintf(stderr, "EVP_DigestInit failed.\n");
     goto cleanup;
   }
@@ -142,7 +269,7 @@ int compute_hash(const unsigned char *data, size_t data_len,
     goto cleanup;
   }
 
-  if (EVP_DigestFinal(digest_context, digest_value, digest_length) != 1) {
+  if (EVP_DigestFinal_ex(digest_context, digest_value, digest_length) != 1) {
     fprintf(stderr, "EVP_DigestFinal failed.\n");
     goto cleanup;
   }
@@ -152,8 +279,26 @@ int compute_hash(const unsigned char *data, size_t data_len,
 cleanup:
   if (ret != 1)
     ERR_print_errors_fp(stderr);
-  EVP_MD_CTX_free(digest_context);
-  EVP_MD_free(message_digest);
-  OSSL_LIB_CTX_free(library_context);
   return ret;
 }
+
+EVP_MD_CTX *create_hash_context(void) {
+  pthread_once(&sha3_512_once, fetch_sha3_512);
+  if (sha3_512 == NULL) {
+    fprintf(stderr, "EVP_MD_fetch could not find SHA3-512.\n");
+    return NULL;
+  }
+  EVP_MD_CTX *context = EVP_MD_CTX_new();
+  if (context == NULL) {
+    fprintf(stderr, "EVP_MD_CTX_new failed.\n");
+  }
+  return context;
+}
+
+bool hash_with_context(EVP_MD_CTX *context, const unsigned char *data,
+                       size_t data_len, unsigned char *hash) {
+  unsigned int hash_length;
+  return EVP_DigestInit_ex2(context, sha3_512, NULL) == 1 &&
+         EVP_DigestUpdate(context, data, data_len) == 1 &&
+         EVP_DigestFinal_ex(context, hash, &hash_length) == 1;
+}
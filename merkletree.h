@@ -2,7 +2,10 @@
 #define MERKLE_TREE_H
 
 #define HASH_SIZE 64
+#define MERKLE_MAX_DEPTH 64
 
+#include <openssl/evp.h>
+#include <stdbool.h>
 #include <stdio.h>
 
 typedef struct Node Node;
@@ -17,6 +20,16 @@ typedef struct {
   Node *root;
 } MerkleTree;
 
+// Inclusion proof of one leaf: the sibling hashes from the leaf up to the
+// root. Levels where the leaf's ancestor was promoted unpaired contribute
+// nothing, so the leaf's position and the leaf count fix the shape.
+typedef struct {
+  size_t leaf_index;
+  size_t num_leaves;
+  unsigned char path[MERKLE_MAX_DEPTH][HASH_SIZE];
+  size_t path_len;
+} MerkleProof;
+
 // -----------------------------------------------------------
 // Merkle Tree
 // -----------------------------------------------------------
@@ -30,11 +43,25 @@ void free_tree(MerkleTree *tree);
 Node *create_node(const unsigned char *hash);
 void free_node(Node *node);
 
+// -----------------------------------------------------------
+// Proofs
+// -----------------------------------------------------------
+// num_leaves must be the count the tree was built from.
+bool merkle_prove(const MerkleTree *tree, size_t num_leaves,
+                  size_t leaf_index, MerkleProof *proof);
+bool merkle_verify(const unsigned char *root, const unsigned char *leaf,
+                   const MerkleProof *proof);
+
 // -----------------------------------------------------------
 // Hash
 // -----------------------------------------------------------
 int compute_hash(const unsigned char *data, size_t data_len,
                  unsigned char *hash, unsigned int *hash_length);
+// For hot loops: one context reused across digests instead of one
+// allocated per compute_hash() call. Free with EVP_MD_CTX_free().
+EVP_MD_CTX *create_hash_context(void);
+bool hash_with_context(EVP_MD_CTX *context, const unsigned char *data,
+                       size_t data_len, unsigned char *hash);
 void combine_hashes(unsigned char *hash1, unsigned char *hash2,
                     unsigned char *combined_hash);
 
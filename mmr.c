@@ -0,0 +1,224 @@
+#include "mmr.h"
+#include "byteorder.h"
+#include <stdlib.h>
+#include <string.h>
+
+// -----------------------------------------------------------
+// MMR Implementation
+// -----------------------------------------------------------
+
+MMR *create_mmr(void) {
+  MMR *mmr = (MMR *)calloc(1, sizeof(MMR));
+  if (mmr == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for MMR\n");
+  }
+  return mmr;
+}
+
+void free_mmr(MMR *mmr) {
+  if (mmr == NULL)
+    return;
+  for (size_t h = 0; h < MMR_MAX_HEIGHT; h++) {
+    free(mmr->levels[h]);
+  }
+  free(mmr);
+}
+
+static inline unsigned char *node_at(const MMR *mmr, size_t height,
+                                     uint64_t index) {
+  return mmr->levels[height] + index * HASH_SIZE;
+}
+
+static bool push_node(MMR *mmr, size_t height, const unsigned char *hash) {
+  if (mmr->level_count[height] == mmr->level_capacity[height]) {
+    uint64_t capacity =
+        mmr->level_capacity[height] ? mmr->level_capacity[height] * 2 : 16;
+    unsigned char *grown =
+        (unsigned char *)realloc(mmr->levels[height], capacity * HASH_SIZE);
+    if (grown == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate memory for MMR level\n");
+      return false;
+    }
+    mmr->levels[height] = grown;
+    mmr->level_capacity[height] = capacity;
+  }
+  memcpy(node_at(mmr, height, mmr->level_count[height]), hash, HASH_SIZE);
+  mmr->level_count[height]++;
+  return true;
+}
+
+// Adds the leaf, then merges while the top of a level completes a pair:
+// one hash per trailing one bit of the old leaf count, O(log n) worst case.
+bool mmr_append(MMR *mmr, const unsigned char *leaf) {
+  if (!push_node(mmr, 0, leaf)) {
+    return false;
+  }
+  size_t height = 0;
+  while (height + 1 < MMR_MAX_HEIGHT && mmr->level_count[height] % 2 == 0) {
+    uint64_t right = mmr->level_count[height] - 1;
+    unsigned char parent[HASH_SIZE];
+    combine_hashes(node_at(mmr, height, right - 1), node_at(mmr, height, right),
+                   parent);
+    if (!push_node(mmr, height + 1, parent)) {
+      return false;
+    }
+    height++;
+  }
+  mmr->num_leaves++;
+  return true;
+}
+
+// Drops every leaf from num_leaves on. Level h of an n-leaf MMR holds
+// exactly n >> h nodes, so this is just a matter of shortening each level.
+void mmr_truncate(MMR *mmr, uint64_t num_leaves) {
+  if (num_leaves >= mmr->num_leaves) {
+    return;
+  }
+  for (size_t h = 0; h < MMR_MAX_HEIGHT; h++) {
+    mmr->level_count[h] = num_leaves >> h;
+  }
+  mmr->num_leaves = num_leaves;
+}
+
+// Peaks of the first num_leaves leaves, tallest (leftmost) first.
+static size_t collect_peaks(const MMR *mmr, uint64_t num_leaves,
+                            unsigned char peaks[][HASH_SIZE]) {
+  size_t num_peaks = 0;
+  uint64_t offset = 0;
+  for (size_t h = MMR_MAX_HEIGHT; h-- > 0;) {
+    if (num_leaves & (1ull << h)) {
+      memcpy(peaks[num_peaks++], node_at(mmr, h, offset >> h), HASH_SIZE);
+      offset += 1ull << h;
+    }
+  }
+  return num_peaks;
+}
+
+// The root binds the leaf count and the peaks, so MMRs of different sizes
+// never share a root.
+static bool bag_peaks(uint64_t num_leaves, unsigned char peaks[][HASH_SIZE],
+                      size_t num_peaks, unsigned char *root) {
+  unsigned char buffer[8 + MMR_MAX_HEIGHT * HASH_SIZE];
+  unsigned int root_length;
+  store_le64(buffer, num_leaves);
+  memcpy(buffer + 8, peaks, num_peaks * HASH_SIZE);
+  return compute_hash(buffer, 8 + num_peaks * HASH_SIZE, root, &root_length);
+}
+
+bool mmr_root(const MMR *mmr, uint64_t num_leaves, unsigned char *root) {
+  if (num_leaves > mmr->num_leaves) {
+    return false;
+  }
+  unsigned char peaks[MMR_MAX_HEIGHT][HASH_SIZE];
+  size_t num_peaks = collect_peaks(mmr, num_leaves, peaks);
+  return bag_peaks(num_leaves, peaks, num_peaks, root);
+}
+
+bool mmr_get_peaks(const MMR *mmr, uint64_t num_leaves, MMRPeaks *peaks) {
+  if (num_leaves > mmr->num_leaves) {
+    return false;
+  }
+  peaks->num_peaks = collect_peaks(mmr, num_leaves, peaks->peaks);
+  peaks->num_leaves = num_leaves;
+  return true;
+}
+
+// Same merges as mmr_append(): one per trailing one bit of the old count,
+// each folding the two shortest peaks.
+void mmr_peaks_append(MMRPeaks *peaks, const unsigned char *leaf) {
+  memcpy(peaks->peaks[peaks->num_peaks++], leaf, HASH_SIZE);
+  for (uint64_t count = peaks->num_leaves; count & 1; count >>= 1) {
+    unsigned char parent[HASH_SIZE];
+    combine_hashes(peaks->peaks[peaks->num_peaks - 2],
+                   peaks->peaks[peaks->num_peaks - 1], parent);
+    memcpy(peaks->peaks[peaks->num_peaks - 2], parent, HASH_SIZE);
+    peaks->num_peaks--;
+  }
+  peaks->num_leaves++;
+}
+
+bool mmr_peaks_root(const MMRPeaks *peaks, unsigned char *root) {
+  return bag_peaks(peaks->num_leaves,
+                   (unsigned char(*)[HASH_SIZE])peaks->peaks,
+                   peaks->num_peaks, root);
+}
+
+bool mmr_prove(const MMR *mmr, uint64_t leaf_index, uint64_t num_leaves,
+               MMRProof *proof) {
+  if (num_leaves > mmr->num_leaves || leaf_index >= num_leaves) {
+    return false;
+  }
+  proof->leaf_index = leaf_index;
+  proof->num_leaves = num_leaves;
+  proof->num_peaks = collect_peaks(mmr, num_leaves, proof->peaks);
+
+  // Find the perfect tree that holds the leaf; every node below its peak
+  // exists regardless of later appends.
+  uint64_t offset = 0;
+  size_t peak_height = 0;
+  for (size_t h = MMR_MAX_HEIGHT; h-- > 0;) {
+    if (num_leaves & (1ull << h)) {
+      if (leaf_index < offset + (1ull << h)) {
+        peak_height = h;
+        break;
+      }
+      offset += 1ull << h;
+    }
+  }
+
+  proof->path_len = 0;
+  for (size_t h = 0; h < peak_height; h++) {
+    uint64_t sibling = (leaf_index >> h) ^ 1;
+    memcpy(proof->path[proof->path_len++], node_at(mmr, h, sibling),
+           HASH_SIZE);
+  }
+  return true;
+}
+
+bool mmr_verify(const unsigned char *root, const unsigned char *leaf,
+                const MMRProof *proof) {
+  if (proof->leaf_index >= proof->num_leaves ||
+      proof->num_peaks != (size_t)__builtin_popcountll(proof->num_leaves) ||
+      proof->num_peaks > MMR_MAX_HEIGHT) {
+    return false;
+  }
+
+  // Locate the peak the path must lead to.
+  uint64_t offset = 0;
+  size_t peak = 0, peak_height = 0;
+  for (size_t h = MMR_MAX_HEIGHT; h-- > 0;) {
+    if (proof->num_leaves & (1ull << h)) {
+      if (proof->leaf_index < offset + (1ull << h)) {
+        peak_height = h;
+        break;
+      }
+      offset += 1ull << h;
+      peak++;
+    }
+  }
+  if (proof->path_len != peak_height) {
+    return false;
+  }
+
+  unsigned char node[HASH_SIZE];
+  memcpy(node, leaf, HASH_SIZE);
+  for (size_t h = 0; h < proof->path_len; h++) {
+    unsigned char parent[HASH_SIZE];
+    if ((proof->leaf_index >> h) & 1) {
+      combine_hashes((unsigned char *)proof->path[h], node, parent);
+    } else {
+      combine_hashes(node, (unsigned char *)proof->path[h], parent);
+    }
+    memcpy(node, parent, HASH_SIZE);
+  }
+  if (memcmp(node, proof->peaks[peak], HASH_SIZE) != 0) {
+    return false;
+  }
+
+  unsigned char expected[HASH_SIZE];
+  if (!bag_peaks(proof->num_leaves, (unsigned char(*)[HASH_SIZE])proof->peaks,
+                 proof->num_peaks, expected)) {
+    return false;
+  }
+  return memcmp(expected, root, HASH_SIZE) == 0;
+}
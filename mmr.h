@@ -0,0 +1,65 @@
+#ifndef MMR_H
+#define MMR_H
+
+#include "merkletree.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MMR_MAX_HEIGHT 64
+
+// Merkle Mountain Range: an append-only list of perfect Merkle trees whose
+// sizes follow the binary digits of the leaf count. levels[h] holds every
+// node at height h in order, so node j at height h covers leaves
+// [j * 2^h, (j + 1) * 2^h).
+typedef struct {
+  unsigned char *levels[MMR_MAX_HEIGHT];
+  uint64_t level_count[MMR_MAX_HEIGHT];
+  uint64_t level_capacity[MMR_MAX_HEIGHT];
+  uint64_t num_leaves;
+} MMR;
+
+// Inclusion proof of one leaf against the root of the first num_leaves
+// leaves: the sibling path up to the leaf's peak, plus every peak.
+typedef struct {
+  uint64_t leaf_index;
+  uint64_t num_leaves;
+  unsigned char path[MMR_MAX_HEIGHT][HASH_SIZE];
+  size_t path_len;
+  unsigned char peaks[MMR_MAX_HEIGHT][HASH_SIZE];
+  size_t num_peaks;
+} MMRProof;
+
+// Just the peaks of an MMR, enough to extend it and take its root: a
+// branch of the chain can grow its own MMR from a prefix of the shared one
+// without copying or rewinding it.
+typedef struct {
+  unsigned char peaks[MMR_MAX_HEIGHT][HASH_SIZE]; // tallest first
+  size_t num_peaks;
+  uint64_t num_leaves;
+} MMRPeaks;
+
+// -----------------------------------------------------------
+// Merkle Mountain Range
+// -----------------------------------------------------------
+MMR *create_mmr(void);
+void free_mmr(MMR *mmr);
+bool mmr_append(MMR *mmr, const unsigned char *leaf);
+void mmr_truncate(MMR *mmr, uint64_t num_leaves);
+bool mmr_root(const MMR *mmr, uint64_t num_leaves, unsigned char *root);
+// Peaks of the first num_leaves leaves; extending them with the same leaves
+// as the MMR gives the same roots.
+bool mmr_get_peaks(const MMR *mmr, uint64_t num_leaves, MMRPeaks *peaks);
+void mmr_peaks_append(MMRPeaks *peaks, const unsigned char *leaf);
+bool mmr_peaks_root(const MMRPeaks *peaks, unsigned char *root);
+
+// -----------------------------------------------------------
+// Proofs
+// -----------------------------------------------------------
+// num_leaves may be any size the MMR has had, so a proof can target the
+// root committed in an older header.
+bool mmr_prove(const MMR *mmr, uint64_t leaf_index, uint64_t num_leaves,
+               MMRProof *proof);
+bool mmr_verify(const unsigned char *root, const unsigned char *leaf,
+                const MMRProof *proof);
+
+#endif // MMR_H
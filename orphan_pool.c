@@ -0,0 +1,193 @@
+#include "orphan_pool.h"
+#include "byteorder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// -----------------------------------------------------------
+// Helpers
+// -----------------------------------------------------------
+
+static size_t count_nodes(const Node *node) {
+  if (node == NULL) {
+    return 0;
+  }
+  return 1 + count_nodes(node->left) + count_nodes(node->right);
+}
+
+// Approximate heap footprint of a block and everything it owns.
+static size_t block_bytes(const Block *block) {
+  size_t bytes = sizeof(Block);
+  if (block->merkletree != NULL) {
+    bytes += sizeof(MerkleTree) +
+             count_nodes(block->merkletree->root) * sizeof(Node);
+  }
+  for (size_t i = 0; i < block->num_transactions; i++) {
+    bytes += sizeof(Transaction) + block->transactions[i].payload_len;
+  }
+  return bytes;
+}
+
+static inline Orphan **bucket_for(OrphanPool *pool,
+                                  const unsigned char *prev_block_hash) {
+  return &pool->buckets[load_le64(prev_block_hash) & (pool->num_buckets - 1)];
+}
+
+// Unlinks an orphan from its bucket and the arrival list and returns its
+// block.
+static Block *unlink_orphan(OrphanPool *pool, Orphan *orphan) {
+  Orphan **link = bucket_for(pool, orphan->block->prev_block_hash);
+  while (*link != orphan) {
+    link = &(*link)->next_in_bucket;
+  }
+  *link = orphan->next_in_bucket;
+
+  if (orphan->older != NULL) {
+    orphan->older->newer = orphan->newer;
+  } else {
+    pool->oldest = orphan->newer;
+  }
+  if (orphan->newer != NULL) {
+    orphan->newer->older = orphan->older;
+  } else {
+    pool->newest = orphan->older;
+  }
+
+  pool->stats.orphans--;
+  pool->stats.bytes -= orphan->bytes;
+  Block *block = orphan->block;
+  free(orphan);
+  return block;
+}
+
+// -----------------------------------------------------------
+// OrphanPool Implementation
+// -----------------------------------------------------------
+
+OrphanPool *create_orphan_pool(const OrphanPoolConfig *config) {
+  OrphanPool *pool = (OrphanPool *)calloc(1, sizeof(OrphanPool));
+  if (pool == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for orphan pool\n");
+    return NULL;
+  }
+  if (config != NULL) {
+    pool->config = *config;
+  }
+  if (pool->config.max_orphans == 0) {
+    pool->config.max_orphans = DEFAULT_MAX_ORPHANS;
+  }
+  if (pool->config.max_bytes == 0) {
+    pool->config.max_bytes = DEFAULT_MAX_ORPHAN_BYTES;
+  }
+  if (pool->config.expiry == 0) {
+    pool->config.expiry = DEFAULT_ORPHAN_EXPIRY;
+  }
+
+  pool->num_buckets = 16;
+  while (pool->num_buckets < pool->config.max_orphans) {
+    pool->num_buckets <<= 1;
+  }
+  pool->buckets = (Orphan **)calloc(pool->num_buckets, sizeof(Orphan *));
+  if (pool->buckets == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for orphan index\n");
+    free(pool);
+    return NULL;
+  }
+  return pool;
+}
+
+void destroy_orphan_pool(OrphanPool *pool) {
+  if (pool == NULL)
+    return;
+  while (pool->oldest != NULL) {
+    free_block(unlink_orphan(pool, pool->oldest));
+  }
+  free(pool->buckets);
+  free(pool);
+}
+
+bool orphan_pool_add(OrphanPool *pool, Block *block, time_t now) {
+  orphan_pool_expire(pool, now);
+
+  size_t bytes = block_bytes(block);
+  if (bytes > pool->config.max_bytes) {
+    fprintf(stderr, "ERROR: Orphan block exceeds the pool's memory limit\n");
+    free_block(block);
+    return false;
+  }
+
+  unsigned char hash[HASH_SIZE];
+  unsigned int hash_size;
+  calculate_block_hash(block, hash, &hash_size);
+  Orphan **bucket = bucket_for(pool, block->prev_block_hash);
+  for (Orphan *curr = *bucket; curr != NULL; curr = curr->next_in_bucket) {
+    if (memcmp(curr->hash, hash, HASH_SIZE) == 0) {
+      pool->stats.duplicates++;
+      free_block(block);
+      return false;
+    }
+  }
+
+  Orphan *orphan = (Orphan *)malloc(sizeof(Orphan));
+  if (orphan == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for orphan\n");
+    free_block(block);
+    return false;
+  }
+
+  while (pool->stats.orphans >= pool->config.max_orphans ||
+         pool->stats.bytes + bytes > pool->config.max_bytes) {
+    free_block(unlink_orphan(pool, pool->oldest));
+    pool->stats.evicted++;
+  }
+
+  orphan->block = block;
+  memcpy(orphan->hash, hash, HASH_SIZE);
+  orphan->bytes = bytes;
+  orphan->received = now;
+  orphan->next_in_bucket = *bucket;
+  *bucket = orphan;
+  orphan->older = pool->newest;
+  orphan->newer = NULL;
+  if (pool->newest != NULL) {
+    pool->newest->newer = orphan;
+  } else {
+    pool->oldest = orphan;
+  }
+  pool->newest = orphan;
+
+  pool->stats.orphans++;
+  pool->stats.bytes += bytes;
+  pool->stats.added++;
+  return true;
+}
+
+Block *orphan_pool_take_child(OrphanPool *pool,
+                              const unsigned char *prev_block_hash) {
+  for (Orphan *curr = *bucket_for(pool, prev_block_hash); curr != NULL;
+       curr = curr->next_in_bucket) {
+    if (memcmp(curr->block->prev_block_hash, prev_block_hash, HASH_SIZE) ==
+        0) {
+      pool->stats.connected++;
+      return unlink_orphan(pool, curr);
+    }
+  }
+  return NULL;
+}
+
+// Drops orphans older than the expiry; the arrival list is in receive
+// order, so this stops at the first one still fresh.
+size_t orphan_pool_expire(OrphanPool *pool, time_t now) {
+  size_t expired = 0;
+  while (pool->oldest != NULL &&
+         now - pool->oldest->received >= pool->config.expiry) {
+    free_block(unlink_orphan(pool, pool->oldest));
+    expired++;
+  }
+  pool->stats.expired += expired;
+  return expired;
+}
+
+void orphan_pool_get_stats(const OrphanPool *pool, OrphanPoolStats *stats) {
+  *stats = pool->stats;
+}
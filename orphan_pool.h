@@ -0,0 +1,71 @@
+#ifndef ORPHAN_POOL_H
+#define ORPHAN_POOL_H
+
+#include "blockchain.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define DEFAULT_MAX_ORPHANS 1024
+#define DEFAULT_MAX_ORPHAN_BYTES (64u << 20)
+#define DEFAULT_ORPHAN_EXPIRY 1200 // seconds
+
+typedef struct Orphan Orphan;
+
+struct Orphan {
+  Block *block;
+  unsigned char hash[HASH_SIZE]; // the block's own hash
+  size_t bytes;
+  time_t received;
+  Orphan *next_in_bucket;
+  Orphan *older; // arrival order, for expiry and eviction
+  Orphan *newer;
+};
+
+// Zero fields take the defaults above.
+typedef struct {
+  size_t max_orphans;
+  size_t max_bytes;
+  time_t expiry;
+} OrphanPoolConfig;
+
+typedef struct {
+  size_t orphans;
+  size_t bytes;
+  uint64_t added;
+  uint64_t connected;
+  uint64_t duplicates;
+  uint64_t evicted; // dropped, oldest first, to stay within the limits
+  uint64_t expired;
+} OrphanPoolStats;
+
+// Blocks whose parent has not arrived yet, indexed by prev_block_hash.
+// Buckets chain the orphans that hash together; a second list keeps them
+// in arrival order so the oldest is the one expired or evicted.
+typedef struct {
+  Orphan **buckets;
+  size_t num_buckets; // power of two
+  Orphan *oldest;
+  Orphan *newest;
+  OrphanPoolConfig config;
+  OrphanPoolStats stats;
+} OrphanPool;
+
+// -----------------------------------------------------------
+// Orphan pool
+// -----------------------------------------------------------
+OrphanPool *create_orphan_pool(const OrphanPoolConfig *config);
+// Frees every block still held.
+void destroy_orphan_pool(OrphanPool *pool);
+// Takes ownership of the block, which must be detached. Returns false, and
+// frees the block, if it is already held or larger than the whole pool.
+bool orphan_pool_add(OrphanPool *pool, Block *block, time_t now);
+// Removes and returns one orphan whose parent hashes to prev_block_hash,
+// or NULL once there are none left.
+Block *orphan_pool_take_child(OrphanPool *pool,
+                              const unsigned char *prev_block_hash);
+size_t orphan_pool_expire(OrphanPool *pool, time_t now);
+void orphan_pool_get_stats(const OrphanPool *pool, OrphanPoolStats *stats);
+
+#endif // ORPHAN_POOL_H
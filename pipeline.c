@@ -0,0 +1,324 @@
+#include "pipeline.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  char **transaction_data; // pointers into storage, or the same allocation
+  void *storage;           // owned bytes behind transaction_data, or NULL
+  size_t num_transactions;
+  unsigned char **transaction_hashes;
+  MerkleTree *merkletree;
+  Block *block;
+  uint64_t submitted_ns;
+} PipelineJob;
+
+typedef struct {
+  Pipeline *pipeline;
+  PipelineStage stage;
+} StageWorker;
+
+static const char *stage_names[STAGE_COUNT] = {
+    "ingest", "leaf_hash", "tree_build", "seal", "persist"};
+
+// -----------------------------------------------------------
+// Pipeline Implementation
+// -----------------------------------------------------------
+
+static void record_stage(Pipeline *pipeline, PipelineStage stage,
+                         uint64_t started_ns) {
+  uint64_t elapsed = monotonic_ns() - started_ns;
+  pthread_mutex_lock(&pipeline->stats_lock);
+  StageStats *stats = &pipeline->stats.stages[stage];
+  stats->processed++;
+  stats->total_latency_ns += elapsed;
+  if (elapsed > stats->max_latency_ns) {
+    stats->max_latency_ns = elapsed;
+  }
+  pthread_mutex_unlock(&pipeline->stats_lock);
+}
+
+static void free_job(PipelineJob *job) {
+  free_transaction_hashes(job->transaction_hashes, job->num_transactions);
+  free_tree(job->merkletree);
+  free(job->transaction_data);
+  free(job->storage);
+  free(job);
+}
+
+static void complete_job(Pipeline *pipeline, PipelineJob *job) {
+  uint64_t latency = monotonic_ns() - job->submitted_ns;
+  pthread_mutex_lock(&pipeline->stats_lock);
+  pipeline->stats.blocks++;
+  pipeline->stats.total_block_latency_ns += latency;
+  if (latency > pipeline->stats.max_block_latency_ns) {
+    pipeline->stats.max_block_latency_ns = latency;
+  }
+  pthread_mutex_unlock(&pipeline->stats_lock);
+
+  // The tree now belongs to the block.
+  if (job->block != NULL) {
+    job->merkletree = NULL;
+  }
+  free_job(job);
+
+  pthread_mutex_lock(&pipeline->flush_lock);
+  pipeline->completed++;
+  pthread_cond_broadcast(&pipeline->flushed);
+  pthread_mutex_unlock(&pipeline->flush_lock);
+}
+
+// Runs one stage's work on a job. Returns false if the job failed and must
+// skip the remaining stages.
+static bool run_stage(Pipeline *pipeline, PipelineStage stage,
+                      PipelineJob *job) {
+  switch (stage) {
+  case STAGE_LEAF_HASH:
+    job->transaction_hashes =
+        hash_transactions(job->transaction_data, job->num_transactions);
+    return job->transaction_hashes != NULL;
+  case STAGE_TREE_BUILD:
+    job->merkletree =
+        create_tree(job->transaction_hashes, job->num_transactions);
+    free_transaction_hashes(job->transaction_hashes, job->num_transactions);
+    job->transaction_hashes = NULL;
+    return job->merkletree != NULL;
+  case STAGE_SEAL:
+    job->block = append_block(pipeline->blockchain, job->merkletree);
+    return job->block != NULL;
+  case STAGE_PERSIST:
+    if (pipeline->config.persist != NULL) {
+      pipeline->config.persist(job->block, pipeline->config.persist_ctx);
+    }
+    return true;
+  default:
+    return false;
+  }
+}
+
+static void *stage_worker(void *arg) {
+  StageWorker *worker = (StageWorker *)arg;
+  Pipeline *pipeline = worker->pipeline;
+  PipelineStage stage = worker->stage;
+  free(worker);
+
+  PipelineJob *job;
+  while ((job = (PipelineJob *)queue_pop(&pipeline->queues[stage])) != NULL) {
+    uint64_t started = monotonic_ns();
+    bool ok = run_stage(pipeline, stage, job);
+    record_stage(pipeline, stage, started);
+
+    if (!ok) {
+      fprintf(stderr, "ERROR: Pipeline stage %s failed, dropping block\n",
+              stage_names[stage]);
+      complete_job(pipeline, job);
+    } else if (stage + 1 < STAGE_COUNT) {
+      queue_push(&pipeline->queues[stage + 1], job);
+    } else {
+      complete_job(pipeline, job);
+    }
+  }
+
+  // Propagate shutdown once this stage has drained.
+  if (stage + 1 < STAGE_COUNT) {
+    queue_close(&pipeline->queues[stage + 1]);
+  }
+  return NULL;
+}
+
+Pipeline *create_pipeline(Blockchain *blockchain,
+                          const PipelineConfig *config) {
+  Pipeline *pipeline = (Pipeline *)calloc(1, sizeof(Pipeline));
+  if (pipeline == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for pipeline\n");
+    return NULL;
+  }
+  pipeline->blockchain = blockchain;
+  if (config != NULL) {
+    pipeline->config = *config;
+  }
+  if (pipeline->config.queue_capacity == 0) {
+    pipeline->config.queue_capacity = 4;
+  }
+
+  for (int s = STAGE_LEAF_HASH; s < STAGE_COUNT; s++) {
+    if (!queue_init(&pipeline->queues[s], pipeline->config.queue_capacity)) {
+      for (int j = STAGE_LEAF_HASH; j < s; j++) {
+        queue_destroy(&pipeline->queues[j]);
+      }
+      free(pipeline);
+      return NULL;
+    }
+  }
+  pthread_mutex_init(&pipeline->stats_lock, NULL);
+  pthread_mutex_init(&pipeline->flush_lock, NULL);
+  pthread_cond_init(&pipeline->flushed, NULL);
+
+  for (int s = STAGE_LEAF_HASH; s < STAGE_COUNT; s++) {
+    StageWorker *worker = (StageWorker *)malloc(sizeof(StageWorker));
+    if (worker != NULL) {
+      worker->pipeline = pipeline;
+      worker->stage = (PipelineStage)s;
+    }
+    if (worker == NULL ||
+        pthread_create(&pipeline->workers[s], NULL, stage_worker, worker) !=
+            0) {
+      fprintf(stderr, "ERROR: Failed to start pipeline stage %s\n",
+              stage_names[s]);
+      free(worker);
+      queue_close(&pipeline->queues[STAGE_LEAF_HASH]);
+      for (int j = STAGE_LEAF_HASH; j < s; j++) {
+        pthread_join(pipeline->workers[j], NULL);
+      }
+      for (int j = STAGE_LEAF_HASH; j < STAGE_COUNT; j++) {
+        queue_destroy(&pipeline->queues[j]);
+      }
+      free(pipeline);
+      return NULL;
+    }
+  }
+
+  return pipeline;
+}
+
+void destroy_pipeline(Pipeline *pipeline) {
+  if (pipeline == NULL)
+    return;
+
+  // Closing the first queue drains every stage in order.
+  queue_close(&pipeline->queues[STAGE_LEAF_HASH]);
+  for (int s = STAGE_LEAF_HASH; s < STAGE_COUNT; s++) {
+    pthread_join(pipeline->workers[s], NULL);
+  }
+  for (int s = STAGE_LEAF_HASH; s < STAGE_COUNT; s++) {
+    queue_destroy(&pipeline->queues[s]);
+  }
+  pthread_mutex_destroy(&pipeline->stats_lock);
+  pthread_mutex_destroy(&pipeline->flush_lock);
+  pthread_cond_destroy(&pipeline->flushed);
+  free(pipeline);
+}
+
+// Ingest stage: copies the transactions into a single allocation so the
+// caller may reuse its buffers as soon as this returns. Blocks when the leaf
+// hash queue is full.
+bool pipeline_submit(Pipeline *pipeline, char **transaction_data,
+                     size_t num_transactions) {
+  if (pipeline == NULL || transaction_data == NULL || num_transactions == 0) {
+    fprintf(stderr, "Transaction data is invalid\n");
+    return false;
+  }
+  uint64_t started = monotonic_ns();
+
+  size_t payload_size = 0;
+  for (size_t i = 0; i < num_transactions; i++) {
+    payload_size += strlen(transaction_data[i]) + 1;
+  }
+
+  PipelineJob *job = (PipelineJob *)calloc(1, sizeof(PipelineJob));
+  char **copy =
+      (char **)malloc(sizeof(char *) * num_transactions + payload_size);
+  if (job == NULL || copy == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for pipeline job\n");
+    free(job);
+    free(copy);
+    return false;
+  }
+
+  char *cursor = (char *)(copy + num_transactions);
+  for (size_t i = 0; i < num_transactions; i++) {
+    size_t len = strlen(transaction_data[i]) + 1;
+    memcpy(cursor, transaction_data[i], len);
+    copy[i] = cursor;
+    cursor += len;
+  }
+  job->transaction_data = copy;
+  job->num_transactions = num_transactions;
+  job->submitted_ns = started;
+
+  pthread_mutex_lock(&pipeline->flush_lock);
+  pipeline->submitted++;
+  pthread_mutex_unlock(&pipeline->flush_lock);
+
+  record_stage(pipeline, STAGE_INGEST, started);
+  if (!queue_push(&pipeline->queues[STAGE_LEAF_HASH], job)) {
+    complete_job(pipeline, job);
+    return false;
+  }
+  return true;
+}
+
+bool pipeline_submit_owned(Pipeline *pipeline, char **transaction_data,
+                           size_t num_transactions, void *storage) {
+  if (pipeline == NULL || transaction_data == NULL || num_transactions == 0) {
+    fprintf(stderr, "Transaction data is invalid\n");
+    free(transaction_data);
+    free(storage);
+    return false;
+  }
+  uint64_t started = monotonic_ns();
+  PipelineJob *job = (PipelineJob *)calloc(1, sizeof(PipelineJob));
+  if (job == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for pipeline job\n");
+    free(transaction_data);
+    free(storage);
+    return false;
+  }
+  job->transaction_data = transaction_data;
+  job->storage = storage;
+  job->num_transactions = num_transactions;
+  job->submitted_ns = started;
+
+  pthread_mutex_lock(&pipeline->flush_lock);
+  pipeline->submitted++;
+  pthread_mutex_unlock(&pipeline->flush_lock);
+
+  record_stage(pipeline, STAGE_INGEST, started);
+  if (!queue_push(&pipeline->queues[STAGE_LEAF_HASH], job)) {
+    complete_job(pipeline, job);
+    return false;
+  }
+  return true;
+}
+
+// Waits until every submitted block has left the persist stage.
+void pipeline_flush(Pipeline *pipeline) {
+  pthread_mutex_lock(&pipeline->flush_lock);
+  while (pipeline->completed < pipeline->submitted) {
+    pthread_cond_wait(&pipeline->flushed, &pipeline->flush_lock);
+  }
+  pthread_mutex_unlock(&pipeline->flush_lock);
+}
+
+void pipeline_get_stats(Pipeline *pipeline, PipelineStats *stats) {
+  pthread_mutex_lock(&pipeline->stats_lock);
+  *stats = pipeline->stats;
+  pthread_mutex_unlock(&pipeline->stats_lock);
+
+  for (int s = STAGE_LEAF_HASH; s < STAGE_COUNT; s++) {
+    stats->stages[s].queue_depth = queue_depth(&pipeline->queues[s]);
+    stats->stages[s].queue_capacity = pipeline->queues[s].capacity;
+  }
+}
+
+void print_pipeline_stats(const PipelineStats *stats) {
+  printf("%-10s %8s %10s %12s %12s\n", "stage", "depth", "processed",
+         "avg_us", "max_us");
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    const StageStats *stage = &stats->stages[s];
+    double avg = stage->processed
+                     ? stage->total_latency_ns / 1e3 / stage->processed
+                     : 0.0;
+    printf("%-10s %4zu/%-3zu %10llu %12.1f %12.1f\n", stage_names[s],
+           stage->queue_depth, stage->queue_capacity,
+           (unsigned long long)stage->processed, avg,
+           stage->max_latency_ns / 1e3);
+  }
+  double avg_block =
+      stats->blocks ? stats->total_block_latency_ns / 1e3 / stats->blocks
+                    : 0.0;
+  printf("blocks: %llu, avg latency %.1f us, max latency %.1f us\n",
+         (unsigned long long)stats->blocks, avg_block,
+         stats->max_block_latency_ns / 1e3);
+}
@@ -0,0 +1,83 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "blockchain.h"
+#include "queue.h"
+#include <pthread.h>
+#include <stdint.h>
+
+// Block production split into stages, each on its own thread, with bounded
+// queues in between so block N+1's leaves are hashed while block N's tree is
+// built and block N-1 is persisted. The ingest stage runs on the submitting
+// thread.
+typedef enum {
+  STAGE_INGEST,
+  STAGE_LEAF_HASH,
+  STAGE_TREE_BUILD,
+  STAGE_SEAL,
+  STAGE_PERSIST,
+  STAGE_COUNT
+} PipelineStage;
+
+typedef struct {
+  size_t queue_depth;    // jobs waiting in front of the stage
+  size_t queue_capacity; // 0 for the ingest stage, which has no input queue
+  uint64_t processed;
+  uint64_t total_latency_ns; // time spent doing the stage's work
+  uint64_t max_latency_ns;
+} StageStats;
+
+typedef struct {
+  StageStats stages[STAGE_COUNT];
+  uint64_t blocks;
+  uint64_t total_block_latency_ns; // submit to persisted, per block
+  uint64_t max_block_latency_ns;
+} PipelineStats;
+
+// Called from the persist thread once a block is linked into the chain. The
+// seal thread may be appending the next block meanwhile, so the callback
+// must not follow block->next_block.
+typedef void (*PersistFn)(Block *block, void *ctx);
+
+typedef struct {
+  size_t queue_capacity;
+  PersistFn persist;
+  void *persist_ctx;
+} PipelineConfig;
+
+typedef struct {
+  Blockchain *blockchain;
+  PipelineConfig config;
+  BoundedQueue queues[STAGE_COUNT]; // queues[s] feeds stage s
+  pthread_t workers[STAGE_COUNT];
+  pthread_mutex_t stats_lock;
+  PipelineStats stats;
+  pthread_mutex_t flush_lock;
+  pthread_cond_t flushed;
+  uint64_t submitted;
+  uint64_t completed;
+} Pipeline;
+
+// -----------------------------------------------------------
+// Pipeline management
+// -----------------------------------------------------------
+// The pipeline owns the blockchain's tail until destroy_pipeline() returns;
+// callers must pipeline_flush() before reading the chain.
+Pipeline *create_pipeline(Blockchain *blockchain, const PipelineConfig *config);
+void destroy_pipeline(Pipeline *pipeline);
+
+// -----------------------------------------------------------
+// Pipeline interaction
+// -----------------------------------------------------------
+bool pipeline_submit(Pipeline *pipeline, char **transaction_data,
+                     size_t num_transactions);
+// Zero-copy variant: takes ownership of the malloc'd pointer array and of
+// storage, the malloc'd buffer the strings live in, and frees both once
+// the block is persisted, or right away on failure.
+bool pipeline_submit_owned(Pipeline *pipeline, char **transaction_data,
+                           size_t num_transactions, void *storage);
+void pipeline_flush(Pipeline *pipeline);
+void pipeline_get_stats(Pipeline *pipeline, PipelineStats *stats);
+void print_pipeline_stats(const PipelineStats *stats);
+
+#endif // PIPELINE_H
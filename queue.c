@@ -0,0 +1,84 @@
+#include "queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// -----------------------------------------------------------
+// BoundedQueue Implementation
+// -----------------------------------------------------------
+
+bool queue_init(BoundedQueue *queue, size_t capacity) {
+  if (capacity == 0) {
+    capacity = 1;
+  }
+  queue->items = (void **)malloc(sizeof(void *) * capacity);
+  if (queue->items == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for queue\n");
+    return false;
+  }
+  queue->capacity = capacity;
+  queue->head = 0;
+  queue->count = 0;
+  queue->closed = false;
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->not_empty, NULL);
+  pthread_cond_init(&queue->not_full, NULL);
+  return true;
+}
+
+void queue_destroy(BoundedQueue *queue) {
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_cond_destroy(&queue->not_full);
+  free(queue->items);
+  queue->items = NULL;
+}
+
+// Blocks while the queue is full. Returns false once the queue is closed.
+bool queue_push(BoundedQueue *queue, void *item) {
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count == queue->capacity && !queue->closed) {
+    pthread_cond_wait(&queue->not_full, &queue->lock);
+  }
+  if (queue->closed) {
+    pthread_mutex_unlock(&queue->lock);
+    return false;
+  }
+  queue->items[(queue->head + queue->count) % queue->capacity] = item;
+  queue->count++;
+  pthread_cond_signal(&queue->not_empty);
+  pthread_mutex_unlock(&queue->lock);
+  return true;
+}
+
+// Blocks while the queue is empty. Returns NULL once the queue is closed and
+// drained, which is the signal for a consumer to exit.
+void *queue_pop(BoundedQueue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count == 0 && !queue->closed) {
+    pthread_cond_wait(&queue->not_empty, &queue->lock);
+  }
+  void *item = NULL;
+  if (queue->count > 0) {
+    item = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return item;
+}
+
+void queue_close(BoundedQueue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  queue->closed = true;
+  pthread_cond_broadcast(&queue->not_empty);
+  pthread_cond_broadcast(&queue->not_full);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+size_t queue_depth(BoundedQueue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  size_t depth = queue->count;
+  pthread_mutex_unlock(&queue->lock);
+  return depth;
+}
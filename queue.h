@@ -0,0 +1,30 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Bounded blocking FIFO of opaque pointers shared between worker threads.
+typedef struct {
+  void **items;
+  size_t capacity;
+  size_t head;
+  size_t count;
+  bool closed;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+} BoundedQueue;
+
+// -----------------------------------------------------------
+// Bounded queue
+// -----------------------------------------------------------
+bool queue_init(BoundedQueue *queue, size_t capacity);
+void queue_destroy(BoundedQueue *queue);
+bool queue_push(BoundedQueue *queue, void *item);
+void *queue_pop(BoundedQueue *queue);
+void queue_close(BoundedQueue *queue);
+size_t queue_depth(BoundedQueue *queue);
+
+#endif // QUEUE_H
@@ -0,0 +1,199 @@
+#include "rcu.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// -----------------------------------------------------------
+// RCU Implementation
+// -----------------------------------------------------------
+
+RcuDomain *create_rcu_domain(void) {
+  RcuDomain *domain = (RcuDomain *)aligned_alloc(
+      RCU_CACHE_LINE,
+      (sizeof(RcuDomain) + RCU_CACHE_LINE - 1) / RCU_CACHE_LINE *
+          RCU_CACHE_LINE);
+  if (domain == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for RCU domain\n");
+    return NULL;
+  }
+  for (size_t i = 0; i < RCU_MAX_READERS; i++) {
+    atomic_init(&domain->readers[i].period, 0);
+    atomic_init(&domain->readers[i].in_use, false);
+    domain->readers[i].domain = domain;
+  }
+  atomic_init(&domain->period, 1);
+  atomic_init(&domain->synchronizations, 0);
+  pthread_mutex_init(&domain->sync_lock, NULL);
+  pthread_mutex_init(&domain->retire_lock, NULL);
+  domain->retired = NULL;
+  domain->num_retired = 0;
+  domain->retired_capacity = 0;
+  domain->retires_since_reclaim = 0;
+  memset(&domain->stats, 0, sizeof(RcuStats));
+  return domain;
+}
+
+void destroy_rcu_domain(RcuDomain *domain) {
+  if (domain == NULL)
+    return;
+  for (size_t i = 0; i < domain->num_retired; i++) {
+    domain->retired[i].free_fn(domain->retired[i].object);
+  }
+  free(domain->retired);
+  pthread_mutex_destroy(&domain->sync_lock);
+  pthread_mutex_destroy(&domain->retire_lock);
+  free(domain);
+}
+
+RcuReader *rcu_register_reader(RcuDomain *domain) {
+  for (size_t i = 0; i < RCU_MAX_READERS; i++) {
+    bool expected = false;
+    if (atomic_compare_exchange_strong(&domain->readers[i].in_use, &expected,
+                                       true)) {
+      return &domain->readers[i];
+    }
+  }
+  fprintf(stderr, "ERROR: No free RCU reader slots\n");
+  return NULL;
+}
+
+void rcu_unregister_reader(RcuReader *reader) {
+  if (reader == NULL)
+    return;
+  atomic_store_explicit(&reader->period, 0, memory_order_release);
+  atomic_store_explicit(&reader->in_use, false, memory_order_release);
+}
+
+// The fence orders the slot store before every load in the section. Paired
+// with the one in rcu_synchronize(), either the writer sees this slot or the
+// reader sees everything unpublished before the synchronize began. The
+// store releases the previous section, for a writer that only ever sees
+// this one.
+void rcu_read_lock(RcuReader *reader) {
+  uint64_t period = atomic_load_explicit(&reader->domain->period,
+                                         memory_order_relaxed);
+  atomic_store_explicit(&reader->period, period, memory_order_release);
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+void rcu_read_unlock(RcuReader *reader) {
+  atomic_store_explicit(&reader->period, 0, memory_order_release);
+}
+
+// Starts a new grace period, then waits out every reader that entered its
+// section in an earlier one. Readers entering afterwards cannot reach what
+// the writer unpublished, so they are not waited for.
+void rcu_synchronize(RcuDomain *domain) {
+  pthread_mutex_lock(&domain->sync_lock);
+  uint64_t target = atomic_fetch_add(&domain->period, 1) + 1;
+  atomic_thread_fence(memory_order_seq_cst);
+  for (size_t i = 0; i < RCU_MAX_READERS; i++) {
+    RcuReader *reader = &domain->readers[i];
+    if (!atomic_load_explicit(&reader->in_use, memory_order_acquire)) {
+      continue;
+    }
+    uint64_t period;
+    while ((period = atomic_load_explicit(&reader->period,
+                                          memory_order_acquire)) != 0 &&
+           period < target) {
+      sched_yield();
+    }
+  }
+  atomic_fetch_add_explicit(&domain->synchronizations, 1,
+                            memory_order_relaxed);
+  pthread_mutex_unlock(&domain->sync_lock);
+}
+
+// -----------------------------------------------------------
+// Deferred reclamation
+// -----------------------------------------------------------
+
+// Advances the period, then finds the oldest epoch any reader still pins.
+// Anything retired before it is unreachable: a reader that could have seen
+// an object entered no later than the period it was retired in. Called
+// with the retire lock held.
+static size_t reclaim_locked(RcuDomain *domain) {
+  uint64_t oldest = atomic_fetch_add(&domain->period, 1) + 1;
+  atomic_thread_fence(memory_order_seq_cst);
+  for (size_t i = 0; i < RCU_MAX_READERS; i++) {
+    RcuReader *reader = &domain->readers[i];
+    if (!atomic_load_explicit(&reader->in_use, memory_order_acquire)) {
+      continue;
+    }
+    uint64_t period =
+        atomic_load_explicit(&reader->period, memory_order_acquire);
+    if (period != 0 && period < oldest) {
+      oldest = period;
+    }
+  }
+
+  size_t freed = 0;
+  while (freed < domain->num_retired &&
+         domain->retired[freed].period < oldest) {
+    domain->retired[freed].free_fn(domain->retired[freed].object);
+    freed++;
+  }
+  if (freed > 0) {
+    domain->num_retired -= freed;
+    memmove(domain->retired, domain->retired + freed,
+            sizeof(RcuRetired) * domain->num_retired);
+  }
+  domain->retires_since_reclaim = 0;
+  domain->stats.reclaimed += freed;
+  domain->stats.passes++;
+  return freed;
+}
+
+void rcu_retire(RcuDomain *domain, void *object, RcuFreeFn free_fn) {
+  if (object == NULL)
+    return;
+  pthread_mutex_lock(&domain->retire_lock);
+  if (domain->num_retired == domain->retired_capacity) {
+    size_t capacity = domain->retired_capacity
+                          ? domain->retired_capacity * 2
+                          : 2 * RCU_RECLAIM_INTERVAL;
+    RcuRetired *retired = (RcuRetired *)realloc(
+        domain->retired, sizeof(RcuRetired) * capacity);
+    if (retired == NULL) {
+      // Out of memory for the list: fall back to waiting.
+      pthread_mutex_unlock(&domain->retire_lock);
+      fprintf(stderr, "ERROR: Failed to allocate memory for RCU retire list\n");
+      rcu_synchronize(domain);
+      free_fn(object);
+      return;
+    }
+    domain->retired = retired;
+    domain->retired_capacity = capacity;
+  }
+
+  // The fence orders the caller's unpublishing store before the period is
+  // read, as in rcu_synchronize().
+  atomic_thread_fence(memory_order_seq_cst);
+  uint64_t period = atomic_load(&domain->period);
+  domain->retired[domain->num_retired++] =
+      (RcuRetired){object, free_fn, period};
+  domain->stats.retired++;
+  if (domain->num_retired > domain->stats.max_pending) {
+    domain->stats.max_pending = domain->num_retired;
+  }
+  if (++domain->retires_since_reclaim >= RCU_RECLAIM_INTERVAL) {
+    reclaim_locked(domain);
+  }
+  pthread_mutex_unlock(&domain->retire_lock);
+}
+
+size_t rcu_reclaim(RcuDomain *domain) {
+  pthread_mutex_lock(&domain->retire_lock);
+  size_t freed = reclaim_locked(domain);
+  pthread_mutex_unlock(&domain->retire_lock);
+  return freed;
+}
+
+void rcu_get_stats(RcuDomain *domain, RcuStats *stats) {
+  pthread_mutex_lock(&domain->retire_lock);
+  *stats = domain->stats;
+  stats->pending = domain->num_retired;
+  pthread_mutex_unlock(&domain->retire_lock);
+  stats->synchronizations = atomic_load(&domain->synchronizations);
+}
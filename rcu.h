@@ -0,0 +1,93 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RCU_MAX_READERS 64
+#define RCU_CACHE_LINE 64
+#define RCU_RECLAIM_INTERVAL 64 // retires between reclaim passes
+
+typedef void (*RcuFreeFn)(void *object);
+
+// An unpublished object and the grace period it was retired in.
+typedef struct {
+  void *object;
+  RcuFreeFn free_fn;
+  uint64_t period;
+} RcuRetired;
+
+typedef struct {
+  uint64_t retired;
+  uint64_t reclaimed;
+  uint64_t passes; // reclaim passes, each one scan of the reader slots
+  size_t pending;  // retired but not yet freed
+  size_t max_pending;
+  uint64_t synchronizations;
+} RcuStats;
+
+// One registered reader thread. Its slot holds the grace period it entered
+// its read-side section in, or 0 outside one, on a cache line of its own so
+// readers never write to shared memory.
+typedef struct {
+  _Alignas(RCU_CACHE_LINE) atomic_uint_fast64_t period;
+  atomic_bool in_use;
+  struct RcuDomain *domain;
+} RcuReader;
+
+// Read-copy-update for one writer and up to RCU_MAX_READERS readers, after
+// the read_lock / synchronize split of OpenSSL's internal/rcu.h. Readers
+// bracket every access to published data with rcu_read_lock() and
+// rcu_read_unlock(), which cost a fence and no shared writes; the grace
+// period a reader entered in is the epoch it pins.
+//
+// A writer that unpublishes an object either waits in rcu_synchronize()
+// and frees it, or hands it to rcu_retire(), which never waits: retired
+// objects are tagged with the current period, and every
+// RCU_RECLAIM_INTERVAL retires a reclaim pass advances the period and
+// frees those older than every pinned epoch. Objects held up by a slow
+// reader wait for a later pass rather than stalling the writer.
+typedef struct RcuDomain {
+  RcuReader readers[RCU_MAX_READERS];
+  atomic_uint_fast64_t period; // current grace period, starting at 1
+  pthread_mutex_t sync_lock;   // one synchronize at a time
+  atomic_uint_fast64_t synchronizations;
+  pthread_mutex_t retire_lock; // guards the fields below
+  RcuRetired *retired;         // oldest first
+  size_t num_retired;
+  size_t retired_capacity;
+  size_t retires_since_reclaim;
+  RcuStats stats;
+} RcuDomain;
+
+// -----------------------------------------------------------
+// RCU domain management
+// -----------------------------------------------------------
+RcuDomain *create_rcu_domain(void);
+// Every reader must have unregistered; objects still retired are freed.
+void destroy_rcu_domain(RcuDomain *domain);
+// Returns NULL once RCU_MAX_READERS readers are registered.
+RcuReader *rcu_register_reader(RcuDomain *domain);
+void rcu_unregister_reader(RcuReader *reader);
+
+// -----------------------------------------------------------
+// RCU interaction
+// -----------------------------------------------------------
+// Read-side sections do not nest.
+void rcu_read_lock(RcuReader *reader);
+void rcu_read_unlock(RcuReader *reader);
+// Returns once every read-side section that began before the call has
+// ended. Must not be called from inside one.
+void rcu_synchronize(RcuDomain *domain);
+// Frees object with free_fn once no reader can still hold it. Call after
+// unpublishing it; safe from any thread outside a read-side section.
+void rcu_retire(RcuDomain *domain, void *object, RcuFreeFn free_fn);
+// One reclaim pass without waiting for the retire interval, as when the
+// writer goes idle. Returns the number of objects freed.
+size_t rcu_reclaim(RcuDomain *domain);
+void rcu_get_stats(RcuDomain *domain, RcuStats *stats);
+
+#endif // RCU_H
@@ -0,0 +1,808 @@
+#define _GNU_SOURCE // accept4, memmem
+#include "rpc_server.h"
+#include "hex.h"
+#include "json.h"
+#include "timing.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define RPC_READ_SIZE (64u << 10)
+// Pipelined requests wait in the input buffer once this much output is
+// unsent, so a client that never reads cannot grow the server without
+// bound.
+#define RPC_MAX_OUTPUT (4u << 20)
+#define RPC_MAX_INPUT (RPC_MAX_HEADER_SIZE + RPC_MAX_BODY_SIZE + RPC_READ_SIZE)
+#define RPC_MAX_EVENTS 256
+#define RPC_MAX_TARGET 256
+
+struct RpcConnection {
+  int fd;
+  RpcBuffer in;
+  RpcBuffer out;
+  size_t out_sent;
+  bool peer_closed;
+  bool closing; // answer what was already parsed, then close
+  RpcConnection *prev;
+  RpcConnection *next;
+};
+
+// -----------------------------------------------------------
+// Buffers
+// -----------------------------------------------------------
+
+static bool buffer_reserve(RpcBuffer *buffer, size_t extra) {
+  if (buffer->capacity - buffer->len >= extra) {
+    return true;
+  }
+  size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+  while (capacity - buffer->len < extra) {
+    capacity *= 2;
+  }
+  char *grown = (char *)realloc(buffer->data, capacity);
+  if (grown == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for RPC buffer\n");
+    return false;
+  }
+  buffer->data = grown;
+  buffer->capacity = capacity;
+  return true;
+}
+
+static bool append(RpcBuffer *buffer, const void *data, size_t length) {
+  if (!buffer_reserve(buffer, length)) {
+    return false;
+  }
+  memcpy(buffer->data + buffer->len, data, length);
+  buffer->len += length;
+  return true;
+}
+
+static bool append_literal(RpcBuffer *buffer, const char *text) {
+  return append(buffer, text, strlen(text));
+}
+
+static bool append_u64(RpcBuffer *buffer, uint64_t value) {
+  char digits[24];
+  int length = snprintf(digits, sizeof(digits), "%llu",
+                        (unsigned long long)value);
+  return append(buffer, digits, (size_t)length);
+}
+
+// Appends ,"name":"<hex>".
+static bool append_hex_member(RpcBuffer *buffer, const char *name,
+                              const unsigned char *data, size_t length) {
+  if (!append_literal(buffer, ",\"") || !append_literal(buffer, name) ||
+      !append_literal(buffer, "\":\"") || !buffer_reserve(buffer, 2 * length)) {
+    return false;
+  }
+  hex_encode(data, length, buffer->data + buffer->len);
+  buffer->len += 2 * length;
+  return append_literal(buffer, "\"");
+}
+
+static void free_buffer(RpcBuffer *buffer) {
+  free(buffer->data);
+  memset(buffer, 0, sizeof(RpcBuffer));
+}
+
+// -----------------------------------------------------------
+// Responses
+// -----------------------------------------------------------
+
+static const char *status_text(int status) {
+  switch (status) {
+  case 200:
+    return "OK";
+  case 202:
+    return "Accepted";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 405:
+    return "Method Not Allowed";
+  case 413:
+    return "Payload Too Large";
+  case 431:
+    return "Request Header Fields Too Large";
+  case 501:
+    return "Not Implemented";
+  default:
+    return "Internal Server Error";
+  }
+}
+
+// Sends the body formatted in server->scratch.
+static bool respond(RpcServer *server, RpcConnection *conn, int status,
+                    bool keep_alive) {
+  char header[192];
+  int length = snprintf(header, sizeof(header),
+                        "HTTP/1.1 %d %s\r\n"
+                        "Content-Type: application/json\r\n"
+                        "Content-Length: %zu\r\n"
+                        "%s\r\n",
+                        status, status_text(status), server->scratch.len,
+                        keep_alive ? "" : "Connection: close\r\n");
+  server->stats.requests++;
+  if (status >= 400) {
+    server->stats.errors++;
+  }
+  if (!keep_alive) {
+    conn->closing = true;
+  }
+  return append(&conn->out, header, (size_t)length) &&
+         append(&conn->out, server->scratch.data, server->scratch.len);
+}
+
+// Messages are literals and need no escaping.
+static bool respond_error(RpcServer *server, RpcConnection *conn, int status,
+                          const char *message, bool keep_alive) {
+  server->scratch.len = 0;
+  return append_literal(&server->scratch, "{\"error\":\"") &&
+         append_literal(&server->scratch, message) &&
+         append_literal(&server->scratch, "\"}") &&
+         respond(server, conn, status, keep_alive);
+}
+
+static bool format_block(RpcBuffer *body, Block *block) {
+  unsigned char hash[HASH_SIZE];
+  unsigned int hash_size;
+  calculate_block_hash(block, hash, &hash_size);
+  bool ok = append_literal(body, "{\"height\":") &&
+            append_u64(body, block->height) &&
+            append_hex_member(body, "hash", hash, HASH_SIZE) &&
+            append_hex_member(body, "prev_block_hash", block->prev_block_hash,
+                              HASH_SIZE) &&
+            append_hex_member(body, "merkle_root", block->merkle_root,
+                              HASH_SIZE);
+  if (ok && block->has_mmr_root) {
+    ok = append_hex_member(body, "mmr_root", block->mmr_root, HASH_SIZE);
+  }
+  return ok && append_literal(body, ",\"version\":") &&
+         append_u64(body, block->version) &&
+         append_literal(body, ",\"timestamp\":") &&
+         append_u64(body, (uint64_t)block->timestamp) &&
+         append_literal(body, ",\"nonce\":") &&
+         append_u64(body, block->nonce) &&
+         append_literal(body, ",\"transactions\":") &&
+         append_u64(body, block->num_transactions) &&
+         append_literal(body, block->pruned ? ",\"pruned\":true}"
+                                            : ",\"pruned\":false}");
+}
+
+static bool format_proof(RpcBuffer *body, Block *block, size_t index,
+                         const MerkleProof *proof) {
+  unsigned char leaf[HASH_SIZE];
+  transaction_id(&block->transactions[index], leaf);
+  bool ok = append_literal(body, "{\"height\":") &&
+            append_u64(body, block->height) &&
+            append_literal(body, ",\"index\":") && append_u64(body, index) &&
+            append_literal(body, ",\"num_leaves\":") &&
+            append_u64(body, proof->num_leaves) &&
+            append_hex_member(body, "leaf", leaf, HASH_SIZE) &&
+            append_hex_member(body, "merkle_root", block->merkle_root,
+                              HASH_SIZE) &&
+            append_literal(body, ",\"path\":[");
+  for (size_t i = 0; ok && i < proof->path_len; i++) {
+    ok = append_literal(body, i == 0 ? "\"" : ",\"") &&
+         buffer_reserve(body, 2 * HASH_SIZE);
+    if (ok) {
+      hex_encode(proof->path[i], HASH_SIZE, body->data + body->len);
+      body->len += 2 * HASH_SIZE;
+      ok = append_literal(body, "\"");
+    }
+  }
+  return ok && append_literal(body, "]}");
+}
+
+// -----------------------------------------------------------
+// Transaction submission
+// -----------------------------------------------------------
+
+static void seal_pending(RpcServer *server) {
+  if (server->num_pending == 0) {
+    return;
+  }
+  Block *block = create_signed_block_on(server->tree, best_tip(server->tree),
+                                        server->pending, server->num_pending);
+  if (block != NULL) {
+    server->stats.blocks++;
+  } else {
+    fprintf(stderr, "ERROR: Failed to seal %zu pending transactions\n",
+            server->num_pending);
+  }
+  for (size_t i = 0; i < server->num_pending; i++) {
+    free_transaction(&server->pending[i]);
+  }
+  server->num_pending = 0;
+}
+
+static bool decode_hex_member(const char *body, const char *end,
+                              const char *key, unsigned char *out,
+                              size_t length) {
+  JsonSpan value;
+  return json_find_member(body, end, key, &value) && value.is_string &&
+         (size_t)(value.end - value.start) == 2 * length &&
+         hex_decode(value.start, 2 * length, out);
+}
+
+// Parses {"payload": ..., "public_key": ..., "signature": ...}.
+static bool parse_submission(const char *body, size_t length,
+                             Transaction *transaction) {
+  const char *end = body + length;
+  JsonSpan payload;
+  if (!json_find_member(body, end, "payload", &payload) ||
+      !payload.is_string) {
+    return false;
+  }
+  memset(transaction, 0, sizeof(Transaction));
+  if (!decode_hex_member(body, end, "public_key", transaction->public_key,
+                         PUBLIC_KEY_SIZE) ||
+      !decode_hex_member(body, end, "signature", transaction->signature,
+                         SIGNATURE_SIZE)) {
+    return false;
+  }
+  transaction->payload =
+      (char *)malloc((size_t)(payload.end - payload.start) + 1);
+  if (transaction->payload == NULL) {
+    return false;
+  }
+  ssize_t payload_len = json_unescape(&payload, transaction->payload);
+  if (payload_len < 0) {
+    free_transaction(transaction);
+    return false;
+  }
+  transaction->payload_len = (size_t)payload_len;
+  return true;
+}
+
+static bool submit_transaction(RpcServer *server, RpcConnection *conn,
+                               const char *body, size_t length,
+                               bool keep_alive) {
+  Transaction transaction;
+  if (!parse_submission(body, length, &transaction)) {
+    return respond_error(server, conn, 400, "malformed transaction",
+                         keep_alive);
+  }
+  if (!verify_transaction(&transaction)) {
+    free_transaction(&transaction);
+    return respond_error(server, conn, 400, "invalid signature", keep_alive);
+  }
+  unsigned char id[HASH_SIZE];
+  transaction_id(&transaction, id);
+  if (server->num_pending == 0) {
+    server->first_pending_ns = monotonic_ns();
+  }
+  server->pending[server->num_pending++] = transaction;
+  server->stats.transactions++;
+  size_t pending = server->num_pending;
+  if (server->num_pending == server->config.block_size) {
+    seal_pending(server);
+  }
+
+  RpcBuffer *reply = &server->scratch;
+  reply->len = 0;
+  return append_literal(reply, "{\"pending\":") && append_u64(reply, pending) &&
+         append_hex_member(reply, "id", id, HASH_SIZE) &&
+         append_literal(reply, "}") && respond(server, conn, 202, keep_alive);
+}
+
+// -----------------------------------------------------------
+// Routing
+// -----------------------------------------------------------
+
+static bool parse_height(const char *text, uint64_t *value) {
+  if (*text < '0' || *text > '9') {
+    return false;
+  }
+  char *end;
+  errno = 0;
+  unsigned long long parsed = strtoull(text, &end, 10);
+  if (errno != 0 || (*end != '\0' && *end != '/')) {
+    return false;
+  }
+  *value = parsed;
+  return true;
+}
+
+static bool route(RpcServer *server, RpcConnection *conn, const char *method,
+                  const char *target, const char *body, size_t body_len,
+                  bool keep_alive) {
+  bool get = strcmp(method, "GET") == 0;
+  RpcBuffer *reply = &server->scratch;
+  reply->len = 0;
+
+  if (strcmp(target, "/tx") == 0) {
+    if (strcmp(method, "POST") != 0) {
+      return respond_error(server, conn, 405, "use POST", keep_alive);
+    }
+    return submit_transaction(server, conn, body, body_len, keep_alive);
+  }
+  if (!get) {
+    return respond_error(server, conn, 405, "use GET", keep_alive);
+  }
+
+  Block *block = NULL;
+  if (strcmp(target, "/tip") == 0) {
+    block = best_tip(server->tree);
+  } else if (strncmp(target, "/block/height/", 14) == 0) {
+    uint64_t height;
+    if (parse_height(target + 14, &height)) {
+      block = get_block_at_height(server->blockchain, height);
+    }
+  } else if (strncmp(target, "/block/hash/", 12) == 0) {
+    unsigned char hash[HASH_SIZE];
+    if (strlen(target + 12) == 2 * HASH_SIZE &&
+        hex_decode(target + 12, 2 * HASH_SIZE, hash)) {
+      block = find_block(server->tree, hash);
+    }
+  } else if (strncmp(target, "/proof/", 7) == 0) {
+    uint64_t height, index;
+    const char *slash = strchr(target + 7, '/');
+    if (!parse_height(target + 7, &height) || slash == NULL ||
+        !parse_height(slash + 1, &index) || strchr(slash + 1, '/') != NULL) {
+      return respond_error(server, conn, 404, "unknown endpoint", keep_alive);
+    }
+    block = get_block_at_height(server->blockchain, height);
+    MerkleProof proof;
+    if (block == NULL || block->merkletree == NULL ||
+        index >= block->num_transactions ||
+        !merkle_prove(block->merkletree, block->num_transactions, index,
+                      &proof)) {
+      return respond_error(server, conn, 404, "no such transaction",
+                           keep_alive);
+    }
+    return format_proof(reply, block, index, &proof) &&
+           respond(server, conn, 200, keep_alive);
+  } else {
+    return respond_error(server, conn, 404, "unknown endpoint", keep_alive);
+  }
+
+  if (block == NULL) {
+    return respond_error(server, conn, 404, "no such block", keep_alive);
+  }
+  return format_block(reply, block) && respond(server, conn, 200, keep_alive);
+}
+
+// -----------------------------------------------------------
+// HTTP parsing
+// -----------------------------------------------------------
+
+static bool header_is(const char *line, size_t length, const char *name,
+                      const char **value, size_t *value_len) {
+  size_t name_len = strlen(name);
+  if (length <= name_len || line[name_len] != ':' ||
+      strncasecmp(line, name, name_len) != 0) {
+    return false;
+  }
+  const char *p = line + name_len + 1;
+  const char *end = line + length;
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    p++;
+  }
+  while (end > p && (end[-1] == ' ' || end[-1] == '\t')) {
+    end--;
+  }
+  *value = p;
+  *value_len = (size_t)(end - p);
+  return true;
+}
+
+// Answers the request at the front of data. Returns the bytes it took, 0
+// if the request is not complete yet, or -1 if the connection must be
+// dropped without an answer.
+static ssize_t handle_request(RpcServer *server, RpcConnection *conn,
+                              const char *data, size_t length) {
+  if (length == 0) {
+    return 0;
+  }
+  const char *header_end = memmem(data, length, "\r\n\r\n", 4);
+  if (header_end == NULL) {
+    if (length > RPC_MAX_HEADER_SIZE) {
+      return respond_error(server, conn, 431, "headers too large", false)
+                 ? (ssize_t)length
+                 : -1;
+    }
+    return 0;
+  }
+  size_t header_len = (size_t)(header_end - data) + 4;
+
+  // Request line: METHOD SP target SP HTTP/1.x
+  const char *line_end = memchr(data, '\r', header_len);
+  const char *method_end = memchr(data, ' ', (size_t)(line_end - data));
+  const char *target_end =
+      method_end != NULL
+          ? memchr(method_end + 1, ' ', (size_t)(line_end - method_end - 1))
+          : NULL;
+  if (target_end == NULL || method_end - data > 7 ||
+      target_end - method_end - 1 >= RPC_MAX_TARGET ||
+      line_end - target_end - 1 != 8 ||
+      memcmp(target_end + 1, "HTTP/1.", 7) != 0) {
+    return respond_error(server, conn, 400, "malformed request line", false)
+               ? (ssize_t)length
+               : -1;
+  }
+  char method[8];
+  char target[RPC_MAX_TARGET];
+  memcpy(method, data, (size_t)(method_end - data));
+  method[method_end - data] = '\0';
+  memcpy(target, method_end + 1, (size_t)(target_end - method_end - 1));
+  target[target_end - method_end - 1] = '\0';
+  bool keep_alive = target_end[8] == '1';
+
+  size_t body_len = 0;
+  const char *line = line_end + 2;
+  while (line < header_end + 2) {
+    const char *end = memchr(line, '\r', (size_t)(header_end + 2 - line));
+    const char *value;
+    size_t value_len;
+    if (header_is(line, (size_t)(end - line), "Content-Length", &value,
+                  &value_len)) {
+      body_len = 0;
+      for (size_t i = 0; i < value_len; i++) {
+        if (value[i] < '0' || value[i] > '9' ||
+            body_len > RPC_MAX_BODY_SIZE) {
+          return respond_error(server, conn, 413, "body too large", false)
+                     ? (ssize_t)length
+                     : -1;
+        }
+        body_len = body_len * 10 + (size_t)(value[i] - '0');
+      }
+      if (body_len > RPC_MAX_BODY_SIZE) {
+        return respond_error(server, conn, 413, "body too large", false)
+                   ? (ssize_t)length
+                   : -1;
+      }
+    } else if (header_is(line, (size_t)(end - line), "Connection", &value,
+                         &value_len)) {
+      if (value_len == 5 && strncasecmp(value, "close", 5) == 0) {
+        keep_alive = false;
+      } else if (value_len == 10 && strncasecmp(value, "keep-alive", 10) == 0) {
+        keep_alive = true;
+      }
+    } else if (header_is(line, (size_t)(end - line), "Transfer-Encoding",
+                         &value, &value_len)) {
+      return respond_error(server, conn, 501, "chunked bodies unsupported",
+                           false)
+                 ? (ssize_t)length
+                 : -1;
+    }
+    line = end + 2;
+  }
+
+  if (length - header_len < body_len) {
+    return 0;
+  }
+  if (!route(server, conn, method, target, data + header_len, body_len,
+             keep_alive)) {
+    return -1;
+  }
+  return (ssize_t)(header_len + body_len);
+}
+
+// -----------------------------------------------------------
+// Connections
+// -----------------------------------------------------------
+
+static void close_connection(RpcServer *server, RpcConnection *conn) {
+  close(conn->fd);
+  if (conn->prev != NULL) {
+    conn->prev->next = conn->next;
+  } else {
+    server->connections = conn->next;
+  }
+  if (conn->next != NULL) {
+    conn->next->prev = conn->prev;
+  }
+  server->num_connections--;
+  free_buffer(&conn->in);
+  free_buffer(&conn->out);
+  free(conn);
+}
+
+static void accept_connections(RpcServer *server) {
+  for (;;) {
+    int fd = accept4(server->listen_fd, NULL, NULL,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror("ERROR: Failed to accept RPC connection");
+      }
+      return;
+    }
+    RpcConnection *conn = NULL;
+    if (server->num_connections < server->config.max_connections) {
+      conn = (RpcConnection *)calloc(1, sizeof(RpcConnection));
+    }
+    if (conn == NULL) {
+      close(fd);
+      continue;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    conn->fd = fd;
+    struct epoll_event event = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP |
+                                          EPOLLET,
+                                .data.ptr = conn};
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+      perror("ERROR: Failed to watch RPC connection");
+      close(fd);
+      free(conn);
+      continue;
+    }
+    conn->next = server->connections;
+    if (conn->next != NULL) {
+      conn->next->prev = conn;
+    }
+    server->connections = conn;
+    server->num_connections++;
+    server->stats.connections++;
+  }
+}
+
+// Answers every complete request in the input, unless too much output is
+// already waiting. Sets *consumed if any request was taken off the input.
+static bool process_requests(RpcServer *server, RpcConnection *conn,
+                             bool *consumed) {
+  size_t offset = 0;
+  while (!conn->closing && conn->out.len - conn->out_sent < RPC_MAX_OUTPUT) {
+    ssize_t used = handle_request(server, conn, conn->in.data + offset,
+                                  conn->in.len - offset);
+    if (used < 0) {
+      return false;
+    }
+    if (used == 0) {
+      break;
+    }
+    offset += (size_t)used;
+  }
+  if (offset > 0) {
+    memmove(conn->in.data, conn->in.data + offset, conn->in.len - offset);
+    conn->in.len -= offset;
+    *consumed = true;
+  }
+  return true;
+}
+
+static bool flush_output(RpcConnection *conn) {
+  while (conn->out_sent < conn->out.len) {
+    ssize_t n = send(conn->fd, conn->out.data + conn->out_sent,
+                     conn->out.len - conn->out_sent, MSG_NOSIGNAL);
+    if (n >= 0) {
+      conn->out_sent += (size_t)n;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return true;
+    } else if (errno != EINTR) {
+      return false;
+    }
+  }
+  conn->out.len = 0;
+  conn->out_sent = 0;
+  return true;
+}
+
+// Reads until the socket would block or the input buffer is full. Sets
+// *progressed if anything arrived.
+static bool read_input(RpcConnection *conn, bool *progressed) {
+  while (conn->in.len < RPC_MAX_INPUT) {
+    if (!buffer_reserve(&conn->in, RPC_READ_SIZE)) {
+      return false;
+    }
+    ssize_t n = read(conn->fd, conn->in.data + conn->in.len,
+                     conn->in.capacity - conn->in.len);
+    if (n > 0) {
+      conn->in.len += (size_t)n;
+      *progressed = true;
+    } else if (n == 0) {
+      conn->peer_closed = true;
+      return true;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return true;
+    } else if (errno != EINTR) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// With edge-triggered events every wakeup must drain the socket: the loop
+// only returns once no buffered request is left and a read would block, or
+// once output is backed up, in which case the EPOLLOUT edge brings it back
+// here. Requests held back by the output limit are already in the buffer,
+// so no edge will announce them; they are answered before reading again.
+static void service_connection(RpcServer *server, RpcConnection *conn) {
+  for (;;) {
+    bool consumed = false;
+    if (!process_requests(server, conn, &consumed) || !flush_output(conn)) {
+      close_connection(server, conn);
+      return;
+    }
+    if (conn->out.len > 0) {
+      return;
+    }
+    if (consumed && conn->in.len > 0 && !conn->closing) {
+      continue;
+    }
+    if (conn->closing || conn->peer_closed) {
+      close_connection(server, conn);
+      return;
+    }
+    bool progressed = false;
+    if (!read_input(conn, &progressed)) {
+      close_connection(server, conn);
+      return;
+    }
+    if (!progressed && !conn->peer_closed) {
+      return;
+    }
+  }
+}
+
+// -----------------------------------------------------------
+// RPC server Implementation
+// -----------------------------------------------------------
+
+static bool watch(int epoll_fd, int fd, void *tag) {
+  struct epoll_event event = {.events = EPOLLIN | EPOLLET, .data.ptr = tag};
+  return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+static bool open_listener(RpcServer *server) {
+  server->listen_fd =
+      socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (server->listen_fd < 0) {
+    perror("ERROR: Failed to create RPC socket");
+    return false;
+  }
+  int one = 1;
+  setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in address = {.sin_family = AF_INET,
+                                .sin_port = htons(server->config.port),
+                                .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  socklen_t length = sizeof(address);
+  if (bind(server->listen_fd, (struct sockaddr *)&address, length) < 0 ||
+      listen(server->listen_fd, SOMAXCONN) < 0 ||
+      getsockname(server->listen_fd, (struct sockaddr *)&address, &length) <
+          0) {
+    perror("ERROR: Failed to listen for RPC connections");
+    return false;
+  }
+  server->port = ntohs(address.sin_port);
+  return true;
+}
+
+RpcServer *create_rpc_server(Blockchain *blockchain, const RpcConfig *config) {
+  RpcServer *server = (RpcServer *)calloc(1, sizeof(RpcServer));
+  if (server == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for RPC server\n");
+    return NULL;
+  }
+  server->blockchain = blockchain;
+  server->config = config != NULL ? *config : (RpcConfig){0};
+  if (server->config.port == 0 && !server->config.ephemeral) {
+    server->config.port = DEFAULT_RPC_PORT;
+  }
+  if (server->config.block_size == 0) {
+    server->config.block_size = DEFAULT_RPC_BLOCK_SIZE;
+  }
+  if (server->config.max_connections == 0) {
+    server->config.max_connections = DEFAULT_RPC_MAX_CONNECTIONS;
+  }
+  if (server->config.seal_interval_ms <= 0) {
+    server->config.seal_interval_ms = DEFAULT_RPC_SEAL_INTERVAL_MS;
+  }
+  server->listen_fd = -1;
+  server->wake_fd = -1;
+  server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  server->pending =
+      (Transaction *)malloc(sizeof(Transaction) * server->config.block_size);
+  if (server->epoll_fd < 0 || server->pending == NULL ||
+      !open_listener(server)) {
+    destroy_rpc_server(server);
+    return NULL;
+  }
+  server->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (server->wake_fd < 0 ||
+      !watch(server->epoll_fd, server->listen_fd, &server->listen_fd) ||
+      !watch(server->epoll_fd, server->wake_fd, &server->wake_fd)) {
+    perror("ERROR: Failed to set up RPC event loop");
+    destroy_rpc_server(server);
+    return NULL;
+  }
+  server->tree = create_block_tree(blockchain);
+  if (server->tree == NULL) {
+    destroy_rpc_server(server);
+    return NULL;
+  }
+  return server;
+}
+
+void destroy_rpc_server(RpcServer *server) {
+  if (server == NULL)
+    return;
+  while (server->connections != NULL) {
+    close_connection(server, server->connections);
+  }
+  for (size_t i = 0; i < server->num_pending; i++) {
+    free_transaction(&server->pending[i]);
+  }
+  free(server->pending);
+  if (server->listen_fd >= 0)
+    close(server->listen_fd);
+  if (server->wake_fd >= 0)
+    close(server->wake_fd);
+  if (server->epoll_fd >= 0)
+    close(server->epoll_fd);
+  destroy_block_tree(server->tree);
+  free_buffer(&server->scratch);
+  free(server);
+}
+
+bool rpc_server_run(RpcServer *server) {
+  struct epoll_event events[RPC_MAX_EVENTS];
+  const uint64_t interval_ns = (uint64_t)server->config.seal_interval_ms * 1000000;
+  bool running = true;
+  while (running) {
+    int timeout = -1;
+    if (server->num_pending > 0) {
+      uint64_t waited = monotonic_ns() - server->first_pending_ns;
+      timeout = waited >= interval_ns
+                    ? 0
+                    : (int)((interval_ns - waited + 999999) / 1000000);
+    }
+    int n = epoll_wait(server->epoll_fd, events, RPC_MAX_EVENTS, timeout);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("ERROR: Failed to wait for RPC events");
+      return false;
+    }
+    for (int i = 0; i < n; i++) {
+      void *tag = events[i].data.ptr;
+      if (tag == &server->listen_fd) {
+        accept_connections(server);
+      } else if (tag == &server->wake_fd) {
+        running = false;
+      } else {
+        service_connection(server, (RpcConnection *)tag);
+      }
+    }
+    if (server->num_pending > 0 &&
+        monotonic_ns() - server->first_pending_ns >= interval_ns) {
+      seal_pending(server);
+    }
+  }
+  seal_pending(server);
+  return true;
+}
+
+void rpc_server_stop(RpcServer *server) {
+  uint64_t one = 1;
+  if (write(server->wake_fd, &one, sizeof(one)) < 0) {
+    // Already signalled: the counter is non-zero either way.
+  }
+}
+
+void print_rpc_stats(const RpcStats *stats) {
+  printf("RPC: %llu connections, %llu requests (%llu errors), %llu "
+         "transactions in %llu blocks\n",
+         (unsigned long long)stats->connections,
+         (unsigned long long)stats->requests,
+         (unsigned long long)stats->errors,
+         (unsigned long long)stats->transactions,
+         (unsigned long long)stats->blocks);
+}
@@ -0,0 +1,87 @@
+#ifndef RPC_SERVER_H
+#define RPC_SERVER_H
+
+#include "block_tree.h"
+#include "blockchain.h"
+#include "transaction.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEFAULT_RPC_PORT 8545
+#define DEFAULT_RPC_BLOCK_SIZE 1024
+#define DEFAULT_RPC_MAX_CONNECTIONS 1024
+#define DEFAULT_RPC_SEAL_INTERVAL_MS 1000
+#define RPC_MAX_HEADER_SIZE (8u << 10)
+#define RPC_MAX_BODY_SIZE (1u << 20)
+
+// Zero fields take the defaults.
+typedef struct {
+  uint16_t port;           // 0 with ephemeral set picks any free port
+  bool ephemeral;
+  size_t block_size;       // pending transactions sealed into one block
+  size_t max_connections;
+  int seal_interval_ms;    // longest a pending transaction waits for a block
+} RpcConfig;
+
+typedef struct {
+  uint64_t connections; // accepted over the server's lifetime
+  uint64_t requests;
+  uint64_t errors;       // requests answered with a 4xx or 5xx status
+  uint64_t transactions; // accepted by POST /tx
+  uint64_t blocks;       // sealed from submitted transactions
+} RpcStats;
+
+typedef struct {
+  char *data;
+  size_t len;
+  size_t capacity;
+} RpcBuffer;
+
+typedef struct RpcConnection RpcConnection;
+
+// Single-threaded HTTP/1.1 server on 127.0.0.1. One edge-triggered epoll
+// loop serves every connection; keep-alive is the default and pipelined
+// requests are answered in order from each read. Endpoints:
+//   GET  /tip
+//   GET  /block/height/<height>
+//   GET  /block/hash/<hex hash>
+//   GET  /proof/<height>/<transaction index>
+//   POST /tx  {"payload": "...", "public_key": "<hex>", "signature": "<hex>"}
+// Submitted transactions are verified on arrival and sealed into a block
+// once block_size are pending or the oldest has waited seal_interval_ms.
+typedef struct {
+  Blockchain *blockchain;
+  BlockTree *tree;
+  RpcConfig config;
+  int listen_fd;
+  int epoll_fd;
+  int wake_fd; // eventfd written by rpc_server_stop()
+  uint16_t port;
+  RpcConnection *connections; // open connections, for teardown
+  size_t num_connections;
+  Transaction *pending;
+  size_t num_pending;
+  uint64_t first_pending_ns;
+  RpcBuffer scratch; // response body being formatted
+  RpcStats stats;
+} RpcServer;
+
+// -----------------------------------------------------------
+// RPC server management
+// -----------------------------------------------------------
+// Binds and listens immediately; the chain is owned by the server's block
+// tree until destroy_rpc_server() returns.
+RpcServer *create_rpc_server(Blockchain *blockchain, const RpcConfig *config);
+void destroy_rpc_server(RpcServer *server);
+
+// -----------------------------------------------------------
+// RPC server interaction
+// -----------------------------------------------------------
+// Serves until rpc_server_stop(), then seals what is still pending.
+bool rpc_server_run(RpcServer *server);
+// Safe from any thread and from signal handlers.
+void rpc_server_stop(RpcServer *server);
+void print_rpc_stats(const RpcStats *stats);
+
+#endif // RPC_SERVER_H
@@ -0,0 +1,403 @@
+#include "sealer.h"
+#include "timing.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+static const char *reason_names[SEAL_REASON_COUNT] = {"count", "bytes",
+                                                      "delay", "stop"};
+
+// -----------------------------------------------------------
+// Batches
+// -----------------------------------------------------------
+
+static bool batch_append(SealBatch *batch, const char *payload, size_t len) {
+  if (batch->used + len + 1 > batch->capacity) {
+    size_t capacity = batch->capacity ? batch->capacity : 4096;
+    while (capacity < batch->used + len + 1) {
+      capacity *= 2;
+    }
+    char *data = (char *)realloc(batch->data, capacity);
+    if (data == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate memory for sealer batch\n");
+      return false;
+    }
+    batch->data = data;
+    batch->capacity = capacity;
+  }
+  if (batch->count == batch->offsets_capacity) {
+    size_t capacity = batch->offsets_capacity ? batch->offsets_capacity * 2
+                                              : 256;
+    size_t *offsets =
+        (size_t *)realloc(batch->offsets, sizeof(size_t) * capacity);
+    if (offsets == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate memory for sealer batch\n");
+      return false;
+    }
+    batch->offsets = offsets;
+    batch->offsets_capacity = capacity;
+  }
+  memcpy(batch->data + batch->used, payload, len);
+  batch->data[batch->used + len] = '\0';
+  batch->offsets[batch->count++] = batch->used;
+  batch->used += len + 1;
+  return true;
+}
+
+static size_t batch_bytes(const SealBatch *batch) {
+  return batch->used - batch->count; // without the terminators
+}
+
+// Why the batch must be sealed now, or SEAL_REASON_COUNT if it may grow.
+static SealReason batch_limit(const Sealer *sealer, const SealBatch *batch) {
+  if (batch->count >= sealer->config.max_transactions) {
+    return SEAL_BY_COUNT;
+  }
+  if (batch->count > 0 && batch_bytes(batch) >= sealer->config.max_bytes) {
+    return SEAL_BY_BYTES;
+  }
+  return SEAL_REASON_COUNT;
+}
+
+static void free_batch(SealBatch *batch) {
+  free(batch->data);
+  free(batch->offsets);
+  *batch = (SealBatch){0};
+}
+
+// -----------------------------------------------------------
+// Sealer Implementation
+// -----------------------------------------------------------
+
+static void wake(Sealer *sealer) {
+  uint64_t one = 1;
+  if (write(sealer->wake_fd, &one, sizeof(one)) < 0) {
+    // Already signalled: the counter is non-zero either way.
+  }
+}
+
+static void arm_timer(Sealer *sealer, uint64_t deadline_ns) {
+  struct itimerspec spec = {0};
+  spec.it_value.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+  spec.it_value.tv_nsec = (long)(deadline_ns % 1000000000ull);
+  if (timerfd_settime(sealer->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+    perror("ERROR: Failed to arm seal timer");
+  }
+}
+
+static uint64_t deadline(const Sealer *sealer, const SealBatch *batch) {
+  return batch->first_ns + (uint64_t)sealer->config.max_delay_ms * 1000000ull;
+}
+
+// Moves the pending batch into the empty full slot. Called with the lock
+// held.
+static void close_pending(Sealer *sealer, SealReason reason) {
+  sealer->full = sealer->pending;
+  sealer->full_by = reason;
+  sealer->pending = (SealBatch){0};
+  wake(sealer);
+}
+
+static void record_seal(Sealer *sealer, const SealBatch *batch,
+                        SealReason reason) {
+  uint64_t latency = monotonic_ns() - batch->first_ns;
+  double fill = (double)batch->count / sealer->config.max_transactions;
+  double byte_fill = (double)batch_bytes(batch) / sealer->config.max_bytes;
+  if (byte_fill > fill) {
+    fill = byte_fill;
+  }
+
+  size_t bucket = 0;
+  while (bucket + 1 < SEAL_LATENCY_BUCKETS &&
+         latency >= (1000ull << bucket)) {
+    bucket++;
+  }
+  size_t tenth = fill >= 1.0 ? SEAL_FILL_BUCKETS - 1 : (size_t)(fill * 10);
+
+  pthread_mutex_lock(&sealer->lock);
+  SealerStats *stats = &sealer->stats;
+  stats->transactions += batch->count;
+  stats->bytes += batch_bytes(batch);
+  stats->blocks++;
+  stats->sealed_by[reason]++;
+  stats->latency[bucket]++;
+  stats->total_latency_ns += latency;
+  if (latency > stats->max_latency_ns) {
+    stats->max_latency_ns = latency;
+  }
+  stats->fill[tenth]++;
+  stats->total_fill += fill > 1.0 ? 1.0 : fill;
+  pthread_mutex_unlock(&sealer->lock);
+}
+
+// Hands a batch to the pipeline, which takes its buffer as the block's
+// storage.
+static void seal_batch(Sealer *sealer, SealBatch *batch, SealReason reason) {
+  if (batch->count == 0) {
+    free_batch(batch);
+    return;
+  }
+  char **transactions = (char **)malloc(sizeof(char *) * batch->count);
+  if (transactions == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for sealed block\n");
+    free_batch(batch);
+    return;
+  }
+  for (size_t i = 0; i < batch->count; i++) {
+    transactions[i] = batch->data + batch->offsets[i];
+  }
+  if (pipeline_submit_owned(sealer->pipeline, transactions, batch->count,
+                            batch->data)) {
+    record_seal(sealer, batch, reason);
+  }
+  batch->data = NULL;
+  free_batch(batch);
+}
+
+// Takes every batch that is due: the full one, the pending one if it has
+// reached a limit or its deadline, or everything once stopping.
+static void seal_due(Sealer *sealer, bool stopping) {
+  SealBatch full = {0}, pending = {0};
+  SealReason full_by = SEAL_REASON_COUNT, pending_by = SEAL_REASON_COUNT;
+  uint64_t now = monotonic_ns();
+
+  pthread_mutex_lock(&sealer->lock);
+  if (sealer->full.count > 0) {
+    full = sealer->full;
+    full_by = sealer->full_by;
+    sealer->full = (SealBatch){0};
+  }
+  if (sealer->pending.count > 0) {
+    pending_by = batch_limit(sealer, &sealer->pending);
+    if (pending_by == SEAL_REASON_COUNT &&
+        now >= deadline(sealer, &sealer->pending)) {
+      pending_by = SEAL_BY_DELAY;
+    }
+    if (pending_by == SEAL_REASON_COUNT && stopping) {
+      pending_by = SEAL_BY_STOP;
+    }
+    if (pending_by != SEAL_REASON_COUNT) {
+      pending = sealer->pending;
+      sealer->pending = (SealBatch){0};
+    } else {
+      // The timer may have fired for a batch that has since been closed.
+      arm_timer(sealer, deadline(sealer, &sealer->pending));
+    }
+  }
+  if (stopping) {
+    sealer->closed = true;
+  }
+  pthread_cond_broadcast(&sealer->drained);
+  pthread_mutex_unlock(&sealer->lock);
+
+  seal_batch(sealer, &full, full_by);
+  seal_batch(sealer, &pending, pending_by);
+}
+
+Sealer *create_sealer(Pipeline *pipeline, const SealerConfig *config) {
+  Sealer *sealer = (Sealer *)calloc(1, sizeof(Sealer));
+  if (sealer == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for sealer\n");
+    return NULL;
+  }
+  sealer->pipeline = pipeline;
+  sealer->config = config != NULL ? *config : (SealerConfig){0};
+  if (sealer->config.max_transactions == 0) {
+    sealer->config.max_transactions = DEFAULT_SEAL_MAX_TRANSACTIONS;
+  }
+  if (sealer->config.max_bytes == 0) {
+    sealer->config.max_bytes = DEFAULT_SEAL_MAX_BYTES;
+  }
+  if (sealer->config.max_delay_ms <= 0) {
+    sealer->config.max_delay_ms = DEFAULT_SEAL_MAX_DELAY_MS;
+  }
+  atomic_init(&sealer->stopping, false);
+  pthread_mutex_init(&sealer->lock, NULL);
+  pthread_cond_init(&sealer->drained, NULL);
+
+  sealer->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  sealer->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  sealer->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  struct epoll_event timer_event = {.events = EPOLLIN,
+                                    .data.ptr = &sealer->timer_fd};
+  struct epoll_event wake_event = {.events = EPOLLIN,
+                                   .data.ptr = &sealer->wake_fd};
+  if (sealer->epoll_fd < 0 || sealer->timer_fd < 0 || sealer->wake_fd < 0 ||
+      epoll_ctl(sealer->epoll_fd, EPOLL_CTL_ADD, sealer->timer_fd,
+                &timer_event) < 0 ||
+      epoll_ctl(sealer->epoll_fd, EPOLL_CTL_ADD, sealer->wake_fd,
+                &wake_event) < 0) {
+    perror("ERROR: Failed to set up sealer event loop");
+    destroy_sealer(sealer);
+    return NULL;
+  }
+  return sealer;
+}
+
+void destroy_sealer(Sealer *sealer) {
+  if (sealer == NULL)
+    return;
+  if (sealer->epoll_fd >= 0)
+    close(sealer->epoll_fd);
+  if (sealer->timer_fd >= 0)
+    close(sealer->timer_fd);
+  if (sealer->wake_fd >= 0)
+    close(sealer->wake_fd);
+  free_batch(&sealer->pending);
+  free_batch(&sealer->full);
+  pthread_mutex_destroy(&sealer->lock);
+  pthread_cond_destroy(&sealer->drained);
+  free(sealer);
+}
+
+bool sealer_submit(Sealer *sealer, const char *payload, size_t len) {
+  if (memchr(payload, '\0', len) != NULL ||
+      atomic_load_explicit(&sealer->stopping, memory_order_relaxed)) {
+    pthread_mutex_lock(&sealer->lock);
+    sealer->stats.rejected++;
+    pthread_mutex_unlock(&sealer->lock);
+    return false;
+  }
+
+  pthread_mutex_lock(&sealer->lock);
+  // A pending batch at its limit waits here until the full slot frees up.
+  SealReason limit;
+  while (!sealer->closed && (limit = batch_limit(sealer, &sealer->pending)) !=
+                                SEAL_REASON_COUNT) {
+    if (sealer->full.count == 0) {
+      close_pending(sealer, limit);
+    } else {
+      pthread_cond_wait(&sealer->drained, &sealer->lock);
+    }
+  }
+  if (sealer->closed) {
+    sealer->stats.rejected++;
+    pthread_mutex_unlock(&sealer->lock);
+    return false;
+  }
+
+  bool opened = sealer->pending.count == 0;
+  if (!batch_append(&sealer->pending, payload, len)) {
+    pthread_mutex_unlock(&sealer->lock);
+    return false;
+  }
+  if (opened) {
+    sealer->pending.first_ns = monotonic_ns();
+    arm_timer(sealer, deadline(sealer, &sealer->pending));
+  }
+  limit = batch_limit(sealer, &sealer->pending);
+  if (limit != SEAL_REASON_COUNT && sealer->full.count == 0) {
+    close_pending(sealer, limit);
+  }
+  pthread_mutex_unlock(&sealer->lock);
+  return true;
+}
+
+bool sealer_run(Sealer *sealer) {
+  struct epoll_event events[2];
+  bool running = true;
+  while (running) {
+    int n = epoll_wait(sealer->epoll_fd, events, 2, -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("ERROR: Failed to wait for sealer events");
+      seal_due(sealer, true);
+      return false;
+    }
+    for (int i = 0; i < n; i++) {
+      uint64_t count;
+      int fd = *(int *)events[i].data.ptr;
+      if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        perror("ERROR: Failed to read sealer event");
+      }
+    }
+    running = !atomic_load_explicit(&sealer->stopping, memory_order_acquire);
+    seal_due(sealer, !running);
+  }
+  return true;
+}
+
+void sealer_stop(Sealer *sealer) {
+  atomic_store_explicit(&sealer->stopping, true, memory_order_release);
+  wake(sealer);
+}
+
+void sealer_get_stats(Sealer *sealer, SealerStats *stats) {
+  pthread_mutex_lock(&sealer->lock);
+  *stats = sealer->stats;
+  pthread_mutex_unlock(&sealer->lock);
+}
+
+uint64_t seal_latency_percentile_us(const SealerStats *stats,
+                                    double percentile) {
+  uint64_t seen = 0;
+  for (size_t i = 0; i < SEAL_LATENCY_BUCKETS; i++) {
+    seen += stats->latency[i];
+    if (seen > 0 && seen >= percentile / 100 * stats->blocks) {
+      return 1ull << i;
+    }
+  }
+  return 1ull << (SEAL_LATENCY_BUCKETS - 1);
+}
+
+static void print_bar(uint64_t count, uint64_t total) {
+  int width = total ? (int)(40 * count / total) : 0;
+  for (int i = 0; i < width; i++) {
+    putchar('#');
+  }
+  putchar('\n');
+}
+
+void print_sealer_stats(const SealerStats *stats) {
+  printf("Sealer: %llu transactions (%.1f MB, %llu rejected) in %llu blocks; "
+         "sealed by",
+         (unsigned long long)stats->transactions, stats->bytes / 1e6,
+         (unsigned long long)stats->rejected,
+         (unsigned long long)stats->blocks);
+  for (int r = 0; r < SEAL_REASON_COUNT; r++) {
+    printf(" %s %llu", reason_names[r],
+           (unsigned long long)stats->sealed_by[r]);
+  }
+  printf("\n");
+  if (stats->blocks == 0) {
+    return;
+  }
+
+  printf("Seal latency: avg %.1f us, p50 < %llu us, p99 < %llu us, max "
+         "%.1f us\n",
+         stats->total_latency_ns / 1e3 / stats->blocks,
+         (unsigned long long)seal_latency_percentile_us(stats, 50),
+         (unsigned long long)seal_latency_percentile_us(stats, 99),
+         stats->max_latency_ns / 1e3);
+  size_t first = 0, last = SEAL_LATENCY_BUCKETS - 1;
+  while (stats->latency[first] == 0) {
+    first++;
+  }
+  while (stats->latency[last] == 0) {
+    last--;
+  }
+  for (size_t i = first; i <= last; i++) {
+    printf("  %s %9llu us %8llu ", i + 1 < SEAL_LATENCY_BUCKETS ? "< " : ">=",
+           1ull << (i + 1 < SEAL_LATENCY_BUCKETS ? i : i - 1),
+           (unsigned long long)stats->latency[i]);
+    print_bar(stats->latency[i], stats->blocks);
+  }
+
+  printf("Block fill: avg %.0f%%\n", 100.0 * stats->total_fill / stats->blocks);
+  for (size_t i = 0; i < SEAL_FILL_BUCKETS; i++) {
+    if (i + 1 < SEAL_FILL_BUCKETS) {
+      printf("  %3zu-%3zu%%    %8llu ", 10 * i, 10 * i + 10,
+             (unsigned long long)stats->fill[i]);
+    } else {
+      printf("  full        %8llu ", (unsigned long long)stats->fill[i]);
+    }
+    print_bar(stats->fill[i], stats->blocks);
+  }
+}
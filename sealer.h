@@ -0,0 +1,108 @@
+#ifndef SEALER_H
+#define SEALER_H
+
+#include "pipeline.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEFAULT_SEAL_MAX_TRANSACTIONS 4096
+#define DEFAULT_SEAL_MAX_BYTES (4u << 20)
+#define DEFAULT_SEAL_MAX_DELAY_MS 100
+#define SEAL_LATENCY_BUCKETS 24 // powers of two microseconds, up to ~8 s
+#define SEAL_FILL_BUCKETS 11    // tenths of a block, the last one full
+
+// Zero fields take the defaults.
+typedef struct {
+  size_t max_transactions; // seal once this many are pending
+  size_t max_bytes;        // or once the pending payloads reach this size
+  int max_delay_ms;        // or once the oldest has waited this long
+} SealerConfig;
+
+typedef enum {
+  SEAL_BY_COUNT,
+  SEAL_BY_BYTES,
+  SEAL_BY_DELAY,
+  SEAL_BY_STOP, // what was pending when the sealer stopped
+  SEAL_REASON_COUNT
+} SealReason;
+
+typedef struct {
+  uint64_t transactions;
+  uint64_t bytes;
+  uint64_t rejected; // containing NUL, or submitted after the sealer stopped
+  uint64_t blocks;
+  uint64_t sealed_by[SEAL_REASON_COUNT];
+  // Oldest transaction's arrival to its block's hand-off to the pipeline.
+  // Bucket i counts latencies below 2^i us; the last bucket takes the rest.
+  uint64_t latency[SEAL_LATENCY_BUCKETS];
+  uint64_t total_latency_ns;
+  uint64_t max_latency_ns;
+  // Share of the count or byte limit a block used, whichever is larger.
+  // Bucket i counts blocks filled to [i/10, (i+1)/10); the last, full ones.
+  uint64_t fill[SEAL_FILL_BUCKETS];
+  double total_fill;
+} SealerStats;
+
+// Transactions collected into one block: payloads packed back to back,
+// each NUL-terminated, in a buffer that becomes the block's storage.
+typedef struct {
+  char *data;
+  size_t used;
+  size_t capacity;
+  size_t *offsets;
+  size_t count;
+  size_t offsets_capacity;
+  uint64_t first_ns; // arrival of the oldest transaction
+} SealBatch;
+
+// Long-running block producer. Any number of threads hand transactions to
+// sealer_submit(); the thread in sealer_run() seals them into blocks through
+// the pipeline whenever max_transactions or max_bytes are pending, or
+// max_delay_ms after the oldest pending one arrived, whichever comes first.
+// The delay is a timerfd armed when a batch opens, and full batches wake the
+// loop through an eventfd, so the sealer never sleeps or polls. A submitter
+// that fills a batch while the previous full one is still being sealed waits
+// for it, which passes pipeline backpressure on to producers.
+typedef struct {
+  Pipeline *pipeline;
+  SealerConfig config;
+  int epoll_fd;
+  int timer_fd;
+  int wake_fd; // eventfd written for full batches and by sealer_stop()
+  pthread_mutex_t lock;
+  pthread_cond_t drained; // signalled when the full batch is taken
+  SealBatch pending;
+  SealBatch full;     // waiting for the sealer, count 0 if none
+  SealReason full_by; // why it was closed
+  bool closed;        // sealer_run() has taken its last batch
+  atomic_bool stopping;
+  SealerStats stats;
+} Sealer;
+
+// -----------------------------------------------------------
+// Sealer management
+// -----------------------------------------------------------
+// The pipeline must outlive the sealer.
+Sealer *create_sealer(Pipeline *pipeline, const SealerConfig *config);
+void destroy_sealer(Sealer *sealer);
+
+// -----------------------------------------------------------
+// Sealer interaction
+// -----------------------------------------------------------
+// Copies len bytes of payload, which must not contain NUL. Safe from any
+// thread; returns false once the sealer is stopping.
+bool sealer_submit(Sealer *sealer, const char *payload, size_t len);
+// Seals until sealer_stop(), then seals whatever is still pending.
+bool sealer_run(Sealer *sealer);
+// Safe from any thread and from signal handlers.
+void sealer_stop(Sealer *sealer);
+void sealer_get_stats(Sealer *sealer, SealerStats *stats);
+// Upper bound of the latency bucket holding the given percentile, in us.
+uint64_t seal_latency_percentile_us(const SealerStats *stats,
+                                    double percentile);
+void print_sealer_stats(const SealerStats *stats);
+
+#endif // SEALER_H
@@ -0,0 +1,242 @@
+#include "sig_cache.h"
+#include <openssl/rand.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIG_CACHE_STRIPES 64
+
+// -----------------------------------------------------------
+// SipHash-2-4, used as the salted key function
+// -----------------------------------------------------------
+
+#define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPROUND                                                               \
+  do {                                                                         \
+    v0 += v1;                                                                  \
+    v1 = ROTL(v1, 13);                                                         \
+    v1 ^= v0;                                                                  \
+    v0 = ROTL(v0, 32);                                                         \
+    v2 += v3;                                                                  \
+    v3 = ROTL(v3, 16);                                                         \
+    v3 ^= v2;                                                                  \
+    v0 += v3;                                                                  \
+    v3 = ROTL(v3, 21);                                                         \
+    v3 ^= v0;                                                                  \
+    v2 += v1;                                                                  \
+    v1 = ROTL(v1, 17);                                                         \
+    v1 ^= v2;                                                                  \
+    v2 = ROTL(v2, 32);                                                         \
+  } while (0)
+
+typedef struct {
+  uint64_t v0, v1, v2, v3;
+  uint64_t tail;
+  size_t tail_len;
+  size_t total_len;
+} SipState;
+
+static void sip_init(SipState *state, uint64_t k0, uint64_t k1) {
+  state->v0 = 0x736f6d6570736575ull ^ k0;
+  state->v1 = 0x646f72616e646f6dull ^ k1;
+  state->v2 = 0x6c7967656e657261ull ^ k0;
+  state->v3 = 0x7465646279746573ull ^ k1;
+  state->tail = 0;
+  state->tail_len = 0;
+  state->total_len = 0;
+}
+
+static void sip_compress(SipState *state, uint64_t m) {
+  uint64_t v0 = state->v0, v1 = state->v1, v2 = state->v2, v3 = state->v3;
+  v3 ^= m;
+  SIPROUND;
+  SIPROUND;
+  v0 ^= m;
+  state->v0 = v0;
+  state->v1 = v1;
+  state->v2 = v2;
+  state->v3 = v3;
+}
+
+static void sip_update(SipState *state, const unsigned char *data,
+                       size_t len) {
+  state->total_len += len;
+  for (size_t i = 0; i < len; i++) {
+    state->tail |= (uint64_t)data[i] << (8 * state->tail_len);
+    if (++state->tail_len == 8) {
+      sip_compress(state, state->tail);
+      state->tail = 0;
+      state->tail_len = 0;
+    }
+  }
+}
+
+static uint64_t sip_final(SipState *state) {
+  sip_compress(state, state->tail | ((uint64_t)(state->total_len & 0xff) << 56));
+  uint64_t v0 = state->v0, v1 = state->v1, v2 = state->v2, v3 = state->v3;
+  v2 ^= 0xff;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static uint64_t siphash(uint64_t k0, uint64_t k1, const unsigned char *payload,
+                        size_t payload_len, const unsigned char *public_key,
+                        size_t public_key_len, const unsigned char *signature,
+                        size_t signature_len) {
+  SipState state;
+  sip_init(&state, k0, k1);
+  sip_update(&state, public_key, public_key_len);
+  sip_update(&state, signature, signature_len);
+  sip_update(&state, payload, payload_len);
+  return sip_final(&state);
+}
+
+// -----------------------------------------------------------
+// SigCache Implementation
+// -----------------------------------------------------------
+
+SigCache *create_sig_cache(size_t capacity) {
+  SigCache *cache = (SigCache *)calloc(1, sizeof(SigCache));
+  if (cache == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for signature cache\n");
+    return NULL;
+  }
+
+  size_t num_sets = 1;
+  while (num_sets * SIG_CACHE_WAYS < capacity) {
+    num_sets <<= 1;
+  }
+  cache->num_sets = num_sets;
+  cache->num_stripes =
+      num_sets < SIG_CACHE_STRIPES ? num_sets : SIG_CACHE_STRIPES;
+  cache->entries = (SigCacheEntry *)calloc(num_sets * SIG_CACHE_WAYS,
+                                           sizeof(SigCacheEntry));
+  cache->hands = (unsigned char *)calloc(num_sets, 1);
+  cache->stripes =
+      (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t) * cache->num_stripes);
+  if (cache->entries == NULL || cache->hands == NULL ||
+      cache->stripes == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for signature cache\n");
+    free(cache->entries);
+    free(cache->hands);
+    free(cache->stripes);
+    free(cache);
+    return NULL;
+  }
+  for (size_t i = 0; i < cache->num_stripes; i++) {
+    pthread_mutex_init(&cache->stripes[i], NULL);
+  }
+
+  // A per-process salt keeps an attacker from crafting colliding keys.
+  if (RAND_bytes((unsigned char *)cache->salt, sizeof(cache->salt)) != 1) {
+    fprintf(stderr, "ERROR: Failed to seed signature cache salt\n");
+    destroy_sig_cache(cache);
+    return NULL;
+  }
+  return cache;
+}
+
+void destroy_sig_cache(SigCache *cache) {
+  if (cache == NULL)
+    return;
+  for (size_t i = 0; i < cache->num_stripes; i++) {
+    pthread_mutex_destroy(&cache->stripes[i]);
+  }
+  free(cache->stripes);
+  free(cache->hands);
+  free(cache->entries);
+  free(cache);
+}
+
+SigCacheKey sig_cache_key(const SigCache *cache, const unsigned char *payload,
+                          size_t payload_len, const unsigned char *public_key,
+                          size_t public_key_len,
+                          const unsigned char *signature,
+                          size_t signature_len) {
+  SigCacheKey key;
+  key.lo = siphash(cache->salt[0], cache->salt[1], payload, payload_len,
+                   public_key, public_key_len, signature, signature_len);
+  key.hi = siphash(cache->salt[2], cache->salt[3], payload, payload_len,
+                   public_key, public_key_len, signature, signature_len);
+  return key;
+}
+
+static inline size_t set_index(const SigCache *cache, const SigCacheKey *key) {
+  return (size_t)(key->lo & (cache->num_sets - 1));
+}
+
+static inline pthread_mutex_t *set_lock(SigCache *cache, size_t set) {
+  return &cache->stripes[set & (cache->num_stripes - 1)];
+}
+
+bool sig_cache_contains(SigCache *cache, const SigCacheKey *key) {
+  size_t set = set_index(cache, key);
+  SigCacheEntry *ways = &cache->entries[set * SIG_CACHE_WAYS];
+  bool found = false;
+
+  pthread_mutex_lock(set_lock(cache, set));
+  for (size_t i = 0; i < SIG_CACHE_WAYS; i++) {
+    if (ways[i].used && ways[i].key.lo == key->lo &&
+        ways[i].key.hi == key->hi) {
+      ways[i].referenced = true;
+      found = true;
+      break;
+    }
+  }
+  pthread_mutex_unlock(set_lock(cache, set));
+
+  atomic_fetch_add_explicit(found ? &cache->hits : &cache->misses, 1,
+                            memory_order_relaxed);
+  return found;
+}
+
+void sig_cache_insert(SigCache *cache, const SigCacheKey *key) {
+  size_t set = set_index(cache, key);
+  SigCacheEntry *ways = &cache->entries[set * SIG_CACHE_WAYS];
+  bool evicted = false;
+
+  pthread_mutex_lock(set_lock(cache, set));
+  SigCacheEntry *slot = NULL;
+  for (size_t i = 0; i < SIG_CACHE_WAYS; i++) {
+    if (ways[i].used && ways[i].key.lo == key->lo &&
+        ways[i].key.hi == key->hi) {
+      pthread_mutex_unlock(set_lock(cache, set));
+      return;
+    }
+    if (!ways[i].used && slot == NULL) {
+      slot = &ways[i];
+    }
+  }
+  // CLOCK: sweep past recently hit entries, clearing their bit, and take
+  // the first one that has not been hit since the last sweep.
+  while (slot == NULL) {
+    SigCacheEntry *candidate = &ways[cache->hands[set]];
+    cache->hands[set] = (cache->hands[set] + 1) % SIG_CACHE_WAYS;
+    if (candidate->referenced) {
+      candidate->referenced = false;
+    } else {
+      slot = candidate;
+      evicted = true;
+    }
+  }
+  slot->key = *key;
+  slot->used = true;
+  slot->referenced = false;
+  pthread_mutex_unlock(set_lock(cache, set));
+
+  atomic_fetch_add_explicit(&cache->inserts, 1, memory_order_relaxed);
+  if (evicted) {
+    atomic_fetch_add_explicit(&cache->evictions, 1, memory_order_relaxed);
+  }
+}
+
+void sig_cache_get_stats(SigCache *cache, SigCacheStats *stats) {
+  stats->hits = atomic_load(&cache->hits);
+  stats->misses = atomic_load(&cache->misses);
+  stats->inserts = atomic_load(&cache->inserts);
+  stats->evictions = atomic_load(&cache->evictions);
+  stats->capacity = cache->num_sets * SIG_CACHE_WAYS;
+}
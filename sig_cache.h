@@ -0,0 +1,62 @@
+#ifndef SIG_CACHE_H
+#define SIG_CACHE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SIG_CACHE_WAYS 4
+
+// 128-bit salted fingerprint of (payload, public key, signature).
+typedef struct {
+  uint64_t lo;
+  uint64_t hi;
+} SigCacheKey;
+
+typedef struct {
+  SigCacheKey key;
+  bool used;
+  bool referenced; // CLOCK bit, set on hit and cleared as the hand passes
+} SigCacheEntry;
+
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t inserts;
+  uint64_t evictions;
+  size_t capacity;
+} SigCacheStats;
+
+// Set-associative cache of signatures that already verified. Each set holds
+// SIG_CACHE_WAYS entries and is guarded by one of a fixed number of striped
+// locks; a full set evicts with a per-set CLOCK hand.
+typedef struct {
+  SigCacheEntry *entries;
+  unsigned char *hands;
+  size_t num_sets; // power of two
+  pthread_mutex_t *stripes;
+  size_t num_stripes;
+  uint64_t salt[4];
+  atomic_uint_fast64_t hits;
+  atomic_uint_fast64_t misses;
+  atomic_uint_fast64_t inserts;
+  atomic_uint_fast64_t evictions;
+} SigCache;
+
+// -----------------------------------------------------------
+// Signature cache
+// -----------------------------------------------------------
+SigCache *create_sig_cache(size_t capacity);
+void destroy_sig_cache(SigCache *cache);
+SigCacheKey sig_cache_key(const SigCache *cache, const unsigned char *payload,
+                          size_t payload_len, const unsigned char *public_key,
+                          size_t public_key_len,
+                          const unsigned char *signature,
+                          size_t signature_len);
+bool sig_cache_contains(SigCache *cache, const SigCacheKey *key);
+void sig_cache_insert(SigCache *cache, const SigCacheKey *key);
+void sig_cache_get_stats(SigCache *cache, SigCacheStats *stats);
+
+#endif // SIG_CACHE_H
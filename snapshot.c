@@ -0,0 +1,384 @@
+#include "snapshot.h"
+#include "byteorder.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DEFAULT_CHUNK_ACCOUNTS 65536
+#define MAX_SNAPSHOT_THREADS 64
+
+typedef struct {
+  // write
+  const AccountEntry *sorted;
+  int fd;
+  // import
+  const unsigned char *map;
+  StateSet *state;
+  pthread_mutex_t state_lock;
+  // shared
+  uint64_t num_accounts;
+  uint64_t num_chunks;
+  uint32_t chunk_accounts;
+  size_t data_offset;
+  unsigned char *chunk_hashes;
+  atomic_size_t next_chunk;
+  atomic_bool failed;
+} SnapshotJob;
+
+// -----------------------------------------------------------
+// Snapshot Implementation
+// -----------------------------------------------------------
+
+static size_t snapshot_threads(size_t num_threads) {
+  if (num_threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = cpus > 0 ? (size_t)cpus : 1;
+  }
+  return num_threads > MAX_SNAPSHOT_THREADS ? MAX_SNAPSHOT_THREADS
+                                            : num_threads;
+}
+
+static void run_workers(void *(*worker)(void *), SnapshotJob *job,
+                        size_t num_threads) {
+  pthread_t threads[MAX_SNAPSHOT_THREADS];
+  size_t started = 0;
+  for (; started + 1 < num_threads; started++) {
+    if (pthread_create(&threads[started], NULL, worker, job) != 0) {
+      break;
+    }
+  }
+  worker(job); // the calling thread always takes part
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+static inline uint64_t chunk_length(const SnapshotJob *job, uint64_t chunk) {
+  uint64_t first = chunk * job->chunk_accounts;
+  uint64_t remaining = job->num_accounts - first;
+  return remaining < job->chunk_accounts ? remaining : job->chunk_accounts;
+}
+
+static int compare_entries(const void *a, const void *b) {
+  const AccountEntry *x = (const AccountEntry *)a;
+  const AccountEntry *y = (const AccountEntry *)b;
+  if (x->key[0] != y->key[0])
+    return x->key[0] < y->key[0] ? -1 : 1;
+  if (x->key[1] != y->key[1])
+    return x->key[1] < y->key[1] ? -1 : 1;
+  return 0;
+}
+
+static void encode_entry(unsigned char *p, const AccountEntry *entry) {
+  store_le64(p, entry->key[0]);
+  store_le64(p + 8, entry->key[1]);
+  store_le64(p + 16, entry->balance);
+  store_le64(p + 24, entry->nonce);
+}
+
+static void decode_entry(const unsigned char *p, AccountEntry *entry) {
+  entry->key[0] = load_le64(p);
+  entry->key[1] = load_le64(p + 8);
+  entry->balance = load_le64(p + 16);
+  entry->nonce = load_le64(p + 24);
+}
+
+// Merkle root over the chunk hashes; all zero for an empty snapshot.
+static bool snapshot_root(const unsigned char *chunk_hashes,
+                          uint64_t num_chunks, unsigned char *root) {
+  memset(root, 0, HASH_SIZE);
+  if (num_chunks == 0) {
+    return true;
+  }
+  unsigned char **leaves =
+      (unsigned char **)malloc(sizeof(unsigned char *) * num_chunks);
+  if (leaves == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for snapshot root\n");
+    return false;
+  }
+  for (uint64_t i = 0; i < num_chunks; i++) {
+    leaves[i] = (unsigned char *)chunk_hashes + i * HASH_SIZE;
+  }
+  MerkleTree *tree = create_tree(leaves, num_chunks);
+  free(leaves);
+  if (tree == NULL || tree->root == NULL) {
+    free_tree(tree);
+    return false;
+  }
+  memcpy(root, tree->root->hash, HASH_SIZE);
+  free_tree(tree);
+  return true;
+}
+
+static void *write_worker(void *arg) {
+  SnapshotJob *job = (SnapshotJob *)arg;
+  size_t buffer_size = (size_t)job->chunk_accounts * SNAPSHOT_ENTRY_SIZE;
+  unsigned char *buffer = (unsigned char *)malloc(buffer_size);
+  if (buffer == NULL) {
+    atomic_store(&job->failed, true);
+    return NULL;
+  }
+
+  for (;;) {
+    uint64_t chunk = atomic_fetch_add(&job->next_chunk, 1);
+    if (chunk >= job->num_chunks || atomic_load(&job->failed)) {
+      break;
+    }
+    uint64_t count = chunk_length(job, chunk);
+    const AccountEntry *entries = job->sorted + chunk * job->chunk_accounts;
+    for (uint64_t i = 0; i < count; i++) {
+      encode_entry(buffer + i * SNAPSHOT_ENTRY_SIZE, &entries[i]);
+    }
+
+    size_t length = count * SNAPSHOT_ENTRY_SIZE;
+    unsigned int hash_length;
+    compute_hash(buffer, length, job->chunk_hashes + chunk * HASH_SIZE,
+                 &hash_length);
+    off_t offset = job->data_offset + chunk * buffer_size;
+    if (pwrite(job->fd, buffer, length, offset) != (ssize_t)length) {
+      fprintf(stderr, "ERROR: Failed to write snapshot chunk %llu\n",
+              (unsigned long long)chunk);
+      atomic_store(&job->failed, true);
+    }
+  }
+  free(buffer);
+  return NULL;
+}
+
+bool write_snapshot(const StateSet *state, Block *block, uint64_t height,
+                    const char *path, uint32_t chunk_accounts,
+                    size_t num_threads, SnapshotInfo *info) {
+  SnapshotJob job;
+  memset(&job, 0, sizeof(job));
+  job.chunk_accounts = chunk_accounts ? chunk_accounts : DEFAULT_CHUNK_ACCOUNTS;
+  job.num_accounts = state->count;
+  job.num_chunks =
+      (job.num_accounts + job.chunk_accounts - 1) / job.chunk_accounts;
+  job.data_offset = SNAPSHOT_HEADER_SIZE + job.num_chunks * HASH_SIZE;
+
+  // Sorting makes the snapshot independent of table layout, so every node
+  // produces the same chunks for the same state.
+  AccountEntry *sorted =
+      (AccountEntry *)malloc(sizeof(AccountEntry) * (job.num_accounts + 1));
+  job.chunk_hashes = (unsigned char *)malloc(HASH_SIZE * (job.num_chunks + 1));
+  if (sorted == NULL || job.chunk_hashes == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for snapshot\n");
+    free(sorted);
+    free(job.chunk_hashes);
+    return false;
+  }
+  size_t n = 0;
+  for (size_t i = 0; i < state->capacity; i++) {
+    const AccountEntry *entry = &state->entries[i];
+    if (entry->key[0] != 0 || entry->key[1] != 0) {
+      sorted[n++] = *entry;
+    }
+  }
+  qsort(sorted, n, sizeof(AccountEntry), compare_entries);
+  job.sorted = sorted;
+
+  bool ok = false;
+  job.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (job.fd < 0) {
+    perror("ERROR: Failed to create snapshot");
+    goto cleanup;
+  }
+
+  run_workers(write_worker, &job, snapshot_threads(num_threads));
+  if (atomic_load(&job.failed)) {
+    goto cleanup;
+  }
+
+  SnapshotInfo result;
+  result.height = height;
+  result.num_accounts = job.num_accounts;
+  result.num_chunks = job.num_chunks;
+  result.chunk_accounts = job.chunk_accounts;
+  unsigned int hash_length;
+  calculate_block_hash(block, result.block_hash, &hash_length);
+  if (!snapshot_root(job.chunk_hashes, job.num_chunks, result.root)) {
+    goto cleanup;
+  }
+
+  unsigned char header[SNAPSHOT_HEADER_SIZE];
+  memcpy(header, SNAPSHOT_MAGIC, 8);
+  store_le32(header + 8, result.chunk_accounts);
+  store_le32(header + 12, 0);
+  store_le64(header + 16, result.height);
+  store_le64(header + 24, result.num_accounts);
+  store_le64(header + 32, result.num_chunks);
+  memcpy(header + 40, result.block_hash, HASH_SIZE);
+  memcpy(header + 40 + HASH_SIZE, result.root, HASH_SIZE);
+
+  size_t table_size = job.num_chunks * HASH_SIZE;
+  if (pwrite(job.fd, job.chunk_hashes, table_size, SNAPSHOT_HEADER_SIZE) !=
+          (ssize_t)table_size ||
+      pwrite(job.fd, header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+    perror("ERROR: Failed to write snapshot header");
+    goto cleanup;
+  }
+  if (info != NULL) {
+    *info = result;
+  }
+  ok = true;
+
+cleanup:
+  if (job.fd >= 0 && close(job.fd) != 0) {
+    ok = false;
+  }
+  free(sorted);
+  free(job.chunk_hashes);
+  return ok;
+}
+
+// Verifies one chunk against the authenticated chunk table, then inserts
+// it. Only the insert is serialized, so hashing runs on every thread.
+static void *import_worker(void *arg) {
+  SnapshotJob *job = (SnapshotJob *)arg;
+  size_t chunk_bytes = (size_t)job->chunk_accounts * SNAPSHOT_ENTRY_SIZE;
+
+  for (;;) {
+    uint64_t chunk = atomic_fetch_add(&job->next_chunk, 1);
+    if (chunk >= job->num_chunks || atomic_load(&job->failed)) {
+      break;
+    }
+    uint64_t count = chunk_length(job, chunk);
+    const unsigned char *data = job->map + job->data_offset + chunk * chunk_bytes;
+
+    unsigned char digest[HASH_SIZE];
+    unsigned int digest_length;
+    compute_hash(data, count * SNAPSHOT_ENTRY_SIZE, digest, &digest_length);
+    if (memcmp(digest, job->chunk_hashes + chunk * HASH_SIZE, HASH_SIZE) !=
+        0) {
+      fprintf(stderr, "ERROR: Snapshot chunk %llu does not match its hash\n",
+              (unsigned long long)chunk);
+      atomic_store(&job->failed, true);
+      break;
+    }
+
+    // Keys must be strictly increasing, across chunk boundaries too, which
+    // rules out duplicate accounts.
+    AccountEntry previous = {0}, entry;
+    if (chunk > 0) {
+      decode_entry(data - SNAPSHOT_ENTRY_SIZE, &previous);
+    }
+    pthread_mutex_lock(&job->state_lock);
+    for (uint64_t i = 0; i < count; i++) {
+      decode_entry(data + i * SNAPSHOT_ENTRY_SIZE, &entry);
+      if ((i > 0 || chunk > 0) && compare_entries(&previous, &entry) >= 0) {
+        atomic_store(&job->failed, true);
+        break;
+      }
+      if (!state_insert_entry(job->state, &entry)) {
+        atomic_store(&job->failed, true);
+        break;
+      }
+      previous = entry;
+    }
+    pthread_mutex_unlock(&job->state_lock);
+  }
+  return NULL;
+}
+
+StateSet *import_snapshot(const char *path,
+                          const unsigned char *expected_block_hash,
+                          uint64_t expected_height,
+                          const unsigned char *expected_root,
+                          size_t num_threads, SnapshotInfo *info) {
+  if (expected_block_hash == NULL || expected_root == NULL) {
+    fprintf(stderr, "ERROR: Snapshot import needs a trusted block and root\n");
+    return NULL;
+  }
+  StateSet *state = NULL;
+  SnapshotJob job;
+  memset(&job, 0, sizeof(job));
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror("ERROR: Failed to open snapshot");
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < SNAPSHOT_HEADER_SIZE) {
+    fprintf(stderr, "ERROR: Snapshot is truncated\n");
+    close(fd);
+    return NULL;
+  }
+  size_t size = (size_t)st.st_size;
+  unsigned char *map =
+      (unsigned char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror("ERROR: Failed to map snapshot");
+    return NULL;
+  }
+  madvise(map, size, MADV_SEQUENTIAL);
+
+  SnapshotInfo header;
+  header.chunk_accounts = load_le32(map + 8);
+  header.height = load_le64(map + 16);
+  header.num_accounts = load_le64(map + 24);
+  header.num_chunks = load_le64(map + 32);
+  memcpy(header.block_hash, map + 40, HASH_SIZE);
+  memcpy(header.root, map + 40 + HASH_SIZE, HASH_SIZE);
+
+  job.map = map;
+  job.chunk_accounts = header.chunk_accounts;
+  job.num_accounts = header.num_accounts;
+  job.num_chunks = header.num_chunks;
+  job.data_offset = SNAPSHOT_HEADER_SIZE + job.num_chunks * HASH_SIZE;
+  job.chunk_hashes = map + SNAPSHOT_HEADER_SIZE;
+
+  if (memcmp(map, SNAPSHOT_MAGIC, 8) != 0 || job.chunk_accounts == 0 ||
+      job.num_chunks !=
+          (job.num_accounts + job.chunk_accounts - 1) / job.chunk_accounts ||
+      job.num_chunks > size / HASH_SIZE ||
+      job.num_accounts > size / SNAPSHOT_ENTRY_SIZE ||
+      job.data_offset + job.num_accounts * SNAPSHOT_ENTRY_SIZE != size) {
+    fprintf(stderr, "ERROR: Snapshot header is malformed\n");
+    goto cleanup;
+  }
+  if (header.height != expected_height ||
+      memcmp(header.block_hash, expected_block_hash, HASH_SIZE) != 0) {
+    fprintf(stderr, "ERROR: Snapshot is for a different block\n");
+    goto cleanup;
+  }
+  unsigned char root[HASH_SIZE];
+  if (!snapshot_root(job.chunk_hashes, job.num_chunks, root) ||
+      memcmp(root, header.root, HASH_SIZE) != 0 ||
+      memcmp(root, expected_root, HASH_SIZE) != 0) {
+    fprintf(stderr, "ERROR: Snapshot chunk table does not match its root\n");
+    goto cleanup;
+  }
+
+  state = create_state(0);
+  if (state == NULL || !state_reserve(state, job.num_accounts)) {
+    destroy_state(state);
+    state = NULL;
+    goto cleanup;
+  }
+  job.state = state;
+  pthread_mutex_init(&job.state_lock, NULL);
+  run_workers(import_worker, &job, snapshot_threads(num_threads));
+  pthread_mutex_destroy(&job.state_lock);
+
+  if (atomic_load(&job.failed)) {
+    fprintf(stderr, "ERROR: Snapshot import failed\n");
+    destroy_state(state);
+    state = NULL;
+    goto cleanup;
+  }
+  if (info != NULL) {
+    *info = header;
+  }
+
+cleanup:
+  munmap(map, size);
+  return state;
+}
@@ -0,0 +1,49 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "blockchain.h"
+#include "state.h"
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC "CBSNAP01"
+#define SNAPSHOT_HEADER_SIZE 168
+#define SNAPSHOT_ENTRY_SIZE 32
+
+// On-disk layout, all integers little-endian:
+//
+//   header      magic[8] chunk_accounts:u32 reserved:u32 height:u64
+//               num_accounts:u64 num_chunks:u64 block_hash[64] root[64]
+//   chunk table num_chunks x SHA3-512 of each chunk
+//   chunks      accounts sorted by key, chunk_accounts per chunk (the last
+//               one may be short), each key[16] balance:u64 nonce:u64
+//
+// root is the Merkle root over the chunk hashes. A snapshot is trusted by
+// checking block_hash against the header chain at height and root against a
+// commitment for that block, after which every chunk can be verified and
+// imported independently.
+typedef struct {
+  uint64_t height;
+  unsigned char block_hash[HASH_SIZE];
+  unsigned char root[HASH_SIZE];
+  uint64_t num_accounts;
+  uint64_t num_chunks;
+  uint32_t chunk_accounts;
+} SnapshotInfo;
+
+// -----------------------------------------------------------
+// Snapshots
+// -----------------------------------------------------------
+// num_threads == 0 uses one thread per online CPU. chunk_accounts == 0
+// picks a default.
+bool write_snapshot(const StateSet *state, Block *block, uint64_t height,
+                    const char *path, uint32_t chunk_accounts,
+                    size_t num_threads, SnapshotInfo *info);
+// The expected block hash, height and root all come from the caller's own
+// chain; the file must match each of them. Returns a new state on success.
+StateSet *import_snapshot(const char *path,
+                          const unsigned char *expected_block_hash,
+                          uint64_t expected_height,
+                          const unsigned char *expected_root,
+                          size_t num_threads, SnapshotInfo *info);
+
+#endif // SNAPSHOT_H
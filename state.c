@@ -0,0 +1,388 @@
+#include "state.h"
+#include "hex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_STATE_CAPACITY 1024
+#define MAX_LOAD_NUMERATOR 7
+#define MAX_LOAD_DENOMINATOR 10
+
+// -----------------------------------------------------------
+// StateSet Implementation
+// -----------------------------------------------------------
+
+static inline bool slot_empty(const AccountEntry *entry) {
+  return entry->key[0] == 0 && entry->key[1] == 0;
+}
+
+static inline bool key_equal(const uint64_t *a, const uint64_t *b) {
+  return a[0] == b[0] && a[1] == b[1];
+}
+
+// Keys are slices of a SHA3 digest, so the low bits index well as they are.
+static inline size_t home_slot(const StateSet *state, const uint64_t *key) {
+  return (size_t)key[0] & (state->capacity - 1);
+}
+
+StateSet *create_state(size_t initial_capacity) {
+  StateSet *state = (StateSet *)malloc(sizeof(StateSet));
+  if (state == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for state\n");
+    return NULL;
+  }
+  size_t capacity = DEFAULT_STATE_CAPACITY;
+  while (capacity < initial_capacity) {
+    capacity <<= 1;
+  }
+  state->entries = (AccountEntry *)calloc(capacity, sizeof(AccountEntry));
+  if (state->entries == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for state table\n");
+    free(state);
+    return NULL;
+  }
+  state->capacity = capacity;
+  state->count = 0;
+  return state;
+}
+
+void destroy_state(StateSet *state) {
+  if (state == NULL)
+    return;
+  free(state->entries);
+  free(state);
+}
+
+void account_key(const unsigned char *public_key, uint64_t *key) {
+  unsigned char digest[HASH_SIZE];
+  unsigned int digest_length;
+  compute_hash(public_key, PUBLIC_KEY_SIZE, digest, &digest_length);
+  memcpy(key, digest, ACCOUNT_KEY_SIZE);
+  if (key[0] == 0 && key[1] == 0) {
+    key[1] = 1; // keep clear of the empty-slot marker
+  }
+}
+
+const AccountEntry *state_lookup(const StateSet *state, const uint64_t *key) {
+  size_t mask = state->capacity - 1;
+  for (size_t i = home_slot(state, key);; i = (i + 1) & mask) {
+    const AccountEntry *entry = &state->entries[i];
+    if (slot_empty(entry)) {
+      return NULL;
+    }
+    if (key_equal(entry->key, key)) {
+      return entry;
+    }
+  }
+}
+
+static bool grow_state(StateSet *state) {
+  size_t old_capacity = state->capacity;
+  AccountEntry *old_entries = state->entries;
+  AccountEntry *entries =
+      (AccountEntry *)calloc(old_capacity * 2, sizeof(AccountEntry));
+  if (entries == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for state table\n");
+    return false;
+  }
+  state->entries = entries;
+  state->capacity = old_capacity * 2;
+
+  size_t mask = state->capacity - 1;
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (slot_empty(&old_entries[i])) {
+      continue;
+    }
+    size_t j = home_slot(state, old_entries[i].key);
+    while (!slot_empty(&entries[j])) {
+      j = (j + 1) & mask;
+    }
+    entries[j] = old_entries[i];
+  }
+  free(old_entries);
+  return true;
+}
+
+// Returns the entry for key, inserting a zero-balance account if needed.
+// Any previously returned entry pointer is invalidated.
+static AccountEntry *state_upsert(StateSet *state, const uint64_t *key) {
+  if ((state->count + 1) * MAX_LOAD_DENOMINATOR >
+          state->capacity * MAX_LOAD_NUMERATOR &&
+      !grow_state(state)) {
+    return NULL;
+  }
+  size_t mask = state->capacity - 1;
+  size_t i = home_slot(state, key);
+  while (!slot_empty(&state->entries[i])) {
+    if (key_equal(state->entries[i].key, key)) {
+      return &state->entries[i];
+    }
+    i = (i + 1) & mask;
+  }
+  AccountEntry *entry = &state->entries[i];
+  entry->key[0] = key[0];
+  entry->key[1] = key[1];
+  entry->balance = 0;
+  entry->nonce = 0;
+  state->count++;
+  return entry;
+}
+
+static void state_remove(StateSet *state, const uint64_t *key) {
+  size_t mask = state->capacity - 1;
+  size_t i = home_slot(state, key);
+  while (!key_equal(state->entries[i].key, key)) {
+    if (slot_empty(&state->entries[i])) {
+      return;
+    }
+    i = (i + 1) & mask;
+  }
+
+  // Shift back any later entry in the run whose home slot does not lie
+  // cyclically in (hole, j], so lookups never stop short.
+  size_t hole = i;
+  for (size_t j = (i + 1) & mask; !slot_empty(&state->entries[j]);
+       j = (j + 1) & mask) {
+    size_t home = home_slot(state, state->entries[j].key);
+    bool in_range = hole <= j ? (hole < home && home <= j)
+                              : (hole < home || home <= j);
+    if (!in_range) {
+      state->entries[hole] = state->entries[j];
+      hole = j;
+    }
+  }
+  memset(&state->entries[hole], 0, sizeof(AccountEntry));
+  state->count--;
+}
+
+bool state_credit(StateSet *state, const unsigned char *public_key,
+                  uint64_t amount) {
+  uint64_t key[2];
+  account_key(public_key, key);
+  AccountEntry *entry = state_upsert(state, key);
+  if (entry == NULL || entry->balance + amount < entry->balance) {
+    return false;
+  }
+  entry->balance += amount;
+  return true;
+}
+
+// Grows the table up front so num_accounts inserts never rehash.
+bool state_reserve(StateSet *state, size_t num_accounts) {
+  while (num_accounts * MAX_LOAD_DENOMINATOR >
+         state->capacity * MAX_LOAD_NUMERATOR) {
+    if (!grow_state(state)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Stores an entry verbatim, replacing any account with the same key.
+bool state_insert_entry(StateSet *state, const AccountEntry *entry) {
+  if (slot_empty(entry)) {
+    return false;
+  }
+  AccountEntry *slot = state_upsert(state, entry->key);
+  if (slot == NULL) {
+    return false;
+  }
+  *slot = *entry;
+  return true;
+}
+
+void state_get_stats(const StateSet *state, StateStats *stats) {
+  stats->accounts = state->count;
+  stats->capacity = state->capacity;
+  stats->bytes = sizeof(StateSet) + state->capacity * sizeof(AccountEntry);
+  stats->bytes_per_account =
+      state->count ? (double)stats->bytes / state->count : 0.0;
+  stats->load_factor = (double)state->count / state->capacity;
+}
+
+// -----------------------------------------------------------
+// Block application
+// -----------------------------------------------------------
+
+static bool parse_u64(const char **cursor, const char *end, uint64_t *value) {
+  const char *p = *cursor;
+  uint64_t result = 0;
+  if (p == end || *p < '0' || *p > '9') {
+    return false;
+  }
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    uint64_t digit = (uint64_t)(*p - '0');
+    if (result > (UINT64_MAX - digit) / 10) {
+      return false;
+    }
+    result = result * 10 + digit;
+  }
+  *value = result;
+  *cursor = p;
+  return true;
+}
+
+bool parse_transfer(const Transaction *transaction, unsigned char *recipient,
+                    uint64_t *amount, uint64_t *nonce) {
+  const char *p = transaction->payload;
+  const char *end = p + transaction->payload_len;
+  if (transaction->payload_len < PUBLIC_KEY_SIZE * 2 + 1) {
+    return false;
+  }
+  if (!hex_decode(p, PUBLIC_KEY_SIZE * 2, recipient)) {
+    return false;
+  }
+  p += PUBLIC_KEY_SIZE * 2;
+  if (*p++ != ':' || !parse_u64(&p, end, amount) || p == end || *p++ != ':' ||
+      !parse_u64(&p, end, nonce)) {
+    return false;
+  }
+  return p == end;
+}
+
+// Maps an account key to its undo record so accounts touched by several
+// transactions in the same block are only recorded the first time.
+typedef struct {
+  uint32_t *slots; // record index + 1, 0 marks an empty slot
+  size_t mask;
+} UndoIndex;
+
+static bool init_undo_index(UndoIndex *index, size_t num_transactions) {
+  size_t capacity = 16;
+  while (capacity < num_transactions * 4) {
+    capacity <<= 1;
+  }
+  index->slots = (uint32_t *)calloc(capacity, sizeof(uint32_t));
+  if (index->slots == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for undo index\n");
+    return false;
+  }
+  index->mask = capacity - 1;
+  return true;
+}
+
+static bool record_undo(StateUndo *undo, UndoIndex *index,
+                        const uint64_t *key, const AccountEntry *entry) {
+  size_t slot = (size_t)(key[0] ^ key[1]) & index->mask;
+  while (index->slots[slot] != 0) {
+    const StateUndoEntry *record = &undo->entries[index->slots[slot] - 1];
+    if (record->key[0] == key[0] && record->key[1] == key[1]) {
+      return true;
+    }
+    slot = (slot + 1) & index->mask;
+  }
+
+  if (undo->count == undo->capacity) {
+    size_t capacity = undo->capacity ? undo->capacity * 2 : 16;
+    StateUndoEntry *grown = (StateUndoEntry *)realloc(
+        undo->entries, sizeof(StateUndoEntry) * capacity);
+    if (grown == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate memory for undo data\n");
+      return false;
+    }
+    undo->entries = grown;
+    undo->capacity = capacity;
+  }
+  StateUndoEntry *record = &undo->entries[undo->count++];
+  record->key[0] = key[0];
+  record->key[1] = key[1];
+  record->existed = entry != NULL;
+  record->balance = entry ? entry->balance : 0;
+  record->nonce = entry ? entry->nonce : 0;
+  index->slots[slot] = (uint32_t)undo->count;
+  return true;
+}
+
+static bool apply_transfer(StateSet *state, const Transaction *transaction,
+                           StateUndo *undo, UndoIndex *index) {
+  unsigned char recipient[PUBLIC_KEY_SIZE];
+  uint64_t amount, nonce;
+  if (!parse_transfer(transaction, recipient, &amount, &nonce)) {
+    return false;
+  }
+
+  uint64_t sender_key[2], recipient_key[2];
+  account_key(transaction->public_key, sender_key);
+  account_key(recipient, recipient_key);
+
+  const AccountEntry *sender = state_lookup(state, sender_key);
+  if (sender == NULL || sender->balance < amount || sender->nonce != nonce) {
+    return false;
+  }
+  const AccountEntry *receiver = state_lookup(state, recipient_key);
+  if (receiver != NULL && sender != receiver &&
+      receiver->balance + amount < receiver->balance) {
+    return false;
+  }
+  if (!record_undo(undo, index, sender_key, sender) ||
+      !record_undo(undo, index, recipient_key, receiver)) {
+    return false;
+  }
+
+  AccountEntry *entry = (AccountEntry *)sender;
+  entry->balance -= amount;
+  entry->nonce++;
+  entry = state_upsert(state, recipient_key);
+  if (entry == NULL) {
+    return false;
+  }
+  entry->balance += amount;
+  return true;
+}
+
+bool state_apply_transactions(StateSet *state,
+                              const Transaction *transactions,
+                              size_t num_transactions, StateUndo *undo) {
+  undo->entries = NULL;
+  undo->count = 0;
+  undo->capacity = 0;
+  if (num_transactions == 0) {
+    return true;
+  }
+  UndoIndex index;
+  if (!init_undo_index(&index, num_transactions)) {
+    return false;
+  }
+  for (size_t i = 0; i < num_transactions; i++) {
+    if (!apply_transfer(state, &transactions[i], undo, &index)) {
+      free(index.slots);
+      state_revert(state, undo);
+      free_state_undo(undo);
+      return false;
+    }
+  }
+  free(index.slots);
+  // Trim the growth slack; undo data lives as long as the block does.
+  if (undo->count < undo->capacity) {
+    StateUndoEntry *trimmed = (StateUndoEntry *)realloc(
+        undo->entries, sizeof(StateUndoEntry) * undo->count);
+    if (trimmed != NULL) {
+      undo->entries = trimmed;
+      undo->capacity = undo->count;
+    }
+  }
+  return true;
+}
+
+// Restores every touched account to its pre-block value.
+void state_revert(StateSet *state, const StateUndo *undo) {
+  for (size_t i = undo->count; i-- > 0;) {
+    const StateUndoEntry *record = &undo->entries[i];
+    if (!record->existed) {
+      state_remove(state, record->key);
+      continue;
+    }
+    AccountEntry *entry = state_upsert(state, record->key);
+    if (entry != NULL) {
+      entry->balance = record->balance;
+      entry->nonce = record->nonce;
+    }
+  }
+}
+
+void free_state_undo(StateUndo *undo) {
+  free(undo->entries);
+  undo->entries = NULL;
+  undo->count = 0;
+  undo->capacity = 0;
+}
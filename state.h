@@ -0,0 +1,78 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include "transaction.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ACCOUNT_KEY_SIZE 16
+
+// Account balances keyed by the first ACCOUNT_KEY_SIZE bytes of the
+// SHA3-512 of the owner's Ed25519 public key.
+typedef struct {
+  uint64_t key[2]; // all-zero marks an empty slot
+  uint64_t balance;
+  uint64_t nonce;
+} AccountEntry;
+
+// Open-addressing table with linear probing; removals use backward-shift
+// deletion so no tombstones build up.
+typedef struct {
+  AccountEntry *entries;
+  size_t capacity; // power of two
+  size_t count;
+} StateSet;
+
+// Pre-block value of every account a block touched, recorded once per
+// account so the records can be restored in any order. Packs into 32 bytes.
+typedef struct {
+  uint64_t key[2];
+  uint64_t balance;
+  uint64_t nonce : 63;
+  uint64_t existed : 1;
+} StateUndoEntry;
+
+typedef struct {
+  StateUndoEntry *entries;
+  size_t count;
+  size_t capacity;
+} StateUndo;
+
+typedef struct {
+  size_t accounts;
+  size_t capacity;
+  size_t bytes;
+  double bytes_per_account;
+  double load_factor;
+} StateStats;
+
+// -----------------------------------------------------------
+// State management
+// -----------------------------------------------------------
+StateSet *create_state(size_t initial_capacity);
+void destroy_state(StateSet *state);
+void account_key(const unsigned char *public_key, uint64_t *key);
+const AccountEntry *state_lookup(const StateSet *state, const uint64_t *key);
+bool state_credit(StateSet *state, const unsigned char *public_key,
+                  uint64_t amount);
+bool state_reserve(StateSet *state, size_t num_accounts);
+bool state_insert_entry(StateSet *state, const AccountEntry *entry);
+void state_get_stats(const StateSet *state, StateStats *stats);
+
+// -----------------------------------------------------------
+// Block application
+// -----------------------------------------------------------
+// A transaction's payload is "<recipient public key hex>:<amount>:<nonce>",
+// where nonce must equal the sender's current nonce. Applying a block is
+// all or nothing: on failure the state is left as it was.
+bool parse_transfer(const Transaction *transaction,
+                    unsigned char *recipient, uint64_t *amount,
+                    uint64_t *nonce);
+bool state_apply_transactions(StateSet *state,
+                              const Transaction *transactions,
+                              size_t num_transactions, StateUndo *undo);
+void state_revert(StateSet *state, const StateUndo *undo);
+void free_state_undo(StateUndo *undo);
+
+#endif // STATE_H
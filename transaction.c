@@ -0,0 +1,219 @@
+#include "transaction.h"
+#include <openssl/err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// -----------------------------------------------------------
+// Transaction Implementation
+// -----------------------------------------------------------
+
+static SigCache *signature_cache = NULL;
+
+void set_signature_cache(SigCache *cache) { signature_cache = cache; }
+
+bool generate_keypair(Keypair *keypair) {
+  keypair->pkey = EVP_PKEY_Q_keygen(NULL, NULL, "ED25519");
+  if (keypair->pkey == NULL) {
+    fprintf(stderr, "ERROR: Failed to generate Ed25519 key\n");
+    ERR_print_errors_fp(stderr);
+    return false;
+  }
+  size_t len = PUBLIC_KEY_SIZE;
+  if (EVP_PKEY_get_raw_public_key(keypair->pkey, keypair->public_key, &len) !=
+          1 ||
+      len != PUBLIC_KEY_SIZE) {
+    fprintf(stderr, "ERROR: Failed to export Ed25519 public key\n");
+    EVP_PKEY_free(keypair->pkey);
+    keypair->pkey = NULL;
+    return false;
+  }
+  return true;
+}
+
+void free_keypair(Keypair *keypair) {
+  EVP_PKEY_free(keypair->pkey);
+  keypair->pkey = NULL;
+}
+
+bool sign_transaction(Transaction *transaction, const Keypair *keypair,
+                      const char *payload, size_t payload_len) {
+  bool ok = false;
+  EVP_MD_CTX *digest_context = EVP_MD_CTX_new();
+  transaction->payload = (char *)malloc(payload_len + 1);
+  if (digest_context == NULL || transaction->payload == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for transaction\n");
+    goto cleanup;
+  }
+  memcpy(transaction->payload, payload, payload_len);
+  transaction->payload[payload_len] = '\0';
+  transaction->payload_len = payload_len;
+  memcpy(transaction->public_key, keypair->public_key, PUBLIC_KEY_SIZE);
+
+  size_t sig_len = SIGNATURE_SIZE;
+  if (EVP_DigestSignInit(digest_context, NULL, NULL, NULL, keypair->pkey) !=
+          1 ||
+      EVP_DigestSign(digest_context, transaction->signature, &sig_len,
+                     (const unsigned char *)payload, payload_len) != 1) {
+    fprintf(stderr, "ERROR: Failed to sign transaction\n");
+    ERR_print_errors_fp(stderr);
+    goto cleanup;
+  }
+  ok = true;
+
+cleanup:
+  EVP_MD_CTX_free(digest_context);
+  if (!ok) {
+    free(transaction->payload);
+    transaction->payload = NULL;
+  }
+  return ok;
+}
+
+bool copy_transaction(Transaction *dst, const Transaction *src) {
+  *dst = *src;
+  dst->payload = (char *)malloc(src->payload_len + 1);
+  if (dst->payload == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for transaction\n");
+    return false;
+  }
+  memcpy(dst->payload, src->payload, src->payload_len + 1);
+  return true;
+}
+
+void free_transaction(Transaction *transaction) {
+  if (transaction != NULL) {
+    free(transaction->payload);
+    transaction->payload = NULL;
+  }
+}
+
+// The id commits to the payload, signer and signature; it is the leaf the
+// transaction contributes to its block's Merkle tree.
+void transaction_id(const Transaction *transaction, unsigned char *id) {
+  size_t size = transaction->payload_len + PUBLIC_KEY_SIZE + SIGNATURE_SIZE;
+  unsigned char stack_buffer[512];
+  unsigned char *buffer =
+      size <= sizeof(stack_buffer) ? stack_buffer : (unsigned char *)malloc(size);
+  unsigned int id_length;
+  if (buffer == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for transaction id\n");
+    memset(id, 0, HASH_SIZE);
+    return;
+  }
+
+  memcpy(buffer, transaction->payload, transaction->payload_len);
+  memcpy(buffer + transaction->payload_len, transaction->public_key,
+         PUBLIC_KEY_SIZE);
+  memcpy(buffer + transaction->payload_len + PUBLIC_KEY_SIZE,
+         transaction->signature, SIGNATURE_SIZE);
+  compute_hash(buffer, size, id, &id_length);
+
+  if (buffer != stack_buffer) {
+    free(buffer);
+  }
+}
+
+bool verify_transaction(const Transaction *transaction) {
+  SignatureVerifier verifier;
+  if (!init_verifier(&verifier)) {
+    return false;
+  }
+  bool valid = verifier_check(&verifier, transaction);
+  free_verifier(&verifier);
+  return valid;
+}
+
+bool init_verifier(SignatureVerifier *verifier) {
+  verifier->cache = signature_cache;
+  verifier->digest_context = EVP_MD_CTX_new();
+  verifier->last_key = NULL;
+  if (verifier->digest_context == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate signature verifier\n");
+    return false;
+  }
+  return true;
+}
+
+void free_verifier(SignatureVerifier *verifier) {
+  EVP_MD_CTX_free(verifier->digest_context);
+  EVP_PKEY_free(verifier->last_key);
+  verifier->digest_context = NULL;
+  verifier->last_key = NULL;
+}
+
+bool verifier_check(SignatureVerifier *verifier,
+                    const Transaction *transaction) {
+  if (transaction == NULL || transaction->payload == NULL) {
+    return false;
+  }
+
+  SigCacheKey key;
+  if (verifier->cache != NULL) {
+    key = sig_cache_key(verifier->cache,
+                        (const unsigned char *)transaction->payload,
+                        transaction->payload_len, transaction->public_key,
+                        PUBLIC_KEY_SIZE, transaction->signature,
+                        SIGNATURE_SIZE);
+    if (sig_cache_contains(verifier->cache, &key)) {
+      return true;
+    }
+  }
+
+  if (verifier->last_key == NULL ||
+      memcmp(verifier->last_public_key, transaction->public_key,
+             PUBLIC_KEY_SIZE) != 0) {
+    EVP_PKEY_free(verifier->last_key);
+    verifier->last_key = EVP_PKEY_new_raw_public_key(
+        EVP_PKEY_ED25519, NULL, transaction->public_key, PUBLIC_KEY_SIZE);
+    if (verifier->last_key == NULL) {
+      ERR_clear_error();
+      return false;
+    }
+    memcpy(verifier->last_public_key, transaction->public_key,
+           PUBLIC_KEY_SIZE);
+  }
+
+  EVP_MD_CTX_reset(verifier->digest_context);
+  if (EVP_DigestVerifyInit(verifier->digest_context, NULL, NULL, NULL,
+                           verifier->last_key) != 1) {
+    ERR_clear_error();
+    return false;
+  }
+  int rc = EVP_DigestVerify(verifier->digest_context, transaction->signature,
+                            SIGNATURE_SIZE,
+                            (const unsigned char *)transaction->payload,
+                            transaction->payload_len);
+  if (rc != 1) {
+    ERR_clear_error();
+    return false;
+  }
+  if (verifier->cache != NULL) {
+    sig_cache_insert(verifier->cache, &key);
+  }
+  return true;
+}
+
+// Checks every signature and stores the per-transaction outcome in results
+// (which may be NULL). Returns the number of valid signatures.
+size_t verify_transactions_batch(const Transaction *transactions,
+                                 size_t num_transactions, bool *results) {
+  SignatureVerifier verifier;
+  if (!init_verifier(&verifier)) {
+    if (results != NULL) {
+      memset(results, 0, sizeof(bool) * num_transactions);
+    }
+    return 0;
+  }
+
+  size_t valid = 0;
+  for (size_t i = 0; i < num_transactions; i++) {
+    bool ok = verifier_check(&verifier, &transactions[i]);
+    if (results != NULL) {
+      results[i] = ok;
+    }
+    valid += ok;
+  }
+  free_verifier(&verifier);
+  return valid;
+}
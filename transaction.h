@@ -0,0 +1,67 @@
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include "merkletree.h"
+#include "sig_cache.h"
+#include <openssl/evp.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PUBLIC_KEY_SIZE 32
+#define SIGNATURE_SIZE 64
+
+// A payload signed with Ed25519. The signature covers the payload bytes.
+typedef struct {
+  char *payload;
+  size_t payload_len;
+  unsigned char public_key[PUBLIC_KEY_SIZE];
+  unsigned char signature[SIGNATURE_SIZE];
+} Transaction;
+
+typedef struct {
+  EVP_PKEY *pkey;
+  unsigned char public_key[PUBLIC_KEY_SIZE];
+} Keypair;
+
+// Verifies signatures one after another while reusing a single digest
+// context, and the parsed public key when consecutive transactions share a
+// signer, so that the per-signature setup cost is paid once per batch.
+// Signatures found in the cache are accepted without being checked again.
+typedef struct {
+  SigCache *cache;
+  EVP_MD_CTX *digest_context;
+  EVP_PKEY *last_key;
+  unsigned char last_public_key[PUBLIC_KEY_SIZE];
+} SignatureVerifier;
+
+// -----------------------------------------------------------
+// Keys
+// -----------------------------------------------------------
+bool generate_keypair(Keypair *keypair);
+void free_keypair(Keypair *keypair);
+
+// -----------------------------------------------------------
+// Transactions
+// -----------------------------------------------------------
+bool sign_transaction(Transaction *transaction, const Keypair *keypair,
+                      const char *payload, size_t payload_len);
+bool copy_transaction(Transaction *dst, const Transaction *src);
+void free_transaction(Transaction *transaction);
+void transaction_id(const Transaction *transaction, unsigned char *id);
+
+// -----------------------------------------------------------
+// Verification
+// -----------------------------------------------------------
+// Successful checks are remembered in the cache, so a transaction verified
+// on admission is not verified again when its block arrives. NULL (the
+// default) disables caching.
+void set_signature_cache(SigCache *cache);
+bool verify_transaction(const Transaction *transaction);
+bool init_verifier(SignatureVerifier *verifier);
+void free_verifier(SignatureVerifier *verifier);
+bool verifier_check(SignatureVerifier *verifier,
+                    const Transaction *transaction);
+size_t verify_transactions_batch(const Transaction *transactions,
+                                 size_t num_transactions, bool *results);
+
+#endif // TRANSACTION_H
@@ -0,0 +1,185 @@
+#include "verify_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define DEFAULT_CHUNK_SIZE 32
+
+// -----------------------------------------------------------
+// VerifyPool Implementation
+// -----------------------------------------------------------
+
+static void lower_first_invalid(VerifyPool *pool, size_t index) {
+  size_t current = atomic_load(&pool->first_invalid);
+  while (index < current &&
+         !atomic_compare_exchange_weak(&pool->first_invalid, &current,
+                                       index)) {
+  }
+}
+
+// Claims chunks in increasing order. A chunk that starts past the lowest
+// invalid index found so far cannot change the answer and is skipped, which
+// is the early abort; every chunk below it is still checked, so the lowest
+// invalid index is always found.
+static void verify_chunks(VerifyPool *pool, SignatureVerifier *verifier) {
+  for (;;) {
+    size_t start = atomic_fetch_add(&pool->next_index, pool->chunk_size);
+    if (start >= pool->num_transactions ||
+        start > atomic_load(&pool->first_invalid)) {
+      return;
+    }
+    size_t end = start + pool->chunk_size;
+    if (end > pool->num_transactions) {
+      end = pool->num_transactions;
+    }
+    for (size_t i = start; i < end; i++) {
+      if (!verifier_check(verifier, &pool->transactions[i])) {
+        lower_first_invalid(pool, i);
+        break;
+      }
+    }
+  }
+}
+
+// Every worker takes part in every generation, even one whose chunks are
+// gone by the time it wakes, so the submitter knows when none of them can
+// still touch the job.
+static void *verify_worker(void *arg) {
+  VerifyPool *pool = (VerifyPool *)arg;
+  SignatureVerifier verifier;
+  bool ready = init_verifier(&verifier);
+
+  unsigned long seen = 0;
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (pool->generation == seen && !pool->shutting_down) {
+      pthread_cond_wait(&pool->work_ready, &pool->lock);
+    }
+    if (pool->shutting_down) {
+      break;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (ready) {
+      verify_chunks(pool, &verifier);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    if (++pool->finished_workers == pool->num_threads) {
+      pthread_cond_signal(&pool->work_done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  if (ready) {
+    free_verifier(&verifier);
+  }
+  return NULL;
+}
+
+VerifyPool *create_verify_pool(size_t num_threads, size_t chunk_size) {
+  VerifyPool *pool = (VerifyPool *)calloc(1, sizeof(VerifyPool));
+  if (pool == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for verify pool\n");
+    return NULL;
+  }
+  if (num_threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = cpus > 0 ? (size_t)cpus : 1;
+  }
+  // The submitting thread is one of the workers.
+  pool->num_threads = num_threads - 1;
+  pool->chunk_size = chunk_size ? chunk_size : DEFAULT_CHUNK_SIZE;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work_ready, NULL);
+  pthread_cond_init(&pool->work_done, NULL);
+
+  pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * (pool->num_threads + 1));
+  if (pool->threads == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate memory for verify pool\n");
+    free(pool);
+    return NULL;
+  }
+  for (size_t i = 0; i < pool->num_threads; i++) {
+    if (pthread_create(&pool->threads[i], NULL, verify_worker, pool) != 0) {
+      fprintf(stderr, "ERROR: Failed to start verify worker\n");
+      pool->num_threads = i;
+      destroy_verify_pool(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+void destroy_verify_pool(VerifyPool *pool) {
+  if (pool == NULL)
+    return;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->shutting_down = true;
+  pthread_cond_broadcast(&pool->work_ready);
+  pthread_mutex_unlock(&pool->lock);
+  for (size_t i = 0; i < pool->num_threads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->work_ready);
+  pthread_cond_destroy(&pool->work_done);
+  free(pool->threads);
+  free(pool);
+}
+
+size_t verify_pool_run(VerifyPool *pool, const Transaction *transactions,
+                       size_t num_transactions) {
+  if (num_transactions == 0) {
+    return 0;
+  }
+
+  // Not worth waking anyone for a single chunk.
+  if (pool->num_threads == 0 || num_transactions <= pool->chunk_size) {
+    bool *results = (bool *)malloc(sizeof(bool) * num_transactions);
+    if (results == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate memory for results\n");
+      return 0;
+    }
+    verify_transactions_batch(transactions, num_transactions, results);
+    size_t first_invalid = num_transactions;
+    for (size_t i = 0; i < num_transactions; i++) {
+      if (!results[i]) {
+        first_invalid = i;
+        break;
+      }
+    }
+    free(results);
+    return first_invalid;
+  }
+
+  SignatureVerifier verifier;
+  if (!init_verifier(&verifier)) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->transactions = transactions;
+  pool->num_transactions = num_transactions;
+  atomic_store(&pool->next_index, 0);
+  atomic_store(&pool->first_invalid, num_transactions);
+  pool->finished_workers = 0;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->work_ready);
+  pthread_mutex_unlock(&pool->lock);
+
+  verify_chunks(pool, &verifier);
+  free_verifier(&verifier);
+
+  // Waits for every worker, including those that wake only now and find
+  // no chunks left: until they have, they may still read the job.
+  pthread_mutex_lock(&pool->lock);
+  while (pool->finished_workers < pool->num_threads) {
+    pthread_cond_wait(&pool->work_done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return atomic_load(&pool->first_invalid);
+}
@@ -0,0 +1,44 @@
+#ifndef VERIFY_POOL_H
+#define VERIFY_POOL_H
+
+#include "transaction.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Persistent worker threads that split a block's signature checks into
+// chunks. The submitting thread works alongside them.
+typedef struct {
+  pthread_t *threads;
+  size_t num_threads;
+  size_t chunk_size;
+
+  pthread_mutex_t lock;
+  pthread_cond_t work_ready;
+  pthread_cond_t work_done;
+  unsigned long generation;
+  size_t finished_workers; // workers done with the current generation
+  bool shutting_down;
+
+  // Current job. Every worker finishes a generation before the next one
+  // is posted, so no worker can read a later job's fields by mistake.
+  const Transaction *transactions;
+  size_t num_transactions;
+  atomic_size_t next_index;
+  atomic_size_t first_invalid;
+} VerifyPool;
+
+// -----------------------------------------------------------
+// Verification pool
+// -----------------------------------------------------------
+// num_threads == 0 sizes the pool to the online CPUs. chunk_size == 0 picks
+// a default that keeps dispatch overhead well below the signature cost.
+VerifyPool *create_verify_pool(size_t num_threads, size_t chunk_size);
+void destroy_verify_pool(VerifyPool *pool);
+
+// Returns the index of the lowest-numbered transaction whose signature is
+// invalid, or num_transactions if all are valid. The result is the same
+// regardless of thread scheduling.
+size_t verify_pool_run(VerifyPool *pool, const Transaction *transactions,
+                       size_t num_transactions);
+
+#endif // VERIFY_POOL_H